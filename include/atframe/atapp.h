@@ -16,6 +16,7 @@
 #include <vector>
 
 #include "atframe/atapp_conf.h"
+#include "atframe/atapp_flat_hash_map.h"
 
 #include "cli/cmd_option.h"
 #include "time/time_utility.h"
@@ -49,8 +50,8 @@ class app {
   using app_id_t = LIBATAPP_MACRO_BUSID_TYPE;
   using module_ptr_t = std::shared_ptr<module_impl>;
   using yaml_conf_map_t = atbus::detail::auto_select_map<std::string, std::vector<YAML::Node> >::type;
-  using endpoint_index_by_id_t = LIBATFRAME_UTILS_AUTO_SELETC_MAP(uint64_t, atapp_endpoint::ptr_t);
-  using endpoint_index_by_name_t = LIBATFRAME_UTILS_AUTO_SELETC_MAP(std::string, atapp_endpoint::ptr_t);
+  using endpoint_index_by_id_t = flat_hash_map<uint64_t, atapp_endpoint::ptr_t>;
+  using endpoint_index_by_name_t = flat_hash_map<std::string, atapp_endpoint::ptr_t>;
   using connector_protocol_map_t = LIBATFRAME_UTILS_AUTO_SELETC_MAP(std::string, std::shared_ptr<atapp_connector_impl>);
   using address_type_t = atapp_connector_impl::address_type_t;
   using ev_loop_t = uv_loop_t;
@@ -92,6 +93,11 @@ class app {
     LIBATAPP_MACRO_API message_sender_t &operator=(const message_sender_t &);
   };
 
+  struct send_message_batch_item_t {
+    uint64_t target_node_id;
+    atapp_forward_request_t request;
+  };
+
   class flag_guard_t {
    public:
     LIBATAPP_MACRO_API flag_guard_t(app &owner, flag_t::type f);
@@ -104,6 +110,7 @@ class app {
     flag_t::type flag_;
   };
   friend class flag_guard_t;
+  friend class atapp_endpoint;
 
   struct LIBATAPP_MACRO_API_HEAD_ONLY mode_t {
     enum type {
@@ -282,6 +289,16 @@ class app {
 
   LIBATAPP_MACRO_API util::time::time_utility::raw_time_t get_last_tick_time() const;
 
+  /**
+   * @brief add a timer which will be triggered in tick after delay, precision is 1 millisecond
+   * @note the returned timer can be moved by get_timer_wheel().arm(...)
+   */
+  LIBATAPP_MACRO_API timer_wheel::timer_ptr_t add_timer(std::chrono::system_clock::duration delay,
+                                                        timer_wheel::callback_fn_t fn);
+  LIBATAPP_MACRO_API bool cancel_timer(const timer_wheel::timer_ptr_t &timer);
+  UTIL_FORCEINLINE timer_wheel &get_timer_wheel() UTIL_CONFIG_NOEXCEPT { return timer_wheel_; }
+  UTIL_FORCEINLINE const timer_wheel &get_timer_wheel() const UTIL_CONFIG_NOEXCEPT { return timer_wheel_; }
+
   LIBATAPP_MACRO_API util::config::ini_loader &get_configure_loader();
   LIBATAPP_MACRO_API const util::config::ini_loader &get_configure_loader() const;
 
@@ -307,7 +324,18 @@ class app {
   LIBATAPP_MACRO_API atapp::protocol::atapp_metadata &mutable_metadata();
   LIBATAPP_MACRO_API const atapp::protocol::atapp_area &get_area() const;
   LIBATAPP_MACRO_API atapp::protocol::atapp_area &mutable_area();
+  /**
+   * @brief set load score of this app, it's published in discovery and refreshed by keepalive of etcd
+   * @note other apps use it in P2C load balancing, it should be coarse-grained to avoid updating etcd too often
+   */
+  LIBATAPP_MACRO_API void set_load_score(uint32_t score);
+  LIBATAPP_MACRO_API uint32_t get_load_score() const;
   LIBATAPP_MACRO_API util::time::time_utility::raw_duration_t get_configure_message_timeout() const;
+  /**
+   * @brief get how long an endpoint without connection will be kept before removed
+   * @note 0 means endpoints will be removed immediately when they have no connection
+   */
+  LIBATAPP_MACRO_API util::time::time_utility::raw_duration_t get_configure_endpoint_idle_timeout() const;
 
   LIBATAPP_MACRO_API void pack(atapp::protocol::atapp_discovery &out) const;
 
@@ -317,6 +345,7 @@ class app {
 
   LIBATAPP_MACRO_API etcd_discovery_node::ptr_t get_discovery_node_by_id(uint64_t id) const;
   LIBATAPP_MACRO_API etcd_discovery_node::ptr_t get_discovery_node_by_name(const std::string &name) const;
+  LIBATAPP_MACRO_API etcd_discovery_node::ptr_t get_discovery_node_by_name(const hashed_string_ref &name) const;
 
   LIBATAPP_MACRO_API int32_t listen(const std::string &address);
   LIBATAPP_MACRO_API int32_t send_message(uint64_t target_node_id, int32_t type, const void *data, size_t data_size,
@@ -325,10 +354,74 @@ class app {
   LIBATAPP_MACRO_API int32_t send_message(const std::string &target_node_name, int32_t type, const void *data,
                                           size_t data_size, uint64_t *msg_sequence = NULL,
                                           const atapp::protocol::atapp_metadata *metadata = NULL);
+  /**
+   * @brief send message by name without allocating a std::string, hash code of name will be reused by all indexes
+   */
+  LIBATAPP_MACRO_API int32_t send_message(const hashed_string_ref &target_node_name, int32_t type, const void *data,
+                                          size_t data_size, uint64_t *msg_sequence = NULL,
+                                          const atapp::protocol::atapp_metadata *metadata = NULL);
   LIBATAPP_MACRO_API int32_t send_message(const etcd_discovery_node::ptr_t &target_node_discovery, int32_t type,
                                           const void *data, size_t data_size, uint64_t *msg_sequence = NULL,
                                           const atapp::protocol::atapp_metadata *metadata = NULL);
 
+  /**
+   * @brief send a message which is made up of several segments, segments will be sent without being joined when the
+   *        connector support it
+   */
+  LIBATAPP_MACRO_API int32_t send_message_v(uint64_t target_node_id, int32_t type, const atapp_iovec_t *iov,
+                                            size_t iov_count, uint64_t *msg_sequence = NULL,
+                                            const atapp::protocol::atapp_metadata *metadata = NULL);
+  LIBATAPP_MACRO_API int32_t send_message_v(const std::string &target_node_name, int32_t type, const atapp_iovec_t *iov,
+                                            size_t iov_count, uint64_t *msg_sequence = NULL,
+                                            const atapp::protocol::atapp_metadata *metadata = NULL);
+  LIBATAPP_MACRO_API int32_t send_message_v(const hashed_string_ref &target_node_name, int32_t type,
+                                            const atapp_iovec_t *iov, size_t iov_count, uint64_t *msg_sequence = NULL,
+                                            const atapp::protocol::atapp_metadata *metadata = NULL);
+  LIBATAPP_MACRO_API int32_t send_message_v(const etcd_discovery_node::ptr_t &target_node_discovery, int32_t type,
+                                            const atapp_iovec_t *iov, size_t iov_count, uint64_t *msg_sequence = NULL,
+                                            const atapp::protocol::atapp_metadata *metadata = NULL);
+
+  /**
+   * @brief send messages to several targets, endpoint of each target will only be found once
+   * @note result of each message will be set into items[i].request.result
+   * @return 0 if all messages are sent, or error code of the first failed message
+   */
+  LIBATAPP_MACRO_API int32_t send_message_batch(send_message_batch_item_t *items, size_t count);
+
+  /**
+   * @brief send the same message to all nodes in discovery_set
+   * @note payload is copied only once and shared by all endpoints which are not ready yet
+   * @return 0 if all messages are sent or pushed into pending list, or error code of the first failed node
+   */
+  LIBATAPP_MACRO_API int32_t broadcast_message(const etcd_discovery_set &discovery_set, int32_t type, const void *data,
+                                               size_t data_size,
+                                               const atapp::protocol::atapp_metadata *metadata = NULL);
+  LIBATAPP_MACRO_API int32_t broadcast_message(const etcd_discovery_set &discovery_set, int32_t type,
+                                               const atapp_endpoint::shared_payload_ptr_t &payload,
+                                               const atapp::protocol::atapp_metadata *metadata = NULL);
+
+  /**
+   * @brief send the same message to the primary and (replica_count - 1) backup nodes of hash key in discovery_set
+   * @note replicas are the same as etcd_discovery_set::get_nodes_by_consistent_hash, payload is copied only once
+   * @return 0 if all messages are sent or pushed into pending list, or error code of the first failed node
+   */
+  LIBATAPP_MACRO_API int32_t send_message_to_replicas(const etcd_discovery_set &discovery_set, const void *hash_buf,
+                                                      size_t hash_bufsz, size_t replica_count, int32_t type,
+                                                      const void *data, size_t data_size,
+                                                      const atapp::protocol::atapp_metadata *metadata = NULL);
+  LIBATAPP_MACRO_API int32_t send_message_to_replicas(const etcd_discovery_set &discovery_set, uint64_t hash_key,
+                                                      size_t replica_count, int32_t type, const void *data,
+                                                      size_t data_size,
+                                                      const atapp::protocol::atapp_metadata *metadata = NULL);
+  LIBATAPP_MACRO_API int32_t send_message_to_replicas(const etcd_discovery_set &discovery_set, int64_t hash_key,
+                                                      size_t replica_count, int32_t type, const void *data,
+                                                      size_t data_size,
+                                                      const atapp::protocol::atapp_metadata *metadata = NULL);
+  LIBATAPP_MACRO_API int32_t send_message_to_replicas(const etcd_discovery_set &discovery_set,
+                                                      const std::string &hash_key, size_t replica_count, int32_t type,
+                                                      const void *data, size_t data_size,
+                                                      const atapp::protocol::atapp_metadata *metadata = NULL);
+
   LIBATAPP_MACRO_API int32_t send_message_by_consistent_hash(const void *hash_buf, size_t hash_bufsz, int32_t type,
                                                              const void *data, size_t data_size,
                                                              uint64_t *msg_sequence = NULL,
@@ -344,12 +437,61 @@ class app {
                                                              uint64_t *msg_sequence = NULL,
                                                              const atapp::protocol::atapp_metadata *metadata = NULL);
 
+  /**
+   * @brief send message to the node selected by consistent hash with specify policy
+   * @see etcd_discovery_consistent_hash_policy_t
+   */
+  LIBATAPP_MACRO_API int32_t send_message_by_consistent_hash(etcd_discovery_consistent_hash_policy_t::type policy,
+                                                             const void *hash_buf, size_t hash_bufsz, int32_t type,
+                                                             const void *data, size_t data_size,
+                                                             uint64_t *msg_sequence = NULL,
+                                                             const atapp::protocol::atapp_metadata *metadata = NULL);
+  LIBATAPP_MACRO_API int32_t send_message_by_consistent_hash(etcd_discovery_consistent_hash_policy_t::type policy,
+                                                             uint64_t hash_key, int32_t type, const void *data,
+                                                             size_t data_size, uint64_t *msg_sequence = NULL,
+                                                             const atapp::protocol::atapp_metadata *metadata = NULL);
+  LIBATAPP_MACRO_API int32_t send_message_by_consistent_hash(etcd_discovery_consistent_hash_policy_t::type policy,
+                                                             int64_t hash_key, int32_t type, const void *data,
+                                                             size_t data_size, uint64_t *msg_sequence = NULL,
+                                                             const atapp::protocol::atapp_metadata *metadata = NULL);
+  LIBATAPP_MACRO_API int32_t send_message_by_consistent_hash(etcd_discovery_consistent_hash_policy_t::type policy,
+                                                             const std::string &hash_key, int32_t type,
+                                                             const void *data, size_t data_size,
+                                                             uint64_t *msg_sequence = NULL,
+                                                             const atapp::protocol::atapp_metadata *metadata = NULL);
+
   LIBATAPP_MACRO_API int32_t send_message_by_random(int32_t type, const void *data, size_t data_size,
                                                     uint64_t *msg_sequence = NULL,
                                                     const atapp::protocol::atapp_metadata *metadata = NULL);
   LIBATAPP_MACRO_API int32_t send_message_by_round_robin(int32_t type, const void *data, size_t data_size,
                                                          uint64_t *msg_sequence = NULL,
                                                          const atapp::protocol::atapp_metadata *metadata = NULL);
+  LIBATAPP_MACRO_API int32_t send_message_by_p2c(int32_t type, const void *data, size_t data_size,
+                                                 uint64_t *msg_sequence = NULL,
+                                                 const atapp::protocol::atapp_metadata *metadata = NULL);
+
+  /**
+   * @brief send message to the node selected by area of this app, prefer nodes in the same zone, district and region
+   * @note bus.locality_spill_over_percent of messages are sent to the next wider locality
+   */
+  LIBATAPP_MACRO_API int32_t send_message_by_locality_random(int32_t type, const void *data, size_t data_size,
+                                                             uint64_t *msg_sequence = NULL,
+                                                             const atapp::protocol::atapp_metadata *metadata = NULL);
+  LIBATAPP_MACRO_API int32_t send_message_by_locality_round_robin(
+      int32_t type, const void *data, size_t data_size, uint64_t *msg_sequence = NULL,
+      const atapp::protocol::atapp_metadata *metadata = NULL);
+  LIBATAPP_MACRO_API int32_t send_message_by_locality_consistent_hash(
+      const void *hash_buf, size_t hash_bufsz, int32_t type, const void *data, size_t data_size,
+      uint64_t *msg_sequence = NULL, const atapp::protocol::atapp_metadata *metadata = NULL);
+  LIBATAPP_MACRO_API int32_t send_message_by_locality_consistent_hash(
+      uint64_t hash_key, int32_t type, const void *data, size_t data_size, uint64_t *msg_sequence = NULL,
+      const atapp::protocol::atapp_metadata *metadata = NULL);
+  LIBATAPP_MACRO_API int32_t send_message_by_locality_consistent_hash(
+      int64_t hash_key, int32_t type, const void *data, size_t data_size, uint64_t *msg_sequence = NULL,
+      const atapp::protocol::atapp_metadata *metadata = NULL);
+  LIBATAPP_MACRO_API int32_t send_message_by_locality_consistent_hash(
+      const std::string &hash_key, int32_t type, const void *data, size_t data_size, uint64_t *msg_sequence = NULL,
+      const atapp::protocol::atapp_metadata *metadata = NULL);
 
   LIBATAPP_MACRO_API int32_t send_message_by_consistent_hash(const etcd_discovery_set &discovery_set,
                                                              const void *hash_buf, size_t hash_bufsz, int32_t type,
@@ -370,6 +512,29 @@ class app {
                                                              uint64_t *msg_sequence = NULL,
                                                              const atapp::protocol::atapp_metadata *metadata = NULL);
 
+  LIBATAPP_MACRO_API int32_t send_message_by_consistent_hash(const etcd_discovery_set &discovery_set,
+                                                             etcd_discovery_consistent_hash_policy_t::type policy,
+                                                             const void *hash_buf, size_t hash_bufsz, int32_t type,
+                                                             const void *data, size_t data_size,
+                                                             uint64_t *msg_sequence = NULL,
+                                                             const atapp::protocol::atapp_metadata *metadata = NULL);
+  LIBATAPP_MACRO_API int32_t send_message_by_consistent_hash(const etcd_discovery_set &discovery_set,
+                                                             etcd_discovery_consistent_hash_policy_t::type policy,
+                                                             uint64_t hash_key, int32_t type, const void *data,
+                                                             size_t data_size, uint64_t *msg_sequence = NULL,
+                                                             const atapp::protocol::atapp_metadata *metadata = NULL);
+  LIBATAPP_MACRO_API int32_t send_message_by_consistent_hash(const etcd_discovery_set &discovery_set,
+                                                             etcd_discovery_consistent_hash_policy_t::type policy,
+                                                             int64_t hash_key, int32_t type, const void *data,
+                                                             size_t data_size, uint64_t *msg_sequence = NULL,
+                                                             const atapp::protocol::atapp_metadata *metadata = NULL);
+  LIBATAPP_MACRO_API int32_t send_message_by_consistent_hash(const etcd_discovery_set &discovery_set,
+                                                             etcd_discovery_consistent_hash_policy_t::type policy,
+                                                             const std::string &hash_key, int32_t type,
+                                                             const void *data, size_t data_size,
+                                                             uint64_t *msg_sequence = NULL,
+                                                             const atapp::protocol::atapp_metadata *metadata = NULL);
+
   LIBATAPP_MACRO_API int32_t send_message_by_random(const etcd_discovery_set &discovery_set, int32_t type,
                                                     const void *data, size_t data_size, uint64_t *msg_sequence = NULL,
                                                     const atapp::protocol::atapp_metadata *metadata = NULL);
@@ -377,6 +542,34 @@ class app {
                                                          const void *data, size_t data_size,
                                                          uint64_t *msg_sequence = NULL,
                                                          const atapp::protocol::atapp_metadata *metadata = NULL);
+  /**
+   * @brief send message by power of two choices, pick two random nodes and send to the less loaded one
+   * @note nodes are compared by in-flight messages of local endpoints first, and then load score in discovery
+   */
+  LIBATAPP_MACRO_API int32_t send_message_by_p2c(const etcd_discovery_set &discovery_set, int32_t type,
+                                                 const void *data, size_t data_size, uint64_t *msg_sequence = NULL,
+                                                 const atapp::protocol::atapp_metadata *metadata = NULL);
+
+  LIBATAPP_MACRO_API int32_t send_message_by_locality_random(const etcd_discovery_set &discovery_set, int32_t type,
+                                                             const void *data, size_t data_size,
+                                                             uint64_t *msg_sequence = NULL,
+                                                             const atapp::protocol::atapp_metadata *metadata = NULL);
+  LIBATAPP_MACRO_API int32_t send_message_by_locality_round_robin(
+      const etcd_discovery_set &discovery_set, int32_t type, const void *data, size_t data_size,
+      uint64_t *msg_sequence = NULL, const atapp::protocol::atapp_metadata *metadata = NULL);
+  LIBATAPP_MACRO_API int32_t send_message_by_locality_consistent_hash(
+      const etcd_discovery_set &discovery_set, const void *hash_buf, size_t hash_bufsz, int32_t type,
+      const void *data, size_t data_size, uint64_t *msg_sequence = NULL,
+      const atapp::protocol::atapp_metadata *metadata = NULL);
+  LIBATAPP_MACRO_API int32_t send_message_by_locality_consistent_hash(
+      const etcd_discovery_set &discovery_set, uint64_t hash_key, int32_t type, const void *data, size_t data_size,
+      uint64_t *msg_sequence = NULL, const atapp::protocol::atapp_metadata *metadata = NULL);
+  LIBATAPP_MACRO_API int32_t send_message_by_locality_consistent_hash(
+      const etcd_discovery_set &discovery_set, int64_t hash_key, int32_t type, const void *data, size_t data_size,
+      uint64_t *msg_sequence = NULL, const atapp::protocol::atapp_metadata *metadata = NULL);
+  LIBATAPP_MACRO_API int32_t send_message_by_locality_consistent_hash(
+      const etcd_discovery_set &discovery_set, const std::string &hash_key, int32_t type, const void *data,
+      size_t data_size, uint64_t *msg_sequence = NULL, const atapp::protocol::atapp_metadata *metadata = NULL);
 
   /**
    * @brief add log sink maker, this function allow user to add custom log sink from the configure of atapp
@@ -395,8 +588,13 @@ class app {
   LIBATAPP_MACRO_API const callback_fn_on_disconnected_t &get_evt_on_app_disconnected() const;
   LIBATAPP_MACRO_API const callback_fn_on_all_module_inited_t &get_evt_on_all_module_inited() const;
 
+  /**
+   * @brief arm the waker timer of endpoint, timer will be created if it's empty
+   * @note every endpoint keeps only one timer, it's moved instead of inserting a new one
+   */
   LIBATAPP_MACRO_API bool add_endpoint_waker(util::time::time_utility::raw_time_t wakeup_time,
-                                             const atapp_endpoint::weak_ptr_t &ep_watcher);
+                                             const atapp_endpoint::weak_ptr_t &ep_watcher,
+                                             timer_wheel::timer_ptr_t &waker_timer);
   LIBATAPP_MACRO_API void remove_endpoint(uint64_t by_id);
   LIBATAPP_MACRO_API void remove_endpoint(const std::string &by_name);
   LIBATAPP_MACRO_API void remove_endpoint(const atapp_endpoint::ptr_t &enpoint);
@@ -405,6 +603,12 @@ class app {
   LIBATAPP_MACRO_API const atapp_endpoint *get_endpoint(uint64_t by_id) const;
   LIBATAPP_MACRO_API atapp_endpoint *get_endpoint(const std::string &by_name);
   LIBATAPP_MACRO_API const atapp_endpoint *get_endpoint(const std::string &by_name) const;
+  LIBATAPP_MACRO_API atapp_endpoint *get_endpoint(const hashed_string_ref &by_name);
+  LIBATAPP_MACRO_API const atapp_endpoint *get_endpoint(const hashed_string_ref &by_name) const;
+  /**
+   * @brief sum of in-flight messages of all endpoints
+   */
+  UTIL_FORCEINLINE uint64_t get_endpoint_inflight_message_count() const { return endpoint_inflight_message_count_; }
 
   template <class TCONNECTOR, class... TARGS>
   LIBATAPP_MACRO_API_HEAD_ONLY std::shared_ptr<TCONNECTOR> add_connector(TARGS &&...args) {
@@ -455,6 +659,22 @@ class app {
   bool match_gateway_namespace(const atapp::protocol::atapp_gateway &checked) const;
   bool match_gateway_labels(const atapp::protocol::atapp_gateway &checked) const;
 
+  void process_endpoint_waker(const atapp_endpoint::weak_ptr_t &ep_watcher);
+  atapp_endpoint::ptr_t allocate_endpoint();
+  void recycle_endpoint(atapp_endpoint::ptr_t &ep);
+  void mark_endpoint_idle(atapp_endpoint &ep);
+  void unmark_endpoint_idle(atapp_endpoint &ep);
+  void touch_idle_endpoint(atapp_endpoint &ep);
+  void evict_idle_endpoints();
+  void connect_endpoint(atapp_endpoint &ep);
+  void wake_endpoint(atapp_endpoint &ep);
+  int32_t send_shared_message_to_nodes(const etcd_discovery_node::ptr_t *nodes, size_t count, int32_t type,
+                                       const atapp_endpoint::shared_payload_ptr_t &payload,
+                                       const atapp::protocol::atapp_metadata *metadata);
+  uint64_t get_node_inflight_message_count(const etcd_discovery_node &node) const;
+  etcd_discovery_node::ptr_t get_node_by_bounded_load(const etcd_discovery_set &discovery_set, const void *hash_buf,
+                                                      size_t hash_bufsz) const;
+
   // ============ inner functional handlers ============
 
  public:
@@ -524,12 +744,16 @@ class app {
   void process_signals();
   void process_signal(int signo);
 
+  int32_t decompress_forward_message(int32_t reserved_type, const message_t &msg, std::vector<unsigned char> &buffer,
+                                     message_t &out) const;
+
  public:
   LIBATAPP_MACRO_API int trigger_event_on_forward_request(const message_sender_t &source, const message_t &msg);
   LIBATAPP_MACRO_API int trigger_event_on_forward_response(const message_sender_t &source, const message_t &msg,
                                                            int32_t error_code);
   LIBATAPP_MACRO_API void trigger_event_on_discovery_event(etcd_discovery_action_t::type,
                                                            const etcd_discovery_node::ptr_t &);
+  LIBATAPP_MACRO_API void trigger_event_on_discovery_events(const std::vector<etcd_discovery_event_t> &events);
 
  private:
   static app *last_instance_;
@@ -554,6 +778,7 @@ class app {
 
   ev_loop_t *ev_loop_;
   std::shared_ptr<atbus::node> bus_node_;
+  std::vector<unsigned char> bus_gather_buffer_;  // used by send_message_v() when falling back to atbus
   std::bitset<flag_t::FLAG_MAX> flags_;
   mode_t::type mode_;
   tick_timer_t tick_timer_;
@@ -582,10 +807,15 @@ class app {
   // inner modules
   std::shared_ptr< ::atapp::etcd_module> inner_module_etcd_;
 
+  // timers, must be destroyed after endpoints
+  timer_wheel timer_wheel_;
+
   // inner endpoints
   endpoint_index_by_id_t endpoint_index_by_id_;
   endpoint_index_by_name_t endpoint_index_by_name_;
-  std::multimap<util::time::time_utility::raw_time_t, atapp_endpoint::weak_ptr_t> endpoint_waker_;
+  atapp_endpoint::idle_list_t endpoint_idle_list_;  // least recently used at front
+  std::vector<atapp_endpoint::ptr_t> endpoint_pool_;
+  uint64_t endpoint_inflight_message_count_;  // maintained by endpoints
 
   // inner connectors
   std::list<std::shared_ptr<atapp_connector_impl> > connectors_;
@@ -0,0 +1,88 @@
+/**
+ * atapp_compression.h
+ *
+ *  Created on: 2021-06-10
+ *      Author: owent
+ */
+#ifndef LIBATAPP_ATAPP_COMPRESSION_H
+#define LIBATAPP_ATAPP_COMPRESSION_H
+
+#pragma once
+
+#include <vector>
+
+#include <config/compiler_features.h>
+
+#include "atframe/atapp_conf.h"
+#include "atframe/atapp_config.h"
+
+namespace atapp {
+/**
+ * @brief Compression of forward messages
+ * @note A compressed message is sent with the message type reserved by the receiver(compression.message_type), and
+ *       its data starts with a frame header which contains algorithm, original size and original message type.
+ *       Messages are compressed only when the remote node report both the reserved message type and the algorithm in
+ *       discovery(compression_message_type and compression_algorithms), other message types are never touched.
+ */
+class message_compression {
+ public:
+  enum {
+    FRAME_HEADER_SIZE = 24,
+  };
+
+ private:
+  message_compression();
+  ~message_compression();
+
+ public:
+  static LIBATAPP_MACRO_API bool is_algorithm_supported(atapp::protocol::atapp_compression_algorithm_t algorithm);
+
+  /**
+   * @brief Get the first algorithm in configure which is supported by both local and remote node
+   * @return ATAPP_COMPRESSION_NONE if there is no available algorithm or remote node reserve no message type for it
+   */
+  static LIBATAPP_MACRO_API atapp::protocol::atapp_compression_algorithm_t select_algorithm(
+      const atapp::protocol::atapp_compression &conf, const atapp::protocol::atapp_discovery &remote);
+
+  /**
+   * @brief Check if a message should be compressed by the threshold and message types in configure
+   */
+  static LIBATAPP_MACRO_API bool match_message(const atapp::protocol::atapp_compression &conf, int32_t type,
+                                               size_t data_size);
+
+  /**
+   * @brief Report the reserved message type and all algorithms which can be decompressed by this node
+   * @note Nothing is reported if compression.message_type is not set
+   */
+  static LIBATAPP_MACRO_API void pack_supported_algorithms(const atapp::protocol::atapp_compression &conf,
+                                                           atapp::protocol::atapp_discovery &out);
+  static LIBATAPP_MACRO_API bool has_supported_algorithm(const atapp::protocol::atapp_compression &conf);
+
+  /**
+   * @brief Check if a received message is sent with the message type reserved for compressed messages
+   * @param reserved_type message type reserved by the node which decompress this message, 0 means none
+   */
+  static UTIL_FORCEINLINE bool is_compressed_type(int32_t reserved_type, int32_t type) {
+    return 0 != reserved_type && reserved_type == type;
+  }
+
+  /**
+   * @brief Compress data into out, frame header with the original message type will be written into it
+   * @return 0 or error code
+   */
+  static LIBATAPP_MACRO_API int32_t compress(atapp::protocol::atapp_compression_algorithm_t algorithm, int32_t level,
+                                             int32_t type, const void *data, size_t data_size,
+                                             std::vector<unsigned char> &out);
+
+  /**
+   * @brief Decompress a message which is generated by compress(...)
+   * @note Caller should check is_compressed_type(...) first, data is only checked by the frame header here
+   * @param type output the original message type
+   * @return 0 or error code
+   */
+  static LIBATAPP_MACRO_API int32_t decompress(const void *data, size_t data_size, size_t max_decompressed_size,
+                                               std::vector<unsigned char> &out, int32_t &type);
+};
+}  // namespace atapp
+
+#endif
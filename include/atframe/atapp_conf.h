@@ -54,6 +54,7 @@ struct app_conf {
   atbus::node::conf_t bus_conf;
   std::string app_version;
   std::string hash_code;
+  uint32_t load_score;  // published in discovery for load balancing
 
   std::list<std::string> startup_log;
 
@@ -74,6 +75,10 @@ typedef enum {
   EN_ATAPP_ERR_SETUP_ATBUS = -1101,
   EN_ATAPP_ERR_SEND_FAILED = -1102,
   EN_ATAPP_ERR_DISCOVERY_DISABLED = -1103,
+  EN_ATAPP_ERR_COMPRESSION_NOT_SUPPORT = -1104,
+  EN_ATAPP_ERR_COMPRESSION_FAILED = -1105,
+  EN_ATAPP_ERR_SAVE_DISCOVERY_SNAPSHOT = -1106,
+  EN_ATAPP_ERR_LOAD_DISCOVERY_SNAPSHOT = -1107,
   EN_ATAPP_ERR_COMMAND_IS_NULL = -1801,
   EN_ATAPP_ERR_NO_AVAILABLE_ADDRESS = -1802,
   EN_ATAPP_ERR_CONNECT_ATAPP_FAILED = -1803,
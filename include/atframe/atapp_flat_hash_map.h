@@ -0,0 +1,354 @@
+/**
+ * atapp_flat_hash_map.h
+ *
+ *  Created on: 2021-06-14
+ *      Author: owent
+ */
+#ifndef LIBATAPP_ATAPP_FLAT_HASH_MAP_H
+#define LIBATAPP_ATAPP_FLAT_HASH_MAP_H
+
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <config/compiler_features.h>
+
+#include "atframe/atapp_config.h"
+
+namespace atapp {
+
+inline size_t flat_hash_bytes(const void *data, size_t size) UTIL_CONFIG_NOEXCEPT {
+  // FNV-1a, names are short and this is fast enough
+  uint64_t ret = 14695981039346656037ULL;
+  const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < size; ++i) {
+    ret ^= static_cast<uint64_t>(p[i]);
+    ret *= 1099511628211ULL;
+  }
+  return static_cast<size_t>(ret);
+}
+
+inline size_t flat_hash_integer(uint64_t key) UTIL_CONFIG_NOEXCEPT {
+  // Finalizer of splitmix64, ids are usually continuous
+  key ^= key >> 30;
+  key *= 0xbf58476d1ce4e5b9ULL;
+  key ^= key >> 27;
+  key *= 0x94d049bb133111ebULL;
+  key ^= key >> 31;
+  return static_cast<size_t>(key);
+}
+
+/**
+ * @brief Reference of a string with precomputed hash code, it can be used to find in string indexes without
+ *        allocating a std::string. The referenced data must be valid while it's used.
+ */
+struct LIBATAPP_MACRO_API_HEAD_ONLY hashed_string_ref {
+  const char *data;
+  size_t size;
+  size_t hash;
+
+  UTIL_FORCEINLINE hashed_string_ref(const char *d, size_t s) : data(d), size(s), hash(flat_hash_bytes(d, s)) {}
+  UTIL_FORCEINLINE explicit hashed_string_ref(const std::string &s)
+      : data(s.data()), size(s.size()), hash(flat_hash_bytes(s.data(), s.size())) {}
+
+  UTIL_FORCEINLINE std::string to_string() const { return std::string(data, size); }
+};
+
+template <class TKey>
+struct LIBATAPP_MACRO_API_HEAD_ONLY flat_hash_default_hasher {
+  UTIL_FORCEINLINE size_t operator()(const TKey &key) const { return flat_hash_integer(static_cast<uint64_t>(key)); }
+};
+
+template <>
+struct LIBATAPP_MACRO_API_HEAD_ONLY flat_hash_default_hasher<std::string> {
+  UTIL_FORCEINLINE size_t operator()(const std::string &key) const { return flat_hash_bytes(key.data(), key.size()); }
+  UTIL_FORCEINLINE size_t operator()(const hashed_string_ref &key) const { return key.hash; }
+};
+
+template <class TKey>
+struct LIBATAPP_MACRO_API_HEAD_ONLY flat_hash_default_equal {
+  UTIL_FORCEINLINE bool operator()(const TKey &l, const TKey &r) const { return l == r; }
+};
+
+template <>
+struct LIBATAPP_MACRO_API_HEAD_ONLY flat_hash_default_equal<std::string> {
+  UTIL_FORCEINLINE bool operator()(const std::string &l, const std::string &r) const { return l == r; }
+  UTIL_FORCEINLINE bool operator()(const std::string &l, const hashed_string_ref &r) const {
+    return l.size() == r.size && (0 == r.size || 0 == memcmp(l.data(), r.data, r.size));
+  }
+};
+
+/**
+ * @brief Open addressing hash map with linear probing and backward shift deletion
+ * @note Hash codes, keys and values are stored in separated arrays, probing only touch the hash codes.
+ *       Any insertion or erasure may invalidate all iterators.
+ */
+template <class TKey, class TValue, class THash = flat_hash_default_hasher<TKey>,
+          class TEqual = flat_hash_default_equal<TKey> >
+class flat_hash_map {
+ public:
+  using key_type = TKey;
+  using mapped_type = TValue;
+  using size_type = size_t;
+
+ private:
+  template <class TMap, class TRefValue>
+  class basic_iterator {
+   public:
+    using reference = std::pair<const TKey &, TRefValue &>;
+    struct pointer {
+      reference ref;
+      UTIL_FORCEINLINE reference *operator->() { return &ref; }
+    };
+    using value_type = reference;
+    using difference_type = std::ptrdiff_t;
+    using iterator_category = std::forward_iterator_tag;
+
+    UTIL_FORCEINLINE basic_iterator() : owner_(NULL), index_(0) {}
+    UTIL_FORCEINLINE basic_iterator(TMap *owner, size_t index) : owner_(owner), index_(index) {}
+    template <class TOtherMap, class TOtherValue>
+    UTIL_FORCEINLINE basic_iterator(const basic_iterator<TOtherMap, TOtherValue> &other)
+        : owner_(other.owner_), index_(other.index_) {}
+
+    UTIL_FORCEINLINE reference operator*() const {
+      return reference(owner_->keys_[index_], owner_->values_[index_]);
+    }
+    UTIL_FORCEINLINE pointer operator->() const {
+      pointer ret = {reference(owner_->keys_[index_], owner_->values_[index_])};
+      return ret;
+    }
+
+    UTIL_FORCEINLINE basic_iterator &operator++() {
+      index_ = owner_->next_used(index_ + 1);
+      return *this;
+    }
+    UTIL_FORCEINLINE basic_iterator operator++(int) {
+      basic_iterator ret = *this;
+      ++(*this);
+      return ret;
+    }
+
+    template <class TOtherMap, class TOtherValue>
+    UTIL_FORCEINLINE bool operator==(const basic_iterator<TOtherMap, TOtherValue> &other) const {
+      return index_ == other.index_;
+    }
+    template <class TOtherMap, class TOtherValue>
+    UTIL_FORCEINLINE bool operator!=(const basic_iterator<TOtherMap, TOtherValue> &other) const {
+      return index_ != other.index_;
+    }
+
+   private:
+    TMap *owner_;
+    size_t index_;
+
+    template <class, class>
+    friend class basic_iterator;
+    friend class flat_hash_map;
+  };
+
+ public:
+  using iterator = basic_iterator<flat_hash_map, TValue>;
+  using const_iterator = basic_iterator<const flat_hash_map, const TValue>;
+
+  flat_hash_map() : size_(0) {}
+
+  UTIL_FORCEINLINE size_t size() const UTIL_CONFIG_NOEXCEPT { return size_; }
+  UTIL_FORCEINLINE bool empty() const UTIL_CONFIG_NOEXCEPT { return 0 == size_; }
+  UTIL_FORCEINLINE size_t capacity() const UTIL_CONFIG_NOEXCEPT { return hashes_.size(); }
+
+  UTIL_FORCEINLINE iterator begin() { return iterator(this, next_used(0)); }
+  UTIL_FORCEINLINE iterator end() { return iterator(this, hashes_.size()); }
+  UTIL_FORCEINLINE const_iterator begin() const { return const_iterator(this, next_used(0)); }
+  UTIL_FORCEINLINE const_iterator end() const { return const_iterator(this, hashes_.size()); }
+
+  void clear() {
+    hashes_.clear();
+    keys_.clear();
+    values_.clear();
+    size_ = 0;
+  }
+
+  void reserve(size_t n) {
+    size_t cap = 8;
+    while (cap * 3 < n * 4) {
+      cap <<= 1;
+    }
+    if (cap > hashes_.size()) {
+      rehash(cap);
+    }
+  }
+
+  UTIL_FORCEINLINE iterator find(const TKey &key) { return iterator(this, find_index(key, THash()(key))); }
+  UTIL_FORCEINLINE const_iterator find(const TKey &key) const {
+    return const_iterator(this, find_index(key, THash()(key)));
+  }
+
+  /**
+   * @brief find by another type of key without converting it to TKey, THash and TEqual must support it
+   */
+  template <class TLookup>
+  UTIL_FORCEINLINE iterator find_as(const TLookup &key) {
+    return iterator(this, find_index(key, THash()(key)));
+  }
+  template <class TLookup>
+  UTIL_FORCEINLINE const_iterator find_as(const TLookup &key) const {
+    return const_iterator(this, find_index(key, THash()(key)));
+  }
+
+  UTIL_FORCEINLINE size_t count(const TKey &key) const { return find(key) == end() ? 0 : 1; }
+
+  TValue &operator[](const TKey &key) {
+    size_t hash = normalize_hash(THash()(key));
+    size_t index = find_index(key, hash);
+    if (index < hashes_.size()) {
+      return values_[index];
+    }
+
+    index = insert_index(key, hash);
+    return values_[index];
+  }
+
+  std::pair<iterator, bool> insert(const std::pair<TKey, TValue> &value) {
+    size_t hash = normalize_hash(THash()(value.first));
+    size_t index = find_index(value.first, hash);
+    if (index < hashes_.size()) {
+      return std::pair<iterator, bool>(iterator(this, index), false);
+    }
+
+    index = insert_index(value.first, hash);
+    values_[index] = value.second;
+    return std::pair<iterator, bool>(iterator(this, index), true);
+  }
+
+  void erase(const_iterator iter) {
+    if (iter.index_ < hashes_.size() && 0 != hashes_[iter.index_]) {
+      erase_index(iter.index_);
+    }
+  }
+
+  size_t erase(const TKey &key) {
+    size_t index = find_index(key, THash()(key));
+    if (index >= hashes_.size()) {
+      return 0;
+    }
+
+    erase_index(index);
+    return 1;
+  }
+
+  void swap(flat_hash_map &other) {
+    hashes_.swap(other.hashes_);
+    keys_.swap(other.keys_);
+    values_.swap(other.values_);
+    std::swap(size_, other.size_);
+  }
+
+ private:
+  // 0 is used to mark empty slot
+  static UTIL_FORCEINLINE size_t normalize_hash(size_t hash) UTIL_CONFIG_NOEXCEPT { return 0 == hash ? 1 : hash; }
+
+  size_t next_used(size_t index) const {
+    while (index < hashes_.size() && 0 == hashes_[index]) {
+      ++index;
+    }
+    return index;
+  }
+
+  template <class TLookup>
+  size_t find_index(const TLookup &key, size_t hash) const {
+    if (0 == size_) {
+      return hashes_.size();
+    }
+
+    hash = normalize_hash(hash);
+    size_t mask = hashes_.size() - 1;
+    TEqual equal;
+    for (size_t index = hash & mask;; index = (index + 1) & mask) {
+      if (0 == hashes_[index]) {
+        return hashes_.size();
+      }
+
+      if (hashes_[index] == hash && equal(keys_[index], key)) {
+        return index;
+      }
+    }
+  }
+
+  size_t insert_index(const TKey &key, size_t hash) {
+    // Max load factor is 0.75
+    if ((size_ + 1) * 4 > hashes_.size() * 3) {
+      rehash(hashes_.empty() ? 8 : hashes_.size() * 2);
+    }
+
+    size_t mask = hashes_.size() - 1;
+    size_t index = hash & mask;
+    while (0 != hashes_[index]) {
+      index = (index + 1) & mask;
+    }
+
+    hashes_[index] = hash;
+    keys_[index] = key;
+    ++size_;
+    return index;
+  }
+
+  void erase_index(size_t index) {
+    size_t mask = hashes_.size() - 1;
+    size_t hole = index;
+    // Move following entries back, so there is no tombstone
+    for (size_t next = (hole + 1) & mask; 0 != hashes_[next]; next = (next + 1) & mask) {
+      size_t ideal = hashes_[next] & mask;
+      // Entry in next can be moved into hole only if hole is in range [ideal, next)
+      if (((next - ideal) & mask) >= ((next - hole) & mask)) {
+        hashes_[hole] = hashes_[next];
+        std::swap(keys_[hole], keys_[next]);
+        std::swap(values_[hole], values_[next]);
+        hole = next;
+      }
+    }
+
+    hashes_[hole] = 0;
+    keys_[hole] = TKey();
+    values_[hole] = TValue();
+    --size_;
+  }
+
+  void rehash(size_t new_capacity) {
+    std::vector<size_t> old_hashes(new_capacity, 0);
+    std::vector<TKey> old_keys(new_capacity);
+    std::vector<TValue> old_values(new_capacity);
+    old_hashes.swap(hashes_);
+    old_keys.swap(keys_);
+    old_values.swap(values_);
+
+    size_t mask = new_capacity - 1;
+    for (size_t i = 0; i < old_hashes.size(); ++i) {
+      if (0 == old_hashes[i]) {
+        continue;
+      }
+
+      size_t index = old_hashes[i] & mask;
+      while (0 != hashes_[index]) {
+        index = (index + 1) & mask;
+      }
+      hashes_[index] = old_hashes[i];
+      std::swap(keys_[index], old_keys[i]);
+      std::swap(values_[index], old_values[i]);
+    }
+  }
+
+ private:
+  std::vector<size_t> hashes_;
+  std::vector<TKey> keys_;
+  std::vector<TValue> values_;
+  size_t size_;
+};
+}  // namespace atapp
+
+#endif
@@ -0,0 +1,118 @@
+/**
+ * atapp_timer_wheel.h
+ *
+ *  Created on: 2021-06-12
+ *      Author: owent
+ */
+#ifndef LIBATAPP_ATAPP_TIMER_WHEEL_H
+#define LIBATAPP_ATAPP_TIMER_WHEEL_H
+
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+
+#include <config/compiler_features.h>
+
+#include <design_pattern/nomovable.h>
+#include <design_pattern/noncopyable.h>
+
+#include "atframe/atapp_config.h"
+
+namespace atapp {
+/**
+ * @brief Hierarchical timer wheel, insert and cancel are both O(1)
+ * @note Precision is 1 millisecond, there are LEVEL_COUNT levels and each level has LEVEL_SIZE slots.
+ *       Timers in higher levels are cascaded into lower levels when the lower level wraps.
+ *       A timer object can be armed again after triggered or canceled, so the owner can keep only one timer.
+ */
+class timer_wheel {
+ public:
+  using time_point = std::chrono::system_clock::time_point;
+  using duration = std::chrono::system_clock::duration;
+
+  class timer_node_t;
+  using timer_ptr_t = std::shared_ptr<timer_node_t>;
+  using callback_fn_t = std::function<void(const timer_ptr_t &)>;
+
+  enum {
+    LEVEL_BITS = 6,
+    LEVEL_SIZE = 1 << LEVEL_BITS,
+    LEVEL_MASK = LEVEL_SIZE - 1,
+    LEVEL_COUNT = 6,
+  };
+
+  class timer_node_t {
+    UTIL_DESIGN_PATTERN_NOCOPYABLE(timer_node_t)
+    UTIL_DESIGN_PATTERN_NOMOVABLE(timer_node_t)
+
+   public:
+    LIBATAPP_MACRO_API timer_node_t();
+    LIBATAPP_MACRO_API ~timer_node_t();
+
+    UTIL_FORCEINLINE bool is_armed() const UTIL_CONFIG_NOEXCEPT { return NULL != owner_; }
+    UTIL_FORCEINLINE const time_point &get_expire_time() const UTIL_CONFIG_NOEXCEPT { return expire_time_; }
+    UTIL_FORCEINLINE const callback_fn_t &get_callback() const UTIL_CONFIG_NOEXCEPT { return callback_; }
+    UTIL_FORCEINLINE void set_callback(callback_fn_t fn) { callback_ = fn; }
+
+   private:
+    timer_node_t *prev_;
+    timer_node_t *next_;
+    timer_node_t **slot_;
+    timer_wheel *owner_;
+    uint64_t expire_tick_;
+    time_point expire_time_;
+    callback_fn_t callback_;
+    timer_ptr_t self_holder_;  // Keep alive while armed
+
+    friend class timer_wheel;
+  };
+
+  UTIL_DESIGN_PATTERN_NOCOPYABLE(timer_wheel)
+  UTIL_DESIGN_PATTERN_NOMOVABLE(timer_wheel)
+
+ public:
+  LIBATAPP_MACRO_API timer_wheel();
+  LIBATAPP_MACRO_API ~timer_wheel();
+
+  static LIBATAPP_MACRO_API timer_ptr_t create_timer(callback_fn_t fn);
+
+  /**
+   * @brief add a timer or move it to a new expire time if it's already armed
+   * @note timer already expired will be triggered at the next tick
+   */
+  LIBATAPP_MACRO_API bool arm(const timer_ptr_t &timer, time_point expire_time);
+  LIBATAPP_MACRO_API timer_ptr_t add_timer(time_point expire_time, callback_fn_t fn);
+  LIBATAPP_MACRO_API bool cancel(const timer_ptr_t &timer);
+  LIBATAPP_MACRO_API void clear();
+
+  /**
+   * @brief trigger all timers expired before now
+   * @return count of triggered timers
+   */
+  LIBATAPP_MACRO_API size_t tick(time_point now);
+
+  UTIL_FORCEINLINE size_t size() const UTIL_CONFIG_NOEXCEPT { return size_; }
+  UTIL_FORCEINLINE bool empty() const UTIL_CONFIG_NOEXCEPT { return 0 == size_; }
+
+ private:
+  uint64_t to_tick(time_point t, bool round_up) const;
+  uint64_t get_next_tick() const;
+  void link(timer_node_t &node);
+  void link_to_slot(timer_node_t &node, timer_node_t **slot);
+  void unlink(timer_node_t &node);
+  void cascade(int level);
+
+ private:
+  bool inited_;
+  time_point base_time_;
+  uint64_t current_tick_;
+  size_t size_;
+  timer_node_t *slots_[LEVEL_COUNT][LEVEL_SIZE];
+};
+}  // namespace atapp
+
+#endif
@@ -22,9 +22,14 @@ class atapp_connector_atbus : public atapp_connector_impl {
                                               const atbus::channel::channel_address_t &addr,
                                               const atapp_connection_handle::ptr_t &handle) UTIL_CONFIG_OVERRIDE;
   LIBATAPP_MACRO_API int32_t on_close_connect(atapp_connection_handle &handle) UTIL_CONFIG_OVERRIDE;
+  // atbus::node::send_data() only accepts continuous data and copies it into the packed message, so vectored sending
+  // still uses the default on_send_forward_request_v() and gathers segments once here.
   LIBATAPP_MACRO_API int32_t
   on_send_forward_request(atapp_connection_handle *handle, int32_t type, uint64_t *msg_sequence, const void *data,
                           size_t data_size, const atapp::protocol::atapp_metadata *metadata) UTIL_CONFIG_OVERRIDE;
+  LIBATAPP_MACRO_API void on_send_forward_request_batch(atapp_connection_handle *handle,
+                                                        atapp_forward_request_t *const *requests,
+                                                        size_t count) UTIL_CONFIG_OVERRIDE;
 
   LIBATAPP_MACRO_API void on_discovery_event(etcd_discovery_action_t::type,
                                              const etcd_discovery_node::ptr_t &) UTIL_CONFIG_OVERRIDE;
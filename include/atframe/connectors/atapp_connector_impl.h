@@ -5,6 +5,7 @@
 
 #include <list>
 #include <string>
+#include <vector>
 
 #include <config/compile_optimize.h>
 #include <config/compiler_features.h>
@@ -99,6 +100,11 @@ class LIBATAPP_MACRO_API_SYMBOL_VISIBLE atapp_connector_impl {
   using handle_set_t = LIBATFRAME_UTILS_AUTO_SELETC_SET(atapp_connection_handle *);
   using protocol_set_t = LIBATFRAME_UTILS_AUTO_SELETC_SET(std::string);
 
+  enum {
+    // Gather buffer larger than it will be released after used
+    MAX_GATHER_BUFFER_SIZE = 65536,
+  };
+
   struct address_type_t {
     enum type {
       EN_ACAT_NONE = 0x0000,
@@ -153,6 +159,33 @@ class LIBATAPP_MACRO_API_SYMBOL_VISIBLE atapp_connector_impl {
                                                              uint64_t *msg_sequence, const void *data, size_t data_size,
                                                              const atapp::protocol::atapp_metadata *metadata);
 
+  /**
+   * @brief vectored version of on_send_forward_request
+   * @note default implementation gathers all segments into a reused buffer and then call on_send_forward_request,
+   *       implement can override it to send segments without the extra copy
+   * @return 0 or error code
+   */
+  LIBATAPP_MACRO_API virtual int32_t on_send_forward_request_v(atapp_connection_handle *handle, int32_t type,
+                                                               uint64_t *msg_sequence, const atapp_iovec_t *iov,
+                                                               size_t iov_count,
+                                                               const atapp::protocol::atapp_metadata *metadata);
+
+  /**
+   * @brief batch version of on_send_forward_request, result of each request must be set
+   * @note default implementation call on_send_forward_request for each request
+   */
+  LIBATAPP_MACRO_API virtual void on_send_forward_request_batch(atapp_connection_handle *handle,
+                                                                atapp_forward_request_t *const *requests,
+                                                                size_t count);
+
+  /**
+   * @brief if remote will send a forward response for every message which is sent successfully
+   * @note If it's true, messages are kept in flight of endpoint until the response is received, and implement must
+   *       call atapp_endpoint::finish_inflight_messages() for each response. Otherwise messages are finished once
+   *       they are accepted by on_send_forward_request*(...). Default is false.
+   */
+  LIBATAPP_MACRO_API virtual bool has_forward_response() const UTIL_CONFIG_NOEXCEPT;
+
   /**
    * @brief implement should call this when receive a response to tell app if a message is success delivered
    */
@@ -162,6 +195,10 @@ class LIBATAPP_MACRO_API_SYMBOL_VISIBLE atapp_connector_impl {
                                                               const atapp::protocol::atapp_metadata *metadata);
 
   LIBATAPP_MACRO_API virtual void on_discovery_event(etcd_discovery_action_t::type, const etcd_discovery_node::ptr_t &);
+  /**
+   * @brief batch of discovery events, it calls on_discovery_event for each event by default
+   */
+  LIBATAPP_MACRO_API virtual void on_discovery_events(const std::vector<etcd_discovery_event_t> &events);
 
   LIBATAPP_MACRO_API const protocol_set_t &get_support_protocols() const UTIL_CONFIG_NOEXCEPT;
 
@@ -173,6 +210,7 @@ class LIBATAPP_MACRO_API_SYMBOL_VISIBLE atapp_connector_impl {
   handle_set_t handles_;
   protocol_set_t support_protocols_;
   mutable std::unique_ptr<util::scoped_demangled_name> auto_demangled_name_;
+  std::vector<unsigned char> gather_buffer_;
 
   friend struct atapp_connector_bind_helper;
 };
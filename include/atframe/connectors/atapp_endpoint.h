@@ -4,6 +4,7 @@
 #pragma once
 
 #include <list>
+#include <string>
 #include <vector>
 
 #include <config/atframe_utils_build_feature.h>
@@ -23,13 +24,29 @@
 #endif
 
 #include <atframe/atapp_conf.h>
+#include <atframe/atapp_timer_wheel.h>
 #include <atframe/etcdcli/etcd_discovery.h>
 
+#include "atframe/connectors/atapp_pending_message_queue.h"
+
 namespace atapp {
 class app;
 class atapp_connection_handle;
+class atapp_connector_impl;
 class atapp_endpoint;
 
+/**
+ * @brief One message of a batch send, result will be set to 0 or error code after sent
+ */
+struct LIBATAPP_MACRO_API_HEAD_ONLY atapp_forward_request_t {
+  int32_t type;
+  uint64_t msg_sequence;
+  const void *data;
+  size_t data_size;
+  const atapp::protocol::atapp_metadata *metadata;
+  int32_t result;
+};
+
 struct atapp_endpoint_bind_helper {
   // This API is used by inner system and will not be exported, do not call it directly
   static LIBATAPP_MACRO_API_SYMBOL_HIDDEN void unbind(atapp_connection_handle &handle, atapp_endpoint &connect);
@@ -44,14 +61,10 @@ class atapp_endpoint {
   using handle_set_const_iterator = handle_set_t::const_iterator;
   using ptr_t = std::shared_ptr<atapp_endpoint>;
   using weak_ptr_t = std::weak_ptr<atapp_endpoint>;
-
-  struct pending_message_t {
-    util::time::time_utility::raw_time_t expired_timepoint;
-    int32_t type;
-    uint64_t msg_sequence;
-    std::vector<unsigned char> data;
-    std::unique_ptr<atapp::protocol::atapp_metadata> metadata;
-  };
+  using idle_list_t = std::list<weak_ptr_t>;
+  // Immutable payload which can be shared by pending lists of many endpoints
+  using shared_payload_ptr_t = atapp_pending_message_queue::shared_payload_ptr_t;
+  using pending_message_t = atapp_pending_message_queue::message_t;
 
   UTIL_DESIGN_PATTERN_NOCOPYABLE(atapp_endpoint)
   UTIL_DESIGN_PATTERN_NOMOVABLE(atapp_endpoint)
@@ -77,6 +90,23 @@ class atapp_endpoint {
 
   LIBATAPP_MACRO_API int32_t push_forward_message(int32_t type, uint64_t &msg_sequence, const void *data,
                                                   size_t data_size, const atapp::protocol::atapp_metadata *metadata);
+  /**
+   * @brief send several messages to this endpoint, the connector will receive all of them in one call if it's ready
+   * @note result of each request will be set, empty messages are always success and never sent, just like
+   *       push_forward_message
+   * @note messages are compressed one by one the same as push_forward_message, the connector receives compressed
+   *       copies of them in the same call, and requests passed in are never modified except result and msg_sequence
+   * @return number of messages which are sent or pushed into pending list successfully
+   */
+  LIBATAPP_MACRO_API size_t push_forward_message_batch(atapp_forward_request_t *const *requests, size_t count);
+  LIBATAPP_MACRO_API int32_t push_forward_message_v(int32_t type, uint64_t &msg_sequence, const atapp_iovec_t *iov,
+                                                    size_t iov_count, const atapp::protocol::atapp_metadata *metadata);
+  /**
+   * @brief send a shared payload, pending list will keep a reference of payload instead of copying it
+   */
+  LIBATAPP_MACRO_API int32_t push_forward_message_shared(int32_t type, uint64_t &msg_sequence,
+                                                         const shared_payload_ptr_t &payload,
+                                                         const atapp::protocol::atapp_metadata *metadata);
 
   LIBATAPP_MACRO_API int32_t retry_pending_messages(const util::time::time_utility::raw_time_t &tick_time,
                                                     int32_t max_count = 0);
@@ -84,25 +114,60 @@ class atapp_endpoint {
 
   UTIL_FORCEINLINE app *get_owner() const UTIL_CONFIG_NOEXCEPT { return owner_; }
 
+  UTIL_FORCEINLINE size_t get_pending_message_count() const UTIL_CONFIG_NOEXCEPT { return pending_messages_.size(); }
+  UTIL_FORCEINLINE size_t get_pending_message_size() const UTIL_CONFIG_NOEXCEPT {
+    return pending_messages_.get_data_size();
+  }
+
+  /**
+   * @brief messages which are pending or waiting for response, it's used as load in bounded-load routing
+   * @note Pending messages are finished when they fail or are sent. Sent messages are finished at once if the
+   *       connector has no forward response, or when the connector receives the response,
+   *       see atapp_connector_impl::has_forward_response()
+   */
+  UTIL_FORCEINLINE size_t get_inflight_message_count() const UTIL_CONFIG_NOEXCEPT { return inflight_message_count_; }
+  LIBATAPP_MACRO_API void finish_inflight_messages(size_t count = 1) UTIL_CONFIG_NOEXCEPT;
+
+  /**
+   * @brief idle endpoints have no connection and will be removed by app after idle timeout
+   */
+  UTIL_FORCEINLINE bool is_idle() const UTIL_CONFIG_NOEXCEPT { return idle_; }
+  UTIL_FORCEINLINE const util::time::time_utility::raw_time_t &get_idle_timepoint() const UTIL_CONFIG_NOEXCEPT {
+    return idle_timepoint_;
+  }
+
  private:
   void reset();
+  void reset_for_reuse();
   void cancel_pending_messages();
+  void add_inflight_messages(size_t count) UTIL_CONFIG_NOEXCEPT;
+  atapp::protocol::atapp_compression_algorithm_t select_compression_algorithm() const;
+  int32_t send_forward_request(atapp_connector_impl &connector, atapp_connection_handle *handle, int32_t type,
+                               uint64_t *msg_sequence, const atapp_iovec_t *iov, size_t iov_count, size_t data_size,
+                               const atapp::protocol::atapp_metadata *metadata);
+  int32_t push_forward_message_inner(int32_t type, uint64_t &msg_sequence, const atapp_iovec_t *iov, size_t iov_count,
+                                     const shared_payload_ptr_t *shared_payload,
+                                     const atapp::protocol::atapp_metadata *metadata);
 
  private:
   bool closing_;
   app *owner_;
-  util::time::time_utility::raw_time_t nearest_waker_;
+  timer_wheel::timer_ptr_t waker_timer_;
+  bool idle_;
+  util::time::time_utility::raw_time_t idle_timepoint_;
+  idle_list_t::iterator idle_iter_;  // position in idle list of app
+  // No new connect attempt before it, unless the current attempt is closed
+  util::time::time_utility::raw_time_t next_connect_timepoint_;
   weak_ptr_t watcher_;
   handle_set_t refer_connections_;
   etcd_discovery_node::ptr_t discovery_;
 
-  std::list<pending_message_t> pending_message_;
-  size_t pending_message_size_;
-#if defined(LIBATAPP_ENABLE_CUSTOM_COUNT_FOR_STD_LIST) && LIBATAPP_ENABLE_CUSTOM_COUNT_FOR_STD_LIST
-  size_t pending_message_count_;
-#endif
+  atapp_pending_message_queue pending_messages_;
+  size_t inflight_message_count_;
+  std::vector<unsigned char> compression_buffer_;
 
   friend struct atapp_endpoint_bind_helper;
+  friend class app;
 };
 }  // namespace atapp
 
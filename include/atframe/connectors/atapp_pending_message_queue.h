@@ -0,0 +1,123 @@
+#ifndef LIBATAPP_ATAPP_CONNECTORS_ATAPP_PENDING_MESSAGE_QUEUE_H
+#define LIBATAPP_ATAPP_CONNECTORS_ATAPP_PENDING_MESSAGE_QUEUE_H
+
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <config/compiler_features.h>
+
+#include <design_pattern/nomovable.h>
+#include <design_pattern/noncopyable.h>
+
+#include <time/time_utility.h>
+
+#include "atframe/atapp_conf.h"
+#include "atframe/atapp_config.h"
+
+namespace atapp {
+/**
+ * @brief Buffer segment for vectored sending, the same layout as iovec of POSIX
+ */
+struct LIBATAPP_MACRO_API_HEAD_ONLY atapp_iovec_t {
+  const void *iov_base;
+  size_t iov_len;
+};
+
+/**
+ * @brief FIFO of pending messages, header and payload of each message are placed contiguously in chunks.
+ * @note Records never move after pushed. Chunks start small and grow up to the max chunk size, drained chunks are
+ *       recycled while there are still messages, and all memory is released once the queue becomes empty.
+ */
+class atapp_pending_message_queue {
+ public:
+  // Immutable payload which can be shared by pending lists of many endpoints
+  using shared_payload_ptr_t = std::shared_ptr<const std::string>;
+
+  struct message_t {
+    util::time::time_utility::raw_time_t expired_timepoint;
+    int32_t type;
+    uint64_t msg_sequence;
+    const void *data;
+    size_t data_size;
+    const atapp::protocol::atapp_metadata *metadata;  // owned by the queue
+    shared_payload_ptr_t shared_payload;              // data points to it if it's not empty
+  };
+
+  enum {
+    MIN_CHUNK_SIZE = 4096,
+    DEFAULT_MAX_CHUNK_SIZE = 65536,
+    MAX_FREE_CHUNK_NUMBER = 4,
+    MAX_FREE_METADATA_NUMBER = 64,
+  };
+
+  UTIL_DESIGN_PATTERN_NOCOPYABLE(atapp_pending_message_queue)
+  UTIL_DESIGN_PATTERN_NOMOVABLE(atapp_pending_message_queue)
+
+ public:
+  LIBATAPP_MACRO_API atapp_pending_message_queue();
+  LIBATAPP_MACRO_API ~atapp_pending_message_queue();
+
+  /**
+   * @brief set max size of chunks, messages larger than it still use a dedicated chunk
+   */
+  LIBATAPP_MACRO_API void set_max_chunk_size(size_t sz) UTIL_CONFIG_NOEXCEPT;
+  UTIL_FORCEINLINE size_t get_max_chunk_size() const UTIL_CONFIG_NOEXCEPT { return max_chunk_size_; }
+
+  /**
+   * @brief copy segments into the queue
+   * @return pushed message or NULL when malloc failed
+   */
+  LIBATAPP_MACRO_API message_t *push(size_t data_size, const atapp_iovec_t *iov, size_t iov_count,
+                                     const atapp::protocol::atapp_metadata *metadata);
+  /**
+   * @brief keep a reference of payload instead of copying it
+   * @return pushed message or NULL when malloc failed
+   */
+  LIBATAPP_MACRO_API message_t *push(const shared_payload_ptr_t &payload,
+                                     const atapp::protocol::atapp_metadata *metadata);
+
+  LIBATAPP_MACRO_API message_t *front() UTIL_CONFIG_NOEXCEPT;
+  LIBATAPP_MACRO_API void pop();
+  LIBATAPP_MACRO_API void clear();
+
+  UTIL_FORCEINLINE bool empty() const UTIL_CONFIG_NOEXCEPT { return 0 == message_count_; }
+  UTIL_FORCEINLINE size_t size() const UTIL_CONFIG_NOEXCEPT { return message_count_; }
+  UTIL_FORCEINLINE size_t get_data_size() const UTIL_CONFIG_NOEXCEPT { return data_size_; }
+
+  UTIL_FORCEINLINE size_t get_chunk_count() const UTIL_CONFIG_NOEXCEPT { return chunks_.size(); }
+  UTIL_FORCEINLINE size_t get_free_chunk_count() const UTIL_CONFIG_NOEXCEPT { return free_chunks_.size(); }
+  // Bytes of all chunks held by this queue, including recycled ones
+  UTIL_FORCEINLINE size_t get_allocated_size() const UTIL_CONFIG_NOEXCEPT { return allocated_size_; }
+
+ private:
+  struct chunk_t {
+    unsigned char *buffer;
+    size_t capacity;
+    size_t read_offset;
+    size_t write_offset;
+  };
+
+  message_t *allocate(size_t payload_capacity, const atapp::protocol::atapp_metadata *metadata);
+  bool append_chunk(size_t record_size);
+  void recycle_chunk(const chunk_t &chunk);
+  void release();
+
+ private:
+  std::deque<chunk_t> chunks_;
+  std::vector<chunk_t> free_chunks_;
+  std::vector<atapp::protocol::atapp_metadata *> free_metadata_;
+  size_t max_chunk_size_;
+  size_t next_chunk_size_;
+  size_t allocated_size_;
+  size_t data_size_;
+  size_t message_count_;
+};
+}  // namespace atapp
+
+#endif
@@ -12,15 +12,21 @@
 
 #pragma once
 
+#include <deque>
+#include <utility>
+#include <vector>
+
 #include <config/atframe_utils_build_feature.h>
 #include <config/compiler_features.h>
 
 #include <design_pattern/nomovable.h>
 #include <design_pattern/noncopyable.h>
 
+#include <lock/spin_lock.h>
 #include <random/random_generator.h>
 
 #include <atframe/atapp_conf.h>
+#include <atframe/atapp_flat_hash_map.h>
 
 namespace atapp {
 struct LIBATAPP_MACRO_API_HEAD_ONLY etcd_discovery_action_t {
@@ -31,6 +37,30 @@ struct LIBATAPP_MACRO_API_HEAD_ONLY etcd_discovery_action_t {
   };
 };
 
+struct LIBATAPP_MACRO_API_HEAD_ONLY etcd_discovery_consistent_hash_policy_t {
+  enum type {
+    EN_CHP_RING = 0,  // Hash ring with virtual points, O(log(n)) lookup and minimal key movement
+    EN_CHP_MAGLEV,    // Maglev lookup table, O(1) lookup and nearly minimal key movement
+    EN_CHP_JUMP,      // Jump consistent hash over sorted nodes, no table and minimal movement on tail changes
+    // Hash ring with bounded load, app skips nodes with too many recently assigned messages clockwise.
+    // It's the same as EN_CHP_RING when it's used by etcd_discovery_set directly.
+    EN_CHP_BOUNDED_LOAD,
+    // Rendezvous(highest random weight) hashing, every node is scored for each key and the highest one wins.
+    // It needs no ring or table and moves only keys of changed nodes, but lookup is O(n), so it's designed for small
+    // sets(less than 64 nodes). Weight of node is not used.
+    EN_CHP_RENDEZVOUS,
+  };
+};
+
+struct LIBATAPP_MACRO_API_HEAD_ONLY etcd_discovery_locality_t {
+  enum type {
+    EN_DL_ZONE = 0,  // The same region, district and zone_id
+    EN_DL_DISTRICT,  // The same region and district
+    EN_DL_REGION,    // The same region
+    EN_DL_MAX,
+  };
+};
+
 class etcd_discovery_node {
  public:
   using on_destroy_fn_t = std::function<void(etcd_discovery_node &)>;
@@ -59,10 +89,18 @@ class etcd_discovery_node {
   UTIL_FORCEINLINE void set_private_data_iptr(intptr_t input) { private_data_iptr_ = input; }
   UTIL_FORCEINLINE intptr_t get_private_data_iptr() const { return private_data_iptr_; }
 
+  /**
+   * @brief callback when this node is destroyed
+   * @note it's called by the thread which releases the last reference, which may be a reader of snapshot
+   */
   LIBATAPP_MACRO_API void set_on_destroy(on_destroy_fn_t fn);
   LIBATAPP_MACRO_API const on_destroy_fn_t &get_on_destroy() const;
   LIBATAPP_MACRO_API void reset_on_destroy();
 
+  /**
+   * @brief round robin of gateways, or listen addresses if there is no gateway
+   * @note it changes the inner index, so it must be called on the thread which owns this node
+   */
   LIBATAPP_MACRO_API const atapp::protocol::atapp_gateway &next_ingress_gateway() const;
   LIBATAPP_MACRO_API int32_t get_ingress_size() const;
 
@@ -81,13 +119,34 @@ class etcd_discovery_node {
   mutable atapp::protocol::atapp_gateway ingress_for_listen_;
 };
 
+struct LIBATAPP_MACRO_API_HEAD_ONLY etcd_discovery_event_t {
+  etcd_discovery_action_t::type action;
+  etcd_discovery_node::ptr_t node;
+};
+
+class etcd_discovery_snapshot;
+
 class etcd_discovery_set {
  public:
-  using node_by_name_t = LIBATFRAME_UTILS_AUTO_SELETC_MAP(std::string, etcd_discovery_node::ptr_t);
-  using node_by_id_t = LIBATFRAME_UTILS_AUTO_SELETC_MAP(uint64_t, etcd_discovery_node::ptr_t);
+  using node_by_name_t = flat_hash_map<std::string, etcd_discovery_node::ptr_t>;
+  using node_by_id_t = flat_hash_map<uint64_t, etcd_discovery_node::ptr_t>;
   using ptr_t = std::shared_ptr<etcd_discovery_set>;
+  using const_ptr_t = std::shared_ptr<const etcd_discovery_set>;
+  using node_load_fn_t = std::function<uint64_t(const etcd_discovery_node &)>;
+  using locality_set_map_t = flat_hash_map<std::string, ptr_t>;
+  // Sorted nodes of each term, term is one of type name, namespace, service subset or label key=value
+  using posting_list_map_t = flat_hash_map<std::string, std::vector<etcd_discovery_node::ptr_t> >;
+
+  // Changes between two generations, nodes added and then removed in the range are not included
+  struct LIBATAPP_MACRO_API_HEAD_ONLY diff_t {
+    std::vector<etcd_discovery_node::ptr_t> added;
+    std::vector<etcd_discovery_node::ptr_t> removed;
+    // Pairs of old node and new node which have the same id or name
+    std::vector<std::pair<etcd_discovery_node::ptr_t, etcd_discovery_node::ptr_t> > updated;
+  };
 
   struct node_hash_t {
+    // Virtual points of a node with default weight(100), it's scaled by atapp_discovery.weight
     enum { HASH_POINT_PER_INS = 80 };
 
     etcd_discovery_node::ptr_t node;
@@ -104,14 +163,120 @@ class etcd_discovery_set {
 
   LIBATAPP_MACRO_API etcd_discovery_node::ptr_t get_node_by_id(uint64_t id) const;
   LIBATAPP_MACRO_API etcd_discovery_node::ptr_t get_node_by_name(const std::string &name) const;
+  LIBATAPP_MACRO_API etcd_discovery_node::ptr_t get_node_by_name(const hashed_string_ref &name) const;
 
   LIBATAPP_MACRO_API etcd_discovery_node::ptr_t get_node_by_consistent_hash(const void *buf, size_t bufsz) const;
   LIBATAPP_MACRO_API etcd_discovery_node::ptr_t get_node_by_consistent_hash(uint64_t key) const;
   LIBATAPP_MACRO_API etcd_discovery_node::ptr_t get_node_by_consistent_hash(int64_t key) const;
   LIBATAPP_MACRO_API etcd_discovery_node::ptr_t get_node_by_consistent_hash(const std::string &key) const;
 
+  /**
+   * @brief get node by consistent hash with specify policy
+   * @note policies except EN_CHP_RING mix integer keys by splitmix64 instead of murmur3, so the result of an integer
+   *       key may be different from passing the same key as a buffer
+   */
+  LIBATAPP_MACRO_API etcd_discovery_node::ptr_t get_node_by_consistent_hash(
+      const void *buf, size_t bufsz, etcd_discovery_consistent_hash_policy_t::type policy) const;
+  LIBATAPP_MACRO_API etcd_discovery_node::ptr_t get_node_by_consistent_hash(
+      uint64_t key, etcd_discovery_consistent_hash_policy_t::type policy) const;
+  LIBATAPP_MACRO_API etcd_discovery_node::ptr_t get_node_by_consistent_hash(
+      int64_t key, etcd_discovery_consistent_hash_policy_t::type policy) const;
+  LIBATAPP_MACRO_API etcd_discovery_node::ptr_t get_node_by_consistent_hash(
+      const std::string &key, etcd_discovery_consistent_hash_policy_t::type policy) const;
+
+  /**
+   * @brief get at most n distinct nodes clockwise from the position of key on hash ring
+   * @note the first node is the same as get_node_by_consistent_hash, the others are its successors as backups
+   * @return number of nodes appended into out
+   */
+  LIBATAPP_MACRO_API size_t get_nodes_by_consistent_hash(const void *buf, size_t bufsz, size_t n,
+                                                         std::vector<etcd_discovery_node::ptr_t> &out) const;
+  LIBATAPP_MACRO_API size_t get_nodes_by_consistent_hash(uint64_t key, size_t n,
+                                                         std::vector<etcd_discovery_node::ptr_t> &out) const;
+  LIBATAPP_MACRO_API size_t get_nodes_by_consistent_hash(int64_t key, size_t n,
+                                                         std::vector<etcd_discovery_node::ptr_t> &out) const;
+  LIBATAPP_MACRO_API size_t get_nodes_by_consistent_hash(const std::string &key, size_t n,
+                                                         std::vector<etcd_discovery_node::ptr_t> &out) const;
+
+  /**
+   * @brief resolve nodes of many keys by one call, node of each key is the same as get_node_by_consistent_hash
+   * @note when there are enough keys, their hash codes are sorted and merged with the hash ring in one sweep
+   * @param out node of each key is appended into out in the same order of keys, NULL is appended if there is no node
+   */
+  LIBATAPP_MACRO_API void get_node_by_consistent_hash_batch(const uint64_t *keys, size_t count,
+                                                            std::vector<etcd_discovery_node::ptr_t> &out,
+                                                            etcd_discovery_consistent_hash_policy_t::type policy) const;
+  LIBATAPP_MACRO_API void get_node_by_consistent_hash_batch(const int64_t *keys, size_t count,
+                                                            std::vector<etcd_discovery_node::ptr_t> &out,
+                                                            etcd_discovery_consistent_hash_policy_t::type policy) const;
+  LIBATAPP_MACRO_API void get_node_by_consistent_hash_batch(const std::string *keys, size_t count,
+                                                            std::vector<etcd_discovery_node::ptr_t> &out,
+                                                            etcd_discovery_consistent_hash_policy_t::type policy) const;
+
+  /**
+   * @brief get node by consistent hash with bounded load, walk clockwise on ring when load of node reaches max_load
+   * @note the first node will be returned if all nodes are full
+   */
+  LIBATAPP_MACRO_API etcd_discovery_node::ptr_t get_node_by_consistent_hash_bounded(
+      const void *buf, size_t bufsz, uint64_t max_load, const node_load_fn_t &load_fn) const;
+  /**
+   * @brief get node by consistent hash with bounded load of recent assignments, and assign one message to it
+   * @note load of a node is the number of messages assigned to it by this function, loads are halved every time
+   *       decay_epoch increases and are reset when the node is changed. Max load is
+   *       ceil(load_factor% * (total load + 1) / node count), so it works without any response of messages.
+   * @param load_factor percent of the average load, it's at least 100
+   * @param decay_epoch caller's clock of decay, such as second of the last tick
+   */
+  LIBATAPP_MACRO_API etcd_discovery_node::ptr_t assign_node_by_consistent_hash_bounded(const void *buf, size_t bufsz,
+                                                                                      uint64_t load_factor,
+                                                                                      uint64_t decay_epoch) const;
+
   LIBATAPP_MACRO_API etcd_discovery_node::ptr_t get_node_by_random() const;
   LIBATAPP_MACRO_API etcd_discovery_node::ptr_t get_node_by_round_robin() const;
+  /**
+   * @brief power of two choices, pick two random nodes and return the one with lower load
+   * @param load_fn load of node, use load_score in discovery info if it's empty
+   */
+  LIBATAPP_MACRO_API etcd_discovery_node::ptr_t get_node_by_p2c(const node_load_fn_t &load_fn = node_load_fn_t()) const;
+
+  /**
+   * @brief get the sub set of nodes in the same locality of area
+   * @note sub sets are built at the first call and then maintained incrementally by add_node and remove_node
+   * @return NULL if there is no node in this locality or locality of area is not set
+   */
+  LIBATAPP_MACRO_API const etcd_discovery_set *get_locality_set(const atapp::protocol::atapp_area &area,
+                                                                etcd_discovery_locality_t::type locality) const;
+
+  /**
+   * @brief locality-aware selection, prefer nodes in the same zone, and then district, region and all nodes
+   * @param area area of caller
+   * @param spill_over_percent percent of selections which are spilled over to the next wider locality
+   * @note spill over of consistent hash is decided by key, so the same key always goes to the same locality
+   */
+  LIBATAPP_MACRO_API etcd_discovery_node::ptr_t get_node_by_random(const atapp::protocol::atapp_area &area,
+                                                                   uint32_t spill_over_percent) const;
+  LIBATAPP_MACRO_API etcd_discovery_node::ptr_t get_node_by_round_robin(const atapp::protocol::atapp_area &area,
+                                                                        uint32_t spill_over_percent) const;
+  LIBATAPP_MACRO_API etcd_discovery_node::ptr_t get_node_by_consistent_hash(
+      const void *buf, size_t bufsz, const atapp::protocol::atapp_area &area, uint32_t spill_over_percent) const;
+  LIBATAPP_MACRO_API etcd_discovery_node::ptr_t get_node_by_consistent_hash(
+      uint64_t key, const atapp::protocol::atapp_area &area, uint32_t spill_over_percent) const;
+  LIBATAPP_MACRO_API etcd_discovery_node::ptr_t get_node_by_consistent_hash(
+      int64_t key, const atapp::protocol::atapp_area &area, uint32_t spill_over_percent) const;
+  LIBATAPP_MACRO_API etcd_discovery_node::ptr_t get_node_by_consistent_hash(
+      const std::string &key, const atapp::protocol::atapp_area &area, uint32_t spill_over_percent) const;
+
+  /**
+   * @brief select nodes by inverted index of type name and metadata
+   * @param selector match namespace_name, service_subset and all labels if they are not empty
+   * @param type_name match type_name of atapp_discovery if it's not empty
+   * @note result is cached and kept updated by add_node and remove_node, so the same selector costs nothing after the
+   *       first call, it can be used by send_message_by_* of app directly. Results held by callers are never evicted,
+   *       others are evicted by LRU when there are more than get_selector_cache_capacity() results
+   * @return sub set of matched nodes, it may be empty but never be NULL
+   */
+  LIBATAPP_MACRO_API const_ptr_t select_nodes(const atapp::protocol::atapp_metadata &selector,
+                                              const std::string &type_name = std::string()) const;
 
   LIBATAPP_MACRO_API const std::vector<etcd_discovery_node::ptr_t> &get_sorted_nodes() const;
   LIBATAPP_MACRO_API std::vector<etcd_discovery_node::ptr_t>::const_iterator lower_bound_sorted_nodes(
@@ -119,23 +284,214 @@ class etcd_discovery_set {
   LIBATAPP_MACRO_API std::vector<etcd_discovery_node::ptr_t>::const_iterator upper_bound_sorted_nodes(
       uint64_t id, const std::string &name) const;
 
+  /**
+   * @brief start publishing immutable snapshots, the first snapshot is published immediately
+   * @note it must be called on the thread which modifies this set
+   */
+  LIBATAPP_MACRO_API void enable_snapshot();
+  /**
+   * @brief publish a new snapshot if this set is changed since last publishing
+   * @note changes are not published until it's called, so owner should call it once per tick instead of copying for
+   *       every change. It must be called on the thread which modifies this set
+   */
+  LIBATAPP_MACRO_API void flush_snapshot();
+  /**
+   * @brief get the latest published snapshot, it's thread-safe
+   * @return NULL if enable_snapshot() is not called
+   */
+  LIBATAPP_MACRO_API std::shared_ptr<const etcd_discovery_snapshot> get_snapshot() const;
+
+  /**
+   * @brief generation is increased by one after every change of this set, it starts from 0
+   */
+  UTIL_FORCEINLINE uint64_t get_generation() const { return generation_; }
+
+  /**
+   * @brief get changes after from_generation until to_generation from change log
+   * @return false if from_generation is too old and changes are already dropped from change log, or the range is
+   *         invalid. Caller should scan get_sorted_nodes() again in this case
+   */
+  LIBATAPP_MACRO_API bool get_diff(uint64_t from_generation, uint64_t to_generation, diff_t &out) const;
+  LIBATAPP_MACRO_API bool get_diff(uint64_t from_generation, diff_t &out) const;
+
+  /**
+   * @brief set max count of records in change log, 1024 by default
+   * @note removed nodes are kept by change log until they are dropped, 0 disables change log
+   */
+  LIBATAPP_MACRO_API void set_change_log_capacity(size_t capacity);
+  UTIL_FORCEINLINE size_t get_change_log_capacity() const { return change_log_capacity_; }
+
+  /**
+   * @brief set max count of cached results of select_nodes(), 64 by default
+   * @note every change of this set walks all cached results, results held by callers are kept even if it's exceeded
+   */
+  LIBATAPP_MACRO_API void set_selector_cache_capacity(size_t capacity);
+  UTIL_FORCEINLINE size_t get_selector_cache_capacity() const { return selector_cache_capacity_; }
+  UTIL_FORCEINLINE size_t get_selector_cache_size() const { return selector_cache_.size(); }
+
   LIBATAPP_MACRO_API void add_node(const etcd_discovery_node::ptr_t &node);
   LIBATAPP_MACRO_API void remove_node(const etcd_discovery_node::ptr_t &node);
   LIBATAPP_MACRO_API void remove_node(uint64_t id);
   LIBATAPP_MACRO_API void remove_node(const std::string &name);
+  /**
+   * @brief remove and then add nodes in batch, caches are updated only once and generation is increased by one
+   */
+  LIBATAPP_MACRO_API void update_nodes(const std::vector<etcd_discovery_node::ptr_t> &removed,
+                                       const std::vector<etcd_discovery_node::ptr_t> &added);
 
  private:
   void rebuild_cache() const;
   void clear_cache() const;
+  void rebuild_maglev_cache() const;
+  void rebuild_rendezvous_cache() const;
+  etcd_discovery_node::ptr_t get_node_by_hash_code(uint64_t hash_code,
+                                                   etcd_discovery_consistent_hash_policy_t::type policy) const;
+  // hash_codes are pairs of hash code and index of output, they may be reordered
+  void get_node_by_hash_code_batch(std::vector<std::pair<uint64_t, size_t> > &hash_codes,
+                                   etcd_discovery_node::ptr_t *out,
+                                   etcd_discovery_consistent_hash_policy_t::type policy) const;
+  /**
+   * @brief update all caches and indexes by changed nodes
+   * @note changed nodes must be unique, their membership of indexes must be already updated
+   */
+  void update_cache(const etcd_discovery_node::ptr_t *nodes, size_t count) const;
+  // Update points of changed nodes in built hash ring instead of rebuilding all of them
+  void update_hashing_cache(const etcd_discovery_node::ptr_t *nodes, size_t count) const;
+  // Walk clockwise from the slot of hash_key, load_fn is NULL to use assigned loads of nodes
+  uint32_t get_node_index_by_consistent_hash_bounded(uint64_t hash_key, uint64_t max_load,
+                                                     const node_load_fn_t *load_fn) const;
+  void decay_assigned_loads(uint64_t decay_epoch) const;
+  void publish_snapshot() const;
+
+  bool contains_node(const etcd_discovery_node::ptr_t &node) const;
+  // Only update indexes of id and name, changed nodes are appended into changed_nodes if they are changed
+  bool add_node_index(const etcd_discovery_node::ptr_t &node, std::vector<etcd_discovery_node::ptr_t> &changed_nodes);
+  bool remove_node_index(const etcd_discovery_node::ptr_t &node);
+  // Increase generation and append changed nodes into change log, it must be called after indexes are updated
+  void record_changes(const etcd_discovery_node::ptr_t *nodes, size_t count);
+
+  void rebuild_locality_sets() const;
+  void update_locality_sets(const etcd_discovery_node::ptr_t *nodes, size_t count) const;
+  const etcd_discovery_set &select_locality_set(const atapp::protocol::atapp_area &area, uint32_t spill_over_percent,
+                                                uint64_t spill_over_seed) const;
+
+  void rebuild_selector_index() const;
+  void update_selector_index(const etcd_discovery_node::ptr_t *nodes, size_t count) const;
+  void shrink_selector_cache(size_t capacity) const;
 
  private:
   node_by_name_t node_by_name_;
   node_by_id_t node_by_id_;
 
-  mutable std::vector<node_hash_t> hashing_cache_;
+  // Consistent hash ring in structure of arrays, hashing_keys_ and hashing_node_index_ are stored in Eytzinger
+  // (BFS) order for branch-free search. Slot 0 of hashing_keys_ is unused and slot 0 of hashing_node_index_ is
+  // the node of the smallest key, which is used when search wraps around the ring.
+  mutable std::vector<uint64_t> hashing_keys_;
+  mutable std::vector<uint32_t> hashing_node_index_;
+  mutable std::vector<etcd_discovery_node::ptr_t> hashing_nodes_;
+  mutable std::vector<uint32_t> hashing_free_nodes_;
+  // Recently assigned messages of each node slot and their sum, used by assign_node_by_consistent_hash_bounded()
+  mutable std::vector<uint64_t> hashing_node_loads_;
+  mutable uint64_t hashing_total_load_;
+  mutable uint64_t hashing_load_epoch_;
+  // Maglev lookup table, which contains indexes of round_robin_cache_
+  mutable std::vector<uint32_t> maglev_table_;
+  // Hash seeds of round_robin_cache_ for rendezvous hashing, they are packed to be scored by SIMD
+  mutable std::vector<uint64_t> rendezvous_seeds_;
   mutable std::vector<etcd_discovery_node::ptr_t> round_robin_cache_;
   mutable util::random::xoshiro256_starstar random_generator_;
   mutable size_t round_robin_index_;
+
+  // Sub sets of zone, district and region, they are only built after locality-aware selection is used
+  mutable bool locality_sets_enabled_;
+  mutable locality_set_map_t locality_sets_;
+
+  // Inverted index and cached results of select_nodes(), they are only built after select_nodes() is used
+  struct selector_cache_t {
+    std::vector<std::string> terms;
+    ptr_t nodes;
+    uint64_t last_used;
+  };
+  mutable bool selector_index_enabled_;
+  mutable posting_list_map_t selector_posting_lists_;
+  mutable flat_hash_map<std::string, selector_cache_t> selector_cache_;
+  mutable uint64_t selector_cache_clock_;
+  size_t selector_cache_capacity_;
+
+  // Snapshot is read by other threads, only the pointer is protected by lock
+  bool snapshot_enabled_;
+  mutable bool snapshot_dirty_;
+  mutable util::lock::spin_lock snapshot_lock_;
+  mutable std::shared_ptr<const etcd_discovery_snapshot> snapshot_;
+
+  struct change_record_t {
+    uint64_t generation;
+    bool added;
+    etcd_discovery_node::ptr_t node;
+  };
+  uint64_t generation_;
+  std::deque<change_record_t> change_log_;
+  size_t change_log_capacity_;
+  // Changes until this generation may be dropped from change log
+  uint64_t change_log_dropped_generation_;
+
+  friend class etcd_discovery_snapshot;
+};
+
+/**
+ * @brief immutable copy of etcd_discovery_set, all lookups of it are thread-safe
+ * @note random and round robin selection use state of caller, so every thread should keep its own selector_state_t
+ * @note nodes returned are shared with the thread which owns the source set, only these accessors of them are safe
+ *       on other threads: get_discovery_info(), get_name_hash(), get_ingress_size() and get_private_data_*() when
+ *       private data is set before the node is added. Discovery info is never changed after added, changed nodes are
+ *       replaced by new ones. next_ingress_gateway() and all setters are not thread-safe.
+ * @note the last reference of a removed node may be held by snapshot or other threads, so on_destroy callback of
+ *       nodes may be called on any thread which releases a snapshot or a node.
+ */
+class etcd_discovery_snapshot {
+ public:
+  using ptr_t = std::shared_ptr<const etcd_discovery_snapshot>;
+
+  struct selector_state_t {
+    size_t round_robin_index;
+    util::random::xoshiro256_starstar random_generator;
+
+    LIBATAPP_MACRO_API selector_state_t();
+  };
+
+  UTIL_DESIGN_PATTERN_NOCOPYABLE(etcd_discovery_snapshot)
+  UTIL_DESIGN_PATTERN_NOMOVABLE(etcd_discovery_snapshot)
+
+ public:
+  LIBATAPP_MACRO_API explicit etcd_discovery_snapshot(const etcd_discovery_set &source);
+  LIBATAPP_MACRO_API ~etcd_discovery_snapshot();
+
+  UTIL_FORCEINLINE bool empty() const { return sorted_nodes_.empty(); }
+  // Generation of etcd_discovery_set when this snapshot is published
+  UTIL_FORCEINLINE uint64_t get_generation() const { return generation_; }
+
+  LIBATAPP_MACRO_API etcd_discovery_node::ptr_t get_node_by_id(uint64_t id) const;
+  LIBATAPP_MACRO_API etcd_discovery_node::ptr_t get_node_by_name(const std::string &name) const;
+
+  // The same result as EN_CHP_RING of etcd_discovery_set
+  LIBATAPP_MACRO_API etcd_discovery_node::ptr_t get_node_by_consistent_hash(const void *buf, size_t bufsz) const;
+  LIBATAPP_MACRO_API etcd_discovery_node::ptr_t get_node_by_consistent_hash(uint64_t key) const;
+  LIBATAPP_MACRO_API etcd_discovery_node::ptr_t get_node_by_consistent_hash(int64_t key) const;
+  LIBATAPP_MACRO_API etcd_discovery_node::ptr_t get_node_by_consistent_hash(const std::string &key) const;
+
+  LIBATAPP_MACRO_API etcd_discovery_node::ptr_t get_node_by_random(selector_state_t &state) const;
+  LIBATAPP_MACRO_API etcd_discovery_node::ptr_t get_node_by_round_robin(selector_state_t &state) const;
+
+  UTIL_FORCEINLINE const std::vector<etcd_discovery_node::ptr_t> &get_sorted_nodes() const { return sorted_nodes_; }
+
+ private:
+  etcd_discovery_set::node_by_name_t node_by_name_;
+  etcd_discovery_set::node_by_id_t node_by_id_;
+  std::vector<etcd_discovery_node::ptr_t> sorted_nodes_;
+  std::vector<uint64_t> hashing_keys_;
+  std::vector<uint32_t> hashing_node_index_;
+  std::vector<etcd_discovery_node::ptr_t> hashing_nodes_;
+  uint64_t generation_;
 };
 }  // namespace atapp
 
@@ -43,6 +43,7 @@ class etcd_watcher {
     bool created;
     bool canceled;
     int64_t compact_revision;
+    bool full_range;  // Response of range request, all keys of this watcher are in events
     std::vector<event_t> events;
   };
 
@@ -82,6 +83,13 @@ class etcd_watcher {
     return rpc_.retry_interval;
   }
 
+  /**
+   * @brief set revision to resume watching from revision + 1 without range request, such as warm start
+   * @note watcher will fall back to range request if the revision is compacted
+   */
+  UTIL_FORCEINLINE void set_last_revision(int64_t v) { rpc_.last_revision = v; }
+  UTIL_FORCEINLINE int64_t get_last_revision() const { return rpc_.last_revision; }
+
   UTIL_FORCEINLINE void set_conf_request_timeout(std::chrono::system_clock::duration v) { rpc_.request_timeout = v; }
   UTIL_FORCEINLINE void set_conf_request_timeout_sec(time_t v) { set_conf_request_timeout(std::chrono::seconds(v)); }
   UTIL_FORCEINLINE void set_conf_request_timeout_min(time_t v) { set_conf_request_timeout(std::chrono::minutes(v)); }
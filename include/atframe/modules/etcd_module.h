@@ -83,6 +83,9 @@ class etcd_module : public ::atapp::module_impl {
   using node_event_callback_t = std::function<void(node_action_t::type, const etcd_discovery_node::ptr_t &)>;
   using node_event_callback_list_t = std::list<node_event_callback_t>;
   using node_event_callback_handle_t = node_event_callback_list_t::iterator;
+  using node_events_callback_t = std::function<void(const std::vector<etcd_discovery_event_t> &)>;
+  using node_events_callback_list_t = std::list<node_events_callback_t>;
+  using node_events_callback_handle_t = node_events_callback_list_t::iterator;
   using atapp_discovery_ptr_t = std::shared_ptr<atapp::protocol::atapp_discovery>;
 
  public:
@@ -132,9 +135,15 @@ class etcd_module : public ::atapp::module_impl {
   LIBATAPP_MACRO_API std::string get_by_name_watcher_path() const;
   LIBATAPP_MACRO_API std::string get_by_tag_watcher_path(const std::string &tag_name) const;
 
+  /**
+   * @brief add callback of inner watcher by id
+   * @note callbacks are delayed until pending events are applied if etcd.watcher.batch_events is true, so discovery
+   *       got in them is always up to date
+   */
   LIBATAPP_MACRO_API int add_watcher_by_id(watcher_list_callback_t fn);
   LIBATAPP_MACRO_API int add_watcher_by_type_id(uint64_t type_id, watcher_one_callback_t fn);
   LIBATAPP_MACRO_API int add_watcher_by_type_name(const std::string &type_name, watcher_one_callback_t fn);
+  // The same as add_watcher_by_id(), callbacks are delayed if etcd.watcher.batch_events is true
   LIBATAPP_MACRO_API int add_watcher_by_name(watcher_list_callback_t fn);
   LIBATAPP_MACRO_API int add_watcher_by_tag(const std::string &tag_name, watcher_one_callback_t fn);
 
@@ -153,10 +162,32 @@ class etcd_module : public ::atapp::module_impl {
 
   LIBATAPP_MACRO_API node_event_callback_handle_t add_on_node_discovery_event(node_event_callback_t fn);
   LIBATAPP_MACRO_API void remove_on_node_event(node_event_callback_handle_t &handle);
+  /**
+   * @brief add callback of discovery events in batch
+   * @note events in one tick are collapsed and delivered together if etcd.watcher.batch_events is true, or it's
+   *       called once for each event
+   */
+  LIBATAPP_MACRO_API node_events_callback_handle_t add_on_node_discovery_events(node_events_callback_t fn);
+  LIBATAPP_MACRO_API void remove_on_node_events(node_events_callback_handle_t &handle);
 
   LIBATAPP_MACRO_API etcd_discovery_set &get_global_discovery();
   LIBATAPP_MACRO_API const etcd_discovery_set &get_global_discovery() const;
 
+  /**
+   * @brief get discovery set of nodes with the same type, it's updated together with the global discovery
+   * @note the set is kept after all nodes of this type are removed, so it can be held and reused by callers
+   * @return NULL if no node of this type has been discovered
+   */
+  LIBATAPP_MACRO_API etcd_discovery_set::ptr_t get_discovery_by_type_id(uint64_t type_id) const;
+  LIBATAPP_MACRO_API etcd_discovery_set::ptr_t get_discovery_by_type_name(const std::string &type_name) const;
+
+  /**
+   * @brief save global discovery and the revision of inner watcher into etcd.snapshot.path
+   * @note it's called automatically when discovery changed and when stopping
+   * @return 0 or error code
+   */
+  LIBATAPP_MACRO_API int save_discovery_snapshot();
+
  private:
   static bool unpack(node_info_t &out, const std::string &path, const std::string &json, bool reset_data);
   static void pack(const node_info_t &out, std::string &json);
@@ -166,11 +197,21 @@ class etcd_module : public ::atapp::module_impl {
   struct watcher_callback_list_wrapper_t {
     etcd_module *mod;
     std::list<watcher_list_callback_t> *callbacks;
+    std::string watcher_path;
 
-    watcher_callback_list_wrapper_t(etcd_module &m, std::list<watcher_list_callback_t> &cbks);
+    watcher_callback_list_wrapper_t(etcd_module &m, std::list<watcher_list_callback_t> *cbks, const std::string &path);
     void operator()(const ::atapp::etcd_response_header &header, const ::atapp::etcd_watcher::response_t &evt_data);
   };
 
+  // Copy of a watcher response, its callbacks are called after pending events are applied
+  struct pending_watcher_response_t {
+    std::list<watcher_list_callback_t> *callbacks;
+    ::atapp::etcd_response_header header;
+    ::atapp::etcd_watcher::response_t body;
+    // Index of event in body and the decoded node
+    std::vector<std::pair<size_t, node_info_t> > nodes;
+  };
+
   struct watcher_callback_one_wrapper_t {
     etcd_module *mod;
     watcher_one_callback_t callback;
@@ -180,7 +221,33 @@ class etcd_module : public ::atapp::module_impl {
   };
 
   bool update_inner_watcher_event(node_info_t &node);
+  // Update or collapse the event into pending events by etcd.watcher.batch_events
+  void handle_inner_watcher_event(node_info_t &node);
+  // Replace the pending event of the same node, they are applied together by flush_pending_events()
+  void push_pending_event(const node_info_t &node);
+  void flush_pending_events();
+  void apply_pending_events();
+  void dispatch_pending_watcher_responses();
+  void add_discovery_node(const etcd_discovery_node::ptr_t &node);
+  void remove_discovery_node(const etcd_discovery_node::ptr_t &node);
+  void update_discovery_nodes(const std::vector<etcd_discovery_node::ptr_t> &removed,
+                              const std::vector<etcd_discovery_node::ptr_t> &added);
   void reset_inner_watchers_and_keepalives();
+  void get_inner_watchers(std::vector<etcd_watcher::ptr_t> &out) const;
+  int add_inner_watcher_by_filter(const std::string &watch_path);
+
+  /**
+   * @brief check if a node should be kept in discovery cache by etcd.watcher.filter
+   * @param key etcd key of the node, NULL means unknown and tags of filter are not checked
+   */
+  bool match_discovery_filter(const std::string *key, const atapp::protocol::atapp_discovery &node) const;
+  // Remove the cached node if it does not match the filter any more
+  void evict_discovery_node(const node_info_t &node);
+
+  int load_discovery_snapshot();
+  void confirm_warm_start_node(const atapp::protocol::atapp_discovery &node);
+  void finish_warm_start(const std::string &watcher_path);
+  void resume_warm_start(const std::string &watcher_path);
 
  private:
   std::string conf_path_cache_;
@@ -201,8 +268,29 @@ class etcd_module : public ::atapp::module_impl {
 
   etcd_watcher::ptr_t inner_watcher_by_name_;
   etcd_watcher::ptr_t inner_watcher_by_id_;
+  // Watchers of etcd.watcher.filter, they replace inner_watcher_by_name_ and inner_watcher_by_id_
+  std::vector<etcd_watcher::ptr_t> inner_watchers_by_filter_;
+  std::vector<std::string> discovery_filter_tag_paths_;
   etcd_discovery_set global_discovery_;
+  flat_hash_map<uint64_t, etcd_discovery_set::ptr_t> discovery_by_type_id_;
+  flat_hash_map<std::string, etcd_discovery_set::ptr_t> discovery_by_type_name_;
   node_event_callback_list_t node_event_callbacks_;
+  node_events_callback_list_t node_events_callbacks_;
+
+  // Discovery events in current tick, only the final state of each node is kept
+  std::vector<node_info_t> pending_events_;
+  flat_hash_map<uint64_t, size_t> pending_event_by_id_;
+  flat_hash_map<std::string, size_t> pending_event_by_name_;
+  std::list<pending_watcher_response_t> pending_watcher_responses_;
+
+  // Nodes loaded from discovery snapshot but not confirmed by etcd yet
+  flat_hash_map<uint64_t, bool> warm_start_ids_;
+  flat_hash_map<std::string, bool> warm_start_names_;
+  flat_hash_map<std::string, bool> warm_start_watcher_paths_;
+  bool discovery_snapshot_dirty_;
+  util::time::time_utility::raw_time_t discovery_snapshot_next_save_time_;
+
+  friend struct etcd_module_test_helper;
 };
 }  // namespace atapp
 
@@ -21,6 +21,8 @@ option(PROJECT_TEST_ENABLE_BOOST_UNIT_TEST "Enable boost unit test." OFF)
 
 option(ATFRAMEWORK_USE_DYNAMIC_LIBRARY "Build and linking with dynamic libraries." OFF)
 
+option(LIBATAPP_ENABLE_COMPRESSION "Enable lz4 and zstd compression for forward messages." OFF)
+
 set(LIBATAPP_MACRO_HASH_MAGIC_NUMBER
     "0x01000193U"
     CACHE STRING "Magic number of libatapp")
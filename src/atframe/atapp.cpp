@@ -20,12 +20,14 @@
 #include <cli/shell_font.h>
 #include <log/log_sink_file_backend.h>
 
+#include <atframe/atapp_compression.h>
 #include <atframe/atapp_conf_rapidjson.h>
 #include <atframe/modules/etcd_module.h>
 
 #include <assert.h>
 #include <signal.h>
 
+#include <algorithm>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
@@ -141,6 +143,7 @@ LIBATAPP_MACRO_API app::app() : setup_result_(0), last_proc_event_count_(0), ev_
   conf_.id = 0;
   conf_.execute_path = nullptr;
   conf_.upgrade_mode = false;
+  conf_.load_score = 0;
 
   tick_timer_.sec_update = util::time::time_utility::raw_time_t::min();
   tick_timer_.sec = 0;
@@ -149,6 +152,7 @@ LIBATAPP_MACRO_API app::app() : setup_result_(0), last_proc_event_count_(0), ev_
 
   stat_.last_checkpoint_min = 0;
   stat_.endpoint_wake_count = 0;
+  endpoint_inflight_message_count_ = 0;
   stat_.inner_etcd.sum_error_requests = 0;
   stat_.inner_etcd.continue_error_requests = 0;
   stat_.inner_etcd.sum_success_requests = 0;
@@ -165,7 +169,9 @@ LIBATAPP_MACRO_API app::app() : setup_result_(0), last_proc_event_count_(0), ev_
 LIBATAPP_MACRO_API app::~app() {
   endpoint_index_by_id_.clear();
   endpoint_index_by_name_.clear();
-  endpoint_waker_.clear();
+  endpoint_idle_list_.clear();
+  endpoint_pool_.clear();
+  timer_wheel_.clear();
 
   if (this == last_instance_) {
     last_instance_ = nullptr;
@@ -755,24 +761,8 @@ LIBATAPP_MACRO_API int app::tick() {
       }
     }
 
-    // step 3. proc for pending messages of endpoints
-    while (!endpoint_waker_.empty() && endpoint_waker_.begin()->first <= tick_timer_.sec_update) {
-      atapp_endpoint::ptr_t ep = endpoint_waker_.begin()->second.lock();
-      endpoint_waker_.erase(endpoint_waker_.begin());
-      ++stat_.endpoint_wake_count;
-
-      if (ep) {
-        res = ep->retry_pending_messages(tick_timer_.sec_update, conf_.origin.bus().loop_times());
-        if (res > 0) {
-          active_count += res;
-        }
-
-        // TODO Support for delay recycle?
-        if (!ep->has_connection_handle()) {
-          remove_endpoint(ep);
-        }
-      }
-    }
+    // step 3. proc timers, including pending messages of endpoints
+    active_count += static_cast<int>(timer_wheel_.tick(tick_timer_.sec_update));
 
     // only tick time less than tick interval will run loop again
     util::time::time_utility::update();
@@ -857,9 +847,11 @@ LIBATAPP_MACRO_API int app::tick() {
           stat_.inner_etcd = current;
         }
 
-        FWLOGINFO("\tendpoint wake count: {}, by_id index size: {}, by_name index size: {}, waker size: {}",
-                  stat_.endpoint_wake_count, endpoint_index_by_id_.size(), endpoint_index_by_name_.size(),
-                  endpoint_waker_.size());
+        FWLOGINFO(
+            "\tendpoint wake count: {}, by_id index size: {}, by_name index size: {}, idle size: {}, pool size: {}, "
+            "timer size: {}",
+            stat_.endpoint_wake_count, endpoint_index_by_id_.size(), endpoint_index_by_name_.size(),
+            endpoint_idle_list_.size(), endpoint_pool_.size(), timer_wheel_.size());
         stat_.endpoint_wake_count = 0;
 #endif
       } else {
@@ -1035,6 +1027,19 @@ LIBATAPP_MACRO_API util::time::time_utility::raw_time_t app::get_last_tick_time(
   return tick_timer_.sec_update;
 }
 
+LIBATAPP_MACRO_API timer_wheel::timer_ptr_t app::add_timer(std::chrono::system_clock::duration delay,
+                                                           timer_wheel::callback_fn_t fn) {
+  util::time::time_utility::raw_time_t now = tick_timer_.sec_update;
+  // Not ticked yet
+  if (now == util::time::time_utility::raw_time_t::min()) {
+    now = util::time::time_utility::sys_now();
+  }
+
+  return timer_wheel_.add_timer(now + delay, fn);
+}
+
+LIBATAPP_MACRO_API bool app::cancel_timer(const timer_wheel::timer_ptr_t &timer) { return timer_wheel_.cancel(timer); }
+
 LIBATAPP_MACRO_API util::config::ini_loader &app::get_configure_loader() { return cfg_loader_; }
 LIBATAPP_MACRO_API const util::config::ini_loader &app::get_configure_loader() const { return cfg_loader_; }
 
@@ -1072,6 +1077,19 @@ LIBATAPP_MACRO_API atapp::protocol::atapp_metadata &app::mutable_metadata() {
 
 LIBATAPP_MACRO_API const atapp::protocol::atapp_area &app::get_area() const { return conf_.origin.area(); }
 
+LIBATAPP_MACRO_API void app::set_load_score(uint32_t score) {
+  if (conf_.load_score == score) {
+    return;
+  }
+
+  conf_.load_score = score;
+  if (inner_module_etcd_) {
+    inner_module_etcd_->set_maybe_update_keepalive_value();
+  }
+}
+
+LIBATAPP_MACRO_API uint32_t app::get_load_score() const { return conf_.load_score; }
+
 LIBATAPP_MACRO_API atapp::protocol::atapp_area &app::mutable_area() {
   if (inner_module_etcd_) {
     inner_module_etcd_->set_maybe_update_keepalive_value();
@@ -1091,6 +1109,18 @@ LIBATAPP_MACRO_API util::time::time_utility::raw_time_t::duration app::get_confi
   return ret;
 }
 
+LIBATAPP_MACRO_API util::time::time_utility::raw_duration_t app::get_configure_endpoint_idle_timeout() const {
+  const google::protobuf::Duration &dur = conf_.origin.endpoint_recycle().idle_timeout();
+  if (dur.seconds() <= 0 && dur.nanos() <= 0) {
+    return util::time::time_utility::raw_duration_t::zero();
+  }
+
+  util::time::time_utility::raw_time_t::duration ret =
+      std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::seconds(dur.seconds()));
+  ret += std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(dur.nanos()));
+  return ret;
+}
+
 LIBATAPP_MACRO_API void app::pack(atapp::protocol::atapp_discovery &out) const {
   out.set_id(get_id());
   out.set_name(get_app_name());
@@ -1105,6 +1135,8 @@ LIBATAPP_MACRO_API void app::pack(atapp::protocol::atapp_discovery &out) const {
     out.mutable_area()->CopyFrom(conf_.origin.area());
   }
   out.set_version(get_app_version());
+  out.set_weight(conf_.origin.weight());
+  out.set_load_score(conf_.load_score);
   // out.set_custom_data(get_conf_custom_data());
   out.mutable_gateways()->Reserve(conf_.origin.bus().gateways().size());
   for (int i = 0; i < conf_.origin.bus().gateways().size(); ++i) {
@@ -1115,6 +1147,7 @@ LIBATAPP_MACRO_API void app::pack(atapp::protocol::atapp_discovery &out) const {
   }
 
   out.mutable_metadata()->CopyFrom(get_metadata());
+  message_compression::pack_supported_algorithms(conf_.origin.bus().compression(), out);
 
   if (bus_node_) {
     const std::vector<atbus::endpoint_subnet_conf> &subnets = bus_node_->get_conf().subnets;
@@ -1184,6 +1217,14 @@ LIBATAPP_MACRO_API etcd_discovery_node::ptr_t app::get_discovery_node_by_name(co
   return inner_module_etcd_->get_global_discovery().get_node_by_name(name);
 }
 
+LIBATAPP_MACRO_API etcd_discovery_node::ptr_t app::get_discovery_node_by_name(const hashed_string_ref &name) const {
+  if (!inner_module_etcd_) {
+    return nullptr;
+  }
+
+  return inner_module_etcd_->get_global_discovery().get_node_by_name(name);
+}
+
 LIBATAPP_MACRO_API int32_t app::listen(const std::string &address) {
   atbus::channel::channel_address_t addr;
   atbus::channel::make_address(address.c_str(), addr);
@@ -1203,19 +1244,56 @@ LIBATAPP_MACRO_API int32_t app::listen(const std::string &address) {
 
 LIBATAPP_MACRO_API int32_t app::send_message(uint64_t target_node_id, int32_t type, const void *data, size_t data_size,
                                              uint64_t *msg_sequence, const atapp::protocol::atapp_metadata *metadata) {
+  atapp_iovec_t iov;
+  iov.iov_base = data;
+  iov.iov_len = data_size;
+  return send_message_v(target_node_id, type, &iov, 1, msg_sequence, metadata);
+}
+
+LIBATAPP_MACRO_API int32_t app::send_message(const std::string &target_node_name, int32_t type, const void *data,
+                                             size_t data_size, uint64_t *msg_sequence,
+                                             const atapp::protocol::atapp_metadata *metadata) {
+  atapp_iovec_t iov;
+  iov.iov_base = data;
+  iov.iov_len = data_size;
+  return send_message_v(target_node_name, type, &iov, 1, msg_sequence, metadata);
+}
+
+LIBATAPP_MACRO_API int32_t app::send_message(const hashed_string_ref &target_node_name, int32_t type,
+                                             const void *data, size_t data_size, uint64_t *msg_sequence,
+                                             const atapp::protocol::atapp_metadata *metadata) {
+  atapp_iovec_t iov;
+  iov.iov_base = data;
+  iov.iov_len = data_size;
+  return send_message_v(target_node_name, type, &iov, 1, msg_sequence, metadata);
+}
+
+LIBATAPP_MACRO_API int32_t app::send_message(const etcd_discovery_node::ptr_t &target_node_discovery, int32_t type,
+                                             const void *data, size_t data_size, uint64_t *msg_sequence,
+                                             const atapp::protocol::atapp_metadata *metadata) {
+  atapp_iovec_t iov;
+  iov.iov_base = data;
+  iov.iov_len = data_size;
+  return send_message_v(target_node_discovery, type, &iov, 1, msg_sequence, metadata);
+}
+
+LIBATAPP_MACRO_API int32_t app::send_message_v(uint64_t target_node_id, int32_t type, const atapp_iovec_t *iov,
+                                               size_t iov_count, uint64_t *msg_sequence,
+                                               const atapp::protocol::atapp_metadata *metadata) {
   // Find from cache
   do {
     atapp_endpoint *cache = get_endpoint(target_node_id);
     if (nullptr == cache) {
       break;
     }
+    wake_endpoint(*cache);
 
     int32_t ret;
     if (nullptr != msg_sequence) {
-      ret = cache->push_forward_message(type, *msg_sequence, data, data_size, metadata);
+      ret = cache->push_forward_message_v(type, *msg_sequence, iov, iov_count, metadata);
     } else {
       uint64_t msg_seq = 0;
-      ret = cache->push_forward_message(type, msg_seq, data, data_size, metadata);
+      ret = cache->push_forward_message_v(type, msg_seq, iov, iov_count, metadata);
     }
     return ret;
   } while (false);
@@ -1231,7 +1309,7 @@ LIBATAPP_MACRO_API int32_t app::send_message(uint64_t target_node_id, int32_t ty
       break;
     }
 
-    return send_message(node, type, data, data_size, msg_sequence, metadata);
+    return send_message_v(node, type, iov, iov_count, msg_sequence, metadata);
   } while (false);
 
   // Fallback to old atbus connector
@@ -1242,24 +1320,54 @@ LIBATAPP_MACRO_API int32_t app::send_message(uint64_t target_node_id, int32_t ty
     return EN_ATAPP_ERR_NOT_INITED;
   }
 
-  return bus_node_->send_data(target_node_id, type, data, data_size, msg_sequence);
+  if (nullptr == iov || 0 == iov_count) {
+    return bus_node_->send_data(target_node_id, type, nullptr, 0, msg_sequence);
+  }
+
+  if (1 == iov_count) {
+    return bus_node_->send_data(target_node_id, type, iov[0].iov_base, iov[0].iov_len, msg_sequence);
+  }
+
+  // Take the buffer away, so it's still safe when send_data() reenter this function
+  std::vector<unsigned char> buffer;
+  buffer.swap(bus_gather_buffer_);
+  buffer.clear();
+  for (size_t i = 0; i < iov_count; ++i) {
+    const unsigned char *begin = reinterpret_cast<const unsigned char *>(iov[i].iov_base);
+    buffer.insert(buffer.end(), begin, begin + iov[i].iov_len);
+  }
+  int32_t ret = bus_node_->send_data(target_node_id, type, buffer.empty() ? nullptr : &buffer[0], buffer.size(),
+                                     msg_sequence);
+
+  if (bus_gather_buffer_.capacity() < buffer.capacity() &&
+      buffer.capacity() <= atapp_connector_impl::MAX_GATHER_BUFFER_SIZE) {
+    buffer.swap(bus_gather_buffer_);
+  }
+  return ret;
+}
+
+LIBATAPP_MACRO_API int32_t app::send_message_v(const std::string &target_node_name, int32_t type,
+                                               const atapp_iovec_t *iov, size_t iov_count, uint64_t *msg_sequence,
+                                               const atapp::protocol::atapp_metadata *metadata) {
+  return send_message_v(hashed_string_ref(target_node_name), type, iov, iov_count, msg_sequence, metadata);
 }
 
-LIBATAPP_MACRO_API int32_t app::send_message(const std::string &target_node_name, int32_t type, const void *data,
-                                             size_t data_size, uint64_t *msg_sequence,
-                                             const atapp::protocol::atapp_metadata *metadata) {
+LIBATAPP_MACRO_API int32_t app::send_message_v(const hashed_string_ref &target_node_name, int32_t type,
+                                               const atapp_iovec_t *iov, size_t iov_count, uint64_t *msg_sequence,
+                                               const atapp::protocol::atapp_metadata *metadata) {
   do {
     atapp_endpoint *cache = get_endpoint(target_node_name);
     if (nullptr == cache) {
       break;
     }
+    wake_endpoint(*cache);
 
     int32_t ret;
     if (nullptr != msg_sequence) {
-      ret = cache->push_forward_message(type, *msg_sequence, data, data_size, metadata);
+      ret = cache->push_forward_message_v(type, *msg_sequence, iov, iov_count, metadata);
     } else {
       uint64_t msg_seq = 0;
-      ret = cache->push_forward_message(type, msg_seq, data, data_size, metadata);
+      ret = cache->push_forward_message_v(type, msg_seq, iov, iov_count, metadata);
     }
     return ret;
   } while (false);
@@ -1274,12 +1382,12 @@ LIBATAPP_MACRO_API int32_t app::send_message(const std::string &target_node_name
     return EN_ATBUS_ERR_ATNODE_NOT_FOUND;
   }
 
-  return send_message(node, type, data, data_size, msg_sequence, metadata);
+  return send_message_v(node, type, iov, iov_count, msg_sequence, metadata);
 }
 
-LIBATAPP_MACRO_API int32_t app::send_message(const etcd_discovery_node::ptr_t &target_node_discovery, int32_t type,
-                                             const void *data, size_t data_size, uint64_t *msg_sequence,
-                                             const atapp::protocol::atapp_metadata *metadata) {
+LIBATAPP_MACRO_API int32_t app::send_message_v(const etcd_discovery_node::ptr_t &target_node_discovery, int32_t type,
+                                               const atapp_iovec_t *iov, size_t iov_count, uint64_t *msg_sequence,
+                                               const atapp::protocol::atapp_metadata *metadata) {
   if (!inner_module_etcd_) {
     return EN_ATBUS_ERR_PARAMS;
   }
@@ -1291,14 +1399,184 @@ LIBATAPP_MACRO_API int32_t app::send_message(const etcd_discovery_node::ptr_t &t
 
   int32_t ret;
   if (nullptr != msg_sequence) {
-    ret = cache->push_forward_message(type, *msg_sequence, data, data_size, metadata);
+    ret = cache->push_forward_message_v(type, *msg_sequence, iov, iov_count, metadata);
   } else {
     uint64_t msg_seq = 0;
-    ret = cache->push_forward_message(type, msg_seq, data, data_size, metadata);
+    ret = cache->push_forward_message_v(type, msg_seq, iov, iov_count, metadata);
   }
   return ret;
 }
 
+namespace {
+struct send_message_batch_item_less_t {
+  inline bool operator()(const app::send_message_batch_item_t *l, const app::send_message_batch_item_t *r) const {
+    return l->target_node_id < r->target_node_id;
+  }
+};
+}  // namespace
+
+LIBATAPP_MACRO_API int32_t app::send_message_batch(send_message_batch_item_t *items, size_t count) {
+  if (nullptr == items || 0 == count) {
+    return EN_ATBUS_ERR_SUCCESS;
+  }
+
+  // Group by target, so we only need to find endpoint once for each target
+  std::vector<send_message_batch_item_t *> sorted_items;
+  sorted_items.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    sorted_items.push_back(&items[i]);
+  }
+  std::stable_sort(sorted_items.begin(), sorted_items.end(), send_message_batch_item_less_t());
+
+  std::vector<atapp_forward_request_t *> requests;
+  requests.reserve(count);
+  for (size_t group_begin = 0; group_begin < count;) {
+    uint64_t target_node_id = sorted_items[group_begin]->target_node_id;
+    size_t group_end = group_begin + 1;
+    while (group_end < count && sorted_items[group_end]->target_node_id == target_node_id) {
+      ++group_end;
+    }
+
+    requests.clear();
+    for (size_t i = group_begin; i < group_end; ++i) {
+      requests.push_back(&sorted_items[i]->request);
+    }
+    group_begin = group_end;
+
+    // Find from cache or create endpoint from discovery
+    atapp_endpoint *endpoint = get_endpoint(target_node_id);
+    atapp_endpoint::ptr_t endpoint_holder;
+    if (nullptr != endpoint) {
+      wake_endpoint(*endpoint);
+    } else if (inner_module_etcd_) {
+      etcd_discovery_node::ptr_t node = inner_module_etcd_->get_global_discovery().get_node_by_id(target_node_id);
+      if (node) {
+        endpoint_holder = mutable_endpoint(node);
+        endpoint = endpoint_holder.get();
+      }
+    }
+
+    if (nullptr != endpoint) {
+      endpoint->push_forward_message_batch(&requests[0], requests.size());
+      continue;
+    }
+
+    // Fallback to old atbus connector
+    for (size_t i = 0; i < requests.size(); ++i) {
+      atapp_forward_request_t *req = requests[i];
+      if (check_flag(flag_t::DISABLE_ATBUS_FALLBACK)) {
+        req->result = EN_ATBUS_ERR_ATNODE_NOT_FOUND;
+      } else if (!bus_node_) {
+        req->result = EN_ATAPP_ERR_NOT_INITED;
+      } else {
+        req->result = bus_node_->send_data(target_node_id, req->type, req->data, req->data_size, &req->msg_sequence);
+      }
+    }
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    if (0 != items[i].request.result) {
+      return items[i].request.result;
+    }
+  }
+
+  return EN_ATBUS_ERR_SUCCESS;
+}
+
+LIBATAPP_MACRO_API int32_t app::broadcast_message(const etcd_discovery_set &discovery_set, int32_t type,
+                                                  const void *data, size_t data_size,
+                                                  const atapp::protocol::atapp_metadata *metadata) {
+  atapp_endpoint::shared_payload_ptr_t payload;
+  if (nullptr != data && data_size > 0) {
+    payload = std::make_shared<std::string>(reinterpret_cast<const char *>(data), data_size);
+  }
+
+  return broadcast_message(discovery_set, type, payload, metadata);
+}
+
+LIBATAPP_MACRO_API int32_t app::broadcast_message(const etcd_discovery_set &discovery_set, int32_t type,
+                                                  const atapp_endpoint::shared_payload_ptr_t &payload,
+                                                  const atapp::protocol::atapp_metadata *metadata) {
+  if (!inner_module_etcd_) {
+    return EN_ATBUS_ERR_PARAMS;
+  }
+
+  const std::vector<etcd_discovery_node::ptr_t> &nodes = discovery_set.get_sorted_nodes();
+  if (nodes.empty()) {
+    return EN_ATBUS_ERR_SUCCESS;
+  }
+
+  return send_shared_message_to_nodes(&nodes[0], nodes.size(), type, payload, metadata);
+}
+
+LIBATAPP_MACRO_API int32_t app::send_message_to_replicas(const etcd_discovery_set &discovery_set,
+                                                         const void *hash_buf, size_t hash_bufsz, size_t replica_count,
+                                                         int32_t type, const void *data, size_t data_size,
+                                                         const atapp::protocol::atapp_metadata *metadata) {
+  std::vector<etcd_discovery_node::ptr_t> nodes;
+  nodes.reserve(replica_count);
+  if (0 == discovery_set.get_nodes_by_consistent_hash(hash_buf, hash_bufsz, replica_count, nodes)) {
+    return EN_ATBUS_ERR_ATNODE_NOT_FOUND;
+  }
+
+  atapp_endpoint::shared_payload_ptr_t payload;
+  if (nullptr != data && data_size > 0) {
+    payload = std::make_shared<std::string>(reinterpret_cast<const char *>(data), data_size);
+  }
+
+  return send_shared_message_to_nodes(&nodes[0], nodes.size(), type, payload, metadata);
+}
+
+LIBATAPP_MACRO_API int32_t app::send_message_to_replicas(const etcd_discovery_set &discovery_set, uint64_t hash_key,
+                                                         size_t replica_count, int32_t type, const void *data,
+                                                         size_t data_size,
+                                                         const atapp::protocol::atapp_metadata *metadata) {
+  return send_message_to_replicas(discovery_set, &hash_key, sizeof(hash_key), replica_count, type, data, data_size,
+                                  metadata);
+}
+
+LIBATAPP_MACRO_API int32_t app::send_message_to_replicas(const etcd_discovery_set &discovery_set, int64_t hash_key,
+                                                         size_t replica_count, int32_t type, const void *data,
+                                                         size_t data_size,
+                                                         const atapp::protocol::atapp_metadata *metadata) {
+  return send_message_to_replicas(discovery_set, &hash_key, sizeof(hash_key), replica_count, type, data, data_size,
+                                  metadata);
+}
+
+LIBATAPP_MACRO_API int32_t app::send_message_to_replicas(const etcd_discovery_set &discovery_set,
+                                                         const std::string &hash_key, size_t replica_count,
+                                                         int32_t type, const void *data, size_t data_size,
+                                                         const atapp::protocol::atapp_metadata *metadata) {
+  return send_message_to_replicas(discovery_set, hash_key.c_str(), hash_key.size(), replica_count, type, data,
+                                  data_size, metadata);
+}
+
+int32_t app::send_shared_message_to_nodes(const etcd_discovery_node::ptr_t *nodes, size_t count, int32_t type,
+                                          const atapp_endpoint::shared_payload_ptr_t &payload,
+                                          const atapp::protocol::atapp_metadata *metadata) {
+  int32_t ret = EN_ATBUS_ERR_SUCCESS;
+  for (size_t i = 0; i < count; ++i) {
+    if (!nodes[i]) {
+      continue;
+    }
+
+    atapp_endpoint::ptr_t cache = mutable_endpoint(nodes[i]);
+    int32_t res;
+    if (!cache) {
+      res = EN_ATBUS_ERR_ATNODE_NOT_FOUND;
+    } else {
+      uint64_t msg_seq = 0;
+      res = cache->push_forward_message_shared(type, msg_seq, payload, metadata);
+    }
+
+    if (0 != res && 0 == ret) {
+      ret = res;
+    }
+  }
+
+  return ret;
+}
+
 LIBATAPP_MACRO_API int32_t app::send_message_by_consistent_hash(const void *hash_buf, size_t hash_bufsz, int32_t type,
                                                                 const void *data, size_t data_size,
                                                                 uint64_t *msg_sequence,
@@ -1345,6 +1623,56 @@ LIBATAPP_MACRO_API int32_t app::send_message_by_consistent_hash(const std::strin
                                          msg_sequence, metadata);
 }
 
+LIBATAPP_MACRO_API int32_t app::send_message_by_consistent_hash(etcd_discovery_consistent_hash_policy_t::type policy,
+                                                                const void *hash_buf, size_t hash_bufsz, int32_t type,
+                                                                const void *data, size_t data_size,
+                                                                uint64_t *msg_sequence,
+                                                                const atapp::protocol::atapp_metadata *metadata) {
+  if (!inner_module_etcd_) {
+    return EN_ATAPP_ERR_DISCOVERY_DISABLED;
+  }
+
+  return send_message_by_consistent_hash(inner_module_etcd_->get_global_discovery(), policy, hash_buf, hash_bufsz,
+                                         type, data, data_size, msg_sequence, metadata);
+}
+
+LIBATAPP_MACRO_API int32_t app::send_message_by_consistent_hash(etcd_discovery_consistent_hash_policy_t::type policy,
+                                                                uint64_t hash_key, int32_t type, const void *data,
+                                                                size_t data_size, uint64_t *msg_sequence,
+                                                                const atapp::protocol::atapp_metadata *metadata) {
+  if (!inner_module_etcd_) {
+    return EN_ATAPP_ERR_DISCOVERY_DISABLED;
+  }
+
+  return send_message_by_consistent_hash(inner_module_etcd_->get_global_discovery(), policy, hash_key, type, data,
+                                         data_size, msg_sequence, metadata);
+}
+
+LIBATAPP_MACRO_API int32_t app::send_message_by_consistent_hash(etcd_discovery_consistent_hash_policy_t::type policy,
+                                                                int64_t hash_key, int32_t type, const void *data,
+                                                                size_t data_size, uint64_t *msg_sequence,
+                                                                const atapp::protocol::atapp_metadata *metadata) {
+  if (!inner_module_etcd_) {
+    return EN_ATAPP_ERR_DISCOVERY_DISABLED;
+  }
+
+  return send_message_by_consistent_hash(inner_module_etcd_->get_global_discovery(), policy, hash_key, type, data,
+                                         data_size, msg_sequence, metadata);
+}
+
+LIBATAPP_MACRO_API int32_t app::send_message_by_consistent_hash(etcd_discovery_consistent_hash_policy_t::type policy,
+                                                                const std::string &hash_key, int32_t type,
+                                                                const void *data, size_t data_size,
+                                                                uint64_t *msg_sequence,
+                                                                const atapp::protocol::atapp_metadata *metadata) {
+  if (!inner_module_etcd_) {
+    return EN_ATAPP_ERR_DISCOVERY_DISABLED;
+  }
+
+  return send_message_by_consistent_hash(inner_module_etcd_->get_global_discovery(), policy, hash_key, type, data,
+                                         data_size, msg_sequence, metadata);
+}
+
 LIBATAPP_MACRO_API int32_t app::send_message_by_random(int32_t type, const void *data, size_t data_size,
                                                        uint64_t *msg_sequence,
                                                        const atapp::protocol::atapp_metadata *metadata) {
@@ -1367,6 +1695,83 @@ LIBATAPP_MACRO_API int32_t app::send_message_by_round_robin(int32_t type, const
                                      metadata);
 }
 
+LIBATAPP_MACRO_API int32_t app::send_message_by_p2c(int32_t type, const void *data, size_t data_size,
+                                                    uint64_t *msg_sequence,
+                                                    const atapp::protocol::atapp_metadata *metadata) {
+  if (!inner_module_etcd_) {
+    return EN_ATAPP_ERR_DISCOVERY_DISABLED;
+  }
+
+  return send_message_by_p2c(inner_module_etcd_->get_global_discovery(), type, data, data_size, msg_sequence,
+                             metadata);
+}
+
+LIBATAPP_MACRO_API int32_t app::send_message_by_locality_random(int32_t type, const void *data, size_t data_size,
+                                                                uint64_t *msg_sequence,
+                                                                const atapp::protocol::atapp_metadata *metadata) {
+  if (!inner_module_etcd_) {
+    return EN_ATAPP_ERR_DISCOVERY_DISABLED;
+  }
+
+  return send_message_by_locality_random(inner_module_etcd_->get_global_discovery(), type, data, data_size,
+                                         msg_sequence, metadata);
+}
+
+LIBATAPP_MACRO_API int32_t app::send_message_by_locality_round_robin(int32_t type, const void *data, size_t data_size,
+                                                                     uint64_t *msg_sequence,
+                                                                     const atapp::protocol::atapp_metadata *metadata) {
+  if (!inner_module_etcd_) {
+    return EN_ATAPP_ERR_DISCOVERY_DISABLED;
+  }
+
+  return send_message_by_locality_round_robin(inner_module_etcd_->get_global_discovery(), type, data, data_size,
+                                              msg_sequence, metadata);
+}
+
+LIBATAPP_MACRO_API int32_t app::send_message_by_locality_consistent_hash(
+    const void *hash_buf, size_t hash_bufsz, int32_t type, const void *data, size_t data_size, uint64_t *msg_sequence,
+    const atapp::protocol::atapp_metadata *metadata) {
+  if (!inner_module_etcd_) {
+    return EN_ATAPP_ERR_DISCOVERY_DISABLED;
+  }
+
+  return send_message_by_locality_consistent_hash(inner_module_etcd_->get_global_discovery(), hash_buf, hash_bufsz,
+                                                  type, data, data_size, msg_sequence, metadata);
+}
+
+LIBATAPP_MACRO_API int32_t app::send_message_by_locality_consistent_hash(
+    uint64_t hash_key, int32_t type, const void *data, size_t data_size, uint64_t *msg_sequence,
+    const atapp::protocol::atapp_metadata *metadata) {
+  if (!inner_module_etcd_) {
+    return EN_ATAPP_ERR_DISCOVERY_DISABLED;
+  }
+
+  return send_message_by_locality_consistent_hash(inner_module_etcd_->get_global_discovery(), hash_key, type, data,
+                                                  data_size, msg_sequence, metadata);
+}
+
+LIBATAPP_MACRO_API int32_t app::send_message_by_locality_consistent_hash(
+    int64_t hash_key, int32_t type, const void *data, size_t data_size, uint64_t *msg_sequence,
+    const atapp::protocol::atapp_metadata *metadata) {
+  if (!inner_module_etcd_) {
+    return EN_ATAPP_ERR_DISCOVERY_DISABLED;
+  }
+
+  return send_message_by_locality_consistent_hash(inner_module_etcd_->get_global_discovery(), hash_key, type, data,
+                                                  data_size, msg_sequence, metadata);
+}
+
+LIBATAPP_MACRO_API int32_t app::send_message_by_locality_consistent_hash(
+    const std::string &hash_key, int32_t type, const void *data, size_t data_size, uint64_t *msg_sequence,
+    const atapp::protocol::atapp_metadata *metadata) {
+  if (!inner_module_etcd_) {
+    return EN_ATAPP_ERR_DISCOVERY_DISABLED;
+  }
+
+  return send_message_by_locality_consistent_hash(inner_module_etcd_->get_global_discovery(), hash_key, type, data,
+                                                  data_size, msg_sequence, metadata);
+}
+
 LIBATAPP_MACRO_API int32_t app::send_message_by_consistent_hash(const etcd_discovery_set &discovery_set,
                                                                 const void *hash_buf, size_t hash_bufsz, int32_t type,
                                                                 const void *data, size_t data_size,
@@ -1417,6 +1822,104 @@ LIBATAPP_MACRO_API int32_t app::send_message_by_consistent_hash(const etcd_disco
   return send_message(node, type, data, data_size, msg_sequence, metadata);
 }
 
+LIBATAPP_MACRO_API int32_t app::send_message_by_consistent_hash(const etcd_discovery_set &discovery_set,
+                                                                etcd_discovery_consistent_hash_policy_t::type policy,
+                                                                const void *hash_buf, size_t hash_bufsz, int32_t type,
+                                                                const void *data, size_t data_size,
+                                                                uint64_t *msg_sequence,
+                                                                const atapp::protocol::atapp_metadata *metadata) {
+  etcd_discovery_node::ptr_t node;
+  if (etcd_discovery_consistent_hash_policy_t::EN_CHP_BOUNDED_LOAD == policy) {
+    node = get_node_by_bounded_load(discovery_set, hash_buf, hash_bufsz);
+  } else {
+    node = discovery_set.get_node_by_consistent_hash(hash_buf, hash_bufsz, policy);
+  }
+  if (!node) {
+    return EN_ATBUS_ERR_ATNODE_NOT_FOUND;
+  }
+
+  return send_message(node, type, data, data_size, msg_sequence, metadata);
+}
+
+LIBATAPP_MACRO_API int32_t app::send_message_by_consistent_hash(const etcd_discovery_set &discovery_set,
+                                                                etcd_discovery_consistent_hash_policy_t::type policy,
+                                                                uint64_t hash_key, int32_t type, const void *data,
+                                                                size_t data_size, uint64_t *msg_sequence,
+                                                                const atapp::protocol::atapp_metadata *metadata) {
+  etcd_discovery_node::ptr_t node;
+  if (etcd_discovery_consistent_hash_policy_t::EN_CHP_BOUNDED_LOAD == policy) {
+    node = get_node_by_bounded_load(discovery_set, &hash_key, sizeof(hash_key));
+  } else {
+    node = discovery_set.get_node_by_consistent_hash(hash_key, policy);
+  }
+  if (!node) {
+    return EN_ATBUS_ERR_ATNODE_NOT_FOUND;
+  }
+
+  return send_message(node, type, data, data_size, msg_sequence, metadata);
+}
+
+LIBATAPP_MACRO_API int32_t app::send_message_by_consistent_hash(const etcd_discovery_set &discovery_set,
+                                                                etcd_discovery_consistent_hash_policy_t::type policy,
+                                                                int64_t hash_key, int32_t type, const void *data,
+                                                                size_t data_size, uint64_t *msg_sequence,
+                                                                const atapp::protocol::atapp_metadata *metadata) {
+  etcd_discovery_node::ptr_t node;
+  if (etcd_discovery_consistent_hash_policy_t::EN_CHP_BOUNDED_LOAD == policy) {
+    node = get_node_by_bounded_load(discovery_set, &hash_key, sizeof(hash_key));
+  } else {
+    node = discovery_set.get_node_by_consistent_hash(hash_key, policy);
+  }
+  if (!node) {
+    return EN_ATBUS_ERR_ATNODE_NOT_FOUND;
+  }
+
+  return send_message(node, type, data, data_size, msg_sequence, metadata);
+}
+
+LIBATAPP_MACRO_API int32_t app::send_message_by_consistent_hash(const etcd_discovery_set &discovery_set,
+                                                                etcd_discovery_consistent_hash_policy_t::type policy,
+                                                                const std::string &hash_key, int32_t type,
+                                                                const void *data, size_t data_size,
+                                                                uint64_t *msg_sequence,
+                                                                const atapp::protocol::atapp_metadata *metadata) {
+  etcd_discovery_node::ptr_t node;
+  if (etcd_discovery_consistent_hash_policy_t::EN_CHP_BOUNDED_LOAD == policy) {
+    node = get_node_by_bounded_load(discovery_set, hash_key.c_str(), hash_key.size());
+  } else {
+    node = discovery_set.get_node_by_consistent_hash(hash_key, policy);
+  }
+  if (!node) {
+    return EN_ATBUS_ERR_ATNODE_NOT_FOUND;
+  }
+
+  return send_message(node, type, data, data_size, msg_sequence, metadata);
+}
+
+etcd_discovery_node::ptr_t app::get_node_by_bounded_load(const etcd_discovery_set &discovery_set, const void *hash_buf,
+                                                         size_t hash_bufsz) const {
+  uint64_t load_factor = conf_.origin.bus().consistent_hash_load_factor();
+  if (0 == load_factor) {
+    return discovery_set.get_node_by_consistent_hash(hash_buf, hash_bufsz);
+  }
+
+  // Load is counted by messages assigned recently instead of in-flight messages, because connectors without forward
+  // response(such as atbus) finish messages once they are sent. Loads are halved every second.
+  return discovery_set.assign_node_by_consistent_hash_bounded(hash_buf, hash_bufsz, load_factor,
+                                                              static_cast<uint64_t>(tick_timer_.sec));
+}
+
+uint64_t app::get_node_inflight_message_count(const etcd_discovery_node &node) const {
+  const atapp_endpoint *ep;
+  if (0 != node.get_discovery_info().id()) {
+    ep = get_endpoint(node.get_discovery_info().id());
+  } else {
+    ep = get_endpoint(node.get_discovery_info().name());
+  }
+
+  return nullptr == ep ? 0 : static_cast<uint64_t>(ep->get_inflight_message_count());
+}
+
 LIBATAPP_MACRO_API int32_t app::send_message_by_random(const etcd_discovery_set &discovery_set, int32_t type,
                                                        const void *data, size_t data_size, uint64_t *msg_sequence,
                                                        const atapp::protocol::atapp_metadata *metadata) {
@@ -1439,6 +1942,95 @@ LIBATAPP_MACRO_API int32_t app::send_message_by_round_robin(const etcd_discovery
   return send_message(node, type, data, data_size, msg_sequence, metadata);
 }
 
+LIBATAPP_MACRO_API int32_t app::send_message_by_p2c(const etcd_discovery_set &discovery_set, int32_t type,
+                                                    const void *data, size_t data_size, uint64_t *msg_sequence,
+                                                    const atapp::protocol::atapp_metadata *metadata) {
+  etcd_discovery_node::ptr_t node = discovery_set.get_node_by_p2c([this](const etcd_discovery_node &checked) {
+    // Local in-flight messages first, and then load score reported by peer
+    return (get_node_inflight_message_count(checked) << 32) |
+           static_cast<uint64_t>(checked.get_discovery_info().load_score());
+  });
+  if (!node) {
+    return EN_ATBUS_ERR_ATNODE_NOT_FOUND;
+  }
+
+  return send_message(node, type, data, data_size, msg_sequence, metadata);
+}
+
+LIBATAPP_MACRO_API int32_t app::send_message_by_locality_random(const etcd_discovery_set &discovery_set, int32_t type,
+                                                                const void *data, size_t data_size,
+                                                                uint64_t *msg_sequence,
+                                                                const atapp::protocol::atapp_metadata *metadata) {
+  etcd_discovery_node::ptr_t node =
+      discovery_set.get_node_by_random(get_area(), conf_.origin.bus().locality_spill_over_percent());
+  if (!node) {
+    return EN_ATBUS_ERR_ATNODE_NOT_FOUND;
+  }
+
+  return send_message(node, type, data, data_size, msg_sequence, metadata);
+}
+
+LIBATAPP_MACRO_API int32_t app::send_message_by_locality_round_robin(const etcd_discovery_set &discovery_set,
+                                                                     int32_t type, const void *data, size_t data_size,
+                                                                     uint64_t *msg_sequence,
+                                                                     const atapp::protocol::atapp_metadata *metadata) {
+  etcd_discovery_node::ptr_t node =
+      discovery_set.get_node_by_round_robin(get_area(), conf_.origin.bus().locality_spill_over_percent());
+  if (!node) {
+    return EN_ATBUS_ERR_ATNODE_NOT_FOUND;
+  }
+
+  return send_message(node, type, data, data_size, msg_sequence, metadata);
+}
+
+LIBATAPP_MACRO_API int32_t app::send_message_by_locality_consistent_hash(
+    const etcd_discovery_set &discovery_set, const void *hash_buf, size_t hash_bufsz, int32_t type, const void *data,
+    size_t data_size, uint64_t *msg_sequence, const atapp::protocol::atapp_metadata *metadata) {
+  etcd_discovery_node::ptr_t node = discovery_set.get_node_by_consistent_hash(
+      hash_buf, hash_bufsz, get_area(), conf_.origin.bus().locality_spill_over_percent());
+  if (!node) {
+    return EN_ATBUS_ERR_ATNODE_NOT_FOUND;
+  }
+
+  return send_message(node, type, data, data_size, msg_sequence, metadata);
+}
+
+LIBATAPP_MACRO_API int32_t app::send_message_by_locality_consistent_hash(
+    const etcd_discovery_set &discovery_set, uint64_t hash_key, int32_t type, const void *data,
+    size_t data_size, uint64_t *msg_sequence, const atapp::protocol::atapp_metadata *metadata) {
+  etcd_discovery_node::ptr_t node =
+      discovery_set.get_node_by_consistent_hash(hash_key, get_area(), conf_.origin.bus().locality_spill_over_percent());
+  if (!node) {
+    return EN_ATBUS_ERR_ATNODE_NOT_FOUND;
+  }
+
+  return send_message(node, type, data, data_size, msg_sequence, metadata);
+}
+
+LIBATAPP_MACRO_API int32_t app::send_message_by_locality_consistent_hash(
+    const etcd_discovery_set &discovery_set, int64_t hash_key, int32_t type, const void *data,
+    size_t data_size, uint64_t *msg_sequence, const atapp::protocol::atapp_metadata *metadata) {
+  etcd_discovery_node::ptr_t node =
+      discovery_set.get_node_by_consistent_hash(hash_key, get_area(), conf_.origin.bus().locality_spill_over_percent());
+  if (!node) {
+    return EN_ATBUS_ERR_ATNODE_NOT_FOUND;
+  }
+
+  return send_message(node, type, data, data_size, msg_sequence, metadata);
+}
+
+LIBATAPP_MACRO_API int32_t app::send_message_by_locality_consistent_hash(
+    const etcd_discovery_set &discovery_set, const std::string &hash_key, int32_t type, const void *data,
+    size_t data_size, uint64_t *msg_sequence, const atapp::protocol::atapp_metadata *metadata) {
+  etcd_discovery_node::ptr_t node =
+      discovery_set.get_node_by_consistent_hash(hash_key, get_area(), conf_.origin.bus().locality_spill_over_percent());
+  if (!node) {
+    return EN_ATBUS_ERR_ATNODE_NOT_FOUND;
+  }
+
+  return send_message(node, type, data, data_size, msg_sequence, metadata);
+}
+
 LIBATAPP_MACRO_API bool app::add_log_sink_maker(const std::string &name, log_sink_maker::log_reg_t fn) {
   if (log_reg_.end() != log_reg_.find(name)) {
     return false;
@@ -1479,14 +2071,132 @@ LIBATAPP_MACRO_API const app::callback_fn_on_all_module_inited_t &app::get_evt_o
 }
 
 LIBATAPP_MACRO_API bool app::add_endpoint_waker(util::time::time_utility::raw_time_t wakeup_time,
-                                                const atapp_endpoint::weak_ptr_t &ep_watcher) {
+                                                const atapp_endpoint::weak_ptr_t &ep_watcher,
+                                                timer_wheel::timer_ptr_t &waker_timer) {
   if (is_closing()) {
     return false;
   }
 
-  endpoint_waker_.insert(
-      std::pair<const util::time::time_utility::raw_time_t, atapp_endpoint::weak_ptr_t>(wakeup_time, ep_watcher));
-  return true;
+  if (!waker_timer) {
+    atapp_endpoint::weak_ptr_t watcher = ep_watcher;
+    waker_timer = timer_wheel::create_timer(
+        [this, watcher](const timer_wheel::timer_ptr_t &) { process_endpoint_waker(watcher); });
+  }
+
+  return timer_wheel_.arm(waker_timer, wakeup_time);
+}
+
+void app::process_endpoint_waker(const atapp_endpoint::weak_ptr_t &ep_watcher) {
+  ++stat_.endpoint_wake_count;
+
+  atapp_endpoint::ptr_t ep = ep_watcher.lock();
+  if (!ep) {
+    return;
+  }
+
+  ep->retry_pending_messages(tick_timer_.sec_update, conf_.origin.bus().loop_times());
+
+  if (ep->has_connection_handle()) {
+    unmark_endpoint_idle(*ep);
+    return;
+  }
+
+  // Keep endpoints without connection for a while, so bursty targets need not to create them again and again
+  util::time::time_utility::raw_duration_t idle_timeout = get_configure_endpoint_idle_timeout();
+  if (!ep->is_idle() && idle_timeout > util::time::time_utility::raw_duration_t::zero()) {
+    mark_endpoint_idle(*ep);
+    evict_idle_endpoints();
+  }
+
+  if (ep->is_idle() && ep->get_idle_timepoint() + idle_timeout > tick_timer_.sec_update) {
+    ep->add_waker(ep->get_idle_timepoint() + idle_timeout);
+    return;
+  }
+
+  unmark_endpoint_idle(*ep);
+  remove_endpoint(ep);
+  recycle_endpoint(ep);
+}
+
+atapp_endpoint::ptr_t app::allocate_endpoint() {
+  if (!endpoint_pool_.empty()) {
+    atapp_endpoint::ptr_t ret = endpoint_pool_.back();
+    endpoint_pool_.pop_back();
+    FWLOGDEBUG("reuse atapp endpoint {}", reinterpret_cast<const void *>(ret.get()));
+    return ret;
+  }
+
+  return atapp_endpoint::create(*this);
+}
+
+void app::recycle_endpoint(atapp_endpoint::ptr_t &ep) {
+  if (!ep) {
+    return;
+  }
+
+  unmark_endpoint_idle(*ep);
+
+  // Only endpoints which are not referenced by others can be reused
+  if (1 == ep.use_count() && !is_closing() && endpoint_pool_.size() < conf_.origin.endpoint_recycle().pool_size()) {
+    ep->reset_for_reuse();
+    endpoint_pool_.push_back(ep);
+  }
+
+  // RAII destruction of ep if it's not pooled
+  ep.reset();
+}
+
+void app::mark_endpoint_idle(atapp_endpoint &ep) {
+  if (ep.idle_) {
+    return;
+  }
+
+  ep.idle_ = true;
+  ep.idle_timepoint_ = tick_timer_.sec_update;
+  ep.idle_iter_ = endpoint_idle_list_.insert(endpoint_idle_list_.end(), ep.watcher_);
+}
+
+void app::unmark_endpoint_idle(atapp_endpoint &ep) {
+  if (!ep.idle_) {
+    return;
+  }
+
+  ep.idle_ = false;
+  endpoint_idle_list_.erase(ep.idle_iter_);
+  ep.idle_iter_ = endpoint_idle_list_.end();
+}
+
+void app::touch_idle_endpoint(atapp_endpoint &ep) {
+  if (!ep.idle_) {
+    return;
+  }
+
+  ep.idle_timepoint_ = tick_timer_.sec_update;
+  endpoint_idle_list_.splice(endpoint_idle_list_.end(), endpoint_idle_list_, ep.idle_iter_);
+}
+
+void app::evict_idle_endpoints() {
+  uint64_t max_count = conf_.origin.endpoint_recycle().max_idle_count();
+  if (0 == max_count) {
+    return;
+  }
+
+  while (endpoint_idle_list_.size() > max_count) {
+    atapp_endpoint::ptr_t ep = endpoint_idle_list_.front().lock();
+    if (!ep) {
+      endpoint_idle_list_.pop_front();
+      continue;
+    }
+
+    unmark_endpoint_idle(*ep);
+    if (ep->has_connection_handle()) {
+      continue;
+    }
+
+    FWLOGDEBUG("atapp endpoint {}({}) is evicted from idle list", ep->get_id(), ep->get_name());
+    remove_endpoint(ep);
+    recycle_endpoint(ep);
+  }
 }
 
 LIBATAPP_MACRO_API void app::remove_endpoint(uint64_t by_id) {
@@ -1509,7 +2219,7 @@ LIBATAPP_MACRO_API void app::remove_endpoint(uint64_t by_id) {
     }
   }
 
-  // RAII destruction of res
+  recycle_endpoint(res);
 }
 
 LIBATAPP_MACRO_API void app::remove_endpoint(const std::string &by_name) {
@@ -1532,7 +2242,7 @@ LIBATAPP_MACRO_API void app::remove_endpoint(const std::string &by_name) {
     }
   }
 
-  // RAII destruction of res
+  recycle_endpoint(res);
 }
 
 LIBATAPP_MACRO_API void app::remove_endpoint(const atapp_endpoint::ptr_t &enpoint) {
@@ -1540,6 +2250,8 @@ LIBATAPP_MACRO_API void app::remove_endpoint(const atapp_endpoint::ptr_t &enpoin
     return;
   }
 
+  unmark_endpoint_idle(*enpoint);
+
   {
     uint64_t id = enpoint->get_id();
     if (id != 0) {
@@ -1611,8 +2323,10 @@ LIBATAPP_MACRO_API atapp_endpoint::ptr_t app::mutable_endpoint(const etcd_discov
   } while (false);
 
   if (!ret) {
-    ret = atapp_endpoint::create(*this);
+    ret = allocate_endpoint();
     is_created = !!ret;
+  } else {
+    touch_idle_endpoint(*ret);
   }
   if (ret) {
     if (need_update_id_index) {
@@ -1624,50 +2338,84 @@ LIBATAPP_MACRO_API atapp_endpoint::ptr_t app::mutable_endpoint(const etcd_discov
     ret->update_discovery(discovery);
   }
 
-  // Wake and maybe it's should be cleanup if it's a new endpoint
-  if (is_created && ret) {
+  // Wake and maybe it's should be cleanup if it's a new endpoint, idle endpoints will try to connect again
+  if (ret && (is_created || nullptr == ret->get_ready_connection_handle())) {
     ret->add_waker(get_last_tick_time());
-    atapp_connection_handle::ptr_t handle = std::make_shared<atapp_connection_handle>();
-
-    int32_t gateway_size = discovery->get_ingress_size();
-    for (int32_t i = 0; handle && i < gateway_size; ++i) {
-      atbus::channel::channel_address_t addr;
-      const atapp::protocol::atapp_gateway &gateway = discovery->next_ingress_gateway();
-      if (!match_gateway(gateway)) {
-        FWLOGDEBUG("atapp endpoint {}({}) skip unmatched gateway {}", ret->get_id(), ret->get_name(),
-                   gateway.address());
-        continue;
-      }
-      atbus::channel::make_address(gateway.address().c_str(), addr);
-      std::transform(addr.scheme.begin(), addr.scheme.end(), addr.scheme.begin(), ::util::string::tolower<char>);
+    connect_endpoint(*ret);
+  }
 
-      connector_protocol_map_t::const_iterator iter = connector_protocols_.find(addr.scheme);
-      if (iter == connector_protocols_.end()) {
-        FWLOGDEBUG("atapp endpoint {}({}) skip unsupported address {}", ret->get_id(), ret->get_name(), addr.address);
-        continue;
-      }
+  return ret;
+}
 
-      if (!iter->second) {
-        FWLOGDEBUG("atapp endpoint {}({}) skip unsupported address {}", ret->get_id(), ret->get_name(), addr.address);
-        continue;
-      }
+void app::connect_endpoint(atapp_endpoint &ep) {
+  const etcd_discovery_node::ptr_t &discovery = ep.get_discovery();
+  if (!discovery || is_closing() || nullptr != ep.get_ready_connection_handle()) {
+    return;
+  }
 
-      int res = iter->second->on_start_connect(discovery.get(), addr, handle);
-      if (0 == res && handle.use_count() > 1) {
-        atapp_connector_bind_helper::bind(*handle, *iter->second);
-        atapp_endpoint_bind_helper::bind(*handle, *ret);
+  // Only one connect attempt is allowed until it fails or times out
+  if (tick_timer_.sec_update < ep.next_connect_timepoint_) {
+    return;
+  }
 
-        FWLOGINFO("atapp endpoint {}({}) connect address {} success and use handle {}", ret->get_id(), ret->get_name(),
-                  addr.address, reinterpret_cast<const void *>(handle.get()));
-        break;
-      } else {
-        FWLOGINFO("atapp endpoint {}({}) skip address {} with handle {}", ret->get_id(), ret->get_name(), addr.address,
-                  reinterpret_cast<const void *>(handle.get()));
-      }
+  atapp_connection_handle::ptr_t handle = std::make_shared<atapp_connection_handle>();
+  bool connected = false;
+  int32_t gateway_size = discovery->get_ingress_size();
+  for (int32_t i = 0; handle && i < gateway_size; ++i) {
+    atbus::channel::channel_address_t addr;
+    const atapp::protocol::atapp_gateway &gateway = discovery->next_ingress_gateway();
+    if (!match_gateway(gateway)) {
+      FWLOGDEBUG("atapp endpoint {}({}) skip unmatched gateway {}", ep.get_id(), ep.get_name(), gateway.address());
+      continue;
+    }
+    atbus::channel::make_address(gateway.address().c_str(), addr);
+    std::transform(addr.scheme.begin(), addr.scheme.end(), addr.scheme.begin(), ::util::string::tolower<char>);
+
+    connector_protocol_map_t::const_iterator iter = connector_protocols_.find(addr.scheme);
+    if (iter == connector_protocols_.end()) {
+      FWLOGDEBUG("atapp endpoint {}({}) skip unsupported address {}", ep.get_id(), ep.get_name(), addr.address);
+      continue;
+    }
+
+    if (!iter->second) {
+      FWLOGDEBUG("atapp endpoint {}({}) skip unsupported address {}", ep.get_id(), ep.get_name(), addr.address);
+      continue;
+    }
+
+    int res = iter->second->on_start_connect(discovery.get(), addr, handle);
+    if (0 == res && handle.use_count() > 1) {
+      atapp_connector_bind_helper::bind(*handle, *iter->second);
+      atapp_endpoint_bind_helper::bind(*handle, ep);
+      connected = true;
+
+      FWLOGINFO("atapp endpoint {}({}) connect address {} success and use handle {}", ep.get_id(), ep.get_name(),
+                addr.address, reinterpret_cast<const void *>(handle.get()));
+      break;
+    } else {
+      FWLOGINFO("atapp endpoint {}({}) skip address {} with handle {}", ep.get_id(), ep.get_name(), addr.address,
+                reinterpret_cast<const void *>(handle.get()));
     }
   }
 
-  return ret;
+  // A pending attempt times out just like the first idle timeout of atbus, or wait a retry interval if it failed
+  uint64_t wait_ms;
+  if (connected && ep.has_connection_handle()) {
+    wait_ms = chrono_to_libuv_duration(conf_.origin.bus().first_idle_timeout(), 30000);
+  } else {
+    wait_ms = chrono_to_libuv_duration(conf_.origin.bus().retry_interval(), 3000);
+  }
+  ep.next_connect_timepoint_ = tick_timer_.sec_update + std::chrono::milliseconds(wait_ms);
+}
+
+void app::wake_endpoint(atapp_endpoint &ep) {
+  if (nullptr != ep.get_ready_connection_handle()) {
+    return;
+  }
+
+  // Idle endpoints are still in indexes, so sending to them should connect again
+  unmark_endpoint_idle(ep);
+  connect_endpoint(ep);
+  ep.add_waker(get_last_tick_time());
 }
 
 LIBATAPP_MACRO_API atapp_endpoint *app::get_endpoint(uint64_t by_id) {
@@ -1706,6 +2454,24 @@ LIBATAPP_MACRO_API const atapp_endpoint *app::get_endpoint(const std::string &by
   return nullptr;
 }
 
+LIBATAPP_MACRO_API atapp_endpoint *app::get_endpoint(const hashed_string_ref &by_name) {
+  endpoint_index_by_name_t::iterator iter_name = endpoint_index_by_name_.find_as(by_name);
+  if (iter_name != endpoint_index_by_name_.end()) {
+    return iter_name->second.get();
+  }
+
+  return nullptr;
+}
+
+LIBATAPP_MACRO_API const atapp_endpoint *app::get_endpoint(const hashed_string_ref &by_name) const {
+  endpoint_index_by_name_t::const_iterator iter_name = endpoint_index_by_name_.find_as(by_name);
+  if (iter_name != endpoint_index_by_name_.end()) {
+    return iter_name->second.get();
+  }
+
+  return nullptr;
+}
+
 LIBATAPP_MACRO_API bool app::match_gateway(const atapp::protocol::atapp_gateway &checked) const {
   if (checked.address().empty()) {
     return false;
@@ -2045,21 +2811,73 @@ void app::process_signal(int signo) {
   }
 }
 
+int32_t app::decompress_forward_message(int32_t reserved_type, const message_t &msg,
+                                        std::vector<unsigned char> &buffer, message_t &out) const {
+  // Only messages sent with the reserved message type are compressed, all other types are delivered untouched
+  if (!message_compression::is_compressed_type(reserved_type, msg.type)) {
+    return EN_ATAPP_ERR_SUCCESS;
+  }
+
+  int32_t original_type = msg.type;
+  int32_t res = message_compression::decompress(
+      msg.data, msg.data_size, static_cast<size_t>(conf_.origin.bus().compression().max_decompressed_size()), buffer,
+      original_type);
+  if (0 != res) {
+    return res;
+  }
+
+  out.data = &buffer[0];
+  out.data_size = buffer.size();
+  out.type = original_type;
+  return EN_ATAPP_ERR_SUCCESS;
+}
+
 LIBATAPP_MACRO_API int app::trigger_event_on_forward_request(const message_sender_t &source, const message_t &msg) {
-  if (evt_on_forward_request_) {
-    return evt_on_forward_request_(std::ref(*this), source, msg);
+  if (!evt_on_forward_request_) {
+    return 0;
   }
 
-  return 0;
+  // Only nodes which report the reserved message type and algorithms in discovery can receive compressed messages
+  const atapp::protocol::atapp_compression &compression_conf = conf_.origin.bus().compression();
+  int32_t reserved_type = 0;
+  if (message_compression::has_supported_algorithm(compression_conf)) {
+    reserved_type = compression_conf.message_type();
+  }
+
+  message_t decompressed_msg = msg;
+  std::vector<unsigned char> decompressed;
+  int32_t res = decompress_forward_message(reserved_type, msg, decompressed, decompressed_msg);
+  if (0 != res) {
+    FWLOGERROR("app {:#x} decompress message from {:#x}(type={}, sequence={}, size={}) failed, res: {}", get_id(),
+               source.id, msg.type, msg.msg_sequence, msg.data_size, res);
+    return res;
+  }
+
+  return evt_on_forward_request_(std::ref(*this), source, decompressed_msg);
 }
 
 LIBATAPP_MACRO_API int app::trigger_event_on_forward_response(const message_sender_t &source, const message_t &msg,
                                                               int32_t error_code) {
-  if (evt_on_forward_response_) {
-    return evt_on_forward_response_(std::ref(*this), source, msg, error_code);
+  if (!evt_on_forward_response_) {
+    return 0;
   }
 
-  return 0;
+  // Failed messages returned by connector are still compressed with the message type reserved by remote node, callback
+  // should always get the original data
+  int32_t reserved_type = 0;
+  if (nullptr != source.remote && source.remote->get_discovery()) {
+    reserved_type = source.remote->get_discovery()->get_discovery_info().compression_message_type();
+  }
+
+  message_t decompressed_msg = msg;
+  std::vector<unsigned char> decompressed;
+  int32_t res = decompress_forward_message(reserved_type, msg, decompressed, decompressed_msg);
+  if (0 != res) {
+    FWLOGERROR("app {:#x} decompress response message from {:#x}(type={}, sequence={}, size={}) failed, res: {}",
+               get_id(), source.id, msg.type, msg.msg_sequence, msg.data_size, res);
+  }
+
+  return evt_on_forward_response_(std::ref(*this), source, decompressed_msg, error_code);
 }
 
 LIBATAPP_MACRO_API void app::trigger_event_on_discovery_event(etcd_discovery_action_t::type action,
@@ -2085,6 +2903,36 @@ LIBATAPP_MACRO_API void app::trigger_event_on_discovery_event(etcd_discovery_act
   }
 }
 
+LIBATAPP_MACRO_API void app::trigger_event_on_discovery_events(const std::vector<etcd_discovery_event_t> &events) {
+  if (events.empty()) {
+    return;
+  }
+
+  size_t put_count = 0;
+  for (size_t i = 0; i < events.size(); ++i) {
+    if (events[i].action == etcd_discovery_action_t::EN_NAT_PUT) {
+      ++put_count;
+    }
+
+    if (events[i].node) {
+      const atapp::protocol::atapp_discovery &discovery_info = events[i].node->get_discovery_info();
+      FWLOGDEBUG("app {}({}, type={}:{}) got a {} discovery event({}({}, type={}:{}))", get_app_name(), get_id(),
+                 get_type_id(), get_type_name(),
+                 events[i].action == etcd_discovery_action_t::EN_NAT_PUT ? "PUT" : "DELETE", discovery_info.name(),
+                 discovery_info.id(), discovery_info.type_id(), discovery_info.type_name());
+    }
+  }
+  FWLOGINFO("app {}({}, type={}:{}) got {} PUT and {} DELETE discovery events", get_app_name(), get_id(),
+            get_type_id(), get_type_name(), put_count, events.size() - put_count);
+
+  for (std::list<std::shared_ptr<atapp_connector_impl> >::const_iterator iter = connectors_.begin();
+       iter != connectors_.end(); ++iter) {
+    if (*iter) {
+      (*iter)->on_discovery_events(events);
+    }
+  }
+}
+
 int app::setup_signal() {
   // block signals
   app::last_instance_ = this;
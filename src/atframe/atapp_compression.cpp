@@ -0,0 +1,255 @@
+// Copyright 2021 atframework
+// Created by owent
+
+#include "atframe/atapp_compression.h"
+
+#include <cstring>
+
+#if defined(LIBATAPP_ENABLE_COMPRESSION_LZ4) && LIBATAPP_ENABLE_COMPRESSION_LZ4
+#  include <lz4.h>
+#endif
+
+#if defined(LIBATAPP_ENABLE_COMPRESSION_ZSTD) && LIBATAPP_ENABLE_COMPRESSION_ZSTD
+#  include <zstd.h>
+#endif
+
+namespace atapp {
+namespace detail {
+// 0x89 is used to avoid conflict with text messages
+static const unsigned char g_compression_frame_magic[4] = {0x89, 'A', 'C', 'Z'};
+
+// Frame header: magic(4), algorithm(1), reserved(3), original size(8), original message type(4), reserved(4)
+static void compression_write_frame_header(unsigned char *out, atapp::protocol::atapp_compression_algorithm_t algorithm,
+                                           uint64_t original_size, int32_t original_type) {
+  memcpy(out, g_compression_frame_magic, sizeof(g_compression_frame_magic));
+  out[4] = static_cast<unsigned char>(algorithm);
+  out[5] = 0;
+  out[6] = 0;
+  out[7] = 0;
+  for (int i = 0; i < 8; ++i) {
+    out[8 + i] = static_cast<unsigned char>((original_size >> (i * 8)) & 0xFF);
+  }
+  uint32_t type = static_cast<uint32_t>(original_type);
+  for (int i = 0; i < 4; ++i) {
+    out[16 + i] = static_cast<unsigned char>((type >> (i * 8)) & 0xFF);
+  }
+  memset(out + 20, 0, 4);
+}
+
+// Messages are recognized by the reserved message type, the frame header is only used to check the data
+static bool compression_check_frame_header(const void *data, size_t data_size) {
+  if (NULL == data || data_size <= message_compression::FRAME_HEADER_SIZE) {
+    return false;
+  }
+
+  const unsigned char *header = reinterpret_cast<const unsigned char *>(data);
+  if (0 != memcmp(header, g_compression_frame_magic, sizeof(g_compression_frame_magic))) {
+    return false;
+  }
+
+  return 0 == header[5] && 0 == header[6] && 0 == header[7] && 0 == header[20] && 0 == header[21] &&
+         0 == header[22] && 0 == header[23];
+}
+
+static uint64_t compression_read_frame_original_size(const unsigned char *in) {
+  uint64_t ret = 0;
+  for (int i = 7; i >= 0; --i) {
+    ret = (ret << 8) | static_cast<uint64_t>(in[8 + i]);
+  }
+  return ret;
+}
+
+static int32_t compression_read_frame_original_type(const unsigned char *in) {
+  uint32_t ret = 0;
+  for (int i = 3; i >= 0; --i) {
+    ret = (ret << 8) | static_cast<uint32_t>(in[16 + i]);
+  }
+  return static_cast<int32_t>(ret);
+}
+}  // namespace detail
+
+LIBATAPP_MACRO_API bool message_compression::is_algorithm_supported(
+    atapp::protocol::atapp_compression_algorithm_t algorithm) {
+  switch (algorithm) {
+#if defined(LIBATAPP_ENABLE_COMPRESSION_ZSTD) && LIBATAPP_ENABLE_COMPRESSION_ZSTD
+    case atapp::protocol::ATAPP_COMPRESSION_ZSTD:
+      return true;
+#endif
+#if defined(LIBATAPP_ENABLE_COMPRESSION_LZ4) && LIBATAPP_ENABLE_COMPRESSION_LZ4
+    case atapp::protocol::ATAPP_COMPRESSION_LZ4:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+LIBATAPP_MACRO_API atapp::protocol::atapp_compression_algorithm_t message_compression::select_algorithm(
+    const atapp::protocol::atapp_compression &conf, const atapp::protocol::atapp_discovery &remote) {
+  // Remote node can not recognize compressed messages without a reserved message type
+  if (0 == remote.compression_message_type()) {
+    return atapp::protocol::ATAPP_COMPRESSION_NONE;
+  }
+
+  for (int i = 0; i < conf.algorithms_size(); ++i) {
+    atapp::protocol::atapp_compression_algorithm_t algorithm = conf.algorithms(i);
+    if (!is_algorithm_supported(algorithm)) {
+      continue;
+    }
+
+    for (int j = 0; j < remote.compression_algorithms_size(); ++j) {
+      if (remote.compression_algorithms(j) == algorithm) {
+        return algorithm;
+      }
+    }
+  }
+
+  return atapp::protocol::ATAPP_COMPRESSION_NONE;
+}
+
+LIBATAPP_MACRO_API bool message_compression::match_message(const atapp::protocol::atapp_compression &conf,
+                                                           int32_t type, size_t data_size) {
+  if (0 == conf.algorithms_size() || data_size < conf.threshold() || data_size <= FRAME_HEADER_SIZE) {
+    return false;
+  }
+
+  if (0 == conf.message_types_size()) {
+    return true;
+  }
+
+  for (int i = 0; i < conf.message_types_size(); ++i) {
+    if (conf.message_types(i) == type) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+LIBATAPP_MACRO_API void message_compression::pack_supported_algorithms(const atapp::protocol::atapp_compression &conf,
+                                                                       atapp::protocol::atapp_discovery &out) {
+  out.clear_compression_algorithms();
+  out.set_compression_message_type(conf.message_type());
+  if (0 == conf.message_type()) {
+    return;
+  }
+
+  for (int i = 0; i < conf.algorithms_size(); ++i) {
+    if (is_algorithm_supported(conf.algorithms(i))) {
+      out.add_compression_algorithms(conf.algorithms(i));
+    }
+  }
+}
+
+LIBATAPP_MACRO_API bool message_compression::has_supported_algorithm(const atapp::protocol::atapp_compression &conf) {
+  if (0 == conf.message_type()) {
+    return false;
+  }
+
+  for (int i = 0; i < conf.algorithms_size(); ++i) {
+    if (is_algorithm_supported(conf.algorithms(i))) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+LIBATAPP_MACRO_API int32_t message_compression::compress(atapp::protocol::atapp_compression_algorithm_t algorithm,
+                                                         int32_t level, int32_t type, const void *data,
+                                                         size_t data_size, std::vector<unsigned char> &out) {
+  if (NULL == data || 0 == data_size) {
+    return EN_ATAPP_ERR_COMPRESSION_FAILED;
+  }
+
+  switch (algorithm) {
+#if defined(LIBATAPP_ENABLE_COMPRESSION_ZSTD) && LIBATAPP_ENABLE_COMPRESSION_ZSTD
+    case atapp::protocol::ATAPP_COMPRESSION_ZSTD: {
+      size_t bound = ZSTD_compressBound(data_size);
+      out.resize(FRAME_HEADER_SIZE + bound);
+      size_t res = ZSTD_compress(&out[FRAME_HEADER_SIZE], bound, data, data_size,
+                                 0 == level ? ZSTD_CLEVEL_DEFAULT : static_cast<int>(level));
+      if (ZSTD_isError(res)) {
+        return EN_ATAPP_ERR_COMPRESSION_FAILED;
+      }
+      out.resize(FRAME_HEADER_SIZE + res);
+      break;
+    }
+#endif
+#if defined(LIBATAPP_ENABLE_COMPRESSION_LZ4) && LIBATAPP_ENABLE_COMPRESSION_LZ4
+    case atapp::protocol::ATAPP_COMPRESSION_LZ4: {
+      if (data_size > static_cast<size_t>(LZ4_MAX_INPUT_SIZE)) {
+        return EN_ATAPP_ERR_COMPRESSION_FAILED;
+      }
+      int bound = LZ4_compressBound(static_cast<int>(data_size));
+      out.resize(FRAME_HEADER_SIZE + static_cast<size_t>(bound));
+      int res = LZ4_compress_fast(reinterpret_cast<const char *>(data),
+                                  reinterpret_cast<char *>(&out[FRAME_HEADER_SIZE]), static_cast<int>(data_size),
+                                  bound, level <= 0 ? 1 : static_cast<int>(level));
+      if (res <= 0) {
+        return EN_ATAPP_ERR_COMPRESSION_FAILED;
+      }
+      out.resize(FRAME_HEADER_SIZE + static_cast<size_t>(res));
+      break;
+    }
+#endif
+    default:
+      (void)level;
+      return EN_ATAPP_ERR_COMPRESSION_NOT_SUPPORT;
+  }
+
+  detail::compression_write_frame_header(&out[0], algorithm, static_cast<uint64_t>(data_size), type);
+  return EN_ATAPP_ERR_SUCCESS;
+}
+
+LIBATAPP_MACRO_API int32_t message_compression::decompress(const void *data, size_t data_size,
+                                                           size_t max_decompressed_size,
+                                                           std::vector<unsigned char> &out, int32_t &type) {
+  if (!detail::compression_check_frame_header(data, data_size)) {
+    return EN_ATAPP_ERR_COMPRESSION_FAILED;
+  }
+
+  const unsigned char *header = reinterpret_cast<const unsigned char *>(data);
+  uint64_t original_size = detail::compression_read_frame_original_size(header);
+  if (0 == original_size || (max_decompressed_size > 0 && original_size > max_decompressed_size)) {
+    return EN_ATAPP_ERR_COMPRESSION_FAILED;
+  }
+
+  const unsigned char *body = header + FRAME_HEADER_SIZE;
+  size_t body_size = data_size - FRAME_HEADER_SIZE;
+  switch (static_cast<atapp::protocol::atapp_compression_algorithm_t>(header[4])) {
+#if defined(LIBATAPP_ENABLE_COMPRESSION_ZSTD) && LIBATAPP_ENABLE_COMPRESSION_ZSTD
+    case atapp::protocol::ATAPP_COMPRESSION_ZSTD: {
+      out.resize(static_cast<size_t>(original_size));
+      size_t res = ZSTD_decompress(&out[0], out.size(), body, body_size);
+      if (ZSTD_isError(res) || res != out.size()) {
+        return EN_ATAPP_ERR_COMPRESSION_FAILED;
+      }
+      break;
+    }
+#endif
+#if defined(LIBATAPP_ENABLE_COMPRESSION_LZ4) && LIBATAPP_ENABLE_COMPRESSION_LZ4
+    case atapp::protocol::ATAPP_COMPRESSION_LZ4: {
+      if (original_size > static_cast<uint64_t>(LZ4_MAX_INPUT_SIZE) ||
+          body_size > static_cast<size_t>(LZ4_MAX_INPUT_SIZE)) {
+        return EN_ATAPP_ERR_COMPRESSION_FAILED;
+      }
+      out.resize(static_cast<size_t>(original_size));
+      int res = LZ4_decompress_safe(reinterpret_cast<const char *>(body), reinterpret_cast<char *>(&out[0]),
+                                    static_cast<int>(body_size), static_cast<int>(out.size()));
+      if (res < 0 || static_cast<size_t>(res) != out.size()) {
+        return EN_ATAPP_ERR_COMPRESSION_FAILED;
+      }
+      break;
+    }
+#endif
+    default:
+      (void)body;
+      (void)body_size;
+      return EN_ATAPP_ERR_COMPRESSION_NOT_SUPPORT;
+  }
+
+  type = detail::compression_read_frame_original_type(header);
+  return EN_ATAPP_ERR_SUCCESS;
+}
+}  // namespace atapp
@@ -0,0 +1,251 @@
+// Copyright 2021 atframework
+// Created by owent
+
+#include "atframe/atapp_timer_wheel.h"
+
+#include <cstring>
+
+namespace atapp {
+
+LIBATAPP_MACRO_API timer_wheel::timer_node_t::timer_node_t()
+    : prev_(NULL), next_(NULL), slot_(NULL), owner_(NULL), expire_tick_(0) {}
+
+LIBATAPP_MACRO_API timer_wheel::timer_node_t::~timer_node_t() {}
+
+LIBATAPP_MACRO_API timer_wheel::timer_wheel() : inited_(false), current_tick_(0), size_(0) {
+  memset(slots_, 0, sizeof(slots_));
+}
+
+LIBATAPP_MACRO_API timer_wheel::~timer_wheel() { clear(); }
+
+LIBATAPP_MACRO_API timer_wheel::timer_ptr_t timer_wheel::create_timer(callback_fn_t fn) {
+  timer_ptr_t ret = std::make_shared<timer_node_t>();
+  if (ret) {
+    ret->callback_ = fn;
+  }
+
+  return ret;
+}
+
+LIBATAPP_MACRO_API bool timer_wheel::arm(const timer_ptr_t &timer, time_point expire_time) {
+  if (!timer) {
+    return false;
+  }
+
+  if (NULL != timer->owner_) {
+    timer->owner_->unlink(*timer);
+  }
+
+  if (!inited_) {
+    inited_ = true;
+    base_time_ = expire_time;
+    current_tick_ = 0;
+  }
+
+  timer->expire_time_ = expire_time;
+  timer->expire_tick_ = to_tick(expire_time, true);
+  timer->self_holder_ = timer;
+  link(*timer);
+  return true;
+}
+
+LIBATAPP_MACRO_API timer_wheel::timer_ptr_t timer_wheel::add_timer(time_point expire_time, callback_fn_t fn) {
+  timer_ptr_t ret = create_timer(fn);
+  if (!arm(ret, expire_time)) {
+    return timer_ptr_t();
+  }
+
+  return ret;
+}
+
+LIBATAPP_MACRO_API bool timer_wheel::cancel(const timer_ptr_t &timer) {
+  if (!timer || this != timer->owner_) {
+    return false;
+  }
+
+  // self_holder_ may be the last reference, keep the node alive until unlinked
+  timer_ptr_t holder = timer;
+  unlink(*timer);
+  return true;
+}
+
+LIBATAPP_MACRO_API void timer_wheel::clear() {
+  for (int level = 0; level < LEVEL_COUNT; ++level) {
+    for (int index = 0; index < LEVEL_SIZE; ++index) {
+      while (NULL != slots_[level][index]) {
+        timer_ptr_t holder = slots_[level][index]->self_holder_;
+        unlink(*slots_[level][index]);
+      }
+    }
+  }
+}
+
+LIBATAPP_MACRO_API size_t timer_wheel::tick(time_point now) {
+  if (!inited_) {
+    inited_ = true;
+    base_time_ = now;
+    current_tick_ = 0;
+    return 0;
+  }
+
+  uint64_t target_tick = to_tick(now, false);
+  if (0 == size_ && target_tick > current_tick_) {
+    current_tick_ = target_tick;
+    return 0;
+  }
+
+  size_t ret = 0;
+  while (current_tick_ < target_tick) {
+    // Nothing happens on empty slots, so jump to the next non-empty slot or cascade boundary after a long stall
+    uint64_t next_tick = get_next_tick();
+    if (next_tick > target_tick) {
+      current_tick_ = target_tick;
+      break;
+    }
+    current_tick_ = next_tick;
+
+    // Cascade timers from higher levels when lower level wraps
+    for (int level = 1; level < LEVEL_COUNT; ++level) {
+      if (0 != ((current_tick_ >> ((level - 1) * LEVEL_BITS)) & LEVEL_MASK)) {
+        break;
+      }
+      cascade(level);
+    }
+
+    timer_node_t **slot = &slots_[0][current_tick_ & LEVEL_MASK];
+    while (NULL != *slot) {
+      timer_ptr_t timer = (*slot)->self_holder_;
+      unlink(*timer);
+
+      // Timers too far away are clamped to the last slot, just move them again
+      if (timer->expire_time_ > now) {
+        timer->expire_tick_ = to_tick(timer->expire_time_, true);
+        timer->self_holder_ = timer;
+        link(*timer);
+        continue;
+      }
+
+      ++ret;
+      if (timer->callback_) {
+        // callback may arm this timer again
+        timer->callback_(timer);
+      }
+    }
+
+    if (0 == size_ && target_tick > current_tick_) {
+      current_tick_ = target_tick;
+    }
+  }
+
+  return ret;
+}
+
+uint64_t timer_wheel::get_next_tick() const {
+  // Level 0 slots before the next boundary only contain timers of this round
+  uint64_t boundary = ((current_tick_ >> LEVEL_BITS) + 1) << LEVEL_BITS;
+  for (uint64_t tick = current_tick_ + 1; tick < boundary; ++tick) {
+    if (NULL != slots_[0][tick & LEVEL_MASK]) {
+      return tick;
+    }
+  }
+
+  return boundary;
+}
+
+uint64_t timer_wheel::to_tick(time_point t, bool round_up) const {
+  if (t <= base_time_) {
+    return 0;
+  }
+
+  duration offset = t - base_time_;
+  uint64_t ret = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(offset).count());
+  // Expire tick should never be earlier than expire time
+  if (round_up && std::chrono::duration_cast<duration>(std::chrono::milliseconds(ret)) < offset) {
+    ++ret;
+  }
+  return ret;
+}
+
+void timer_wheel::link(timer_node_t &node) {
+  // Expired timers will be triggered at next tick
+  if (node.expire_tick_ <= current_tick_) {
+    node.expire_tick_ = current_tick_ + 1;
+  }
+
+  uint64_t delta = node.expire_tick_ - current_tick_;
+  const uint64_t max_delta = (static_cast<uint64_t>(1) << (LEVEL_BITS * LEVEL_COUNT)) - 1;
+  if (delta > max_delta) {
+    delta = max_delta;
+    node.expire_tick_ = current_tick_ + max_delta;
+  }
+
+  int level = 0;
+  while (level + 1 < LEVEL_COUNT && delta >= (static_cast<uint64_t>(1) << (LEVEL_BITS * (level + 1)))) {
+    ++level;
+  }
+
+  link_to_slot(node, &slots_[level][(node.expire_tick_ >> (level * LEVEL_BITS)) & LEVEL_MASK]);
+}
+
+void timer_wheel::link_to_slot(timer_node_t &node, timer_node_t **slot) {
+  node.prev_ = NULL;
+  node.next_ = *slot;
+  if (NULL != *slot) {
+    (*slot)->prev_ = &node;
+  }
+  *slot = &node;
+  node.slot_ = slot;
+  node.owner_ = this;
+  ++size_;
+}
+
+void timer_wheel::unlink(timer_node_t &node) {
+  if (this != node.owner_) {
+    return;
+  }
+
+  if (NULL != node.prev_) {
+    node.prev_->next_ = node.next_;
+  } else if (NULL != node.slot_) {
+    *node.slot_ = node.next_;
+  }
+  if (NULL != node.next_) {
+    node.next_->prev_ = node.prev_;
+  }
+
+  node.prev_ = NULL;
+  node.next_ = NULL;
+  node.slot_ = NULL;
+  node.owner_ = NULL;
+  if (size_ > 0) {
+    --size_;
+  }
+
+  // Must be the last step, it may destroy this node
+  node.self_holder_.reset();
+}
+
+void timer_wheel::cascade(int level) {
+  timer_node_t **slot = &slots_[level][(current_tick_ >> (level * LEVEL_BITS)) & LEVEL_MASK];
+  timer_node_t *head = *slot;
+  *slot = NULL;
+
+  while (NULL != head) {
+    timer_node_t *node = head;
+    head = head->next_;
+
+    node->prev_ = NULL;
+    node->next_ = NULL;
+    node->slot_ = NULL;
+    --size_;
+
+    // Timers expired at this tick will be triggered by the following level 0 slot
+    if (node->expire_tick_ <= current_tick_) {
+      node->expire_tick_ = current_tick_;
+      link_to_slot(*node, &slots_[0][current_tick_ & LEVEL_MASK]);
+    } else {
+      link(*node);
+    }
+  }
+}
+}  // namespace atapp
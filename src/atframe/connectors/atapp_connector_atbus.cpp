@@ -150,12 +150,43 @@ LIBATAPP_MACRO_API int32_t atapp_connector_atbus::on_send_forward_request(atapp_
   return node->send_data(handle->get_private_data_u64(), type, data, data_size, sequence);
 }
 
+LIBATAPP_MACRO_API void atapp_connector_atbus::on_send_forward_request_batch(atapp_connection_handle *handle,
+                                                                           atapp_forward_request_t *const *requests,
+                                                                           size_t count) {
+  int32_t error_code = EN_ATBUS_ERR_SUCCESS;
+  std::shared_ptr<atbus::node> node;
+  if (NULL == get_owner() || NULL == handle) {
+    error_code = EN_ATAPP_ERR_NOT_INITED;
+  } else {
+    node = get_owner()->get_bus_node();
+    if (!node) {
+      error_code = EN_ATAPP_ERR_SETUP_ATBUS;
+    }
+  }
+
+  for (size_t i = 0; NULL != requests && i < count; ++i) {
+    atapp_forward_request_t *req = requests[i];
+    if (NULL == req) {
+      continue;
+    }
+
+    if (0 != error_code) {
+      req->result = error_code;
+      continue;
+    }
+
+    req->result =
+        node->send_data(handle->get_private_data_u64(), req->type, req->data, req->data_size, &req->msg_sequence);
+  }
+}
+
 LIBATAPP_MACRO_API void atapp_connector_atbus::on_receive_forward_response(
     uint64_t app_id, int32_t type, uint64_t msg_sequence, int32_t error_code, const void *data, size_t data_size,
     const atapp::protocol::atapp_metadata *metadata) {
   LIBATFRAME_UTILS_AUTO_SELETC_MAP(uint64_t, atapp_connection_handle::ptr_t)::iterator iter = handles_.find(app_id);
 
   if (iter != handles_.end()) {
+    // Messages sent by atbus do not require response, they are already finished when sent, see has_forward_response()
     atapp_connector_impl::on_receive_forward_response(iter->second.get(), type, msg_sequence, error_code, data,
                                                       data_size, metadata);
     return;
@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cstring>
 
 #include <common/string_oprs.h>
 
@@ -45,6 +46,8 @@ LIBATAPP_MACRO_API_SYMBOL_HIDDEN void atapp_endpoint_bind_helper::unbind(atapp_c
                                                                          atapp_endpoint &endpoint) {
   if (endpoint.refer_connections_.erase(&handle) > 0) {
     if (endpoint.refer_connections_.empty()) {
+      // The connect attempt failed or the connection is lost, it can be connected again
+      endpoint.next_connect_timepoint_ = std::chrono::system_clock::from_time_t(0);
       if (NULL != endpoint.owner_) {
         endpoint.add_waker(endpoint.owner_->get_last_tick_time());
       }
@@ -209,6 +212,60 @@ LIBATAPP_MACRO_API int32_t atapp_connector_impl::on_send_forward_request(atapp_c
   return EN_ATBUS_ERR_CHANNEL_NOT_SUPPORT;
 }
 
+LIBATAPP_MACRO_API int32_t atapp_connector_impl::on_send_forward_request_v(
+    atapp_connection_handle *handle, int32_t type, uint64_t *sequence, const atapp_iovec_t *iov, size_t iov_count,
+    const atapp::protocol::atapp_metadata *metadata) {
+  if (NULL == iov || 0 == iov_count) {
+    return on_send_forward_request(handle, type, sequence, NULL, 0, metadata);
+  }
+
+  if (1 == iov_count) {
+    return on_send_forward_request(handle, type, sequence, iov[0].iov_base, iov[0].iov_len, metadata);
+  }
+
+  size_t data_size = 0;
+  for (size_t i = 0; i < iov_count; ++i) {
+    data_size += iov[i].iov_len;
+  }
+
+  // Take the buffer away, so it's still safe when on_send_forward_request send another message
+  std::vector<unsigned char> buffer;
+  buffer.swap(gather_buffer_);
+  buffer.resize(data_size);
+
+  size_t offset = 0;
+  for (size_t i = 0; i < iov_count; ++i) {
+    if (iov[i].iov_len > 0) {
+      memcpy(&buffer[offset], iov[i].iov_base, iov[i].iov_len);
+      offset += iov[i].iov_len;
+    }
+  }
+
+  int32_t ret = on_send_forward_request(handle, type, sequence, data_size > 0 ? &buffer[0] : NULL, data_size, metadata);
+
+  // Do not keep a buffer for rare large messages
+  if (gather_buffer_.capacity() < buffer.capacity() && buffer.capacity() <= MAX_GATHER_BUFFER_SIZE) {
+    buffer.swap(gather_buffer_);
+  }
+  return ret;
+}
+
+LIBATAPP_MACRO_API void atapp_connector_impl::on_send_forward_request_batch(atapp_connection_handle *handle,
+                                                                          atapp_forward_request_t *const *requests,
+                                                                          size_t count) {
+  for (size_t i = 0; NULL != requests && i < count; ++i) {
+    atapp_forward_request_t *req = requests[i];
+    if (NULL == req) {
+      continue;
+    }
+
+    req->result =
+        on_send_forward_request(handle, req->type, &req->msg_sequence, req->data, req->data_size, req->metadata);
+  }
+}
+
+LIBATAPP_MACRO_API bool atapp_connector_impl::has_forward_response() const UTIL_CONFIG_NOEXCEPT { return false; }
+
 LIBATAPP_MACRO_API void atapp_connector_impl::on_receive_forward_response(
     atapp_connection_handle *handle, int32_t type, uint64_t sequence, int32_t error_code, const void *data,
     size_t data_size, const atapp::protocol::atapp_metadata *metadata) {
@@ -239,6 +296,12 @@ LIBATAPP_MACRO_API void atapp_connector_impl::on_receive_forward_response(
 LIBATAPP_MACRO_API void atapp_connector_impl::on_discovery_event(etcd_discovery_action_t::type,
                                                                  const etcd_discovery_node::ptr_t &) {}
 
+LIBATAPP_MACRO_API void atapp_connector_impl::on_discovery_events(const std::vector<etcd_discovery_event_t> &events) {
+  for (size_t i = 0; i < events.size(); ++i) {
+    on_discovery_event(events[i].action, events[i].node);
+  }
+}
+
 LIBATAPP_MACRO_API const atapp_connector_impl::protocol_set_t &atapp_connector_impl::get_support_protocols() const
     UTIL_CONFIG_NOEXCEPT {
   return support_protocols_;
@@ -1,8 +1,10 @@
 #include <limits>
+#include <vector>
 
 #include <detail/libatbus_error.h>
 
 #include <atframe/atapp.h>
+#include <atframe/atapp_compression.h>
 
 #include <atframe/connectors/atapp_connector_impl.h>
 #include <atframe/connectors/atapp_endpoint.h>
@@ -12,16 +14,45 @@
 #endif
 
 namespace atapp {
+namespace {
+// Make a continuous copy of segments only when required, it's only used when reporting failures
+class pending_message_gather_t {
+ public:
+  pending_message_gather_t(const atapp_iovec_t *iov, size_t iov_count, size_t data_size) : data_(NULL) {
+    if (NULL == iov || 0 == iov_count) {
+      return;
+    }
+
+    if (1 == iov_count) {
+      data_ = iov[0].iov_base;
+      return;
+    }
+
+    buffer_.reserve(data_size);
+    for (size_t i = 0; i < iov_count; ++i) {
+      if (iov[i].iov_len > 0) {
+        const unsigned char *begin = reinterpret_cast<const unsigned char *>(iov[i].iov_base);
+        buffer_.insert(buffer_.end(), begin, begin + iov[i].iov_len);
+      }
+    }
+    data_ = buffer_.empty() ? NULL : &buffer_[0];
+  }
+
+  inline const void *data() const { return data_; }
+
+ private:
+  const void *data_;
+  std::vector<unsigned char> buffer_;
+};
+}  // namespace
+
 LIBATAPP_MACRO_API atapp_endpoint::atapp_endpoint(app &owner, construct_helper_t &)
     : closing_(false),
       owner_(&owner),
-      pending_message_size_(0)
-#if defined(LIBATAPP_ENABLE_CUSTOM_COUNT_FOR_STD_LIST) && LIBATAPP_ENABLE_CUSTOM_COUNT_FOR_STD_LIST
-      ,
-      pending_message_count_(0)
-#endif
-{
-  nearest_waker_ = std::chrono::system_clock::from_time_t(0);
+      idle_(false),
+      inflight_message_count_(0) {
+  idle_timepoint_ = std::chrono::system_clock::from_time_t(0);
+  next_connect_timepoint_ = std::chrono::system_clock::from_time_t(0);
 }
 
 LIBATAPP_MACRO_API atapp_endpoint::ptr_t atapp_endpoint::create(app &owner) {
@@ -37,6 +68,12 @@ LIBATAPP_MACRO_API atapp_endpoint::ptr_t atapp_endpoint::create(app &owner) {
 
 LIBATAPP_MACRO_API atapp_endpoint::~atapp_endpoint() {
   reset();
+  pending_messages_.clear();
+  finish_inflight_messages(inflight_message_count_);
+
+  if (waker_timer_ && NULL != owner_) {
+    owner_->cancel_timer(waker_timer_);
+  }
   FWLOGINFO("destroy atapp endpoint {}", reinterpret_cast<const void *>(this));
 }
 
@@ -60,6 +97,21 @@ void atapp_endpoint::reset() {
   closing_ = false;
 }
 
+void atapp_endpoint::reset_for_reuse() {
+  // Pending messages are canceled and their memory is released by reset()
+  reset();
+  discovery_.reset();
+  finish_inflight_messages(inflight_message_count_);
+
+  if (waker_timer_ && NULL != owner_) {
+    owner_->cancel_timer(waker_timer_);
+  }
+
+  idle_ = false;
+  idle_timepoint_ = std::chrono::system_clock::from_time_t(0);
+  next_connect_timepoint_ = std::chrono::system_clock::from_time_t(0);
+}
+
 LIBATAPP_MACRO_API void atapp_endpoint::add_connection_handle(atapp_connection_handle &handle) {
   if (closing_) {
     return;
@@ -124,6 +176,43 @@ LIBATAPP_MACRO_API void atapp_endpoint::update_discovery(const etcd_discovery_no
 LIBATAPP_MACRO_API int32_t atapp_endpoint::push_forward_message(int32_t type, uint64_t &msg_sequence, const void *data,
                                                                 size_t data_size,
                                                                 const atapp::protocol::atapp_metadata *metadata) {
+  if (NULL == data || 0 == data_size) {
+    return push_forward_message_v(type, msg_sequence, NULL, 0, metadata);
+  }
+
+  atapp_iovec_t iov;
+  iov.iov_base = data;
+  iov.iov_len = data_size;
+  return push_forward_message_v(type, msg_sequence, &iov, 1, metadata);
+}
+
+LIBATAPP_MACRO_API int32_t atapp_endpoint::push_forward_message_v(int32_t type, uint64_t &msg_sequence,
+                                                                  const atapp_iovec_t *iov, size_t iov_count,
+                                                                  const atapp::protocol::atapp_metadata *metadata) {
+  return push_forward_message_inner(type, msg_sequence, iov, iov_count, NULL, metadata);
+}
+
+LIBATAPP_MACRO_API int32_t atapp_endpoint::push_forward_message_shared(
+    int32_t type, uint64_t &msg_sequence, const shared_payload_ptr_t &payload,
+    const atapp::protocol::atapp_metadata *metadata) {
+  if (!payload || payload->empty()) {
+    return push_forward_message_inner(type, msg_sequence, NULL, 0, NULL, metadata);
+  }
+
+  atapp_iovec_t iov;
+  iov.iov_base = payload->data();
+  iov.iov_len = payload->size();
+  return push_forward_message_inner(type, msg_sequence, &iov, 1, &payload, metadata);
+}
+
+int32_t atapp_endpoint::push_forward_message_inner(int32_t type, uint64_t &msg_sequence, const atapp_iovec_t *iov,
+                                                   size_t iov_count, const shared_payload_ptr_t *shared_payload,
+                                                   const atapp::protocol::atapp_metadata *metadata) {
+  size_t data_size = 0;
+  for (size_t i = 0; NULL != iov && i < iov_count; ++i) {
+    data_size += iov[i].iov_len;
+  }
+
   // Closing
   if (closing_ || NULL == owner_) {
     do {
@@ -137,19 +226,20 @@ LIBATAPP_MACRO_API int32_t atapp_endpoint::push_forward_message(int32_t type, ui
         break;
       }
 
-      connector->on_receive_forward_response(handle, type, msg_sequence, EN_ATBUS_ERR_CLOSING, data, data_size,
-                                             metadata);
+      pending_message_gather_t gathered(iov, iov_count, data_size);
+      connector->on_receive_forward_response(handle, type, msg_sequence, EN_ATBUS_ERR_CLOSING, gathered.data(),
+                                             data_size, metadata);
     } while (false);
     return EN_ATBUS_ERR_CLOSING;
   }
 
-  if (NULL == data || 0 == data_size) {
+  if (0 == data_size) {
     return EN_ATBUS_ERR_SUCCESS;
   }
 
   // Has handle
   do {
-    if (!pending_message_.empty()) {
+    if (!pending_messages_.empty()) {
       break;
     }
 
@@ -163,9 +253,12 @@ LIBATAPP_MACRO_API int32_t atapp_endpoint::push_forward_message(int32_t type, ui
       break;
     }
 
-    int32_t ret = connector->on_send_forward_request(handle, type, &msg_sequence, data, data_size, metadata);
+    int32_t ret = send_forward_request(*connector, handle, type, &msg_sequence, iov, iov_count, data_size, metadata);
     if (0 != ret) {
-      connector->on_receive_forward_response(handle, type, msg_sequence, ret, data, data_size, metadata);
+      pending_message_gather_t gathered(iov, iov_count, data_size);
+      connector->on_receive_forward_response(handle, type, msg_sequence, ret, gathered.data(), data_size, metadata);
+    } else if (connector->has_forward_response()) {
+      add_inflight_messages(1);
     }
 
     return ret;
@@ -176,19 +269,31 @@ LIBATAPP_MACRO_API int32_t atapp_endpoint::push_forward_message(int32_t type, ui
   if (NULL != owner_) {
     uint64_t send_buffer_number = owner_->get_origin_configure().bus().send_buffer_number();
     uint64_t send_buffer_size = owner_->get_origin_configure().bus().send_buffer_size();
-    if (send_buffer_number > 0 &&
-#if defined(LIBATAPP_ENABLE_CUSTOM_COUNT_FOR_STD_LIST) && LIBATAPP_ENABLE_CUSTOM_COUNT_FOR_STD_LIST
-        pending_message_count_ + 1 > send_buffer_number
-#else
-        pending_message_.size() + 1 > send_buffer_number
-#endif
-    ) {
+    if (send_buffer_number > 0 && pending_messages_.size() + 1 > send_buffer_number) {
       failed_error_code = EN_ATBUS_ERR_BUFF_LIMIT;
     }
 
-    if (send_buffer_size > 0 && pending_message_size_ + data_size > send_buffer_size) {
+    if (send_buffer_size > 0 && pending_messages_.get_data_size() + data_size > send_buffer_size) {
       failed_error_code = EN_ATBUS_ERR_BUFF_LIMIT;
     }
+
+    // No chunk is larger than the whole send buffer
+    if (send_buffer_size > 0 &&
+        send_buffer_size < static_cast<uint64_t>(atapp_pending_message_queue::DEFAULT_MAX_CHUNK_SIZE)) {
+      pending_messages_.set_max_chunk_size(static_cast<size_t>(send_buffer_size));
+    }
+  }
+
+  pending_message_t *msg = NULL;
+  if (failed_error_code == 0) {
+    if (NULL != shared_payload) {
+      msg = pending_messages_.push(*shared_payload, metadata);
+    } else {
+      msg = pending_messages_.push(data_size, iov, iov_count, metadata);
+    }
+    if (NULL == msg) {
+      failed_error_code = EN_ATBUS_ERR_MALLOC;
+    }
   }
 
   if (failed_error_code != 0) {
@@ -202,44 +307,147 @@ LIBATAPP_MACRO_API int32_t atapp_endpoint::push_forward_message(int32_t type, ui
       return failed_error_code;
     }
 
-    connector->on_receive_forward_response(handle, type, msg_sequence, failed_error_code, data, data_size, metadata);
+    pending_message_gather_t gathered(iov, iov_count, data_size);
+    connector->on_receive_forward_response(handle, type, msg_sequence, failed_error_code, gathered.data(), data_size,
+                                           metadata);
     return failed_error_code;
   }
 
   // Success to add to pending
-  pending_message_.push_back(pending_message_t());
-  pending_message_t &msg = pending_message_.back();
-  msg.type = type;
-  msg.msg_sequence = msg_sequence;
-  msg.data.resize(data_size);
-  msg.expired_timepoint = owner_->get_last_tick_time();
-  msg.expired_timepoint += owner_->get_configure_message_timeout();
-  memcpy(&msg.data[0], data, data_size);
-  if (NULL != metadata) {
-    msg.metadata.reset(new atapp::protocol::atapp_metadata());
-    if (msg.metadata) {
-      msg.metadata->CopyFrom(*metadata);
-    }
+  msg->type = type;
+  msg->msg_sequence = msg_sequence;
+  msg->expired_timepoint = owner_->get_last_tick_time();
+  msg->expired_timepoint += owner_->get_configure_message_timeout();
+
+  add_inflight_messages(1);
+  add_waker(msg->expired_timepoint);
+  return EN_ATBUS_ERR_SUCCESS;
+}
+
+LIBATAPP_MACRO_API size_t atapp_endpoint::push_forward_message_batch(atapp_forward_request_t *const *requests,
+                                                                    size_t count) {
+  if (NULL == requests || 0 == count) {
+    return 0;
   }
 
-  pending_message_size_ += data_size;
-#if defined(LIBATAPP_ENABLE_CUSTOM_COUNT_FOR_STD_LIST) && LIBATAPP_ENABLE_CUSTOM_COUNT_FOR_STD_LIST
-  ++pending_message_count_;
-#endif
+  size_t ret = 0;
+  // Send all messages by one call of connector
+  do {
+    if (closing_ || NULL == owner_ || !pending_messages_.empty()) {
+      break;
+    }
 
-  add_waker(msg.expired_timepoint);
-  return EN_ATBUS_ERR_SUCCESS;
+    atapp_connection_handle *handle = get_ready_connection_handle();
+    if (NULL == handle) {
+      break;
+    }
+
+    atapp_connector_impl *connector = handle->get_connector();
+    if (NULL == connector) {
+      break;
+    }
+
+    // Compressed messages are sent by copies of requests, which point to scratch buffers of this batch
+    const atapp::protocol::atapp_compression &compression_conf = owner_->get_origin_configure().bus().compression();
+    atapp::protocol::atapp_compression_algorithm_t algorithm = select_compression_algorithm();
+    std::vector<atapp_forward_request_t *> run_requests;
+    std::vector<atapp_forward_request_t> compressed_requests;
+    std::vector<std::vector<unsigned char> > compressed_buffers;
+    if (atapp::protocol::ATAPP_COMPRESSION_NONE != algorithm) {
+      // Reserve all, so pointers to them are not invalidated during this batch
+      run_requests.reserve(count);
+      compressed_requests.reserve(count);
+      compressed_buffers.reserve(count);
+    }
+
+    size_t sent_count = 0;
+    for (size_t run_begin = 0; run_begin < count;) {
+      // Empty messages are finished immediately, the same as push_forward_message
+      atapp_forward_request_t *req = requests[run_begin];
+      if (NULL == req || 0 == req->data_size) {
+        if (NULL != req) {
+          req->result = EN_ATBUS_ERR_SUCCESS;
+          ++ret;
+        }
+        ++run_begin;
+        continue;
+      }
+
+      size_t run_end = run_begin + 1;
+      while (run_end < count && NULL != requests[run_end] && 0 != requests[run_end]->data_size) {
+        ++run_end;
+      }
+
+      atapp_forward_request_t *const *send_requests = requests + run_begin;
+      if (atapp::protocol::ATAPP_COMPRESSION_NONE != algorithm) {
+        run_requests.clear();
+        for (size_t i = run_begin; i < run_end; ++i) {
+          req = requests[i];
+          if (message_compression::match_message(compression_conf, req->type, req->data_size)) {
+            compressed_buffers.push_back(std::vector<unsigned char>());
+            std::vector<unsigned char> &compressed = compressed_buffers.back();
+            // Send the original data if it can not be compressed smaller, the same as send_forward_request
+            if (0 == message_compression::compress(algorithm, compression_conf.level(), req->type, req->data,
+                                                   req->data_size, compressed) &&
+                compressed.size() < req->data_size) {
+              compressed_requests.push_back(*req);
+              req = &compressed_requests.back();
+              req->type = discovery_->get_discovery_info().compression_message_type();
+              req->data = &compressed[0];
+              req->data_size = compressed.size();
+            }
+          }
+          run_requests.push_back(req);
+        }
+        send_requests = &run_requests[0];
+      }
+
+      connector->on_send_forward_request_batch(handle, send_requests, run_end - run_begin);
+      for (size_t i = run_begin; i < run_end; ++i) {
+        // Copy result back from compressed requests, failures are reported with the original messages
+        if (send_requests[i - run_begin] != requests[i]) {
+          requests[i]->result = send_requests[i - run_begin]->result;
+          requests[i]->msg_sequence = send_requests[i - run_begin]->msg_sequence;
+        }
+      }
+
+      for (; run_begin < run_end; ++run_begin) {
+        req = requests[run_begin];
+        if (0 == req->result) {
+          ++sent_count;
+        } else {
+          connector->on_receive_forward_response(handle, req->type, req->msg_sequence, req->result, req->data,
+                                                 req->data_size, req->metadata);
+        }
+      }
+    }
+
+    if (connector->has_forward_response()) {
+      add_inflight_messages(sent_count);
+    }
+    return ret + sent_count;
+  } while (false);
+
+  // Fallback to push one by one
+  for (size_t i = 0; i < count; ++i) {
+    atapp_forward_request_t *req = requests[i];
+    if (NULL == req) {
+      continue;
+    }
+
+    req->result = push_forward_message(req->type, req->msg_sequence, req->data, req->data_size, req->metadata);
+    if (0 == req->result) {
+      ++ret;
+    }
+  }
+
+  return ret;
 }
 
 LIBATAPP_MACRO_API int32_t atapp_endpoint::retry_pending_messages(const util::time::time_utility::raw_time_t &tick_time,
                                                                   int32_t max_count) {
-  // Including equal
-  if (nearest_waker_ <= tick_time) {
-    nearest_waker_ = std::chrono::system_clock::from_time_t(0);
-  }
-
   int ret = 0;
-  if (pending_message_.empty()) {
+  if (pending_messages_.empty()) {
     return ret;
   }
 
@@ -253,98 +461,146 @@ LIBATAPP_MACRO_API int32_t atapp_endpoint::retry_pending_messages(const util::ti
     connector = handle->get_connector();
   }
 
-  while (!pending_message_.empty()) {
-    pending_message_t &msg = pending_message_.front();
-
+  pending_message_t *msg;
+  while (NULL != (msg = pending_messages_.front())) {
     int res = EN_ATBUS_ERR_NODE_TIMEOUT;
     // Support to send data after reconnected
     if (max_count > 0 && NULL != handle && NULL != connector) {
       --max_count;
-      res = connector->on_send_forward_request(handle, msg.type, &msg.msg_sequence,
-                                               reinterpret_cast<const void *>(msg.data.data()), msg.data.size(),
-                                               msg.metadata.get());
-    } else if (msg.expired_timepoint > tick_time) {
+      atapp_iovec_t iov;
+      iov.iov_base = msg->data;
+      iov.iov_len = msg->data_size;
+      res = send_forward_request(*connector, handle, msg->type, &msg->msg_sequence, &iov, 1, msg->data_size,
+                                 msg->metadata);
+    } else if (msg->expired_timepoint > tick_time) {
       break;
     }
 
     if (0 != res) {
+      finish_inflight_messages(1);
       if (NULL != handle && NULL != connector) {
-        connector->on_receive_forward_response(handle, msg.type, msg.msg_sequence, res,
-                                               reinterpret_cast<const void *>(msg.data.data()), msg.data.size(),
-                                               msg.metadata.get());
+        connector->on_receive_forward_response(handle, msg->type, msg->msg_sequence, res, msg->data, msg->data_size,
+                                               msg->metadata);
       }
+    } else if (!connector->has_forward_response()) {
+      // Sent messages are kept in flight only when the connector will receive their responses
+      finish_inflight_messages(1);
     }
 
     ++ret;
-
-    if (likely(pending_message_size_ >= msg.data.size())) {
-      pending_message_size_ -= msg.data.size();
-    } else {
-      pending_message_size_ = 0;
-    }
-#if defined(LIBATAPP_ENABLE_CUSTOM_COUNT_FOR_STD_LIST) && LIBATAPP_ENABLE_CUSTOM_COUNT_FOR_STD_LIST
-    if (pending_message_count_ > 0) {
-      --pending_message_count_;
-    }
-#endif
-    pending_message_.pop_front();
+    pending_messages_.pop();
   }
 
-  if (pending_message_.empty()) {
-    pending_message_size_ = 0;
-#if defined(LIBATAPP_ENABLE_CUSTOM_COUNT_FOR_STD_LIST) && LIBATAPP_ENABLE_CUSTOM_COUNT_FOR_STD_LIST
-    pending_message_count_ = 0;
-#endif
-  } else if (NULL != owner_) {
-    add_waker(pending_message_.front().expired_timepoint);
+  msg = pending_messages_.front();
+  if (NULL != msg && NULL != owner_) {
+    add_waker(msg->expired_timepoint);
   }
 
   return ret;
 }
 
 LIBATAPP_MACRO_API void atapp_endpoint::add_waker(util::time::time_utility::raw_time_t wakeup_time) {
-  if (wakeup_time < nearest_waker_ || std::chrono::system_clock::to_time_t(nearest_waker_) == 0) {
-    if (NULL != owner_) {
-      if (owner_->add_endpoint_waker(wakeup_time, watcher_)) {
-        nearest_waker_ = wakeup_time;
-      }
-    }
+  if (NULL == owner_) {
+    return;
+  }
+
+  // Only move the timer when the new wakeup time is earlier
+  if (waker_timer_ && waker_timer_->is_armed() && waker_timer_->get_expire_time() <= wakeup_time) {
+    return;
   }
+
+  owner_->add_endpoint_waker(wakeup_time, watcher_, waker_timer_);
 }
 
 void atapp_endpoint::cancel_pending_messages() {
   atapp_connection_handle *handle = get_ready_connection_handle();
-  if (NULL == handle) {
-    return;
+  atapp_connector_impl *connector = NULL;
+  if (NULL != handle) {
+    connector = handle->get_connector();
   }
 
-  atapp_connector_impl *connector = handle->get_connector();
-  if (NULL == connector) {
+  pending_message_t *msg;
+  while (NULL != (msg = pending_messages_.front())) {
+    if (NULL != connector) {
+      connector->on_receive_forward_response(handle, msg->type, msg->msg_sequence, EN_ATBUS_ERR_CLOSING, msg->data,
+                                             msg->data_size, msg->metadata);
+    }
+
+    pending_messages_.pop();
+    finish_inflight_messages(1);
+  }
+
+  pending_messages_.clear();
+}
+
+LIBATAPP_MACRO_API void atapp_endpoint::finish_inflight_messages(size_t count) UTIL_CONFIG_NOEXCEPT {
+  if (count > inflight_message_count_) {
+    count = inflight_message_count_;
+  }
+  if (0 == count) {
     return;
   }
 
-  while (!pending_message_.empty()) {
-    const pending_message_t &msg = pending_message_.front();
-    connector->on_receive_forward_response(handle, msg.type, msg.msg_sequence, EN_ATBUS_ERR_CLOSING,
-                                           reinterpret_cast<const void *>(msg.data.data()), msg.data.size(),
-                                           msg.metadata.get());
+  inflight_message_count_ -= count;
+  if (NULL != owner_) {
+    owner_->endpoint_inflight_message_count_ -= count;
+  }
+}
 
-    if (likely(pending_message_size_ >= msg.data.size())) {
-      pending_message_size_ -= msg.data.size();
-    } else {
-      pending_message_size_ = 0;
-    }
-#if defined(LIBATAPP_ENABLE_CUSTOM_COUNT_FOR_STD_LIST) && LIBATAPP_ENABLE_CUSTOM_COUNT_FOR_STD_LIST
-    if (pending_message_count_ > 0) {
-      --pending_message_count_;
-    }
-#endif
-    pending_message_.pop_front();
+void atapp_endpoint::add_inflight_messages(size_t count) UTIL_CONFIG_NOEXCEPT {
+  inflight_message_count_ += count;
+  if (NULL != owner_) {
+    owner_->endpoint_inflight_message_count_ += count;
   }
+}
 
-  pending_message_size_ = 0;
-#if defined(LIBATAPP_ENABLE_CUSTOM_COUNT_FOR_STD_LIST) && LIBATAPP_ENABLE_CUSTOM_COUNT_FOR_STD_LIST
-  pending_message_count_ = 0;
-#endif
+atapp::protocol::atapp_compression_algorithm_t atapp_endpoint::select_compression_algorithm() const {
+  if (NULL == owner_ || !discovery_) {
+    return atapp::protocol::ATAPP_COMPRESSION_NONE;
+  }
+
+  const atapp::protocol::atapp_compression &conf = owner_->get_origin_configure().bus().compression();
+  if (0 == conf.algorithms_size()) {
+    return atapp::protocol::ATAPP_COMPRESSION_NONE;
+  }
+
+  return message_compression::select_algorithm(conf, discovery_->get_discovery_info());
+}
+
+int32_t atapp_endpoint::send_forward_request(atapp_connector_impl &connector, atapp_connection_handle *handle,
+                                             int32_t type, uint64_t *msg_sequence, const atapp_iovec_t *iov,
+                                             size_t iov_count, size_t data_size,
+                                             const atapp::protocol::atapp_metadata *metadata) {
+  atapp::protocol::atapp_compression_algorithm_t algorithm = atapp::protocol::ATAPP_COMPRESSION_NONE;
+  if (NULL != owner_ && message_compression::match_message(owner_->get_origin_configure().bus().compression(), type,
+                                                           data_size)) {
+    algorithm = select_compression_algorithm();
+  }
+
+  if (atapp::protocol::ATAPP_COMPRESSION_NONE == algorithm) {
+    return connector.on_send_forward_request_v(handle, type, msg_sequence, iov, iov_count, metadata);
+  }
+
+  // Take the buffer away, so it's still safe when connector send another message to this endpoint
+  std::vector<unsigned char> compressed;
+  compressed.swap(compression_buffer_);
+
+  int32_t ret;
+  pending_message_gather_t gathered(iov, iov_count, data_size);
+  if (0 == message_compression::compress(algorithm, owner_->get_origin_configure().bus().compression().level(), type,
+                                         gathered.data(), data_size, compressed) &&
+      compressed.size() < data_size) {
+    // Original type is kept in frame header, remote node recognizes compressed messages by its reserved type
+    ret = connector.on_send_forward_request(handle, discovery_->get_discovery_info().compression_message_type(),
+                                            msg_sequence, &compressed[0], compressed.size(), metadata);
+  } else {
+    // Send the original data if it can not be compressed smaller
+    ret = connector.on_send_forward_request_v(handle, type, msg_sequence, iov, iov_count, metadata);
+  }
+
+  if (compression_buffer_.capacity() < compressed.capacity()) {
+    compressed.swap(compression_buffer_);
+  }
+  return ret;
 }
 }  // namespace atapp
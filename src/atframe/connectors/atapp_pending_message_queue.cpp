@@ -0,0 +1,266 @@
+#include <cstring>
+#include <new>
+
+#include <atframe/connectors/atapp_pending_message_queue.h>
+
+namespace atapp {
+namespace {
+static size_t pending_message_align_size(size_t sz) {
+  const size_t align_size = sizeof(void *) > sizeof(uint64_t) ? sizeof(void *) : sizeof(uint64_t);
+  return (sz + align_size - 1) & ~(align_size - 1);
+}
+
+static size_t pending_message_record_size(size_t data_size) {
+  return pending_message_align_size(sizeof(atapp_pending_message_queue::message_t)) +
+         pending_message_align_size(data_size);
+}
+}  // namespace
+
+LIBATAPP_MACRO_API atapp_pending_message_queue::atapp_pending_message_queue()
+    : max_chunk_size_(DEFAULT_MAX_CHUNK_SIZE),
+      next_chunk_size_(MIN_CHUNK_SIZE),
+      allocated_size_(0),
+      data_size_(0),
+      message_count_(0) {}
+
+LIBATAPP_MACRO_API atapp_pending_message_queue::~atapp_pending_message_queue() { clear(); }
+
+LIBATAPP_MACRO_API void atapp_pending_message_queue::set_max_chunk_size(size_t sz) UTIL_CONFIG_NOEXCEPT {
+  if (sz < MIN_CHUNK_SIZE) {
+    sz = MIN_CHUNK_SIZE;
+  }
+  max_chunk_size_ = sz;
+  if (next_chunk_size_ > max_chunk_size_) {
+    next_chunk_size_ = max_chunk_size_;
+  }
+}
+
+LIBATAPP_MACRO_API atapp_pending_message_queue::message_t *atapp_pending_message_queue::push(
+    size_t data_size, const atapp_iovec_t *iov, size_t iov_count, const atapp::protocol::atapp_metadata *metadata) {
+  message_t *ret = allocate(data_size, metadata);
+  if (NULL == ret) {
+    return NULL;
+  }
+
+  unsigned char *payload = reinterpret_cast<unsigned char *>(const_cast<void *>(ret->data));
+  for (size_t i = 0; NULL != iov && i < iov_count; ++i) {
+    if (iov[i].iov_len > 0) {
+      memcpy(payload, iov[i].iov_base, iov[i].iov_len);
+      payload += iov[i].iov_len;
+    }
+  }
+  ret->data_size = data_size;
+
+  data_size_ += data_size;
+  return ret;
+}
+
+LIBATAPP_MACRO_API atapp_pending_message_queue::message_t *atapp_pending_message_queue::push(
+    const shared_payload_ptr_t &payload, const atapp::protocol::atapp_metadata *metadata) {
+  message_t *ret = allocate(0, metadata);
+  if (NULL == ret) {
+    return NULL;
+  }
+
+  if (payload) {
+    ret->shared_payload = payload;
+    ret->data = payload->data();
+    ret->data_size = payload->size();
+  }
+
+  data_size_ += ret->data_size;
+  return ret;
+}
+
+LIBATAPP_MACRO_API atapp_pending_message_queue::message_t *atapp_pending_message_queue::front() UTIL_CONFIG_NOEXCEPT {
+  if (0 == message_count_ || chunks_.empty()) {
+    return NULL;
+  }
+
+  chunk_t &chunk = chunks_.front();
+  if (chunk.read_offset >= chunk.write_offset) {
+    return NULL;
+  }
+
+  return reinterpret_cast<message_t *>(chunk.buffer + chunk.read_offset);
+}
+
+LIBATAPP_MACRO_API void atapp_pending_message_queue::pop() {
+  message_t *msg = front();
+  if (NULL == msg) {
+    return;
+  }
+
+  size_t data_size = msg->data_size;
+  size_t record_size = pending_message_record_size(msg->shared_payload ? 0 : data_size);
+  if (NULL != msg->metadata) {
+    atapp::protocol::atapp_metadata *metadata = const_cast<atapp::protocol::atapp_metadata *>(msg->metadata);
+    if (free_metadata_.size() < MAX_FREE_METADATA_NUMBER) {
+      metadata->Clear();
+      free_metadata_.push_back(metadata);
+    } else {
+      delete metadata;
+    }
+    msg->metadata = NULL;
+  }
+  msg->~message_t();
+
+  if (data_size_ >= data_size) {
+    data_size_ -= data_size;
+  } else {
+    data_size_ = 0;
+  }
+  if (message_count_ > 0) {
+    --message_count_;
+  }
+
+  // Nothing is kept when the queue is drained, most endpoints have no pending message in most time
+  if (0 == message_count_) {
+    release();
+    return;
+  }
+
+  chunk_t &chunk = chunks_.front();
+  chunk.read_offset += record_size;
+  if (chunk.read_offset < chunk.write_offset) {
+    return;
+  }
+
+  // Messages are left in later chunks, so this chunk can not be the last one
+  recycle_chunk(chunk);
+  chunks_.pop_front();
+}
+
+LIBATAPP_MACRO_API void atapp_pending_message_queue::clear() {
+  while (NULL != front()) {
+    pop();
+  }
+
+  release();
+}
+
+atapp_pending_message_queue::message_t *atapp_pending_message_queue::allocate(
+    size_t payload_capacity, const atapp::protocol::atapp_metadata *metadata) {
+  size_t record_size = pending_message_record_size(payload_capacity);
+
+  if (chunks_.empty() || chunks_.back().capacity - chunks_.back().write_offset < record_size) {
+    if (!append_chunk(record_size)) {
+      return NULL;
+    }
+  }
+
+  atapp::protocol::atapp_metadata *copied_metadata = NULL;
+  if (NULL != metadata) {
+    if (!free_metadata_.empty()) {
+      copied_metadata = free_metadata_.back();
+      free_metadata_.pop_back();
+    } else {
+      copied_metadata = new (std::nothrow) atapp::protocol::atapp_metadata();
+      if (NULL == copied_metadata) {
+        return NULL;
+      }
+    }
+    copied_metadata->CopyFrom(*metadata);
+  }
+
+  chunk_t &chunk = chunks_.back();
+  unsigned char *record = chunk.buffer + chunk.write_offset;
+  unsigned char *payload = record + pending_message_align_size(sizeof(message_t));
+  chunk.write_offset += record_size;
+
+  message_t *ret = new (record) message_t();
+  ret->type = 0;
+  ret->msg_sequence = 0;
+  ret->data = payload;
+  ret->data_size = 0;
+  ret->metadata = copied_metadata;
+
+  ++message_count_;
+  return ret;
+}
+
+bool atapp_pending_message_queue::append_chunk(size_t record_size) {
+  chunk_t chunk;
+  chunk.buffer = NULL;
+  chunk.capacity = 0;
+  chunk.read_offset = 0;
+  chunk.write_offset = 0;
+
+  // Reuse a drained chunk first
+  for (std::vector<chunk_t>::iterator iter = free_chunks_.begin(); iter != free_chunks_.end(); ++iter) {
+    if ((*iter).capacity >= record_size) {
+      chunk = *iter;
+      free_chunks_.erase(iter);
+      break;
+    }
+  }
+
+  if (NULL == chunk.buffer) {
+    // Chunks grow from MIN_CHUNK_SIZE, so a few pending messages never take a large block
+    chunk.capacity = next_chunk_size_;
+    if (record_size > chunk.capacity) {
+      chunk.capacity = record_size;
+    }
+    chunk.buffer = new (std::nothrow) unsigned char[chunk.capacity];
+    if (NULL == chunk.buffer) {
+      return false;
+    }
+    allocated_size_ += chunk.capacity;
+
+    if (next_chunk_size_ < max_chunk_size_) {
+      next_chunk_size_ *= 2;
+      if (next_chunk_size_ > max_chunk_size_) {
+        next_chunk_size_ = max_chunk_size_;
+      }
+    }
+  }
+
+  // The last chunk has no message, it's too small for this record
+  if (!chunks_.empty() && chunks_.back().read_offset >= chunks_.back().write_offset) {
+    recycle_chunk(chunks_.back());
+    chunks_.pop_back();
+  }
+
+  chunks_.push_back(chunk);
+  return true;
+}
+
+void atapp_pending_message_queue::recycle_chunk(const chunk_t &chunk) {
+  if (free_chunks_.size() < MAX_FREE_CHUNK_NUMBER) {
+    free_chunks_.push_back(chunk);
+    free_chunks_.back().read_offset = 0;
+    free_chunks_.back().write_offset = 0;
+    return;
+  }
+
+  if (allocated_size_ >= chunk.capacity) {
+    allocated_size_ -= chunk.capacity;
+  } else {
+    allocated_size_ = 0;
+  }
+  delete[] chunk.buffer;
+}
+
+void atapp_pending_message_queue::release() {
+  for (std::deque<chunk_t>::iterator iter = chunks_.begin(); iter != chunks_.end(); ++iter) {
+    delete[](*iter).buffer;
+  }
+  chunks_.clear();
+
+  for (std::vector<chunk_t>::iterator iter = free_chunks_.begin(); iter != free_chunks_.end(); ++iter) {
+    delete[](*iter).buffer;
+  }
+  free_chunks_.clear();
+
+  for (std::vector<atapp::protocol::atapp_metadata *>::iterator iter = free_metadata_.begin();
+       iter != free_metadata_.end(); ++iter) {
+    delete *iter;
+  }
+  free_metadata_.clear();
+
+  allocated_size_ = 0;
+  next_chunk_size_ = MIN_CHUNK_SIZE;
+  data_size_ = 0;
+  message_count_ = 0;
+}
+}  // namespace atapp
@@ -1,11 +1,31 @@
 #include <algorithm>
+#include <iterator>
 
+#include <lock/lock_holder.h>
 #include <time/time_utility.h>
 
 #include <algorithm/murmur_hash.h>
 
 #include <atframe/etcdcli/etcd_discovery.h>
 
+// AVX2 is detected at runtime if it's not enabled by compiler options, SSE2 is used as fallback
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#  define LIBATAPP_ETCD_DISCOVERY_ENABLE_AVX2 1
+#  define LIBATAPP_ETCD_DISCOVERY_AVX2_TARGET
+#elif (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#  include <immintrin.h>
+#  define LIBATAPP_ETCD_DISCOVERY_ENABLE_AVX2 1
+#  define LIBATAPP_ETCD_DISCOVERY_ENABLE_AVX2_DISPATCH 1
+#  define LIBATAPP_ETCD_DISCOVERY_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define LIBATAPP_ETCD_DISCOVERY_ENABLE_SSE2 1
+#endif
+
 #ifdef max
 #  undef max
 #endif
@@ -22,46 +42,428 @@ static std::pair<uint64_t, uint64_t> consistent_hash_calc(const void *buf, size_
   return ret;
 }
 
-static bool consistent_hash_compare_find(const etcd_discovery_set::node_hash_t &l,
-                                         const std::pair<uint64_t, uint64_t> &r) {
-  return l.hash_code < r;
+static bool round_robin_compare_index(const etcd_discovery_node::ptr_t &l, const etcd_discovery_node::ptr_t &r) {
+  if (!l || !r) {
+    return reinterpret_cast<uintptr_t>(l.get()) < reinterpret_cast<uintptr_t>(r.get());
+  }
+
+  if (l->get_discovery_info().id() != r->get_discovery_info().id()) {
+    return l->get_discovery_info().id() < r->get_discovery_info().id();
+  }
+
+  if (l->get_name_hash() != r->get_name_hash()) {
+    return l->get_name_hash() < r->get_name_hash();
+  }
+
+  return l->get_discovery_info().name() < r->get_discovery_info().name();
+}
+
+static bool update_nodes_compare_ptr(const etcd_discovery_node::ptr_t &l, const etcd_discovery_node::ptr_t &r) {
+  return l.get() < r.get();
 }
 
-static bool consistent_hash_compare_index(const etcd_discovery_set::node_hash_t &l,
-                                          const etcd_discovery_set::node_hash_t &r) {
-  if (l.hash_code != r.hash_code) {
-    return l.hash_code < r.hash_code;
+namespace {
+struct consistent_hash_point_t {
+  uint64_t key;
+  uint32_t node_index;
+};
+
+struct consistent_hash_point_compare_t {
+  const std::vector<etcd_discovery_node::ptr_t> *nodes;
+
+  explicit consistent_hash_point_compare_t(const std::vector<etcd_discovery_node::ptr_t> &n) : nodes(&n) {}
+
+  bool operator()(const consistent_hash_point_t &l, const consistent_hash_point_t &r) const {
+    if (l.key != r.key) {
+      return l.key < r.key;
+    }
+
+    if (l.node_index == r.node_index) {
+      return false;
+    }
+
+    return round_robin_compare_index((*nodes)[l.node_index], (*nodes)[r.node_index]);
   }
+};
+}  // namespace
+
+// Virtual points of each hash source(id or name) of a node, which are scaled by weight
+static size_t consistent_hash_point_count(const etcd_discovery_node &node) {
+  // Limit the weight to avoid too many points in ring
+  const uint32_t max_weight = 10000;
+  uint32_t weight = node.get_discovery_info().weight();
+  if (0 == weight) {
+    weight = 100;
+  } else if (weight > max_weight) {
+    weight = max_weight;
+  }
+
+  size_t ret = etcd_discovery_set::node_hash_t::HASH_POINT_PER_INS / 2 * static_cast<size_t>(weight) / 100;
+  return ret > 0 ? ret : 1;
+}
 
-  if (!l.node || !r.node) {
-    return reinterpret_cast<uintptr_t>(l.node.get()) < reinterpret_cast<uintptr_t>(r.node.get());
+static void consistent_hash_append_points(std::vector<consistent_hash_point_t> &out, const void *buf, size_t bufsz,
+                                          uint32_t node_index, size_t point_count) {
+  for (size_t i = 0; i < point_count; ++i) {
+    consistent_hash_point_t point;
+    point.key = consistent_hash_calc(buf, bufsz, static_cast<uint32_t>(i)).first;
+    point.node_index = node_index;
+    out.push_back(point);
   }
+}
 
-  if (l.node->get_discovery_info().id() != r.node->get_discovery_info().id()) {
-    return l.node->get_discovery_info().id() < r.node->get_discovery_info().id();
+// Fill Eytzinger layout by in-order traversal of the implicit tree, sorted[i] goes to the k-th slot
+static size_t consistent_hash_eytzinger_layout(const std::vector<consistent_hash_point_t> &sorted, size_t i, size_t k,
+                                               std::vector<uint64_t> &keys, std::vector<uint32_t> &node_index) {
+  if (k < keys.size()) {
+    i = consistent_hash_eytzinger_layout(sorted, i, 2 * k, keys, node_index);
+    keys[k] = sorted[i].key;
+    node_index[k] = sorted[i].node_index;
+    ++i;
+    i = consistent_hash_eytzinger_layout(sorted, i, 2 * k + 1, keys, node_index);
   }
 
-  if (l.node->get_name_hash() != r.node->get_name_hash()) {
-    return l.node->get_name_hash() < r.node->get_name_hash();
+  return i;
+}
+
+static void consistent_hash_assign_points(const std::vector<consistent_hash_point_t> &sorted,
+                                          std::vector<uint64_t> &keys, std::vector<uint32_t> &node_index) {
+  keys.resize(sorted.size() + 1);
+  node_index.resize(sorted.size() + 1);
+  keys[0] = 0;
+  node_index[0] = sorted.empty() ? 0 : sorted[0].node_index;
+  consistent_hash_eytzinger_layout(sorted, 0, 1, keys, node_index);
+}
+
+// Collect points in sorted order from Eytzinger layout
+static void consistent_hash_eytzinger_collect(const std::vector<uint64_t> &keys,
+                                              const std::vector<uint32_t> &node_index, size_t k,
+                                              std::vector<consistent_hash_point_t> &out) {
+  if (k < keys.size()) {
+    consistent_hash_eytzinger_collect(keys, node_index, 2 * k, out);
+    consistent_hash_point_t point;
+    point.key = keys[k];
+    point.node_index = node_index[k];
+    out.push_back(point);
+    consistent_hash_eytzinger_collect(keys, node_index, 2 * k + 1, out);
   }
+}
 
-  return l.node->get_discovery_info().name() < r.node->get_discovery_info().name();
+// Remove the trailing right turns and the last left turn of the search path, which is the position of lower bound
+static UTIL_FORCEINLINE size_t consistent_hash_eytzinger_lower_bound_slot(size_t k) {
+#if defined(__GNUC__) || defined(__clang__)
+  return k >> __builtin_ffsll(static_cast<long long>(~static_cast<unsigned long long>(k)));
+#else
+  while (k & 1) {
+    k >>= 1;
+  }
+  return k >> 1;
+#endif
 }
 
-static bool round_robin_compare_index(const etcd_discovery_node::ptr_t &l, const etcd_discovery_node::ptr_t &r) {
-  if (!l || !r) {
-    return reinterpret_cast<uintptr_t>(l.get()) < reinterpret_cast<uintptr_t>(r.get());
+// Jump consistent hash, see https://arxiv.org/abs/1406.2294
+static size_t consistent_hash_jump(uint64_t key, size_t bucket_count) {
+  int64_t b = -1;
+  int64_t j = 0;
+  while (j < static_cast<int64_t>(bucket_count)) {
+    b = j;
+    key = key * 2862933555777941757ULL + 1;
+    j = static_cast<int64_t>(static_cast<double>(b + 1) *
+                             (static_cast<double>(1LL << 31) / static_cast<double>((key >> 33) + 1)));
   }
 
-  if (l->get_discovery_info().id() != r->get_discovery_info().id()) {
-    return l->get_discovery_info().id() < r->get_discovery_info().id();
+  return static_cast<size_t>(b);
+}
+
+// Hash seed of a node for maglev and rendezvous hashing
+static std::pair<uint64_t, uint64_t> consistent_hash_node_seed(const etcd_discovery_node &node) {
+  uint64_t id = node.get_discovery_info().id();
+  if (0 != id) {
+    return consistent_hash_calc(&id, sizeof(id), LIBATAPP_MACRO_HASH_MAGIC_NUMBER);
   }
 
-  if (l->get_name_hash() != r->get_name_hash()) {
-    return l->get_name_hash() < r->get_name_hash();
+  return node.get_name_hash();
+}
+
+#define LIBATAPP_ETCD_DISCOVERY_RENDEZVOUS_MUL1 0xff51afd7ed558ccdULL
+#define LIBATAPP_ETCD_DISCOVERY_RENDEZVOUS_MUL2 0xc4ceb9fe1a85ec53ULL
+
+// Score of rendezvous hashing is fmix64 of murmur3 on (seed ^ key)
+static UTIL_FORCEINLINE uint64_t consistent_hash_rendezvous_mix(uint64_t seed, uint64_t key) {
+  uint64_t h = seed ^ key;
+  h ^= h >> 33;
+  h *= LIBATAPP_ETCD_DISCOVERY_RENDEZVOUS_MUL1;
+  h ^= h >> 33;
+  h *= LIBATAPP_ETCD_DISCOVERY_RENDEZVOUS_MUL2;
+  h ^= h >> 33;
+  return h;
+}
+
+// There is no 64-bit multiply before AVX-512, so a * b = a_lo * b_lo + ((a_hi * b_lo + a_lo * b_hi) << 32)
+#if defined(LIBATAPP_ETCD_DISCOVERY_ENABLE_AVX2)
+static UTIL_FORCEINLINE LIBATAPP_ETCD_DISCOVERY_AVX2_TARGET __m256i consistent_hash_rendezvous_mul(__m256i a,
+                                                                                                 __m256i b_lo,
+                                                                                                 __m256i b_hi) {
+  __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b_lo), _mm256_mul_epu32(a, b_hi));
+  return _mm256_add_epi64(_mm256_mul_epu32(a, b_lo), _mm256_slli_epi64(cross, 32));
+}
+
+static bool consistent_hash_rendezvous_has_avx2() {
+#  if defined(LIBATAPP_ETCD_DISCOVERY_ENABLE_AVX2_DISPATCH)
+  static const bool ret = 0 != __builtin_cpu_supports("avx2");
+  return ret;
+#  else
+  return true;
+#  endif
+}
+
+// Return count of scored seeds, the tail which is not aligned to vector width is left
+static LIBATAPP_ETCD_DISCOVERY_AVX2_TARGET size_t consistent_hash_rendezvous_score_avx2(const uint64_t *seeds,
+                                                                                       size_t count, uint64_t key,
+                                                                                       uint64_t *out) {
+  size_t i = 0;
+  const __m256i k = _mm256_set1_epi64x(static_cast<long long>(key));
+  const __m256i mul1_lo = _mm256_set1_epi64x(static_cast<long long>(LIBATAPP_ETCD_DISCOVERY_RENDEZVOUS_MUL1));
+  const __m256i mul1_hi = _mm256_set1_epi64x(static_cast<long long>(LIBATAPP_ETCD_DISCOVERY_RENDEZVOUS_MUL1 >> 32));
+  const __m256i mul2_lo = _mm256_set1_epi64x(static_cast<long long>(LIBATAPP_ETCD_DISCOVERY_RENDEZVOUS_MUL2));
+  const __m256i mul2_hi = _mm256_set1_epi64x(static_cast<long long>(LIBATAPP_ETCD_DISCOVERY_RENDEZVOUS_MUL2 >> 32));
+  for (; i + 4 <= count; i += 4) {
+    __m256i h = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(seeds + i)), k);
+    h = _mm256_xor_si256(h, _mm256_srli_epi64(h, 33));
+    h = consistent_hash_rendezvous_mul(h, mul1_lo, mul1_hi);
+    h = _mm256_xor_si256(h, _mm256_srli_epi64(h, 33));
+    h = consistent_hash_rendezvous_mul(h, mul2_lo, mul2_hi);
+    h = _mm256_xor_si256(h, _mm256_srli_epi64(h, 33));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), h);
   }
+  return i;
+}
+#endif
 
-  return l->get_discovery_info().name() < r->get_discovery_info().name();
+#if defined(LIBATAPP_ETCD_DISCOVERY_ENABLE_SSE2)
+static UTIL_FORCEINLINE __m128i consistent_hash_rendezvous_mul(__m128i a, __m128i b_lo, __m128i b_hi) {
+  __m128i cross = _mm_add_epi64(_mm_mul_epu32(_mm_srli_epi64(a, 32), b_lo), _mm_mul_epu32(a, b_hi));
+  return _mm_add_epi64(_mm_mul_epu32(a, b_lo), _mm_slli_epi64(cross, 32));
+}
+
+static size_t consistent_hash_rendezvous_score_sse2(const uint64_t *seeds, size_t count, uint64_t key,
+                                                    uint64_t *out) {
+  size_t i = 0;
+  const __m128i k = _mm_set1_epi64x(static_cast<long long>(key));
+  const __m128i mul1_lo = _mm_set1_epi64x(static_cast<long long>(LIBATAPP_ETCD_DISCOVERY_RENDEZVOUS_MUL1));
+  const __m128i mul1_hi = _mm_set1_epi64x(static_cast<long long>(LIBATAPP_ETCD_DISCOVERY_RENDEZVOUS_MUL1 >> 32));
+  const __m128i mul2_lo = _mm_set1_epi64x(static_cast<long long>(LIBATAPP_ETCD_DISCOVERY_RENDEZVOUS_MUL2));
+  const __m128i mul2_hi = _mm_set1_epi64x(static_cast<long long>(LIBATAPP_ETCD_DISCOVERY_RENDEZVOUS_MUL2 >> 32));
+  for (; i + 2 <= count; i += 2) {
+    __m128i h = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(seeds + i)), k);
+    h = _mm_xor_si128(h, _mm_srli_epi64(h, 33));
+    h = consistent_hash_rendezvous_mul(h, mul1_lo, mul1_hi);
+    h = _mm_xor_si128(h, _mm_srli_epi64(h, 33));
+    h = consistent_hash_rendezvous_mul(h, mul2_lo, mul2_hi);
+    h = _mm_xor_si128(h, _mm_srli_epi64(h, 33));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), h);
+  }
+  return i;
+}
+#endif
+
+static void consistent_hash_rendezvous_score(const uint64_t *seeds, size_t count, uint64_t key, uint64_t *out) {
+  size_t i = 0;
+#if defined(LIBATAPP_ETCD_DISCOVERY_ENABLE_AVX2)
+  if (consistent_hash_rendezvous_has_avx2()) {
+    i = consistent_hash_rendezvous_score_avx2(seeds, count, key, out);
+  }
+#endif
+#if defined(LIBATAPP_ETCD_DISCOVERY_ENABLE_SSE2)
+  i += consistent_hash_rendezvous_score_sse2(seeds + i, count - i, key, out + i);
+#endif
+
+  for (; i < count; ++i) {
+    out[i] = consistent_hash_rendezvous_mix(seeds[i], key);
+  }
+}
+
+// Index of the highest score, the first one wins when there are equal scores
+static size_t consistent_hash_rendezvous_select(const uint64_t *seeds, size_t count, uint64_t key) {
+  uint64_t scores[64];
+  size_t ret = 0;
+  uint64_t max_score = 0;
+  for (size_t base = 0; base < count; base += sizeof(scores) / sizeof(scores[0])) {
+    size_t batch_count = count - base;
+    if (batch_count > sizeof(scores) / sizeof(scores[0])) {
+      batch_count = sizeof(scores) / sizeof(scores[0]);
+    }
+
+    consistent_hash_rendezvous_score(seeds + base, batch_count, key, scores);
+    for (size_t i = 0; i < batch_count; ++i) {
+      if (scores[i] > max_score) {
+        max_score = scores[i];
+        ret = base + i;
+      }
+    }
+  }
+
+  return ret;
+}
+
+// Branch-free search of the first key not less than hash_key, 0 means all keys are less than hash_key
+static size_t consistent_hash_eytzinger_lower_bound(const std::vector<uint64_t> &keys, uint64_t hash_key) {
+  const uint64_t *data = &keys[0];
+  size_t size = keys.size();
+  size_t k = 1;
+  while (k < size) {
+    k = 2 * k + static_cast<size_t>(data[k] < hash_key);
+  }
+
+  return consistent_hash_eytzinger_lower_bound_slot(k);
+}
+
+// First slot in sorted order of Eytzinger layout, it's the leftmost node of the implicit tree
+static size_t consistent_hash_eytzinger_first_slot(size_t size) {
+  size_t k = 1;
+  while (2 * k < size) {
+    k = 2 * k;
+  }
+
+  return k;
+}
+
+// Next slot in sorted order of Eytzinger layout, and wrap around to the first slot after the last one
+static size_t consistent_hash_eytzinger_next_slot(size_t k, size_t size) {
+  if (2 * k + 1 < size) {
+    k = 2 * k + 1;
+    while (2 * k < size) {
+      k = 2 * k;
+    }
+    return k;
+  }
+
+  k = consistent_hash_eytzinger_lower_bound_slot(k);
+  return 0 == k ? consistent_hash_eytzinger_first_slot(size) : k;
+}
+
+// Partition hash codes into buckets by their top bits, and then sort each bucket which has only a few codes
+static void consistent_hash_sort_codes(std::vector<std::pair<uint64_t, size_t> > &hash_codes) {
+  size_t bits = 1;
+  while (bits < 16 && (static_cast<size_t>(1) << bits) < hash_codes.size()) {
+    ++bits;
+  }
+  size_t shift = 64 - bits;
+
+  std::vector<size_t> bucket_offsets;
+  bucket_offsets.resize((static_cast<size_t>(1) << bits) + 1, 0);
+  for (size_t i = 0; i < hash_codes.size(); ++i) {
+    ++bucket_offsets[static_cast<size_t>(hash_codes[i].first >> shift) + 1];
+  }
+  for (size_t i = 1; i < bucket_offsets.size(); ++i) {
+    bucket_offsets[i] += bucket_offsets[i - 1];
+  }
+
+  std::vector<std::pair<uint64_t, size_t> > sorted;
+  sorted.resize(hash_codes.size());
+  std::vector<size_t> bucket_next(bucket_offsets.begin(), bucket_offsets.end() - 1);
+  for (size_t i = 0; i < hash_codes.size(); ++i) {
+    sorted[bucket_next[static_cast<size_t>(hash_codes[i].first >> shift)]++] = hash_codes[i];
+  }
+
+  for (size_t i = 0; i + 1 < bucket_offsets.size(); ++i) {
+    std::vector<std::pair<uint64_t, size_t> >::iterator begin = sorted.begin() + bucket_offsets[i];
+    std::vector<std::pair<uint64_t, size_t> >::iterator end = sorted.begin() + bucket_offsets[i + 1];
+    if (end - begin > 1) {
+      std::sort(begin, end);
+    }
+  }
+
+  hash_codes.swap(sorted);
+}
+
+static size_t consistent_hash_maglev_table_size(size_t node_count) {
+  // Prime table size, at least 100 entries for each node to keep the max imbalance under about 1%
+  static const size_t maglev_primes[] = {65537, 131101, 262147, 524309, 1048583, 2097169};
+  for (size_t i = 0; i < sizeof(maglev_primes) / sizeof(maglev_primes[0]); ++i) {
+    if (maglev_primes[i] >= node_count * 100) {
+      return maglev_primes[i];
+    }
+  }
+
+  return maglev_primes[sizeof(maglev_primes) / sizeof(maglev_primes[0]) - 1];
+}
+
+static bool locality_make_key(const atapp::protocol::atapp_area &area, etcd_discovery_locality_t::type locality,
+                              std::string &out) {
+  // Keys of different levels are prefixed and fields are separated by '\0', so they never conflict
+  out.clear();
+  switch (locality) {
+    case etcd_discovery_locality_t::EN_DL_ZONE: {
+      uint64_t zone_id = area.zone_id();
+      if (0 == zone_id) {
+        return false;
+      }
+      out.reserve(area.region().size() + area.district().size() + sizeof(zone_id) + 3);
+      out.push_back('Z');
+      out.append(area.region());
+      out.push_back('\0');
+      out.append(area.district());
+      out.push_back('\0');
+      out.append(reinterpret_cast<const char *>(&zone_id), sizeof(zone_id));
+      return true;
+    }
+    case etcd_discovery_locality_t::EN_DL_DISTRICT: {
+      if (area.district().empty()) {
+        return false;
+      }
+      out.reserve(area.region().size() + area.district().size() + 2);
+      out.push_back('D');
+      out.append(area.region());
+      out.push_back('\0');
+      out.append(area.district());
+      return true;
+    }
+    case etcd_discovery_locality_t::EN_DL_REGION: {
+      if (area.region().empty()) {
+        return false;
+      }
+      out.reserve(area.region().size() + 1);
+      out.push_back('R');
+      out.append(area.region());
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+static void selector_make_terms(const std::string &type_name, const atapp::protocol::atapp_metadata &metadata,
+                                std::vector<std::string> &out) {
+  // Terms are prefixed by kind, label key and value are separated by '\0'
+  out.clear();
+  if (!type_name.empty()) {
+    out.push_back("T" + type_name);
+  }
+  if (!metadata.namespace_name().empty()) {
+    out.push_back("N" + metadata.namespace_name());
+  }
+  if (!metadata.service_subset().empty()) {
+    out.push_back("S" + metadata.service_subset());
+  }
+
+  ATBUS_MACRO_PROTOBUF_NAMESPACE_ID::Map<std::string, std::string>::const_iterator iter = metadata.labels().begin();
+  for (; iter != metadata.labels().end(); ++iter) {
+    if (iter->first.empty() || iter->second.empty()) {
+      continue;
+    }
+
+    std::string term;
+    term.reserve(iter->first.size() + iter->second.size() + 2);
+    term.push_back('L');
+    term.append(iter->first);
+    term.push_back('\0');
+    term.append(iter->second);
+    out.push_back(term);
+  }
+
+  std::sort(out.begin(), out.end());
+  out.erase(std::unique(out.begin(), out.end()), out.end());
 }
 
 struct lower_upper_bound_pred_t {
@@ -175,6 +577,17 @@ LIBATAPP_MACRO_API etcd_discovery_set::etcd_discovery_set() {
   random_generator_.init_seed(
       static_cast<util::random::xoshiro256_starstar::result_type>(util::time::time_utility::get_now()));
   round_robin_index_ = 0;
+  hashing_total_load_ = 0;
+  hashing_load_epoch_ = 0;
+  locality_sets_enabled_ = false;
+  selector_index_enabled_ = false;
+  selector_cache_clock_ = 0;
+  selector_cache_capacity_ = 64;
+  snapshot_enabled_ = false;
+  snapshot_dirty_ = false;
+  generation_ = 0;
+  change_log_capacity_ = 1024;
+  change_log_dropped_generation_ = 0;
 }
 
 LIBATAPP_MACRO_API etcd_discovery_set::~etcd_discovery_set() {}
@@ -199,20 +612,19 @@ LIBATAPP_MACRO_API etcd_discovery_node::ptr_t etcd_discovery_set::get_node_by_na
   return iter->second;
 }
 
-LIBATAPP_MACRO_API etcd_discovery_node::ptr_t etcd_discovery_set::get_node_by_consistent_hash(const void *buf,
-                                                                                              size_t bufsz) const {
-  if (hashing_cache_.empty()) {
-    rebuild_cache();
+LIBATAPP_MACRO_API etcd_discovery_node::ptr_t etcd_discovery_set::get_node_by_name(
+    const hashed_string_ref &name) const {
+  node_by_name_t::const_iterator iter = node_by_name_.find_as(name);
+  if (iter == node_by_name_.end()) {
+    return NULL;
   }
 
-  std::pair<uint64_t, uint64_t> hash_key = consistent_hash_calc(buf, bufsz, LIBATAPP_MACRO_HASH_MAGIC_NUMBER);
-  std::vector<node_hash_t>::const_iterator hash_iter =
-      std::lower_bound(hashing_cache_.begin(), hashing_cache_.end(), hash_key, consistent_hash_compare_find);
-  if (hash_iter == hashing_cache_.end()) {
-    return (*hashing_cache_.begin()).node;
-  }
+  return iter->second;
+}
 
-  return (*hash_iter).node;
+LIBATAPP_MACRO_API etcd_discovery_node::ptr_t etcd_discovery_set::get_node_by_consistent_hash(const void *buf,
+                                                                                              size_t bufsz) const {
+  return get_node_by_consistent_hash(buf, bufsz, etcd_discovery_consistent_hash_policy_t::EN_CHP_RING);
 }
 
 LIBATAPP_MACRO_API etcd_discovery_node::ptr_t etcd_discovery_set::get_node_by_consistent_hash(uint64_t key) const {
@@ -228,145 +640,848 @@ LIBATAPP_MACRO_API etcd_discovery_node::ptr_t etcd_discovery_set::get_node_by_co
   return get_node_by_consistent_hash(key.c_str(), key.size());
 }
 
-LIBATAPP_MACRO_API etcd_discovery_node::ptr_t etcd_discovery_set::get_node_by_random() const {
-  if (round_robin_cache_.empty()) {
-    rebuild_cache();
+LIBATAPP_MACRO_API etcd_discovery_node::ptr_t etcd_discovery_set::get_node_by_consistent_hash(
+    const void *buf, size_t bufsz, etcd_discovery_consistent_hash_policy_t::type policy) const {
+  return get_node_by_hash_code(consistent_hash_calc(buf, bufsz, LIBATAPP_MACRO_HASH_MAGIC_NUMBER).first, policy);
+}
+
+LIBATAPP_MACRO_API etcd_discovery_node::ptr_t etcd_discovery_set::get_node_by_consistent_hash(
+    uint64_t key, etcd_discovery_consistent_hash_policy_t::type policy) const {
+  if (etcd_discovery_consistent_hash_policy_t::EN_CHP_RING == policy) {
+    return get_node_by_consistent_hash(&key, sizeof(key), policy);
   }
 
-  if (round_robin_cache_.empty()) {
-    return NULL;
+  return get_node_by_hash_code(flat_hash_integer(key), policy);
+}
+
+LIBATAPP_MACRO_API etcd_discovery_node::ptr_t etcd_discovery_set::get_node_by_consistent_hash(
+    int64_t key, etcd_discovery_consistent_hash_policy_t::type policy) const {
+  if (etcd_discovery_consistent_hash_policy_t::EN_CHP_RING == policy) {
+    return get_node_by_consistent_hash(&key, sizeof(key), policy);
   }
 
-  return round_robin_cache_[random_generator_.random_between<size_t>(0, round_robin_cache_.size())];
+  return get_node_by_hash_code(flat_hash_integer(static_cast<uint64_t>(key)), policy);
 }
 
-LIBATAPP_MACRO_API etcd_discovery_node::ptr_t etcd_discovery_set::get_node_by_round_robin() const {
-  if (round_robin_cache_.empty()) {
+LIBATAPP_MACRO_API etcd_discovery_node::ptr_t etcd_discovery_set::get_node_by_consistent_hash(
+    const std::string &key, etcd_discovery_consistent_hash_policy_t::type policy) const {
+  return get_node_by_consistent_hash(key.c_str(), key.size(), policy);
+}
+
+etcd_discovery_node::ptr_t etcd_discovery_set::get_node_by_hash_code(
+    uint64_t hash_key, etcd_discovery_consistent_hash_policy_t::type policy) const {
+  if (hashing_keys_.empty()) {
     rebuild_cache();
   }
 
-  if (round_robin_cache_.empty()) {
+  if (hashing_keys_.empty()) {
     return NULL;
   }
 
-  if (round_robin_index_ >= round_robin_cache_.size()) {
-    round_robin_index_ %= round_robin_cache_.size();
-  }
+  if (etcd_discovery_consistent_hash_policy_t::EN_CHP_MAGLEV == policy) {
+    if (maglev_table_.empty()) {
+      rebuild_maglev_cache();
+    }
 
-  return round_robin_cache_[round_robin_index_++];
-}
+    if (maglev_table_.empty()) {
+      return NULL;
+    }
 
-LIBATAPP_MACRO_API const std::vector<etcd_discovery_node::ptr_t> &etcd_discovery_set::get_sorted_nodes() const {
-  if (round_robin_cache_.empty()) {
-    rebuild_cache();
+    // Map hash_key into [0, table size) by multiply and shift instead of modulo
+    uint64_t slot = ((hash_key >> 32) * static_cast<uint64_t>(maglev_table_.size())) >> 32;
+    return round_robin_cache_[maglev_table_[static_cast<size_t>(slot)]];
   }
 
-  return round_robin_cache_;
-}
-
-LIBATAPP_MACRO_API std::vector<etcd_discovery_node::ptr_t>::const_iterator etcd_discovery_set::lower_bound_sorted_nodes(
-    uint64_t id, const std::string &name) const {
-  const std::vector<etcd_discovery_node::ptr_t> &container = get_sorted_nodes();
+  if (etcd_discovery_consistent_hash_policy_t::EN_CHP_JUMP == policy) {
+    if (round_robin_cache_.empty()) {
+      return NULL;
+    }
 
-  lower_upper_bound_pred_t pred_val;
-  pred_val.id = id;
-  pred_val.name = &name;
-  if (!name.empty()) {
-    pred_val.hash_code = consistent_hash_calc(name.c_str(), name.size(), LIBATAPP_MACRO_HASH_MAGIC_NUMBER);
-  } else {
-    pred_val.hash_code = std::pair<uint64_t, uint64_t>(0, 0);
+    return round_robin_cache_[consistent_hash_jump(hash_key, round_robin_cache_.size())];
   }
 
-  return std::lower_bound(container.begin(), container.end(), pred_val, lower_bound_compare_index);
-}
+  if (etcd_discovery_consistent_hash_policy_t::EN_CHP_RENDEZVOUS == policy) {
+    if (rendezvous_seeds_.empty()) {
+      rebuild_rendezvous_cache();
+    }
 
-LIBATAPP_MACRO_API std::vector<etcd_discovery_node::ptr_t>::const_iterator etcd_discovery_set::upper_bound_sorted_nodes(
-    uint64_t id, const std::string &name) const {
-  const std::vector<etcd_discovery_node::ptr_t> &container = get_sorted_nodes();
+    if (rendezvous_seeds_.empty()) {
+      return NULL;
+    }
 
-  lower_upper_bound_pred_t pred_val;
-  pred_val.id = id;
-  pred_val.name = &name;
-  if (!name.empty()) {
-    pred_val.hash_code = consistent_hash_calc(name.c_str(), name.size(), LIBATAPP_MACRO_HASH_MAGIC_NUMBER);
-  } else {
-    pred_val.hash_code = std::pair<uint64_t, uint64_t>(0, 0);
+    return round_robin_cache_[consistent_hash_rendezvous_select(&rendezvous_seeds_[0], rendezvous_seeds_.size(),
+                                                                hash_key)];
   }
 
-  return std::upper_bound(container.begin(), container.end(), pred_val, upper_bound_compare_index);
+  // Slot 0 means all keys are less than hash_key, wrap around to the node of smallest key
+  return hashing_nodes_[hashing_node_index_[consistent_hash_eytzinger_lower_bound(hashing_keys_, hash_key)]];
 }
 
-LIBATAPP_MACRO_API void etcd_discovery_set::add_node(const etcd_discovery_node::ptr_t &node) {
-  if (!node) {
-    return;
+void etcd_discovery_set::get_node_by_hash_code_batch(std::vector<std::pair<uint64_t, size_t> > &hash_codes,
+                                                     etcd_discovery_node::ptr_t *out,
+                                                     etcd_discovery_consistent_hash_policy_t::type policy) const {
+  if (hashing_keys_.empty()) {
+    rebuild_cache();
   }
 
-  bool has_insert = false;
-  std::string old_name;
-  uint64_t old_id = 0;
-
-  // Insert into id index if id != 0
-  if (0 != node->get_discovery_info().id()) {
-    node_by_id_t::iterator iter_id = node_by_id_.find(node->get_discovery_info().id());
-    if (iter_id == node_by_id_.end()) {
-      node_by_id_[node->get_discovery_info().id()] = node;
-      has_insert = true;
-    } else if (iter_id->second != node) {
-      // name change and remove node of old name
-      if (iter_id->second->get_discovery_info().name() != node->get_discovery_info().name()) {
-        old_name = iter_id->second->get_discovery_info().name();
-      }
-
-      // Remove old first, because directly change value of shared_ptr is not thread-safe
-      iter_id->second.reset();
-      iter_id->second = node;
-      has_insert = true;
+  // Only hash ring can be merged, the other policies are already O(1) or have no order of hash codes
+  size_t keys_size = hashing_keys_.size();
+  if (hashing_keys_.empty() || etcd_discovery_consistent_hash_policy_t::EN_CHP_MAGLEV == policy ||
+      etcd_discovery_consistent_hash_policy_t::EN_CHP_JUMP == policy ||
+      etcd_discovery_consistent_hash_policy_t::EN_CHP_RENDEZVOUS == policy) {
+    for (size_t i = 0; i < hash_codes.size(); ++i) {
+      out[hash_codes[i].second] = get_node_by_hash_code(hash_codes[i].first, policy);
     }
+    return;
   }
 
-  // Insert into name index if name().empty() != true
-  if (!node->get_discovery_info().name().empty()) {
-    node_by_name_t::iterator iter_name = node_by_name_.find(node->get_discovery_info().name());
-    if (iter_name == node_by_name_.end()) {
-      node_by_name_[node->get_discovery_info().name()] = node;
-      has_insert = true;
-    } else if (iter_name->second != node) {
-      // id change and remove node of old id
-      if (iter_name->second->get_discovery_info().id() != node->get_discovery_info().id()) {
-        old_id = iter_name->second->get_discovery_info().id();
-      }
-
-      // Remove old first, because directly change value of shared_ptr is not thread-safe
-      iter_name->second.reset();
-      iter_name->second = node;
-      has_insert = true;
+  // Searching a small ring in cache is faster than sorting hash codes, and sweeping the whole ring costs more than
+  // searching each key when there are only a few keys
+  if (keys_size < 32768 || hash_codes.size() * 16 < keys_size) {
+    for (size_t i = 0; i < hash_codes.size(); ++i) {
+      size_t slot = consistent_hash_eytzinger_lower_bound(hashing_keys_, hash_codes[i].first);
+      out[hash_codes[i].second] = hashing_nodes_[hashing_node_index_[slot]];
     }
+    return;
   }
 
-  if (has_insert) {
-    if (0 != old_id) {
-      node_by_id_t::iterator iter_id = node_by_id_.find(old_id);
-      if (iter_id != node_by_id_.end() && iter_id->second != node) {
-        node_by_id_.erase(iter_id);
-      }
-    }
-
-    if (!old_name.empty()) {
-      node_by_name_t::iterator iter_name = node_by_name_.find(old_name);
-      if (iter_name != node_by_name_.end() && iter_name->second != node) {
-        node_by_name_.erase(iter_name);
-      }
+  // Walk the ring in sorted order of Eytzinger layout together with sorted hash codes
+  consistent_hash_sort_codes(hash_codes);
+  size_t slot = consistent_hash_eytzinger_first_slot(keys_size);
+  size_t passed = 0;
+  for (size_t i = 0; i < hash_codes.size(); ++i) {
+    while (passed + 1 < keys_size && hashing_keys_[slot] < hash_codes[i].first) {
+      slot = consistent_hash_eytzinger_next_slot(slot, keys_size);
+      ++passed;
     }
 
-    clear_cache();
+    // Slot 0 means all keys are less than hash code, wrap around to the node of smallest key
+    out[hash_codes[i].second] = hashing_nodes_[hashing_node_index_[passed + 1 < keys_size ? slot : 0]];
   }
 }
 
-LIBATAPP_MACRO_API void etcd_discovery_set::remove_node(const etcd_discovery_node::ptr_t &node) {
-  if (!node) {
+LIBATAPP_MACRO_API size_t etcd_discovery_set::get_nodes_by_consistent_hash(
+    const void *buf, size_t bufsz, size_t n, std::vector<etcd_discovery_node::ptr_t> &out) const {
+  if (0 == n) {
+    return 0;
+  }
+
+  if (hashing_keys_.empty()) {
+    rebuild_cache();
+  }
+
+  if (hashing_keys_.empty()) {
+    return 0;
+  }
+
+  uint64_t hash_key = consistent_hash_calc(buf, bufsz, LIBATAPP_MACRO_HASH_MAGIC_NUMBER).first;
+  size_t keys_size = hashing_keys_.size();
+  size_t slot = consistent_hash_eytzinger_lower_bound(hashing_keys_, hash_key);
+  if (0 == slot) {
+    slot = consistent_hash_eytzinger_first_slot(keys_size);
+  }
+
+  size_t node_count = hashing_nodes_.size() - hashing_free_nodes_.size();
+  if (n > node_count) {
+    n = node_count;
+  }
+
+  // Walk clockwise and skip duplicated nodes
+  std::vector<bool> checked;
+  checked.resize(hashing_nodes_.size(), false);
+  size_t ret = 0;
+  for (size_t i = 1; i < keys_size && ret < n; ++i) {
+    uint32_t node_index = hashing_node_index_[slot];
+    if (!checked[node_index]) {
+      checked[node_index] = true;
+      out.push_back(hashing_nodes_[node_index]);
+      ++ret;
+    }
+
+    slot = consistent_hash_eytzinger_next_slot(slot, keys_size);
+  }
+
+  return ret;
+}
+
+LIBATAPP_MACRO_API size_t etcd_discovery_set::get_nodes_by_consistent_hash(
+    uint64_t key, size_t n, std::vector<etcd_discovery_node::ptr_t> &out) const {
+  return get_nodes_by_consistent_hash(&key, sizeof(key), n, out);
+}
+
+LIBATAPP_MACRO_API size_t etcd_discovery_set::get_nodes_by_consistent_hash(
+    int64_t key, size_t n, std::vector<etcd_discovery_node::ptr_t> &out) const {
+  return get_nodes_by_consistent_hash(&key, sizeof(key), n, out);
+}
+
+LIBATAPP_MACRO_API size_t etcd_discovery_set::get_nodes_by_consistent_hash(
+    const std::string &key, size_t n, std::vector<etcd_discovery_node::ptr_t> &out) const {
+  return get_nodes_by_consistent_hash(key.c_str(), key.size(), n, out);
+}
+
+LIBATAPP_MACRO_API void etcd_discovery_set::get_node_by_consistent_hash_batch(
+    const uint64_t *keys, size_t count, std::vector<etcd_discovery_node::ptr_t> &out,
+    etcd_discovery_consistent_hash_policy_t::type policy) const {
+  if (0 == count) {
+    return;
+  }
+
+  // The same hash codes as get_node_by_consistent_hash(uint64_t, policy)
+  std::vector<std::pair<uint64_t, size_t> > hash_codes;
+  hash_codes.resize(count);
+  if (etcd_discovery_consistent_hash_policy_t::EN_CHP_RING == policy) {
+    for (size_t i = 0; i < count; ++i) {
+      hash_codes[i].first = consistent_hash_calc(&keys[i], sizeof(keys[i]), LIBATAPP_MACRO_HASH_MAGIC_NUMBER).first;
+      hash_codes[i].second = i;
+    }
+  } else {
+    for (size_t i = 0; i < count; ++i) {
+      hash_codes[i].first = flat_hash_integer(keys[i]);
+      hash_codes[i].second = i;
+    }
+  }
+
+  size_t offset = out.size();
+  out.resize(offset + count);
+  get_node_by_hash_code_batch(hash_codes, &out[offset], policy);
+}
+
+LIBATAPP_MACRO_API void etcd_discovery_set::get_node_by_consistent_hash_batch(
+    const int64_t *keys, size_t count, std::vector<etcd_discovery_node::ptr_t> &out,
+    etcd_discovery_consistent_hash_policy_t::type policy) const {
+  // Both of murmur3 and splitmix64 use the same bits of signed and unsigned keys
+  get_node_by_consistent_hash_batch(reinterpret_cast<const uint64_t *>(keys), count, out, policy);
+}
+
+LIBATAPP_MACRO_API void etcd_discovery_set::get_node_by_consistent_hash_batch(
+    const std::string *keys, size_t count, std::vector<etcd_discovery_node::ptr_t> &out,
+    etcd_discovery_consistent_hash_policy_t::type policy) const {
+  if (0 == count) {
+    return;
+  }
+
+  std::vector<std::pair<uint64_t, size_t> > hash_codes;
+  hash_codes.resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    hash_codes[i].first =
+        consistent_hash_calc(keys[i].c_str(), keys[i].size(), LIBATAPP_MACRO_HASH_MAGIC_NUMBER).first;
+    hash_codes[i].second = i;
+  }
+
+  size_t offset = out.size();
+  out.resize(offset + count);
+  get_node_by_hash_code_batch(hash_codes, &out[offset], policy);
+}
+
+LIBATAPP_MACRO_API etcd_discovery_node::ptr_t etcd_discovery_set::get_node_by_consistent_hash_bounded(
+    const void *buf, size_t bufsz, uint64_t max_load, const node_load_fn_t &load_fn) const {
+  if (hashing_keys_.empty()) {
+    rebuild_cache();
+  }
+
+  if (hashing_keys_.empty()) {
+    return NULL;
+  }
+
+  uint64_t hash_key = consistent_hash_calc(buf, bufsz, LIBATAPP_MACRO_HASH_MAGIC_NUMBER).first;
+  if (!load_fn) {
+    return hashing_nodes_[hashing_node_index_[consistent_hash_eytzinger_lower_bound(hashing_keys_, hash_key)]];
+  }
+
+  return hashing_nodes_[get_node_index_by_consistent_hash_bounded(hash_key, max_load, &load_fn)];
+}
+
+LIBATAPP_MACRO_API etcd_discovery_node::ptr_t etcd_discovery_set::assign_node_by_consistent_hash_bounded(
+    const void *buf, size_t bufsz, uint64_t load_factor, uint64_t decay_epoch) const {
+  if (hashing_keys_.empty()) {
+    rebuild_cache();
+  }
+
+  if (hashing_keys_.empty()) {
+    return NULL;
+  }
+
+  if (load_factor < 100) {
+    load_factor = 100;
+  }
+  decay_assigned_loads(decay_epoch);
+
+  uint64_t node_count = static_cast<uint64_t>(hashing_nodes_.size() - hashing_free_nodes_.size());
+  uint64_t max_load = ((hashing_total_load_ + 1) * load_factor + node_count * 100 - 1) / (node_count * 100);
+  uint64_t hash_key = consistent_hash_calc(buf, bufsz, LIBATAPP_MACRO_HASH_MAGIC_NUMBER).first;
+  uint32_t node_index = get_node_index_by_consistent_hash_bounded(hash_key, max_load, NULL);
+
+  ++hashing_node_loads_[node_index];
+  ++hashing_total_load_;
+  return hashing_nodes_[node_index];
+}
+
+uint32_t etcd_discovery_set::get_node_index_by_consistent_hash_bounded(uint64_t hash_key, uint64_t max_load,
+                                                                       const node_load_fn_t *load_fn) const {
+  size_t keys_size = hashing_keys_.size();
+  size_t slot = consistent_hash_eytzinger_lower_bound(hashing_keys_, hash_key);
+  if (0 == slot) {
+    slot = consistent_hash_eytzinger_first_slot(keys_size);
+  }
+
+  uint32_t first_index = hashing_node_index_[slot];
+  if ((NULL == load_fn ? hashing_node_loads_[first_index] : (*load_fn)(*hashing_nodes_[first_index])) < max_load) {
+    return first_index;
+  }
+
+  // Walk clockwise and check every node only once
+  std::vector<bool> checked;
+  checked.resize(hashing_nodes_.size(), false);
+  checked[first_index] = true;
+  size_t left_nodes = hashing_nodes_.size() - hashing_free_nodes_.size() - 1;
+  for (size_t i = 1; i + 1 < keys_size && left_nodes > 0; ++i) {
+    slot = consistent_hash_eytzinger_next_slot(slot, keys_size);
+    uint32_t node_index = hashing_node_index_[slot];
+    if (checked[node_index]) {
+      continue;
+    }
+    checked[node_index] = true;
+    --left_nodes;
+
+    if ((NULL == load_fn ? hashing_node_loads_[node_index] : (*load_fn)(*hashing_nodes_[node_index])) < max_load) {
+      return node_index;
+    }
+  }
+
+  return first_index;
+}
+
+void etcd_discovery_set::decay_assigned_loads(uint64_t decay_epoch) const {
+  if (decay_epoch <= hashing_load_epoch_) {
     return;
   }
 
+  // Halve loads once for every passed epoch, the total is summed again to drop rounding errors
+  uint64_t shift = decay_epoch - hashing_load_epoch_;
+  hashing_load_epoch_ = decay_epoch;
+  if (0 == hashing_total_load_) {
+    return;
+  }
+
+  hashing_total_load_ = 0;
+  for (size_t i = 0; i < hashing_node_loads_.size(); ++i) {
+    hashing_node_loads_[i] = shift >= 64 ? 0 : (hashing_node_loads_[i] >> shift);
+    hashing_total_load_ += hashing_node_loads_[i];
+  }
+}
+
+LIBATAPP_MACRO_API etcd_discovery_node::ptr_t etcd_discovery_set::get_node_by_random() const {
+  if (round_robin_cache_.empty()) {
+    rebuild_cache();
+  }
+
+  if (round_robin_cache_.empty()) {
+    return NULL;
+  }
+
+  return round_robin_cache_[random_generator_.random_between<size_t>(0, round_robin_cache_.size())];
+}
+
+LIBATAPP_MACRO_API etcd_discovery_node::ptr_t etcd_discovery_set::get_node_by_round_robin() const {
+  if (round_robin_cache_.empty()) {
+    rebuild_cache();
+  }
+
+  if (round_robin_cache_.empty()) {
+    return NULL;
+  }
+
+  if (round_robin_index_ >= round_robin_cache_.size()) {
+    round_robin_index_ %= round_robin_cache_.size();
+  }
+
+  return round_robin_cache_[round_robin_index_++];
+}
+
+LIBATAPP_MACRO_API etcd_discovery_node::ptr_t etcd_discovery_set::get_node_by_p2c(const node_load_fn_t &load_fn) const {
+  if (round_robin_cache_.empty()) {
+    rebuild_cache();
+  }
+
+  size_t node_count = round_robin_cache_.size();
+  if (0 == node_count) {
+    return NULL;
+  }
+
+  if (1 == node_count) {
+    return round_robin_cache_[0];
+  }
+
+  // Pick two different nodes
+  size_t first = random_generator_.random_between<size_t>(0, node_count);
+  size_t second = random_generator_.random_between<size_t>(0, node_count - 1);
+  if (second >= first) {
+    ++second;
+  }
+
+  const etcd_discovery_node::ptr_t &l = round_robin_cache_[first];
+  const etcd_discovery_node::ptr_t &r = round_robin_cache_[second];
+  uint64_t l_load;
+  uint64_t r_load;
+  if (load_fn) {
+    l_load = load_fn(*l);
+    r_load = load_fn(*r);
+  } else {
+    l_load = l->get_discovery_info().load_score();
+    r_load = r->get_discovery_info().load_score();
+  }
+
+  return r_load < l_load ? r : l;
+}
+
+LIBATAPP_MACRO_API const etcd_discovery_set *etcd_discovery_set::get_locality_set(
+    const atapp::protocol::atapp_area &area, etcd_discovery_locality_t::type locality) const {
+  std::string key;
+  if (!locality_make_key(area, locality, key)) {
+    return NULL;
+  }
+
+  if (!locality_sets_enabled_) {
+    rebuild_locality_sets();
+  }
+
+  locality_set_map_t::const_iterator iter = locality_sets_.find(key);
+  if (iter == locality_sets_.end() || !iter->second || iter->second->empty()) {
+    return NULL;
+  }
+
+  return iter->second.get();
+}
+
+LIBATAPP_MACRO_API etcd_discovery_node::ptr_t etcd_discovery_set::get_node_by_random(
+    const atapp::protocol::atapp_area &area, uint32_t spill_over_percent) const {
+  uint64_t spill_over_seed = 0;
+  if (spill_over_percent > 0) {
+    spill_over_seed = random_generator_.random_between<uint64_t>(0, 100);
+  }
+
+  return select_locality_set(area, spill_over_percent, spill_over_seed).get_node_by_random();
+}
+
+LIBATAPP_MACRO_API etcd_discovery_node::ptr_t etcd_discovery_set::get_node_by_round_robin(
+    const atapp::protocol::atapp_area &area, uint32_t spill_over_percent) const {
+  uint64_t spill_over_seed = 0;
+  if (spill_over_percent > 0) {
+    spill_over_seed = random_generator_.random_between<uint64_t>(0, 100);
+  }
+
+  return select_locality_set(area, spill_over_percent, spill_over_seed).get_node_by_round_robin();
+}
+
+LIBATAPP_MACRO_API etcd_discovery_node::ptr_t etcd_discovery_set::get_node_by_consistent_hash(
+    const void *buf, size_t bufsz, const atapp::protocol::atapp_area &area, uint32_t spill_over_percent) const {
+  uint64_t spill_over_seed = 0;
+  if (spill_over_percent > 0) {
+    spill_over_seed = flat_hash_integer(flat_hash_bytes(buf, bufsz));
+  }
+
+  return select_locality_set(area, spill_over_percent, spill_over_seed).get_node_by_consistent_hash(buf, bufsz);
+}
+
+LIBATAPP_MACRO_API etcd_discovery_node::ptr_t etcd_discovery_set::get_node_by_consistent_hash(
+    uint64_t key, const atapp::protocol::atapp_area &area, uint32_t spill_over_percent) const {
+  uint64_t spill_over_seed = 0;
+  if (spill_over_percent > 0) {
+    spill_over_seed = flat_hash_integer(key);
+  }
+
+  return select_locality_set(area, spill_over_percent, spill_over_seed).get_node_by_consistent_hash(key);
+}
+
+LIBATAPP_MACRO_API etcd_discovery_node::ptr_t etcd_discovery_set::get_node_by_consistent_hash(
+    int64_t key, const atapp::protocol::atapp_area &area, uint32_t spill_over_percent) const {
+  uint64_t spill_over_seed = 0;
+  if (spill_over_percent > 0) {
+    spill_over_seed = flat_hash_integer(static_cast<uint64_t>(key));
+  }
+
+  return select_locality_set(area, spill_over_percent, spill_over_seed).get_node_by_consistent_hash(key);
+}
+
+LIBATAPP_MACRO_API etcd_discovery_node::ptr_t etcd_discovery_set::get_node_by_consistent_hash(
+    const std::string &key, const atapp::protocol::atapp_area &area, uint32_t spill_over_percent) const {
+  return get_node_by_consistent_hash(key.c_str(), key.size(), area, spill_over_percent);
+}
+
+LIBATAPP_MACRO_API etcd_discovery_set::const_ptr_t etcd_discovery_set::select_nodes(
+    const atapp::protocol::atapp_metadata &selector, const std::string &type_name) const {
+  std::vector<std::string> terms;
+  selector_make_terms(type_name, selector, terms);
+
+  // Length prefixed terms as key of cache
+  std::string cache_key;
+  for (size_t i = 0; i < terms.size(); ++i) {
+    uint32_t term_size = static_cast<uint32_t>(terms[i].size());
+    cache_key.append(reinterpret_cast<const char *>(&term_size), sizeof(term_size));
+    cache_key.append(terms[i]);
+  }
+
+  if (!selector_index_enabled_) {
+    rebuild_selector_index();
+  }
+
+  flat_hash_map<std::string, selector_cache_t>::iterator iter_cache = selector_cache_.find(cache_key);
+  if (iter_cache != selector_cache_.end()) {
+    iter_cache->second.last_used = ++selector_cache_clock_;
+    return iter_cache->second.nodes;
+  }
+
+  // Leave one slot for the new result
+  if (selector_cache_.size() >= selector_cache_capacity_) {
+    shrink_selector_cache(selector_cache_capacity_ > 0 ? selector_cache_capacity_ - 1 : 0);
+  }
+
+  selector_cache_t &cache = selector_cache_[cache_key];
+  cache.terms.swap(terms);
+  cache.nodes = std::make_shared<etcd_discovery_set>();
+  cache.last_used = ++selector_cache_clock_;
+
+  if (cache.terms.empty()) {
+    for (node_by_id_t::const_iterator iter = node_by_id_.begin(); iter != node_by_id_.end(); ++iter) {
+      cache.nodes->add_node(iter->second);
+    }
+    for (node_by_name_t::const_iterator iter = node_by_name_.begin(); iter != node_by_name_.end(); ++iter) {
+      cache.nodes->add_node(iter->second);
+    }
+    return cache.nodes;
+  }
+
+  // Intersect posting lists from the shortest one
+  std::vector<const std::vector<etcd_discovery_node::ptr_t> *> posting_lists;
+  posting_lists.reserve(cache.terms.size());
+  for (size_t i = 0; i < cache.terms.size(); ++i) {
+    posting_list_map_t::const_iterator iter = selector_posting_lists_.find(cache.terms[i]);
+    if (iter == selector_posting_lists_.end() || iter->second.empty()) {
+      return cache.nodes;
+    }
+    posting_lists.push_back(&iter->second);
+  }
+  std::sort(posting_lists.begin(), posting_lists.end(),
+            [](const std::vector<etcd_discovery_node::ptr_t> *l, const std::vector<etcd_discovery_node::ptr_t> *r) {
+              return l->size() < r->size();
+            });
+
+  std::vector<etcd_discovery_node::ptr_t> matched = *posting_lists[0];
+  std::vector<etcd_discovery_node::ptr_t> intersection;
+  for (size_t i = 1; i < posting_lists.size() && !matched.empty(); ++i) {
+    intersection.clear();
+    std::set_intersection(matched.begin(), matched.end(), posting_lists[i]->begin(), posting_lists[i]->end(),
+                          std::back_inserter(intersection), round_robin_compare_index);
+    matched.swap(intersection);
+  }
+
+  for (size_t i = 0; i < matched.size(); ++i) {
+    cache.nodes->add_node(matched[i]);
+  }
+
+  return cache.nodes;
+}
+
+LIBATAPP_MACRO_API const std::vector<etcd_discovery_node::ptr_t> &etcd_discovery_set::get_sorted_nodes() const {
+  if (round_robin_cache_.empty()) {
+    rebuild_cache();
+  }
+
+  return round_robin_cache_;
+}
+
+LIBATAPP_MACRO_API std::vector<etcd_discovery_node::ptr_t>::const_iterator etcd_discovery_set::lower_bound_sorted_nodes(
+    uint64_t id, const std::string &name) const {
+  const std::vector<etcd_discovery_node::ptr_t> &container = get_sorted_nodes();
+
+  lower_upper_bound_pred_t pred_val;
+  pred_val.id = id;
+  pred_val.name = &name;
+  if (!name.empty()) {
+    pred_val.hash_code = consistent_hash_calc(name.c_str(), name.size(), LIBATAPP_MACRO_HASH_MAGIC_NUMBER);
+  } else {
+    pred_val.hash_code = std::pair<uint64_t, uint64_t>(0, 0);
+  }
+
+  return std::lower_bound(container.begin(), container.end(), pred_val, lower_bound_compare_index);
+}
+
+LIBATAPP_MACRO_API std::vector<etcd_discovery_node::ptr_t>::const_iterator etcd_discovery_set::upper_bound_sorted_nodes(
+    uint64_t id, const std::string &name) const {
+  const std::vector<etcd_discovery_node::ptr_t> &container = get_sorted_nodes();
+
+  lower_upper_bound_pred_t pred_val;
+  pred_val.id = id;
+  pred_val.name = &name;
+  if (!name.empty()) {
+    pred_val.hash_code = consistent_hash_calc(name.c_str(), name.size(), LIBATAPP_MACRO_HASH_MAGIC_NUMBER);
+  } else {
+    pred_val.hash_code = std::pair<uint64_t, uint64_t>(0, 0);
+  }
+
+  return std::upper_bound(container.begin(), container.end(), pred_val, upper_bound_compare_index);
+}
+
+LIBATAPP_MACRO_API void etcd_discovery_set::enable_snapshot() {
+  snapshot_enabled_ = true;
+  publish_snapshot();
+}
+
+LIBATAPP_MACRO_API void etcd_discovery_set::flush_snapshot() {
+  if (snapshot_enabled_ && snapshot_dirty_) {
+    publish_snapshot();
+  }
+}
+
+LIBATAPP_MACRO_API std::shared_ptr<const etcd_discovery_snapshot> etcd_discovery_set::get_snapshot() const {
+  util::lock::lock_holder<util::lock::spin_lock> holder(snapshot_lock_);
+  return snapshot_;
+}
+
+LIBATAPP_MACRO_API bool etcd_discovery_set::get_diff(uint64_t from_generation, uint64_t to_generation,
+                                                     diff_t &out) const {
+  if (from_generation > to_generation || to_generation > generation_ ||
+      from_generation < change_log_dropped_generation_) {
+    return false;
+  }
+
+  // First and last change of each node in range
+  struct node_change_t {
+    bool first_added;
+    bool last_added;
+  };
+  flat_hash_map<uintptr_t, node_change_t> node_changes;
+  std::vector<etcd_discovery_node::ptr_t> changed_nodes;
+  for (std::deque<change_record_t>::const_iterator iter = change_log_.begin(); iter != change_log_.end(); ++iter) {
+    if (iter->generation <= from_generation) {
+      continue;
+    }
+    if (iter->generation > to_generation) {
+      break;
+    }
+
+    flat_hash_map<uintptr_t, node_change_t>::iterator iter_change =
+        node_changes.find(reinterpret_cast<uintptr_t>(iter->node.get()));
+    if (iter_change == node_changes.end()) {
+      node_change_t &change = node_changes[reinterpret_cast<uintptr_t>(iter->node.get())];
+      change.first_added = iter->added;
+      change.last_added = iter->added;
+      changed_nodes.push_back(iter->node);
+    } else {
+      iter_change->second.last_added = iter->added;
+    }
+  }
+
+  std::vector<etcd_discovery_node::ptr_t> added;
+  flat_hash_map<uint64_t, size_t> removed_by_id;
+  flat_hash_map<std::string, size_t> removed_by_name;
+  std::vector<etcd_discovery_node::ptr_t> removed;
+  for (size_t i = 0; i < changed_nodes.size(); ++i) {
+    const node_change_t &change = node_changes[reinterpret_cast<uintptr_t>(changed_nodes[i].get())];
+    // Nodes exist or not exist at both of the beginning and the end are not changed
+    if (change.first_added != change.last_added) {
+      continue;
+    }
+
+    if (change.last_added) {
+      added.push_back(changed_nodes[i]);
+      continue;
+    }
+
+    const atapp::protocol::atapp_discovery &info = changed_nodes[i]->get_discovery_info();
+    if (0 != info.id()) {
+      removed_by_id[info.id()] = removed.size();
+    }
+    if (!info.name().empty()) {
+      removed_by_name[info.name()] = removed.size();
+    }
+    removed.push_back(changed_nodes[i]);
+  }
+
+  // A removed node and an added node with the same id or name is an update
+  std::vector<bool> replaced;
+  replaced.resize(removed.size(), false);
+  for (size_t i = 0; i < added.size(); ++i) {
+    const atapp::protocol::atapp_discovery &info = added[i]->get_discovery_info();
+    size_t removed_index = removed.size();
+    if (0 != info.id()) {
+      flat_hash_map<uint64_t, size_t>::const_iterator iter_id = removed_by_id.find(info.id());
+      if (iter_id != removed_by_id.end() && !replaced[iter_id->second]) {
+        removed_index = iter_id->second;
+      }
+    }
+    if (removed_index >= removed.size() && !info.name().empty()) {
+      flat_hash_map<std::string, size_t>::const_iterator iter_name = removed_by_name.find(info.name());
+      if (iter_name != removed_by_name.end() && !replaced[iter_name->second]) {
+        removed_index = iter_name->second;
+      }
+    }
+
+    if (removed_index < removed.size()) {
+      replaced[removed_index] = true;
+      out.updated.push_back(std::make_pair(removed[removed_index], added[i]));
+    } else {
+      out.added.push_back(added[i]);
+    }
+  }
+
+  for (size_t i = 0; i < removed.size(); ++i) {
+    if (!replaced[i]) {
+      out.removed.push_back(removed[i]);
+    }
+  }
+
+  return true;
+}
+
+LIBATAPP_MACRO_API bool etcd_discovery_set::get_diff(uint64_t from_generation, diff_t &out) const {
+  return get_diff(from_generation, generation_, out);
+}
+
+LIBATAPP_MACRO_API void etcd_discovery_set::set_change_log_capacity(size_t capacity) {
+  change_log_capacity_ = capacity;
+  while (change_log_.size() > change_log_capacity_) {
+    change_log_dropped_generation_ = change_log_.front().generation;
+    change_log_.pop_front();
+  }
+}
+
+LIBATAPP_MACRO_API void etcd_discovery_set::set_selector_cache_capacity(size_t capacity) {
+  selector_cache_capacity_ = capacity;
+  shrink_selector_cache(selector_cache_capacity_);
+}
+
+LIBATAPP_MACRO_API void etcd_discovery_set::add_node(const etcd_discovery_node::ptr_t &node) {
+  if (!node) {
+    return;
+  }
+
+  // Nodes whose membership of indexes may be changed, at most the new node and two replaced nodes
+  std::vector<etcd_discovery_node::ptr_t> changed_nodes;
+  changed_nodes.reserve(3);
+  if (add_node_index(node, changed_nodes)) {
+    record_changes(&changed_nodes[0], changed_nodes.size());
+    update_cache(&changed_nodes[0], changed_nodes.size());
+  }
+}
+
+LIBATAPP_MACRO_API void etcd_discovery_set::remove_node(const etcd_discovery_node::ptr_t &node) {
+  if (node && remove_node_index(node)) {
+    record_changes(&node, 1);
+    update_cache(&node, 1);
+  }
+}
+
+LIBATAPP_MACRO_API void etcd_discovery_set::update_nodes(const std::vector<etcd_discovery_node::ptr_t> &removed,
+                                                         const std::vector<etcd_discovery_node::ptr_t> &added) {
+  // Nodes removed and then added again are not changed
+  std::vector<etcd_discovery_node::ptr_t> sorted_added = added;
+  std::sort(sorted_added.begin(), sorted_added.end(), update_nodes_compare_ptr);
+
+  std::vector<etcd_discovery_node::ptr_t> changed_nodes;
+  changed_nodes.reserve(removed.size() + added.size());
+  for (size_t i = 0; i < removed.size(); ++i) {
+    if (!removed[i] ||
+        std::binary_search(sorted_added.begin(), sorted_added.end(), removed[i], update_nodes_compare_ptr)) {
+      continue;
+    }
+    if (remove_node_index(removed[i])) {
+      changed_nodes.push_back(removed[i]);
+    }
+  }
+
+  for (size_t i = 0; i < added.size(); ++i) {
+    if (added[i]) {
+      add_node_index(added[i], changed_nodes);
+    }
+  }
+
+  if (changed_nodes.empty()) {
+    return;
+  }
+
+  // Caches require unique changed nodes
+  std::sort(changed_nodes.begin(), changed_nodes.end(), update_nodes_compare_ptr);
+  changed_nodes.erase(std::unique(changed_nodes.begin(), changed_nodes.end()), changed_nodes.end());
+
+  record_changes(&changed_nodes[0], changed_nodes.size());
+  update_cache(&changed_nodes[0], changed_nodes.size());
+}
+
+bool etcd_discovery_set::add_node_index(const etcd_discovery_node::ptr_t &node,
+                                        std::vector<etcd_discovery_node::ptr_t> &changed_nodes) {
+  bool has_insert = false;
+  std::string old_name;
+  uint64_t old_id = 0;
+  size_t changed_offset = changed_nodes.size();
+  changed_nodes.push_back(node);
+
+  // Insert into id index if id != 0
+  if (0 != node->get_discovery_info().id()) {
+    node_by_id_t::iterator iter_id = node_by_id_.find(node->get_discovery_info().id());
+    if (iter_id == node_by_id_.end()) {
+      node_by_id_[node->get_discovery_info().id()] = node;
+      has_insert = true;
+    } else if (iter_id->second != node) {
+      // name change and remove node of old name
+      if (iter_id->second->get_discovery_info().name() != node->get_discovery_info().name()) {
+        old_name = iter_id->second->get_discovery_info().name();
+      }
+
+      changed_nodes.push_back(iter_id->second);
+      // Remove old first, because directly change value of shared_ptr is not thread-safe
+      iter_id->second.reset();
+      iter_id->second = node;
+      has_insert = true;
+    }
+  }
+
+  // Insert into name index if name().empty() != true
+  if (!node->get_discovery_info().name().empty()) {
+    node_by_name_t::iterator iter_name = node_by_name_.find(node->get_discovery_info().name());
+    if (iter_name == node_by_name_.end()) {
+      node_by_name_[node->get_discovery_info().name()] = node;
+      has_insert = true;
+    } else if (iter_name->second != node) {
+      // id change and remove node of old id
+      if (iter_name->second->get_discovery_info().id() != node->get_discovery_info().id()) {
+        old_id = iter_name->second->get_discovery_info().id();
+      }
+
+      if (changed_nodes.end() ==
+          std::find(changed_nodes.begin() + static_cast<std::ptrdiff_t>(changed_offset), changed_nodes.end(),
+                    iter_name->second)) {
+        changed_nodes.push_back(iter_name->second);
+      }
+      // Remove old first, because directly change value of shared_ptr is not thread-safe
+      iter_name->second.reset();
+      iter_name->second = node;
+      has_insert = true;
+    }
+  }
+
+  if (has_insert) {
+    if (0 != old_id) {
+      node_by_id_t::iterator iter_id = node_by_id_.find(old_id);
+      if (iter_id != node_by_id_.end() && iter_id->second != node) {
+        node_by_id_.erase(iter_id);
+      }
+    }
+
+    if (!old_name.empty()) {
+      node_by_name_t::iterator iter_name = node_by_name_.find(old_name);
+      if (iter_name != node_by_name_.end() && iter_name->second != node) {
+        node_by_name_.erase(iter_name);
+      }
+    }
+  } else {
+    changed_nodes.resize(changed_offset);
+  }
+
+  return has_insert;
+}
+
+bool etcd_discovery_set::remove_node_index(const etcd_discovery_node::ptr_t &node) {
   bool has_cleanup = false;
   if (!node->get_discovery_info().name().empty()) {
     node_by_name_t::iterator iter_name = node_by_name_.find(node->get_discovery_info().name());
@@ -384,9 +1499,7 @@ LIBATAPP_MACRO_API void etcd_discovery_set::remove_node(const etcd_discovery_nod
     }
   }
 
-  if (has_cleanup) {
-    clear_cache();
-  }
+  return has_cleanup;
 }
 
 LIBATAPP_MACRO_API void etcd_discovery_set::remove_node(uint64_t id) {
@@ -395,16 +1508,18 @@ LIBATAPP_MACRO_API void etcd_discovery_set::remove_node(uint64_t id) {
     return;
   }
 
-  if (iter_id->second && !iter_id->second->get_discovery_info().name().empty()) {
-    node_by_name_t::iterator iter_name = node_by_name_.find(iter_id->second->get_discovery_info().name());
-    if (iter_name != node_by_name_.end() && iter_name->second == iter_id->second) {
+  etcd_discovery_node::ptr_t node = iter_id->second;
+  if (node && !node->get_discovery_info().name().empty()) {
+    node_by_name_t::iterator iter_name = node_by_name_.find(node->get_discovery_info().name());
+    if (iter_name != node_by_name_.end() && iter_name->second == node) {
       node_by_name_.erase(iter_name);
     }
   }
 
   node_by_id_.erase(iter_id);
 
-  clear_cache();
+  record_changes(&node, 1);
+  update_cache(&node, 1);
 }
 
 LIBATAPP_MACRO_API void etcd_discovery_set::remove_node(const std::string &name) {
@@ -413,22 +1528,24 @@ LIBATAPP_MACRO_API void etcd_discovery_set::remove_node(const std::string &name)
     return;
   }
 
-  if (iter_name->second && 0 != iter_name->second->get_discovery_info().id()) {
-    node_by_id_t::iterator iter_id = node_by_id_.find(iter_name->second->get_discovery_info().id());
-    if (iter_id != node_by_id_.end() && iter_name->second == iter_id->second) {
+  etcd_discovery_node::ptr_t node = iter_name->second;
+  if (node && 0 != node->get_discovery_info().id()) {
+    node_by_id_t::iterator iter_id = node_by_id_.find(node->get_discovery_info().id());
+    if (iter_id != node_by_id_.end() && node == iter_id->second) {
       node_by_id_.erase(iter_id);
     }
   }
 
   node_by_name_.erase(iter_name);
 
-  clear_cache();
+  record_changes(&node, 1);
+  update_cache(&node, 1);
 }
 
 void etcd_discovery_set::rebuild_cache() const {
   using std::max;
 
-  if (!hashing_cache_.empty()) {
+  if (!hashing_keys_.empty()) {
     return;
   }
 
@@ -438,44 +1555,543 @@ void etcd_discovery_set::rebuild_cache() const {
 
   clear_cache();
 
+  std::vector<consistent_hash_point_t> points;
+  flat_hash_map<uint64_t, uint32_t> node_index_by_id;
   round_robin_cache_.reserve(max(node_by_id_.size(), node_by_name_.size()));
-  hashing_cache_.reserve(max(node_by_id_.size(), node_by_name_.size()) * node_hash_t::HASH_POINT_PER_INS);
+  hashing_nodes_.reserve(max(node_by_id_.size(), node_by_name_.size()));
+  points.reserve(max(node_by_id_.size(), node_by_name_.size()) * node_hash_t::HASH_POINT_PER_INS);
+  node_index_by_id.reserve(node_by_id_.size());
 
   for (node_by_id_t::const_iterator iter = node_by_id_.begin(); iter != node_by_id_.end(); ++iter) {
     round_robin_cache_.push_back(iter->second);
 
-    for (size_t i = 0; i < node_hash_t::HASH_POINT_PER_INS / 2; ++i) {
-      node_hash_t hash_node;
-      hash_node.node = iter->second;
-      uint64_t key = iter->second->get_discovery_info().id();
-      hash_node.hash_code = consistent_hash_calc(&key, sizeof(key), static_cast<uint32_t>(i));
+    uint32_t node_index = static_cast<uint32_t>(hashing_nodes_.size());
+    hashing_nodes_.push_back(iter->second);
+    node_index_by_id[iter->first] = node_index;
 
-      hashing_cache_.push_back(hash_node);
-    }
+    uint64_t key = iter->second->get_discovery_info().id();
+    consistent_hash_append_points(points, &key, sizeof(key), node_index, consistent_hash_point_count(*iter->second));
   }
 
   for (node_by_name_t::const_iterator iter = node_by_name_.begin(); iter != node_by_name_.end(); ++iter) {
+    uint64_t id = iter->second->get_discovery_info().id();
     // If already pushed by id, skip round robin cache
-    if (0 == iter->second->get_discovery_info().id()) {
+    if (0 == id) {
       round_robin_cache_.push_back(iter->second);
     }
 
-    for (size_t i = 0; i < node_hash_t::HASH_POINT_PER_INS / 2; ++i) {
-      node_hash_t hash_node;
-      hash_node.node = iter->second;
-      const std::string &name = iter->second->get_discovery_info().name();
-      hash_node.hash_code = consistent_hash_calc(name.c_str(), name.size(), static_cast<uint32_t>(i));
-
-      hashing_cache_.push_back(hash_node);
+    // Share the node slot if it's also in id index
+    uint32_t node_index = static_cast<uint32_t>(hashing_nodes_.size());
+    flat_hash_map<uint64_t, uint32_t>::const_iterator iter_index = node_index_by_id.find(id);
+    if (0 != id && iter_index != node_index_by_id.end() && hashing_nodes_[iter_index->second] == iter->second) {
+      node_index = iter_index->second;
+    } else {
+      hashing_nodes_.push_back(iter->second);
     }
+
+    const std::string &name = iter->second->get_discovery_info().name();
+    consistent_hash_append_points(points, name.c_str(), name.size(), node_index,
+                                  consistent_hash_point_count(*iter->second));
   }
 
   std::sort(round_robin_cache_.begin(), round_robin_cache_.end(), round_robin_compare_index);
-  std::sort(hashing_cache_.begin(), hashing_cache_.end(), consistent_hash_compare_index);
+  std::sort(points.begin(), points.end(), consistent_hash_point_compare_t(hashing_nodes_));
+  consistent_hash_assign_points(points, hashing_keys_, hashing_node_index_);
+  hashing_node_loads_.resize(hashing_nodes_.size(), 0);
 }
 
 void etcd_discovery_set::clear_cache() const {
-  hashing_cache_.clear();
+  hashing_keys_.clear();
+  hashing_node_index_.clear();
+  hashing_nodes_.clear();
+  hashing_free_nodes_.clear();
+  hashing_node_loads_.clear();
+  hashing_total_load_ = 0;
   round_robin_cache_.clear();
+  maglev_table_.clear();
+  rendezvous_seeds_.clear();
+}
+
+void etcd_discovery_set::rebuild_maglev_cache() const {
+  maglev_table_.clear();
+  if (round_robin_cache_.empty()) {
+    return;
+  }
+
+  size_t node_count = round_robin_cache_.size();
+  size_t table_size = consistent_hash_maglev_table_size(node_count);
+
+  // Each node walks its own permutation of table slots by offset and skip, and takes the next empty slot in turn
+  std::vector<size_t> next_slot;
+  std::vector<size_t> skip;
+  next_slot.resize(node_count);
+  skip.resize(node_count);
+  for (size_t i = 0; i < node_count; ++i) {
+    std::pair<uint64_t, uint64_t> hash_code = consistent_hash_node_seed(*round_robin_cache_[i]);
+    next_slot[i] = static_cast<size_t>(hash_code.first % table_size);
+    skip[i] = static_cast<size_t>(hash_code.second % (table_size - 1)) + 1;
+  }
+
+  const uint32_t empty_slot = static_cast<uint32_t>(-1);
+  maglev_table_.resize(table_size, empty_slot);
+  size_t filled = 0;
+  while (filled < table_size) {
+    for (size_t i = 0; i < node_count && filled < table_size; ++i) {
+      while (maglev_table_[next_slot[i]] != empty_slot) {
+        next_slot[i] = (next_slot[i] + skip[i]) % table_size;
+      }
+
+      maglev_table_[next_slot[i]] = static_cast<uint32_t>(i);
+      next_slot[i] = (next_slot[i] + skip[i]) % table_size;
+      ++filled;
+    }
+  }
+}
+
+void etcd_discovery_set::rebuild_rendezvous_cache() const {
+  rendezvous_seeds_.clear();
+  rendezvous_seeds_.reserve(round_robin_cache_.size());
+  for (size_t i = 0; i < round_robin_cache_.size(); ++i) {
+    rendezvous_seeds_.push_back(consistent_hash_node_seed(*round_robin_cache_[i]).first);
+  }
+}
+
+void etcd_discovery_set::update_cache(const etcd_discovery_node::ptr_t *nodes, size_t count) const {
+  update_locality_sets(nodes, count);
+  update_selector_index(nodes, count);
+  update_hashing_cache(nodes, count);
+
+  // Snapshot is published by flush_snapshot(), so many changes in one tick only copy once
+  snapshot_dirty_ = true;
+}
+
+void etcd_discovery_set::update_hashing_cache(const etcd_discovery_node::ptr_t *nodes, size_t count) const {
+  // Maglev table and rendezvous seeds are built lazily from round_robin_cache_, just drop them
+  maglev_table_.clear();
+  rendezvous_seeds_.clear();
+
+  // Cache is not built yet, it will be built when it's used
+  if (hashing_keys_.empty() || 0 == count) {
+    return;
+  }
+
+  // Rebuilding is cheaper when a large part of nodes are changed together, such as a batch update of mass restart
+  if (count > 8 && count * 4 > hashing_nodes_.size()) {
+    clear_cache();
+    return;
+  }
+
+  // Release node slots of changed nodes
+  std::vector<bool> removed_index;
+  removed_index.resize(hashing_nodes_.size(), false);
+  for (size_t i = 0; i < count; ++i) {
+    for (size_t j = 0; nodes[i] && j < hashing_nodes_.size(); ++j) {
+      if (hashing_nodes_[j] == nodes[i]) {
+        hashing_nodes_[j].reset();
+        hashing_free_nodes_.push_back(static_cast<uint32_t>(j));
+        hashing_total_load_ -= hashing_node_loads_[j];
+        hashing_node_loads_[j] = 0;
+        removed_index[j] = true;
+        break;
+      }
+    }
+  }
+
+  round_robin_cache_.erase(std::remove_if(round_robin_cache_.begin(), round_robin_cache_.end(),
+                                          [nodes, count](const etcd_discovery_node::ptr_t &checked) {
+                                            for (size_t i = 0; i < count; ++i) {
+                                              if (checked == nodes[i]) {
+                                                return true;
+                                              }
+                                            }
+                                            return false;
+                                          }),
+                           round_robin_cache_.end());
+
+  // Remove all old points of changed nodes by one pass
+  std::vector<consistent_hash_point_t> old_points;
+  old_points.reserve(hashing_keys_.size());
+  consistent_hash_eytzinger_collect(hashing_keys_, hashing_node_index_, 1, old_points);
+  old_points.erase(std::remove_if(old_points.begin(), old_points.end(),
+                                  [&removed_index](const consistent_hash_point_t &point) {
+                                    return removed_index[point.node_index];
+                                  }),
+                   old_points.end());
+
+  // Then insert points of nodes which are still in indexes
+  std::vector<consistent_hash_point_t> new_points;
+  for (size_t i = 0; i < count; ++i) {
+    const etcd_discovery_node::ptr_t &node = nodes[i];
+    if (!node) {
+      continue;
+    }
+
+    uint64_t id = node->get_discovery_info().id();
+    const std::string &name = node->get_discovery_info().name();
+    bool in_id_index = false;
+    bool in_name_index = false;
+    if (0 != id) {
+      node_by_id_t::const_iterator iter_id = node_by_id_.find(id);
+      in_id_index = iter_id != node_by_id_.end() && iter_id->second == node;
+    }
+    if (!name.empty()) {
+      node_by_name_t::const_iterator iter_name = node_by_name_.find(name);
+      in_name_index = iter_name != node_by_name_.end() && iter_name->second == node;
+    }
+
+    // The same rules as rebuild_cache()
+    if (in_id_index || (in_name_index && 0 == id)) {
+      round_robin_cache_.insert(
+          std::upper_bound(round_robin_cache_.begin(), round_robin_cache_.end(), node, round_robin_compare_index),
+          node);
+    }
+
+    if (!in_id_index && !in_name_index) {
+      continue;
+    }
+
+    uint32_t node_index;
+    if (!hashing_free_nodes_.empty()) {
+      node_index = hashing_free_nodes_.back();
+      hashing_free_nodes_.pop_back();
+      hashing_nodes_[node_index] = node;
+    } else {
+      node_index = static_cast<uint32_t>(hashing_nodes_.size());
+      hashing_nodes_.push_back(node);
+      hashing_node_loads_.push_back(0);
+    }
+
+    if (in_id_index) {
+      consistent_hash_append_points(new_points, &id, sizeof(id), node_index, consistent_hash_point_count(*node));
+    }
+    if (in_name_index) {
+      consistent_hash_append_points(new_points, name.c_str(), name.size(), node_index,
+                                    consistent_hash_point_count(*node));
+    }
+  }
+
+  if (old_points.empty() && new_points.empty()) {
+    clear_cache();
+    return;
+  }
+
+  // Merge sorted new points into the ring, it's linear and no more hashing or sorting of the whole ring
+  consistent_hash_point_compare_t compare(hashing_nodes_);
+  std::sort(new_points.begin(), new_points.end(), compare);
+  std::vector<consistent_hash_point_t> merged_points;
+  merged_points.resize(old_points.size() + new_points.size());
+  std::merge(old_points.begin(), old_points.end(), new_points.begin(), new_points.end(), merged_points.begin(),
+             compare);
+  consistent_hash_assign_points(merged_points, hashing_keys_, hashing_node_index_);
+}
+
+bool etcd_discovery_set::contains_node(const etcd_discovery_node::ptr_t &node) const {
+  if (!node) {
+    return false;
+  }
+
+  if (0 != node->get_discovery_info().id()) {
+    node_by_id_t::const_iterator iter_id = node_by_id_.find(node->get_discovery_info().id());
+    if (iter_id != node_by_id_.end() && iter_id->second == node) {
+      return true;
+    }
+  }
+
+  if (!node->get_discovery_info().name().empty()) {
+    node_by_name_t::const_iterator iter_name = node_by_name_.find(node->get_discovery_info().name());
+    if (iter_name != node_by_name_.end() && iter_name->second == node) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void etcd_discovery_set::record_changes(const etcd_discovery_node::ptr_t *nodes, size_t count) {
+  ++generation_;
+
+  // Every change is dropped at once without change log
+  if (0 == change_log_capacity_) {
+    change_log_dropped_generation_ = generation_;
+    return;
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    if (!nodes[i]) {
+      continue;
+    }
+
+    change_record_t record;
+    record.generation = generation_;
+    record.added = contains_node(nodes[i]);
+    record.node = nodes[i];
+    change_log_.push_back(record);
+  }
+
+  while (change_log_.size() > change_log_capacity_) {
+    change_log_dropped_generation_ = change_log_.front().generation;
+    change_log_.pop_front();
+  }
+}
+
+void etcd_discovery_set::rebuild_locality_sets() const {
+  locality_sets_enabled_ = true;
+  locality_sets_.clear();
+
+  for (node_by_id_t::const_iterator iter = node_by_id_.begin(); iter != node_by_id_.end(); ++iter) {
+    update_locality_sets(&iter->second, 1);
+  }
+
+  for (node_by_name_t::const_iterator iter = node_by_name_.begin(); iter != node_by_name_.end(); ++iter) {
+    update_locality_sets(&iter->second, 1);
+  }
+}
+
+void etcd_discovery_set::update_locality_sets(const etcd_discovery_node::ptr_t *nodes, size_t count) const {
+  if (!locality_sets_enabled_) {
+    return;
+  }
+
+  std::string key;
+  for (size_t i = 0; i < count; ++i) {
+    const etcd_discovery_node::ptr_t &node = nodes[i];
+    if (!node) {
+      continue;
+    }
+
+    bool in_index = contains_node(node);
+
+    // Sub sets have their own caches, so changes of them are also incremental
+    for (int locality = 0; locality < etcd_discovery_locality_t::EN_DL_MAX; ++locality) {
+      if (!locality_make_key(node->get_discovery_info().area(), static_cast<etcd_discovery_locality_t::type>(locality),
+                             key)) {
+        continue;
+      }
+
+      if (in_index) {
+        ptr_t &sub_set = locality_sets_[key];
+        if (!sub_set) {
+          sub_set = std::make_shared<etcd_discovery_set>();
+        }
+        sub_set->add_node(node);
+        continue;
+      }
+
+      locality_set_map_t::iterator iter = locality_sets_.find(key);
+      if (iter == locality_sets_.end()) {
+        continue;
+      }
+      if (iter->second) {
+        iter->second->remove_node(node);
+      }
+      if (!iter->second || iter->second->empty()) {
+        locality_sets_.erase(iter);
+      }
+    }
+  }
+}
+
+const etcd_discovery_set &etcd_discovery_set::select_locality_set(const atapp::protocol::atapp_area &area,
+                                                                  uint32_t spill_over_percent,
+                                                                  uint64_t spill_over_seed) const {
+  bool spill_over = spill_over_percent > 0 && (spill_over_seed % 100) < spill_over_percent;
+  const etcd_discovery_set *selected = NULL;
+  for (int locality = 0; locality < etcd_discovery_locality_t::EN_DL_MAX; ++locality) {
+    const etcd_discovery_set *checked =
+        get_locality_set(area, static_cast<etcd_discovery_locality_t::type>(locality));
+    if (NULL == checked) {
+      continue;
+    }
+
+    if (NULL == selected) {
+      selected = checked;
+      if (!spill_over) {
+        return *selected;
+      }
+      continue;
+    }
+
+    // Spill over to the next wider locality which has more nodes
+    if (checked->get_sorted_nodes().size() > selected->get_sorted_nodes().size()) {
+      return *checked;
+    }
+  }
+
+  if (NULL == selected || get_sorted_nodes().size() > selected->get_sorted_nodes().size()) {
+    return *this;
+  }
+
+  return *selected;
+}
+
+void etcd_discovery_set::rebuild_selector_index() const {
+  selector_index_enabled_ = true;
+  selector_posting_lists_.clear();
+  selector_cache_.clear();
+
+  for (node_by_id_t::const_iterator iter = node_by_id_.begin(); iter != node_by_id_.end(); ++iter) {
+    update_selector_index(&iter->second, 1);
+  }
+
+  for (node_by_name_t::const_iterator iter = node_by_name_.begin(); iter != node_by_name_.end(); ++iter) {
+    update_selector_index(&iter->second, 1);
+  }
+}
+
+void etcd_discovery_set::update_selector_index(const etcd_discovery_node::ptr_t *nodes, size_t count) const {
+  if (!selector_index_enabled_) {
+    return;
+  }
+
+  std::vector<std::string> terms;
+  for (size_t i = 0; i < count; ++i) {
+    const etcd_discovery_node::ptr_t &node = nodes[i];
+    if (!node) {
+      continue;
+    }
+
+    bool in_index = contains_node(node);
+    selector_make_terms(node->get_discovery_info().type_name(), node->get_discovery_info().metadata(), terms);
+
+    // Posting lists are sorted in the same order as get_sorted_nodes()
+    for (size_t j = 0; j < terms.size(); ++j) {
+      std::vector<etcd_discovery_node::ptr_t> &posting_list = selector_posting_lists_[terms[j]];
+      std::vector<etcd_discovery_node::ptr_t>::iterator iter =
+          std::lower_bound(posting_list.begin(), posting_list.end(), node, round_robin_compare_index);
+      while (iter != posting_list.end() && *iter != node && !round_robin_compare_index(node, *iter)) {
+        ++iter;
+      }
+      bool in_posting_list = iter != posting_list.end() && *iter == node;
+
+      if (in_index && !in_posting_list) {
+        posting_list.insert(iter, node);
+      } else if (!in_index && in_posting_list) {
+        posting_list.erase(iter);
+        if (posting_list.empty()) {
+          selector_posting_lists_.erase(terms[j]);
+        }
+      }
+    }
+
+    // Cached results are updated as well
+    for (flat_hash_map<std::string, selector_cache_t>::iterator iter = selector_cache_.begin();
+         iter != selector_cache_.end(); ++iter) {
+      if (in_index && std::includes(terms.begin(), terms.end(), iter->second.terms.begin(), iter->second.terms.end())) {
+        iter->second.nodes->add_node(node);
+      } else {
+        iter->second.nodes->remove_node(node);
+      }
+    }
+  }
+}
+
+void etcd_discovery_set::shrink_selector_cache(size_t capacity) const {
+  while (selector_cache_.size() > capacity) {
+    // Results only referenced by cache can be evicted, callers keep the others updated by holding them
+    flat_hash_map<std::string, selector_cache_t>::iterator evict_iter = selector_cache_.end();
+    for (flat_hash_map<std::string, selector_cache_t>::iterator iter = selector_cache_.begin();
+         iter != selector_cache_.end(); ++iter) {
+      if (iter->second.nodes.use_count() > 1) {
+        continue;
+      }
+      if (evict_iter == selector_cache_.end() || iter->second.last_used < evict_iter->second.last_used) {
+        evict_iter = iter;
+      }
+    }
+
+    if (evict_iter == selector_cache_.end()) {
+      break;
+    }
+    selector_cache_.erase(evict_iter);
+  }
+}
+
+void etcd_discovery_set::publish_snapshot() const {
+  snapshot_dirty_ = false;
+  rebuild_cache();
+  std::shared_ptr<const etcd_discovery_snapshot> snapshot = std::make_shared<etcd_discovery_snapshot>(*this);
+
+  // Old snapshot is released after unlock, readers may still hold it
+  util::lock::lock_holder<util::lock::spin_lock> holder(snapshot_lock_);
+  snapshot_.swap(snapshot);
+}
+
+LIBATAPP_MACRO_API etcd_discovery_snapshot::selector_state_t::selector_state_t() : round_robin_index(0) {
+  random_generator.init_seed(static_cast<util::random::xoshiro256_starstar::result_type>(
+      util::time::time_utility::get_now() ^ static_cast<time_t>(reinterpret_cast<uintptr_t>(this))));
+}
+
+LIBATAPP_MACRO_API etcd_discovery_snapshot::etcd_discovery_snapshot(const etcd_discovery_set &source)
+    : node_by_name_(source.node_by_name_),
+      node_by_id_(source.node_by_id_),
+      sorted_nodes_(source.round_robin_cache_),
+      hashing_keys_(source.hashing_keys_),
+      hashing_node_index_(source.hashing_node_index_),
+      hashing_nodes_(source.hashing_nodes_),
+      generation_(source.generation_) {}
+
+LIBATAPP_MACRO_API etcd_discovery_snapshot::~etcd_discovery_snapshot() {}
+
+LIBATAPP_MACRO_API etcd_discovery_node::ptr_t etcd_discovery_snapshot::get_node_by_id(uint64_t id) const {
+  etcd_discovery_set::node_by_id_t::const_iterator iter = node_by_id_.find(id);
+  if (iter == node_by_id_.end()) {
+    return NULL;
+  }
+
+  return iter->second;
+}
+
+LIBATAPP_MACRO_API etcd_discovery_node::ptr_t etcd_discovery_snapshot::get_node_by_name(const std::string &name) const {
+  etcd_discovery_set::node_by_name_t::const_iterator iter = node_by_name_.find(name);
+  if (iter == node_by_name_.end()) {
+    return NULL;
+  }
+
+  return iter->second;
+}
+
+LIBATAPP_MACRO_API etcd_discovery_node::ptr_t etcd_discovery_snapshot::get_node_by_consistent_hash(
+    const void *buf, size_t bufsz) const {
+  if (hashing_keys_.empty()) {
+    return NULL;
+  }
+
+  uint64_t hash_key = consistent_hash_calc(buf, bufsz, LIBATAPP_MACRO_HASH_MAGIC_NUMBER).first;
+  return hashing_nodes_[hashing_node_index_[consistent_hash_eytzinger_lower_bound(hashing_keys_, hash_key)]];
+}
+
+LIBATAPP_MACRO_API etcd_discovery_node::ptr_t etcd_discovery_snapshot::get_node_by_consistent_hash(uint64_t key) const {
+  return get_node_by_consistent_hash(&key, sizeof(key));
+}
+
+LIBATAPP_MACRO_API etcd_discovery_node::ptr_t etcd_discovery_snapshot::get_node_by_consistent_hash(int64_t key) const {
+  return get_node_by_consistent_hash(&key, sizeof(key));
+}
+
+LIBATAPP_MACRO_API etcd_discovery_node::ptr_t etcd_discovery_snapshot::get_node_by_consistent_hash(
+    const std::string &key) const {
+  return get_node_by_consistent_hash(key.c_str(), key.size());
+}
+
+LIBATAPP_MACRO_API etcd_discovery_node::ptr_t etcd_discovery_snapshot::get_node_by_random(
+    selector_state_t &state) const {
+  if (sorted_nodes_.empty()) {
+    return NULL;
+  }
+
+  return sorted_nodes_[state.random_generator.random_between<size_t>(0, sorted_nodes_.size())];
+}
+
+LIBATAPP_MACRO_API etcd_discovery_node::ptr_t etcd_discovery_snapshot::get_node_by_round_robin(
+    selector_state_t &state) const {
+  if (sorted_nodes_.empty()) {
+    return NULL;
+  }
+
+  if (state.round_robin_index >= sorted_nodes_.size()) {
+    state.round_robin_index %= sorted_nodes_.size();
+  }
+
+  return sorted_nodes_[state.round_robin_index++];
 }
 }  // namespace atapp
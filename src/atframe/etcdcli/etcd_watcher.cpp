@@ -206,6 +206,7 @@ int etcd_watcher::libcurl_callback_on_range_completed(util::network::http_reques
   response.created = false;
   response.canceled = false;
   response.compact_revision = 0;
+  response.full_range = !self->rpc_.is_retry_mode;
   {
     rapidjson::Document::ConstMemberIterator res = doc.FindMember("kvs");
 
@@ -261,7 +262,8 @@ int etcd_watcher::libcurl_callback_on_watch_completed(util::network::http_reques
   }
   util::network::http_request::ptr_t keep_rpc = self->rpc_.rpc_opr_;
   self->rpc_.rpc_opr_.reset();
-  self->rpc_.is_retry_mode = true;
+  // last_revision is reset when it's compacted, and then we need a full range request
+  self->rpc_.is_retry_mode = 0 != self->rpc_.last_revision;
 
   // 服务器错误则过一段时间后重试
   if (0 != req.get_error_code() || util::network::http_request::status_code_t::EN_ECG_SUCCESS !=
@@ -388,6 +390,7 @@ int etcd_watcher::libcurl_callback_on_watch_write(util::network::http_request &r
     }
 
     response_t response;
+    response.full_range = false;
     // decode basic info
     etcd_packer::unpack_int(*result, "watch_id", response.watch_id);
     etcd_packer::unpack_int(*result, "compact_revision", response.compact_revision);
@@ -463,6 +466,13 @@ int etcd_watcher::libcurl_callback_on_watch_write(util::network::http_request &r
 
     // stopped if canceled and wait to start another watcher later
     if (response.canceled) {
+      // Revision is compacted, fall back to range request to get all keys
+      if (response.compact_revision > 0) {
+        FWLOGWARNING("Etcd watcher {} got compacted revision {}, restart with range request",
+                     reinterpret_cast<const void *>(self), static_cast<long long>(response.compact_revision));
+        self->rpc_.last_revision = 0;
+        self->rpc_.is_retry_mode = false;
+      }
       req.stop();
     }
   }
@@ -1,4 +1,6 @@
-﻿#include <sstream>
+﻿#include <cstdio>
+#include <fstream>
+#include <sstream>
 #include <vector>
 
 #include <config/compiler/protobuf_prefix.h>
@@ -83,8 +85,10 @@ static void init_timer_closed_callback(uv_handle_t *handle) {
 
 }  // namespace detail
 
-LIBATAPP_MACRO_API etcd_module::etcd_module() : etcd_ctx_enabled_(false), maybe_update_inner_keepalive_value_(true) {
+LIBATAPP_MACRO_API etcd_module::etcd_module()
+    : etcd_ctx_enabled_(false), maybe_update_inner_keepalive_value_(true), discovery_snapshot_dirty_(false) {
   tick_next_timepoint_ = util::time::time_utility::sys_now();
+  discovery_snapshot_next_save_time_ = tick_next_timepoint_;
   tick_interval_ = std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::milliseconds(128));
 }
 
@@ -140,6 +144,9 @@ LIBATAPP_MACRO_API int etcd_module::init() {
     return res;
   }
 
+  // Warm start is optional, routing is just not available until the first range response if it failed
+  load_discovery_snapshot();
+
   // Setup for first, we must check if all resource available.
   bool is_failed = false;
   bool is_timeout = false;
@@ -240,6 +247,9 @@ LIBATAPP_MACRO_API int etcd_module::init() {
     return -1;
   }
 
+  // Discovery data should be available after initialization
+  flush_pending_events();
+
   return res;
 }
 
@@ -339,6 +349,32 @@ int etcd_module::init_keepalives() {
 int etcd_module::init_watchers() {
   const atapp::protocol::atapp_etcd &conf = get_configure();
 
+  // Only watch selected types and tags if discovery filter is set, nodes of other services are never received
+  const atapp::protocol::atapp_etcd_discovery_filter &filter = conf.watcher().filter();
+  discovery_filter_tag_paths_.clear();
+  // Watch paths end with "/", or type 1 also matches type 10 and tag foo also matches tag foobar
+  if (filter.type_ids_size() > 0 || filter.type_names_size() > 0 || filter.tags_size() > 0) {
+    int res = 0;
+    for (int i = 0; res >= 0 && i < filter.type_ids_size(); ++i) {
+      if (0 != filter.type_ids(i)) {
+        res = add_inner_watcher_by_filter(get_by_type_id_watcher_path(filter.type_ids(i)) + "/");
+      }
+    }
+    for (int i = 0; res >= 0 && i < filter.type_names_size(); ++i) {
+      if (!filter.type_names(i).empty()) {
+        res = add_inner_watcher_by_filter(get_by_type_name_watcher_path(filter.type_names(i)) + "/");
+      }
+    }
+    for (int i = 0; res >= 0 && i < filter.tags_size(); ++i) {
+      if (!filter.tags(i).empty()) {
+        std::string watch_path = get_by_tag_watcher_path(filter.tags(i)) + "/";
+        discovery_filter_tag_paths_.push_back(watch_path);
+        res = add_inner_watcher_by_filter(watch_path);
+      }
+    }
+    return res;
+  }
+
   // setup configured watchers
   if (conf.watcher().by_name()) {
     add_watcher_by_name(NULL);
@@ -527,6 +563,8 @@ LIBATAPP_MACRO_API int etcd_module::stop() {
       cleanup_request_->set_priv_data(this);
       cleanup_request_->set_on_complete(http_callback_on_etcd_closed);
     }
+    flush_pending_events();
+    save_discovery_snapshot();
     reset_inner_watchers_and_keepalives();
   }
 
@@ -547,6 +585,20 @@ LIBATAPP_MACRO_API int etcd_module::timeout() {
 LIBATAPP_MACRO_API const char *etcd_module::name() const { return "atapp: etcd module"; }
 
 LIBATAPP_MACRO_API int etcd_module::tick() {
+  // Discovery events received in last tick
+  flush_pending_events();
+
+  // Snapshots are published at most once per tick
+  global_discovery_.flush_snapshot();
+  for (flat_hash_map<uint64_t, etcd_discovery_set::ptr_t>::const_iterator iter = discovery_by_type_id_.begin();
+       iter != discovery_by_type_id_.end(); ++iter) {
+    iter->second->flush_snapshot();
+  }
+  for (flat_hash_map<std::string, etcd_discovery_set::ptr_t>::const_iterator iter = discovery_by_type_name_.begin();
+       iter != discovery_by_type_name_.end(); ++iter) {
+    iter->second->flush_snapshot();
+  }
+
   // Slow down the tick interval of etcd module, it require http request which is very slow compared to atbus
   if (tick_next_timepoint_ >= get_app()->get_last_tick_time()) {
     return 0;
@@ -606,6 +658,14 @@ LIBATAPP_MACRO_API int etcd_module::tick() {
     update_keepalive_value();
   }
 
+  if (discovery_snapshot_dirty_ && discovery_snapshot_next_save_time_ < get_app()->get_last_tick_time()) {
+    discovery_snapshot_next_save_time_ =
+        get_app()->get_last_tick_time() + detail::convert_to_chrono(get_configure().snapshot().save_interval(), 10000);
+    if (save_discovery_snapshot() >= 0) {
+      discovery_snapshot_dirty_ = false;
+    }
+  }
+
   return ret;
 }
 
@@ -694,7 +754,7 @@ LIBATAPP_MACRO_API int etcd_module::add_watcher_by_id(watcher_list_callback_t fn
     etcd_ctx_.add_watcher(inner_watcher_by_id_);
     FWLOGINFO("create etcd_watcher for by_id index {} success", watch_path);
 
-    inner_watcher_by_id_->set_evt_handle(watcher_callback_list_wrapper_t(*this, watcher_by_id_callbacks_));
+    inner_watcher_by_id_->set_evt_handle(watcher_callback_list_wrapper_t(*this, &watcher_by_id_callbacks_, watch_path));
   }
 
   if (fn) {
@@ -772,7 +832,8 @@ LIBATAPP_MACRO_API int etcd_module::add_watcher_by_name(watcher_list_callback_t
     etcd_ctx_.add_watcher(inner_watcher_by_name_);
     FWLOGINFO("create etcd_watcher for by_name index {} success", watch_path);
 
-    inner_watcher_by_name_->set_evt_handle(watcher_callback_list_wrapper_t(*this, watcher_by_name_callbacks_));
+    inner_watcher_by_name_->set_evt_handle(
+        watcher_callback_list_wrapper_t(*this, &watcher_by_name_callbacks_, watch_path));
   }
 
   if (fn) {
@@ -908,9 +969,121 @@ LIBATAPP_MACRO_API void etcd_module::remove_on_node_event(node_event_callback_ha
   handle = node_event_callbacks_.end();
 }
 
+LIBATAPP_MACRO_API etcd_module::node_events_callback_handle_t etcd_module::add_on_node_discovery_events(
+    node_events_callback_t fn) {
+  if (!fn) {
+    return node_events_callbacks_.end();
+  }
+
+  return node_events_callbacks_.insert(node_events_callbacks_.end(), fn);
+}
+
+LIBATAPP_MACRO_API void etcd_module::remove_on_node_events(node_events_callback_handle_t &handle) {
+  if (handle == node_events_callbacks_.end()) {
+    return;
+  }
+
+  node_events_callbacks_.erase(handle);
+  handle = node_events_callbacks_.end();
+}
+
 LIBATAPP_MACRO_API etcd_discovery_set &etcd_module::get_global_discovery() { return global_discovery_; }
 LIBATAPP_MACRO_API const etcd_discovery_set &etcd_module::get_global_discovery() const { return global_discovery_; }
 
+LIBATAPP_MACRO_API etcd_discovery_set::ptr_t etcd_module::get_discovery_by_type_id(uint64_t type_id) const {
+  flat_hash_map<uint64_t, etcd_discovery_set::ptr_t>::const_iterator iter = discovery_by_type_id_.find(type_id);
+  if (iter == discovery_by_type_id_.end()) {
+    return NULL;
+  }
+
+  return iter->second;
+}
+
+LIBATAPP_MACRO_API etcd_discovery_set::ptr_t etcd_module::get_discovery_by_type_name(
+    const std::string &type_name) const {
+  flat_hash_map<std::string, etcd_discovery_set::ptr_t>::const_iterator iter = discovery_by_type_name_.find(type_name);
+  if (iter == discovery_by_type_name_.end()) {
+    return NULL;
+  }
+
+  return iter->second;
+}
+
+LIBATAPP_MACRO_API int etcd_module::save_discovery_snapshot() {
+  const std::string &file_path = get_configure().snapshot().path();
+  if (file_path.empty()) {
+    return 0;
+  }
+
+  atapp::protocol::atapp_discovery_snapshot snapshot;
+  int64_t revision = 0;
+  std::vector<etcd_watcher::ptr_t> watchers;
+  get_inner_watchers(watchers);
+  for (size_t i = 0; i < watchers.size(); ++i) {
+    if (!watchers[i]) {
+      continue;
+    }
+
+    // Data is only complete before the smallest revision of all watchers
+    if (watchers[i]->get_last_revision() <= 0) {
+      FWLOGDEBUG("etcd watcher {} is not ready, skip saving discovery snapshot", watchers[i]->get_path());
+      return EN_ATAPP_ERR_NOT_INITED;
+    }
+    if (0 == revision || watchers[i]->get_last_revision() < revision) {
+      revision = watchers[i]->get_last_revision();
+    }
+    snapshot.add_watcher_paths(watchers[i]->get_path());
+  }
+
+  if (0 == revision) {
+    return 0;
+  }
+  snapshot.set_revision(revision);
+
+  const std::vector<etcd_discovery_node::ptr_t> &nodes = global_discovery_.get_sorted_nodes();
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    if (nodes[i]) {
+      snapshot.add_nodes()->CopyFrom(nodes[i]->get_discovery_info());
+    }
+  }
+
+  std::string data;
+  if (!snapshot.SerializeToString(&data)) {
+    FWLOGERROR("serialize discovery snapshot failed");
+    return EN_ATAPP_ERR_SAVE_DISCOVERY_SNAPSHOT;
+  }
+
+  // Write into a temporary file and then rename it, so a crash will never leave a broken snapshot
+  std::string tmp_file_path = file_path + ".tmp";
+  {
+    std::fstream file;
+    file.open(tmp_file_path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+      FWLOGERROR("open discovery snapshot {} to write failed", tmp_file_path);
+      return EN_ATAPP_ERR_SAVE_DISCOVERY_SNAPSHOT;
+    }
+    file.write(data.data(), static_cast<std::streamsize>(data.size()));
+    if (!file.good()) {
+      file.close();
+      std::remove(tmp_file_path.c_str());
+      FWLOGERROR("write discovery snapshot {} failed", tmp_file_path);
+      return EN_ATAPP_ERR_SAVE_DISCOVERY_SNAPSHOT;
+    }
+    file.close();
+  }
+
+  // rename() can not replace an existed file on Windows
+  std::remove(file_path.c_str());
+  if (0 != std::rename(tmp_file_path.c_str(), file_path.c_str())) {
+    FWLOGERROR("rename discovery snapshot {} to {} failed", tmp_file_path, file_path);
+    return EN_ATAPP_ERR_SAVE_DISCOVERY_SNAPSHOT;
+  }
+
+  FWLOGDEBUG("save {} nodes into discovery snapshot {} with revision {}", snapshot.nodes_size(), file_path,
+             static_cast<long long>(revision));
+  return 0;
+}
+
 bool etcd_module::unpack(node_info_t &out, const std::string &path, const std::string &json, bool reset_data) {
   if (reset_data) {
     out.node_discovery.Clear();
@@ -996,13 +1169,25 @@ int etcd_module::http_callback_on_etcd_closed(util::network::http_request &req)
 }
 
 etcd_module::watcher_callback_list_wrapper_t::watcher_callback_list_wrapper_t(etcd_module &m,
-                                                                              std::list<watcher_list_callback_t> &cbks)
-    : mod(&m), callbacks(&cbks) {}
+                                                                              std::list<watcher_list_callback_t> *cbks,
+                                                                              const std::string &path)
+    : mod(&m), callbacks(cbks), watcher_path(path) {}
 void etcd_module::watcher_callback_list_wrapper_t::operator()(const ::atapp::etcd_response_header &header,
                                                               const ::atapp::etcd_watcher::response_t &body) {
   if (NULL == mod) {
     return;
   }
+
+  // Callbacks are called after this response is applied to discovery, in flush_pending_events()
+  pending_watcher_response_t *deferred = NULL;
+  if (NULL != callbacks && !callbacks->empty() && mod->get_configure().watcher().batch_events()) {
+    mod->pending_watcher_responses_.push_back(pending_watcher_response_t());
+    deferred = &mod->pending_watcher_responses_.back();
+    deferred->callbacks = callbacks;
+    deferred->header = header;
+    deferred->body = body;
+  }
+
   // decode data
   for (size_t i = 0; i < body.events.size(); ++i) {
     const ::atapp::etcd_watcher::event_t &evt_data = body.events[i];
@@ -1022,7 +1207,20 @@ void etcd_module::watcher_callback_list_wrapper_t::operator()(const ::atapp::etc
       node.action = node_action_t::EN_NAT_PUT;
     }
 
-    mod->update_inner_watcher_event(node);
+    // Nodes not matched are never cached
+    if (mod->match_discovery_filter(&evt_data.kv.key, node.node_discovery)) {
+      if (body.full_range) {
+        mod->confirm_warm_start_node(node.node_discovery);
+      }
+      mod->handle_inner_watcher_event(node);
+    } else {
+      mod->evict_discovery_node(node);
+    }
+
+    if (NULL != deferred) {
+      deferred->nodes.push_back(std::make_pair(i, node));
+      continue;
+    }
 
     if (NULL == callbacks) {
       continue;
@@ -1039,6 +1237,18 @@ void etcd_module::watcher_callback_list_wrapper_t::operator()(const ::atapp::etc
       }
     }
   }
+
+  if (NULL != deferred && deferred->nodes.empty()) {
+    mod->pending_watcher_responses_.pop_back();
+  }
+
+  // All keys are in a range response, nodes from snapshot which are not in it are already removed from etcd
+  if (body.full_range) {
+    mod->finish_warm_start(watcher_path);
+  } else if (!body.canceled || body.compact_revision <= 0) {
+    // Watching is resumed from the revision of snapshot, a range response will never come
+    mod->resume_warm_start(watcher_path);
+  }
 }
 
 etcd_module::watcher_callback_one_wrapper_t::watcher_callback_one_wrapper_t(etcd_module &m, watcher_one_callback_t cbk)
@@ -1069,7 +1279,11 @@ void etcd_module::watcher_callback_one_wrapper_t::operator()(const ::atapp::etcd
       node.action = node_action_t::EN_NAT_PUT;
     }
 
-    mod->update_inner_watcher_event(node);
+    if (mod->match_discovery_filter(&evt_data.kv.key, node.node_discovery)) {
+      mod->handle_inner_watcher_event(node);
+    } else {
+      mod->evict_discovery_node(node);
+    }
 
     if (!callback) {
       continue;
@@ -1089,7 +1303,7 @@ bool etcd_module::update_inner_watcher_event(node_info_t &node) {
   if (likely(local_cache_by_id == local_cache_by_name)) {
     if (node_action_t::EN_NAT_DELETE == node.action) {
       if (local_cache_by_id) {
-        global_discovery_.remove_node(local_cache_by_id);
+        remove_discovery_node(local_cache_by_id);
 
         has_event = true;
       }
@@ -1099,24 +1313,24 @@ bool etcd_module::update_inner_watcher_event(node_info_t &node) {
       }
 
       if (local_cache_by_id) {
-        global_discovery_.remove_node(local_cache_by_id);
+        remove_discovery_node(local_cache_by_id);
       }
 
       new_inst = std::make_shared<etcd_discovery_node>();
       new_inst->copy_from(node.node_discovery);
 
-      global_discovery_.add_node(new_inst);
+      add_discovery_node(new_inst);
 
       has_event = true;
     }
   } else {
     if (node_action_t::EN_NAT_DELETE == node.action) {
       if (local_cache_by_id) {
-        global_discovery_.remove_node(local_cache_by_id);
+        remove_discovery_node(local_cache_by_id);
         has_event = true;
       }
       if (local_cache_by_name) {
-        global_discovery_.remove_node(local_cache_by_name);
+        remove_discovery_node(local_cache_by_name);
         has_event = true;
       }
     } else {
@@ -1136,13 +1350,13 @@ bool etcd_module::update_inner_watcher_event(node_info_t &node) {
         new_inst->copy_from(node.node_discovery);
 
         if (local_cache_by_id) {
-          global_discovery_.remove_node(local_cache_by_id);
+          remove_discovery_node(local_cache_by_id);
         }
         if (local_cache_by_name) {
-          global_discovery_.remove_node(local_cache_by_name);
+          remove_discovery_node(local_cache_by_name);
         }
 
-        global_discovery_.add_node(new_inst);
+        add_discovery_node(new_inst);
       }
     }
   }
@@ -1187,11 +1401,360 @@ bool etcd_module::update_inner_watcher_event(node_info_t &node) {
         }
       }
     }
+
+    if (!node_events_callbacks_.empty()) {
+      std::vector<etcd_discovery_event_t> events;
+      events.resize(1);
+      events[0].action = node.action;
+      if (new_inst) {
+        events[0].node = new_inst;
+      } else if (local_cache_by_name) {
+        events[0].node = local_cache_by_name;
+      } else {
+        events[0].node = local_cache_by_id;
+      }
+
+      for (node_events_callback_list_t::iterator iter = node_events_callbacks_.begin();
+           iter != node_events_callbacks_.end(); ++iter) {
+        if (*iter) {
+          (*iter)(events);
+        }
+      }
+    }
   }
 
   return has_event;
 }
 
+void etcd_module::add_discovery_node(const etcd_discovery_node::ptr_t &node) {
+  if (!node) {
+    return;
+  }
+
+  global_discovery_.add_node(node);
+  discovery_snapshot_dirty_ = true;
+
+  // Typed sets are updated in the same pass, so routing by type is just a lookup. They are never erased, callers may
+  // hold them
+  if (0 != node->get_discovery_info().type_id()) {
+    etcd_discovery_set::ptr_t &typed_set = discovery_by_type_id_[node->get_discovery_info().type_id()];
+    if (!typed_set) {
+      typed_set = std::make_shared<etcd_discovery_set>();
+    }
+    typed_set->add_node(node);
+  }
+
+  if (!node->get_discovery_info().type_name().empty()) {
+    etcd_discovery_set::ptr_t &typed_set = discovery_by_type_name_[node->get_discovery_info().type_name()];
+    if (!typed_set) {
+      typed_set = std::make_shared<etcd_discovery_set>();
+    }
+    typed_set->add_node(node);
+  }
+}
+
+void etcd_module::remove_discovery_node(const etcd_discovery_node::ptr_t &node) {
+  if (!node) {
+    return;
+  }
+
+  global_discovery_.remove_node(node);
+  discovery_snapshot_dirty_ = true;
+
+  if (0 != node->get_discovery_info().type_id()) {
+    flat_hash_map<uint64_t, etcd_discovery_set::ptr_t>::iterator iter =
+        discovery_by_type_id_.find(node->get_discovery_info().type_id());
+    if (iter != discovery_by_type_id_.end()) {
+      iter->second->remove_node(node);
+    }
+  }
+
+  if (!node->get_discovery_info().type_name().empty()) {
+    flat_hash_map<std::string, etcd_discovery_set::ptr_t>::iterator iter =
+        discovery_by_type_name_.find(node->get_discovery_info().type_name());
+    if (iter != discovery_by_type_name_.end()) {
+      iter->second->remove_node(node);
+    }
+  }
+}
+
+void etcd_module::update_discovery_nodes(const std::vector<etcd_discovery_node::ptr_t> &removed,
+                                         const std::vector<etcd_discovery_node::ptr_t> &added) {
+  if (removed.empty() && added.empty()) {
+    return;
+  }
+
+  global_discovery_.update_nodes(removed, added);
+  discovery_snapshot_dirty_ = true;
+
+  // Group nodes by type, so every typed set is also updated only once
+  using typed_nodes_t = std::pair<std::vector<etcd_discovery_node::ptr_t>, std::vector<etcd_discovery_node::ptr_t> >;
+  flat_hash_map<uint64_t, typed_nodes_t> nodes_by_type_id;
+  flat_hash_map<std::string, typed_nodes_t> nodes_by_type_name;
+  for (size_t i = 0; i < removed.size(); ++i) {
+    if (!removed[i]) {
+      continue;
+    }
+    if (0 != removed[i]->get_discovery_info().type_id()) {
+      nodes_by_type_id[removed[i]->get_discovery_info().type_id()].first.push_back(removed[i]);
+    }
+    if (!removed[i]->get_discovery_info().type_name().empty()) {
+      nodes_by_type_name[removed[i]->get_discovery_info().type_name()].first.push_back(removed[i]);
+    }
+  }
+  for (size_t i = 0; i < added.size(); ++i) {
+    if (!added[i]) {
+      continue;
+    }
+    if (0 != added[i]->get_discovery_info().type_id()) {
+      nodes_by_type_id[added[i]->get_discovery_info().type_id()].second.push_back(added[i]);
+    }
+    if (!added[i]->get_discovery_info().type_name().empty()) {
+      nodes_by_type_name[added[i]->get_discovery_info().type_name()].second.push_back(added[i]);
+    }
+  }
+
+  for (flat_hash_map<uint64_t, typed_nodes_t>::const_iterator iter = nodes_by_type_id.begin();
+       iter != nodes_by_type_id.end(); ++iter) {
+    etcd_discovery_set::ptr_t &typed_set = discovery_by_type_id_[iter->first];
+    if (!typed_set) {
+      typed_set = std::make_shared<etcd_discovery_set>();
+    }
+    typed_set->update_nodes(iter->second.first, iter->second.second);
+  }
+
+  for (flat_hash_map<std::string, typed_nodes_t>::const_iterator iter = nodes_by_type_name.begin();
+       iter != nodes_by_type_name.end(); ++iter) {
+    etcd_discovery_set::ptr_t &typed_set = discovery_by_type_name_[iter->first];
+    if (!typed_set) {
+      typed_set = std::make_shared<etcd_discovery_set>();
+    }
+    typed_set->update_nodes(iter->second.first, iter->second.second);
+  }
+}
+
+void etcd_module::handle_inner_watcher_event(node_info_t &node) {
+  if (!get_configure().watcher().batch_events()) {
+    update_inner_watcher_event(node);
+    return;
+  }
+
+  push_pending_event(node);
+}
+
+void etcd_module::push_pending_event(const node_info_t &node) {
+  // Replace the pending event of the same node, only the final state is applied
+  size_t index_by_id = pending_events_.size();
+  size_t index_by_name = pending_events_.size();
+  if (0 != node.node_discovery.id()) {
+    flat_hash_map<uint64_t, size_t>::const_iterator iter_id = pending_event_by_id_.find(node.node_discovery.id());
+    if (iter_id != pending_event_by_id_.end()) {
+      index_by_id = iter_id->second;
+    }
+  }
+  if (!node.node_discovery.name().empty()) {
+    flat_hash_map<std::string, size_t>::const_iterator iter_name =
+        pending_event_by_name_.find(node.node_discovery.name());
+    if (iter_name != pending_event_by_name_.end()) {
+      index_by_name = iter_name->second;
+    }
+  }
+
+  // Keys of the replaced event which are not in the new one, the old node is removed by them when applied one by one
+  node_info_t residual;
+  residual.action = node_action_t::EN_NAT_DELETE;
+  size_t index = pending_events_.size();
+  if (index_by_id < pending_events_.size()) {
+    index = index_by_id;
+    const std::string &replaced_name = pending_events_[index].node_discovery.name();
+    if (!replaced_name.empty() && replaced_name != node.node_discovery.name()) {
+      residual.node_discovery.set_name(replaced_name);
+      pending_event_by_name_.erase(replaced_name);
+    }
+
+    // The name is moved from another pending node, only the deletion of its id is left
+    if (index_by_name < pending_events_.size() && index_by_name != index_by_id) {
+      node_info_t &moved = pending_events_[index_by_name];
+      uint64_t moved_id = moved.node_discovery.id();
+      moved.node_discovery.Clear();
+      moved.node_discovery.set_id(moved_id);
+      moved.action = node_action_t::EN_NAT_DELETE;
+    }
+  } else if (index_by_name < pending_events_.size()) {
+    index = index_by_name;
+    uint64_t replaced_id = pending_events_[index].node_discovery.id();
+    if (0 != replaced_id && replaced_id != node.node_discovery.id()) {
+      residual.node_discovery.set_id(replaced_id);
+      pending_event_by_id_.erase(replaced_id);
+    }
+  }
+
+  if (index >= pending_events_.size()) {
+    pending_events_.push_back(node);
+  } else {
+    pending_events_[index] = node;
+  }
+
+  if (0 != node.node_discovery.id()) {
+    pending_event_by_id_[node.node_discovery.id()] = index;
+  }
+  if (!node.node_discovery.name().empty()) {
+    pending_event_by_name_[node.node_discovery.name()] = index;
+  }
+
+  if (0 != residual.node_discovery.id()) {
+    pending_event_by_id_[residual.node_discovery.id()] = pending_events_.size();
+    pending_events_.push_back(residual);
+  } else if (!residual.node_discovery.name().empty()) {
+    pending_event_by_name_[residual.node_discovery.name()] = pending_events_.size();
+    pending_events_.push_back(residual);
+  }
+}
+
+void etcd_module::flush_pending_events() {
+  apply_pending_events();
+  dispatch_pending_watcher_responses();
+}
+
+void etcd_module::apply_pending_events() {
+  if (pending_events_.empty()) {
+    return;
+  }
+
+  std::vector<node_info_t> pending_events;
+  pending_events.swap(pending_events_);
+  pending_event_by_id_.clear();
+  pending_event_by_name_.clear();
+
+  // The same rules as update_inner_watcher_event(), but all changes are applied together
+  std::vector<etcd_discovery_node::ptr_t> removed_nodes;
+  std::vector<etcd_discovery_node::ptr_t> added_nodes;
+  std::vector<etcd_discovery_event_t> events;
+  std::vector<size_t> deleted_event_index;
+  // Events of only id and only name may point to the same cached node, such as stale nodes of warm start
+  flat_hash_map<uintptr_t, bool> removed_node_set;
+  for (size_t i = 0; i < pending_events.size(); ++i) {
+    const node_info_t &node = pending_events[i];
+    etcd_discovery_node::ptr_t local_cache_by_id = global_discovery_.get_node_by_id(node.node_discovery.id());
+    etcd_discovery_node::ptr_t local_cache_by_name = global_discovery_.get_node_by_name(node.node_discovery.name());
+    bool same_node = local_cache_by_name == local_cache_by_id;
+    if (same_node) {
+      local_cache_by_name.reset();
+    }
+
+    if (node_action_t::EN_NAT_DELETE == node.action) {
+      if (!local_cache_by_id && !local_cache_by_name) {
+        continue;
+      }
+
+      deleted_event_index.push_back(i);
+      etcd_discovery_node::ptr_t locals[] = {local_cache_by_id, local_cache_by_name};
+      for (size_t j = 0; j < sizeof(locals) / sizeof(locals[0]); ++j) {
+        if (!locals[j]) {
+          continue;
+        }
+        if (!removed_node_set.insert(std::make_pair(reinterpret_cast<uintptr_t>(locals[j].get()), true)).second) {
+          continue;
+        }
+        removed_nodes.push_back(locals[j]);
+        events.push_back(etcd_discovery_event_t());
+        events.back().action = node_action_t::EN_NAT_DELETE;
+        events.back().node = locals[j];
+      }
+      continue;
+    }
+
+    bool has_event = (same_node && !local_cache_by_id) || (!local_cache_by_id && 0 != node.node_discovery.id()) ||
+                     (!same_node && !local_cache_by_name && !node.node_discovery.name().empty());
+    if (local_cache_by_id && !protobuf_equal(local_cache_by_id->get_discovery_info(), node.node_discovery)) {
+      has_event = true;
+    }
+    if (local_cache_by_name && !protobuf_equal(local_cache_by_name->get_discovery_info(), node.node_discovery)) {
+      has_event = true;
+    }
+    if (!has_event) {
+      continue;
+    }
+
+    etcd_discovery_node::ptr_t new_inst = std::make_shared<etcd_discovery_node>();
+    new_inst->copy_from(node.node_discovery);
+    if (local_cache_by_id &&
+        removed_node_set.insert(std::make_pair(reinterpret_cast<uintptr_t>(local_cache_by_id.get()), true)).second) {
+      removed_nodes.push_back(local_cache_by_id);
+    }
+    if (local_cache_by_name &&
+        removed_node_set.insert(std::make_pair(reinterpret_cast<uintptr_t>(local_cache_by_name.get()), true)).second) {
+      removed_nodes.push_back(local_cache_by_name);
+    }
+    added_nodes.push_back(new_inst);
+
+    events.push_back(etcd_discovery_event_t());
+    events.back().action = node_action_t::EN_NAT_PUT;
+    events.back().node = new_inst;
+  }
+
+  if (events.empty()) {
+    return;
+  }
+
+  update_discovery_nodes(removed_nodes, added_nodes);
+
+  app *owner = get_app();
+  if (NULL == owner) {
+    return;
+  }
+
+  for (size_t i = 0; i < deleted_event_index.size(); ++i) {
+    const node_info_t &node = pending_events[deleted_event_index[i]];
+    if (0 != node.node_discovery.id()) {
+      owner->remove_endpoint(node.node_discovery.id());
+    }
+    if (!node.node_discovery.name().empty()) {
+      owner->remove_endpoint(node.node_discovery.name());
+    }
+  }
+
+  owner->trigger_event_on_discovery_events(events);
+  for (size_t i = 0; i < events.size(); ++i) {
+    for (node_event_callback_list_t::iterator iter = node_event_callbacks_.begin(); iter != node_event_callbacks_.end();
+         ++iter) {
+      if (*iter) {
+        (*iter)(events[i].action, events[i].node);
+      }
+    }
+  }
+  for (node_events_callback_list_t::iterator iter = node_events_callbacks_.begin();
+       iter != node_events_callbacks_.end(); ++iter) {
+    if (*iter) {
+      (*iter)(events);
+    }
+  }
+}
+
+void etcd_module::dispatch_pending_watcher_responses() {
+  if (pending_watcher_responses_.empty()) {
+    return;
+  }
+
+  // Move them out first, callbacks may receive new responses
+  std::list<pending_watcher_response_t> responses;
+  responses.swap(pending_watcher_responses_);
+  for (std::list<pending_watcher_response_t>::iterator iter_rsp = responses.begin(); iter_rsp != responses.end();
+       ++iter_rsp) {
+    pending_watcher_response_t &rsp = *iter_rsp;
+    for (size_t i = 0; i < rsp.nodes.size(); ++i) {
+      watcher_sender_list_t sender(*this, rsp.header, rsp.body, rsp.body.events[rsp.nodes[i].first],
+                                   rsp.nodes[i].second);
+      for (std::list<watcher_list_callback_t>::iterator iter = rsp.callbacks->begin(); iter != rsp.callbacks->end();
+           ++iter) {
+        if (*iter) {
+          (*iter)(std::ref(sender));
+        }
+      }
+    }
+  }
+}
+
 void etcd_module::reset_inner_watchers_and_keepalives() {
   if (inner_watcher_by_name_) {
     etcd_ctx_.remove_watcher(inner_watcher_by_name_);
@@ -1203,7 +1766,264 @@ void etcd_module::reset_inner_watchers_and_keepalives() {
     inner_watcher_by_id_.reset();
   }
 
+  for (size_t i = 0; i < inner_watchers_by_filter_.size(); ++i) {
+    etcd_ctx_.remove_watcher(inner_watchers_by_filter_[i]);
+  }
+  inner_watchers_by_filter_.clear();
+
   inner_keepalive_actors_.clear();
 }
 
+void etcd_module::get_inner_watchers(std::vector<etcd_watcher::ptr_t> &out) const {
+  if (inner_watcher_by_id_) {
+    out.push_back(inner_watcher_by_id_);
+  }
+  if (inner_watcher_by_name_) {
+    out.push_back(inner_watcher_by_name_);
+  }
+  out.insert(out.end(), inner_watchers_by_filter_.begin(), inner_watchers_by_filter_.end());
+}
+
+int etcd_module::add_inner_watcher_by_filter(const std::string &watch_path) {
+  for (size_t i = 0; i < inner_watchers_by_filter_.size(); ++i) {
+    if (inner_watchers_by_filter_[i] && inner_watchers_by_filter_[i]->get_path() == watch_path) {
+      return 0;
+    }
+  }
+
+  atapp::etcd_watcher::ptr_t p = atapp::etcd_watcher::create(etcd_ctx_, watch_path, "+1");
+  if (!p) {
+    FWLOGERROR("create etcd_watcher by filter failed.");
+    return EN_ATBUS_ERR_MALLOC;
+  }
+
+  p->set_conf_request_timeout(detail::convert_to_chrono(get_configure().watcher().request_timeout(), 3600000));
+  p->set_conf_retry_interval(detail::convert_to_chrono(get_configure().watcher().retry_interval(), 15000));
+  etcd_ctx_.add_watcher(p);
+  FWLOGINFO("create etcd_watcher for filter index {} success", watch_path);
+
+  p->set_evt_handle(watcher_callback_list_wrapper_t(*this, NULL, watch_path));
+  inner_watchers_by_filter_.push_back(p);
+  return 0;
+}
+
+bool etcd_module::match_discovery_filter(const std::string *key, const atapp::protocol::atapp_discovery &node) const {
+  const atapp::protocol::atapp_etcd_discovery_filter &filter = get_configure().watcher().filter();
+
+  // Select by type or tag, the tag is only known from the path of key
+  if (filter.type_ids_size() > 0 || filter.type_names_size() > 0 || filter.tags_size() > 0) {
+    bool selected = NULL == key && filter.tags_size() > 0;
+    for (int i = 0; !selected && i < filter.type_ids_size(); ++i) {
+      selected = 0 != filter.type_ids(i) && filter.type_ids(i) == node.type_id();
+    }
+    for (int i = 0; !selected && i < filter.type_names_size(); ++i) {
+      selected = !filter.type_names(i).empty() && filter.type_names(i) == node.type_name();
+    }
+    for (size_t i = 0; !selected && NULL != key && i < discovery_filter_tag_paths_.size(); ++i) {
+      selected = key->size() > discovery_filter_tag_paths_[i].size() &&
+                 0 == key->compare(0, discovery_filter_tag_paths_[i].size(), discovery_filter_tag_paths_[i]);
+    }
+    if (!selected) {
+      return false;
+    }
+  }
+
+  bool has_valid_namespace = false;
+  bool has_matched_namespace = false;
+  for (int i = 0; !has_matched_namespace && i < filter.match_namespaces_size(); ++i) {
+    if (filter.match_namespaces(i).empty()) {
+      continue;
+    }
+    has_valid_namespace = true;
+    has_matched_namespace = filter.match_namespaces(i) == node.metadata().namespace_name();
+  }
+  if (has_valid_namespace && !has_matched_namespace) {
+    return false;
+  }
+
+  ATBUS_MACRO_PROTOBUF_NAMESPACE_ID::Map<std::string, std::string>::const_iterator iter = filter.match_labels().begin();
+  for (; iter != filter.match_labels().end(); ++iter) {
+    if (iter->first.empty() || iter->second.empty()) {
+      continue;
+    }
+
+    ATBUS_MACRO_PROTOBUF_NAMESPACE_ID::Map<std::string, std::string>::const_iterator node_label_iter =
+        node.metadata().labels().find(iter->first);
+    if (node_label_iter == node.metadata().labels().end()) {
+      return false;
+    }
+    if (node_label_iter->second != iter->second) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void etcd_module::evict_discovery_node(const node_info_t &node) {
+  bool cached = global_discovery_.get_node_by_id(node.node_discovery.id()) ||
+                global_discovery_.get_node_by_name(node.node_discovery.name());
+  if (!cached && !pending_events_.empty()) {
+    cached = pending_event_by_id_.end() != pending_event_by_id_.find(node.node_discovery.id()) ||
+             pending_event_by_name_.end() != pending_event_by_name_.find(node.node_discovery.name());
+  }
+  if (!cached) {
+    return;
+  }
+
+  node_info_t evict_node;
+  evict_node.node_discovery.set_id(node.node_discovery.id());
+  evict_node.node_discovery.set_name(node.node_discovery.name());
+  evict_node.action = node_action_t::EN_NAT_DELETE;
+  handle_inner_watcher_event(evict_node);
+}
+
+int etcd_module::load_discovery_snapshot() {
+  const std::string &file_path = get_configure().snapshot().path();
+  if (file_path.empty()) {
+    return 0;
+  }
+
+  std::string data;
+  {
+    std::fstream file;
+    file.open(file_path.c_str(), std::ios::in | std::ios::binary);
+    if (!file.is_open()) {
+      FWLOGINFO("discovery snapshot {} not found, skip warm start", file_path);
+      return 0;
+    }
+
+    std::stringstream ss;
+    ss << file.rdbuf();
+    data = ss.str();
+  }
+
+  atapp::protocol::atapp_discovery_snapshot snapshot;
+  if (!snapshot.ParseFromString(data)) {
+    FWLOGERROR("parse discovery snapshot {} failed, skip warm start", file_path);
+    return EN_ATAPP_ERR_LOAD_DISCOVERY_SNAPSHOT;
+  }
+
+  // The revision is meaningless if the watch paths are changed
+  std::vector<etcd_watcher::ptr_t> watchers;
+  get_inner_watchers(watchers);
+  int watcher_count = 0;
+  for (size_t i = 0; i < watchers.size(); ++i) {
+    if (!watchers[i]) {
+      continue;
+    }
+    ++watcher_count;
+
+    bool found = false;
+    for (int j = 0; !found && j < snapshot.watcher_paths_size(); ++j) {
+      found = snapshot.watcher_paths(j) == watchers[i]->get_path();
+    }
+    if (!found) {
+      FWLOGWARNING("discovery snapshot {} does not contain watcher path {}, skip warm start", file_path,
+                   watchers[i]->get_path());
+      return EN_ATAPP_ERR_LOAD_DISCOVERY_SNAPSHOT;
+    }
+  }
+  if (0 == watcher_count || watcher_count != snapshot.watcher_paths_size() || snapshot.revision() <= 0) {
+    FWLOGWARNING("discovery snapshot {} does not match current watchers, skip warm start", file_path);
+    return EN_ATAPP_ERR_LOAD_DISCOVERY_SNAPSHOT;
+  }
+
+  for (int i = 0; i < snapshot.nodes_size(); ++i) {
+    node_info_t node;
+    node.node_discovery.CopyFrom(snapshot.nodes(i));
+    node.action = node_action_t::EN_NAT_PUT;
+    if (node.node_discovery.id() == 0 && node.node_discovery.name().empty()) {
+      continue;
+    }
+    // Filter may be changed since last saving
+    if (!match_discovery_filter(NULL, node.node_discovery)) {
+      continue;
+    }
+
+    push_pending_event(node);
+    if (0 != node.node_discovery.id()) {
+      warm_start_ids_[node.node_discovery.id()] = true;
+    }
+    if (!node.node_discovery.name().empty()) {
+      warm_start_names_[node.node_discovery.name()] = true;
+    }
+  }
+
+  // All nodes are applied and dispatched in one batch
+  flush_pending_events();
+
+  // Resume watching from the saved revision, watcher will fall back to range request if it's compacted
+  for (size_t i = 0; i < watchers.size(); ++i) {
+    watchers[i]->set_last_revision(snapshot.revision());
+    warm_start_watcher_paths_[watchers[i]->get_path()] = true;
+  }
+
+  FWLOGINFO("load {} nodes from discovery snapshot {} with revision {}", snapshot.nodes_size(), file_path,
+            static_cast<long long>(snapshot.revision()));
+  return 0;
+}
+
+void etcd_module::confirm_warm_start_node(const atapp::protocol::atapp_discovery &node) {
+  if (0 != node.id()) {
+    warm_start_ids_.erase(node.id());
+  }
+  if (!node.name().empty()) {
+    warm_start_names_.erase(node.name());
+  }
+}
+
+void etcd_module::finish_warm_start(const std::string &watcher_path) {
+  // Nodes may come from any inner watcher, wait for range responses of all of them
+  warm_start_watcher_paths_.erase(watcher_path);
+  if (!warm_start_watcher_paths_.empty()) {
+    return;
+  }
+
+  if (warm_start_ids_.empty() && warm_start_names_.empty()) {
+    return;
+  }
+
+  // Move them out first, flush_pending_events() may be reentered by callbacks
+  flat_hash_map<uint64_t, bool> stale_ids;
+  flat_hash_map<std::string, bool> stale_names;
+  stale_ids.swap(warm_start_ids_);
+  stale_names.swap(warm_start_names_);
+
+  for (flat_hash_map<uint64_t, bool>::const_iterator iter = stale_ids.begin(); iter != stale_ids.end(); ++iter) {
+    node_info_t node;
+    node.node_discovery.set_id(iter->first);
+    node.action = node_action_t::EN_NAT_DELETE;
+    push_pending_event(node);
+  }
+
+  for (flat_hash_map<std::string, bool>::const_iterator iter = stale_names.begin(); iter != stale_names.end();
+       ++iter) {
+    node_info_t node;
+    node.node_discovery.set_name(iter->first);
+    node.action = node_action_t::EN_NAT_DELETE;
+    push_pending_event(node);
+  }
+
+  // Stale nodes are removed in one batch, they are flushed by next tick if etcd.watcher.batch_events is true
+  if (!get_configure().watcher().batch_events()) {
+    flush_pending_events();
+  }
+
+  FWLOGINFO("remove {} stale nodes from discovery snapshot", stale_ids.size() + stale_names.size());
+}
+
+void etcd_module::resume_warm_start(const std::string &watcher_path) {
+  if (warm_start_watcher_paths_.end() == warm_start_watcher_paths_.find(watcher_path)) {
+    return;
+  }
+
+  // Nodes removed after the revision of snapshot are replayed by watch events, so nodes from snapshot need not be
+  // confirmed any more. All watchers resume from the same revision, so they are compacted or resumed together
+  warm_start_watcher_paths_.clear();
+  warm_start_ids_.clear();
+  warm_start_names_.clear();
+  FWLOGINFO("watcher {} resumed from discovery snapshot", watcher_path);
+}
+
 }  // namespace atapp
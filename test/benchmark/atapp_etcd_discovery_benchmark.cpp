@@ -0,0 +1,116 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <atframe/etcdcli/etcd_discovery.h>
+
+static atapp::etcd_discovery_node::ptr_t atapp_etcd_discovery_benchmark_make_node(uint64_t id,
+                                                                                  const std::string &name) {
+  atapp::protocol::atapp_discovery info;
+  info.set_id(id);
+  info.set_name(name);
+
+  atapp::etcd_discovery_node::ptr_t ret = std::make_shared<atapp::etcd_discovery_node>();
+  ret->copy_from(info);
+  return ret;
+}
+
+static int64_t atapp_etcd_discovery_benchmark_ns(std::chrono::steady_clock::time_point start,
+                                                 std::chrono::steady_clock::time_point end, uint64_t count) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / static_cast<int64_t>(count);
+}
+
+static const atapp::etcd_discovery_consistent_hash_policy_t::type atapp_etcd_discovery_benchmark_policies[] = {
+    atapp::etcd_discovery_consistent_hash_policy_t::EN_CHP_RING,
+    atapp::etcd_discovery_consistent_hash_policy_t::EN_CHP_MAGLEV,
+    atapp::etcd_discovery_consistent_hash_policy_t::EN_CHP_JUMP,
+    atapp::etcd_discovery_consistent_hash_policy_t::EN_CHP_RENDEZVOUS,
+};
+
+static const char *atapp_etcd_discovery_benchmark_policy_names[] = {"ring", "maglev", "jump", "rendezvous"};
+
+// Lookup cost and keys moved after removing a node, of each consistent hash policy
+static void atapp_etcd_discovery_benchmark_policy(atapp::etcd_discovery_set &discovery_set, uint64_t node_count,
+                                                  uint64_t key_count) {
+  for (size_t p = 0;
+       p < sizeof(atapp_etcd_discovery_benchmark_policies) / sizeof(atapp_etcd_discovery_benchmark_policies[0]); ++p) {
+    atapp::etcd_discovery_consistent_hash_policy_t::type policy = atapp_etcd_discovery_benchmark_policies[p];
+    // Build cache before timing
+    discovery_set.get_node_by_consistent_hash(static_cast<uint64_t>(0), policy);
+
+    std::vector<uint64_t> before;
+    before.reserve(key_count);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (uint64_t key = 0; key < key_count; ++key) {
+      before.push_back(discovery_set.get_node_by_consistent_hash(key, policy)->get_discovery_info().id());
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    // Remove a node in the middle and count moved keys
+    atapp::etcd_discovery_node::ptr_t removed = discovery_set.get_node_by_id(node_count / 2);
+    discovery_set.remove_node(removed);
+    uint64_t moved = 0;
+    for (uint64_t key = 0; key < key_count; ++key) {
+      if (before[key] != discovery_set.get_node_by_consistent_hash(key, policy)->get_discovery_info().id()) {
+        ++moved;
+      }
+    }
+    discovery_set.add_node(removed);
+
+    std::cout << atapp_etcd_discovery_benchmark_policy_names[p] << ": "
+              << atapp_etcd_discovery_benchmark_ns(start, end, key_count) << "ns/lookup, " << moved << "/"
+              << key_count << " keys moved after removing 1 of " << node_count << " nodes" << std::endl;
+  }
+}
+
+// Lookup cost of searching hash ring one by one and merging sorted keys with it
+static void atapp_etcd_discovery_benchmark_batch(atapp::etcd_discovery_set &discovery_set, uint64_t key_count) {
+  std::vector<uint64_t> keys;
+  keys.reserve(key_count);
+  for (uint64_t key = 0; key < key_count; ++key) {
+    keys.push_back(key * 7);
+  }
+
+  std::vector<atapp::etcd_discovery_node::ptr_t> nodes;
+  nodes.reserve(keys.size());
+  discovery_set.get_node_by_consistent_hash(static_cast<uint64_t>(0));
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < keys.size(); ++i) {
+    nodes.push_back(discovery_set.get_node_by_consistent_hash(keys[i]));
+  }
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+  nodes.clear();
+  discovery_set.get_node_by_consistent_hash_batch(&keys[0], keys.size(), nodes,
+                                                  atapp::etcd_discovery_consistent_hash_policy_t::EN_CHP_RING);
+  std::chrono::steady_clock::time_point batch_end = std::chrono::steady_clock::now();
+
+  std::cout << "ring: " << atapp_etcd_discovery_benchmark_ns(start, end, key_count)
+            << "ns/lookup, batch: " << atapp_etcd_discovery_benchmark_ns(end, batch_end, key_count) << "ns/lookup"
+            << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  uint64_t node_count = 1000;
+  uint64_t key_count = 200000;
+  if (argc > 1) {
+    node_count = static_cast<uint64_t>(std::stoull(argv[1]));
+  }
+  if (argc > 2) {
+    key_count = static_cast<uint64_t>(std::stoull(argv[2]));
+  }
+  if (node_count < 2 || key_count < 1) {
+    std::cerr << "Usage: " << argv[0] << " [node count(>=2)] [key count(>=1)]" << std::endl;
+    return 1;
+  }
+
+  atapp::etcd_discovery_set discovery_set;
+  for (uint64_t i = 1; i <= node_count; ++i) {
+    discovery_set.add_node(atapp_etcd_discovery_benchmark_make_node(i, "node-" + std::to_string(i)));
+  }
+
+  atapp_etcd_discovery_benchmark_policy(discovery_set, node_count, key_count);
+  atapp_etcd_discovery_benchmark_batch(discovery_set, key_count);
+  return 0;
+}
@@ -0,0 +1,115 @@
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <atframe/atapp_compression.h>
+
+#include "frame/test_macros.h"
+
+CASE_TEST(atapp_compression, select_algorithm) {
+  atapp::protocol::atapp_compression conf;
+  atapp::protocol::atapp_discovery remote;
+
+  conf.add_algorithms(atapp::protocol::ATAPP_COMPRESSION_ZSTD);
+  conf.add_algorithms(atapp::protocol::ATAPP_COMPRESSION_LZ4);
+
+  // Remote do not report any algorithm
+  CASE_EXPECT_EQ(atapp::protocol::ATAPP_COMPRESSION_NONE,
+                 atapp::message_compression::select_algorithm(conf, remote));
+
+  // Remote do not reserve a message type for compressed messages
+  remote.add_compression_algorithms(atapp::protocol::ATAPP_COMPRESSION_LZ4);
+  CASE_EXPECT_EQ(atapp::protocol::ATAPP_COMPRESSION_NONE,
+                 atapp::message_compression::select_algorithm(conf, remote));
+
+  remote.set_compression_message_type(1000);
+  if (atapp::message_compression::is_algorithm_supported(atapp::protocol::ATAPP_COMPRESSION_LZ4)) {
+    CASE_EXPECT_EQ(atapp::protocol::ATAPP_COMPRESSION_LZ4, atapp::message_compression::select_algorithm(conf, remote));
+  } else {
+    CASE_EXPECT_EQ(atapp::protocol::ATAPP_COMPRESSION_NONE,
+                   atapp::message_compression::select_algorithm(conf, remote));
+  }
+
+  // Nothing is reported without a reserved message type
+  atapp::protocol::atapp_discovery self;
+  atapp::message_compression::pack_supported_algorithms(conf, self);
+  CASE_EXPECT_EQ(0, self.compression_algorithms_size());
+  CASE_EXPECT_EQ(0, self.compression_message_type());
+  CASE_EXPECT_FALSE(atapp::message_compression::has_supported_algorithm(conf));
+
+  conf.set_message_type(1000);
+  atapp::message_compression::pack_supported_algorithms(conf, self);
+  CASE_EXPECT_EQ(1000, self.compression_message_type());
+  for (int i = 0; i < self.compression_algorithms_size(); ++i) {
+    CASE_EXPECT_TRUE(atapp::message_compression::is_algorithm_supported(self.compression_algorithms(i)));
+  }
+}
+
+CASE_TEST(atapp_compression, match_message) {
+  atapp::protocol::atapp_compression conf;
+  conf.set_threshold(1024);
+  CASE_EXPECT_FALSE(atapp::message_compression::match_message(conf, 1, 4096));
+
+  conf.add_algorithms(atapp::protocol::ATAPP_COMPRESSION_ZSTD);
+  CASE_EXPECT_TRUE(atapp::message_compression::match_message(conf, 1, 4096));
+  CASE_EXPECT_FALSE(atapp::message_compression::match_message(conf, 1, 512));
+
+  conf.add_message_types(2);
+  CASE_EXPECT_FALSE(atapp::message_compression::match_message(conf, 1, 4096));
+  CASE_EXPECT_TRUE(atapp::message_compression::match_message(conf, 2, 4096));
+
+  // All message types can be compressed, including negative ones
+  conf.clear_message_types();
+  CASE_EXPECT_TRUE(atapp::message_compression::match_message(conf, -1, 4096));
+  CASE_EXPECT_TRUE(atapp::message_compression::match_message(conf, 0x40000001, 4096));
+}
+
+CASE_TEST(atapp_compression, compressed_type) {
+  // Only the reserved message type is recognized as compressed
+  CASE_EXPECT_FALSE(atapp::message_compression::is_compressed_type(0, 0));
+  CASE_EXPECT_FALSE(atapp::message_compression::is_compressed_type(0, 123));
+  CASE_EXPECT_FALSE(atapp::message_compression::is_compressed_type(1000, 123));
+  CASE_EXPECT_FALSE(atapp::message_compression::is_compressed_type(1000, -1));
+  CASE_EXPECT_FALSE(atapp::message_compression::is_compressed_type(1000, 0x40000000 | 1000));
+  CASE_EXPECT_TRUE(atapp::message_compression::is_compressed_type(1000, 1000));
+}
+
+CASE_TEST(atapp_compression, compress_and_decompress) {
+  std::string input;
+  for (int i = 0; i < 256; ++i) {
+    input += "hello world, this is a compression test of atapp. ";
+  }
+
+  atapp::protocol::atapp_compression_algorithm_t algorithms[] = {atapp::protocol::ATAPP_COMPRESSION_ZSTD,
+                                                                 atapp::protocol::ATAPP_COMPRESSION_LZ4};
+  for (size_t i = 0; i < sizeof(algorithms) / sizeof(algorithms[0]); ++i) {
+    std::vector<unsigned char> compressed;
+    int32_t res =
+        atapp::message_compression::compress(algorithms[i], 0, -123, input.data(), input.size(), compressed);
+    if (!atapp::message_compression::is_algorithm_supported(algorithms[i])) {
+      CASE_EXPECT_EQ(atapp::EN_ATAPP_ERR_COMPRESSION_NOT_SUPPORT, res);
+      continue;
+    }
+
+    CASE_EXPECT_EQ(0, res);
+    CASE_EXPECT_LT(compressed.size(), input.size());
+    std::vector<unsigned char> output;
+    int32_t type = 0;
+    res = atapp::message_compression::decompress(&compressed[0], compressed.size(), 0, output, type);
+    CASE_EXPECT_EQ(0, res);
+    CASE_EXPECT_EQ(-123, type);
+    CASE_EXPECT_EQ(input.size(), output.size());
+    if (input.size() == output.size()) {
+      CASE_EXPECT_EQ(0, memcmp(input.data(), &output[0], output.size()));
+    }
+
+    // Limit of decompressed size
+    res = atapp::message_compression::decompress(&compressed[0], compressed.size(), input.size() - 1, output, type);
+    CASE_EXPECT_NE(0, res);
+  }
+
+  // Data which is not generated by compress(...) is rejected
+  std::vector<unsigned char> output;
+  int32_t type = 0;
+  CASE_EXPECT_NE(0, atapp::message_compression::decompress(input.data(), input.size(), 0, output, type));
+}
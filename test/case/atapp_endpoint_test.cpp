@@ -0,0 +1,453 @@
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <atframe/atapp.h>
+#include <atframe/atapp_compression.h>
+#include <atframe/connectors/atapp_connector_impl.h>
+#include <atframe/connectors/atapp_endpoint.h>
+
+#include <common/file_system.h>
+
+#include "frame/test_macros.h"
+
+namespace {
+class atapp_endpoint_test_connector : public atapp::atapp_connector_impl {
+ public:
+  struct sent_message_t {
+    uint64_t target_node_id;
+    int32_t type;
+    std::string data;
+  };
+
+  explicit atapp_endpoint_test_connector(atapp::app &owner)
+      : atapp::atapp_connector_impl(owner),
+        auto_ready(true),
+        connect_error_code(0),
+        connect_count(0),
+        forward_response(false),
+        failed_node_id(0),
+        batch_count(0) {
+    register_protocol("testep");
+  }
+
+  ~atapp_endpoint_test_connector() {
+    for (size_t i = 0; i < handles.size(); ++i) {
+      if (handles[i]) {
+        handles[i]->close();
+      }
+    }
+    handles.clear();
+    cleanup();
+  }
+
+  const char *name() UTIL_CONFIG_NOEXCEPT UTIL_CONFIG_OVERRIDE { return "atapp_endpoint_test_connector"; }
+
+  bool has_forward_response() const UTIL_CONFIG_NOEXCEPT UTIL_CONFIG_OVERRIDE { return forward_response; }
+
+  uint32_t get_address_type(const atbus::channel::channel_address_t &) const UTIL_CONFIG_OVERRIDE {
+    return address_type_t::EN_ACAT_DUPLEX | address_type_t::EN_ACAT_LOCAL_PROCESS;
+  }
+
+  int32_t on_start_connect(const atapp::etcd_discovery_node *, const atbus::channel::channel_address_t &,
+                           const atapp::atapp_connection_handle::ptr_t &handle) UTIL_CONFIG_OVERRIDE {
+    ++connect_count;
+    if (0 != connect_error_code) {
+      return connect_error_code;
+    }
+
+    handles.push_back(handle);
+    if (auto_ready) {
+      handle->set_ready();
+    }
+    return 0;
+  }
+
+  int32_t on_send_forward_request(atapp::atapp_connection_handle *handle, int32_t type, uint64_t *, const void *data,
+                                  size_t data_size, const atapp::protocol::atapp_metadata *) UTIL_CONFIG_OVERRIDE {
+    uint64_t target_node_id = 0;
+    if (NULL != handle && NULL != handle->get_endpoint()) {
+      target_node_id = handle->get_endpoint()->get_id();
+    }
+    if (0 != failed_node_id && target_node_id == failed_node_id) {
+      return EN_ATBUS_ERR_BUFF_LIMIT;
+    }
+
+    sent_message_t msg;
+    msg.target_node_id = target_node_id;
+    msg.type = type;
+    msg.data.assign(reinterpret_cast<const char *>(data), data_size);
+    sent_messages.push_back(msg);
+    return 0;
+  }
+
+  void on_send_forward_request_batch(atapp::atapp_connection_handle *handle,
+                                     atapp::atapp_forward_request_t *const *requests,
+                                     size_t count) UTIL_CONFIG_OVERRIDE {
+    ++batch_count;
+    atapp::atapp_connector_impl::on_send_forward_request_batch(handle, requests, count);
+  }
+
+  bool auto_ready;
+  int32_t connect_error_code;
+  size_t connect_count;
+  bool forward_response;
+  uint64_t failed_node_id;
+  size_t batch_count;
+  std::vector<sent_message_t> sent_messages;
+  std::vector<atapp::atapp_connection_handle::ptr_t> handles;
+};
+
+static atapp::etcd_discovery_node::ptr_t create_test_discovery_node(uint64_t id, const std::string &name) {
+  atapp::protocol::atapp_discovery info;
+  info.set_id(id);
+  info.set_name(name);
+  info.add_listen("testep://" + name);
+
+  atapp::etcd_discovery_node::ptr_t ret = std::make_shared<atapp::etcd_discovery_node>();
+  ret->copy_from(info);
+  return ret;
+}
+
+static bool load_test_configure(atapp::app &app, const char *file_name) {
+  std::string conf_path;
+  util::file_system::dirname(__FILE__, 0, conf_path);
+  conf_path += "/";
+  conf_path += file_name;
+
+  if (!util::file_system::is_exist(conf_path.c_str())) {
+    CASE_MSG_INFO() << CASE_MSG_FCOLOR(YELLOW) << conf_path << " not found, skip" << std::endl;
+    return false;
+  }
+
+  const char *argv[] = {"unit-test", "-c", &conf_path[0], "--version"};
+  app.init(NULL, 4, argv);
+  app.reload();
+  return true;
+}
+
+static void set_test_batch_item(atapp::app::send_message_batch_item_t &item, uint64_t target_node_id,
+                                const char *data) {
+  memset(&item, 0, sizeof(item));
+  item.target_node_id = target_node_id;
+  item.request.type = 1;
+  item.request.data = data;
+  item.request.data_size = NULL == data ? 0 : strlen(data);
+  item.request.result = -1;
+}
+}  // namespace
+
+CASE_TEST(atapp_endpoint, send_message_batch) {
+  atapp::app app;
+  std::shared_ptr<atapp_endpoint_test_connector> connector = app.add_connector<atapp_endpoint_test_connector>();
+  CASE_EXPECT_TRUE(!!connector);
+  if (!connector) {
+    return;
+  }
+
+  atapp::atapp_endpoint::ptr_t ep1 = app.mutable_endpoint(create_test_discovery_node(0x101, "ep-1"));
+  atapp::atapp_endpoint::ptr_t ep2 = app.mutable_endpoint(create_test_discovery_node(0x102, "ep-2"));
+  CASE_EXPECT_TRUE(ep1 && NULL != ep1->get_ready_connection_handle());
+  CASE_EXPECT_TRUE(ep2 && NULL != ep2->get_ready_connection_handle());
+  connector->failed_node_id = 0x102;
+
+  int32_t failed_response_count = 0;
+  app.set_evt_on_forward_response(
+      [&failed_response_count](atapp::app &, const atapp::app::message_sender_t &, const atapp::app::message_t &,
+                               int32_t error_code) {
+        if (0 != error_code) {
+          ++failed_response_count;
+        }
+        return 0;
+      });
+
+  atapp::app::send_message_batch_item_t items[5];
+  set_test_batch_item(items[0], 0x102, "a");
+  set_test_batch_item(items[1], 0x101, "b");
+  set_test_batch_item(items[2], 0x103, "c");  // No endpoint and atbus is not initialized
+  set_test_batch_item(items[3], 0x101, NULL);
+  set_test_batch_item(items[4], 0x101, "d");
+
+  // Return value is the first failed item in input order
+  CASE_EXPECT_EQ(EN_ATBUS_ERR_BUFF_LIMIT, app.send_message_batch(items, 5));
+  CASE_EXPECT_EQ(EN_ATBUS_ERR_BUFF_LIMIT, items[0].request.result);
+  CASE_EXPECT_EQ(0, items[1].request.result);
+  CASE_EXPECT_EQ(EN_ATAPP_ERR_NOT_INITED, items[2].request.result);
+  CASE_EXPECT_EQ(0, items[3].request.result);
+  CASE_EXPECT_EQ(0, items[4].request.result);
+  CASE_EXPECT_EQ(1, failed_response_count);
+
+  // Messages are grouped by target and keep their order, the empty message is finished without sending
+  CASE_EXPECT_EQ(3, connector->batch_count);
+  CASE_EXPECT_EQ(2, connector->sent_messages.size());
+  if (connector->sent_messages.size() >= 2) {
+    CASE_EXPECT_EQ(0x101, connector->sent_messages[0].target_node_id);
+    CASE_EXPECT_EQ("b", connector->sent_messages[0].data);
+    CASE_EXPECT_EQ(0x101, connector->sent_messages[1].target_node_id);
+    CASE_EXPECT_EQ("d", connector->sent_messages[1].data);
+  }
+
+  // The same result as sending them one by one
+  uint64_t msg_sequence = 0;
+  CASE_EXPECT_EQ(0, ep1->push_forward_message(1, msg_sequence, NULL, 0, NULL));
+  CASE_EXPECT_EQ(EN_ATBUS_ERR_BUFF_LIMIT, ep2->push_forward_message(1, msg_sequence, "a", 1, NULL));
+  CASE_EXPECT_EQ(2, connector->sent_messages.size());
+}
+
+CASE_TEST(atapp_endpoint, send_message_batch_compression) {
+  if (!atapp::message_compression::is_algorithm_supported(atapp::protocol::ATAPP_COMPRESSION_ZSTD) &&
+      !atapp::message_compression::is_algorithm_supported(atapp::protocol::ATAPP_COMPRESSION_LZ4)) {
+    CASE_MSG_INFO() << CASE_MSG_FCOLOR(YELLOW) << "compression is not enabled, skip" << std::endl;
+    return;
+  }
+
+  atapp::app app;
+  if (!load_test_configure(app, "atapp_endpoint_test.compression.yaml")) {
+    return;
+  }
+
+  std::shared_ptr<atapp_endpoint_test_connector> connector = app.add_connector<atapp_endpoint_test_connector>();
+  CASE_EXPECT_TRUE(!!connector);
+  if (!connector) {
+    return;
+  }
+
+  atapp::etcd_discovery_node::ptr_t discovery = create_test_discovery_node(0x101, "ep-1");
+  atapp::protocol::atapp_discovery info = discovery->get_discovery_info();
+  info.add_compression_algorithms(atapp::protocol::ATAPP_COMPRESSION_ZSTD);
+  info.add_compression_algorithms(atapp::protocol::ATAPP_COMPRESSION_LZ4);
+  info.set_compression_message_type(0x7f000002);
+  discovery->copy_from(info);
+
+  atapp::atapp_endpoint::ptr_t ep = app.mutable_endpoint(discovery);
+  CASE_EXPECT_TRUE(ep && NULL != ep->get_ready_connection_handle());
+  if (!ep) {
+    return;
+  }
+
+  std::string large_data(1024, 'a');
+  atapp::atapp_forward_request_t requests[2];
+  atapp::atapp_forward_request_t *request_ptrs[2] = {&requests[0], &requests[1]};
+  memset(requests, 0, sizeof(requests));
+  requests[0].type = 1;
+  requests[0].data = large_data.data();
+  requests[0].data_size = large_data.size();
+  requests[0].result = -1;
+  requests[1].type = 2;
+  requests[1].data = "b";
+  requests[1].data_size = 1;
+  requests[1].result = -1;
+
+  // Both messages are sent by one call, only the large one is compressed
+  CASE_EXPECT_EQ(2, ep->push_forward_message_batch(request_ptrs, 2));
+  CASE_EXPECT_EQ(1, connector->batch_count);
+  CASE_EXPECT_EQ(0, requests[0].result);
+  CASE_EXPECT_EQ(0, requests[1].result);
+  CASE_EXPECT_EQ(2, connector->sent_messages.size());
+  if (connector->sent_messages.size() < 2) {
+    return;
+  }
+
+  // Requests passed in are not modified
+  CASE_EXPECT_EQ(1, requests[0].type);
+  CASE_EXPECT_TRUE(large_data.data() == requests[0].data);
+  CASE_EXPECT_EQ(large_data.size(), requests[0].data_size);
+
+  CASE_EXPECT_EQ(0x7f000002, connector->sent_messages[0].type);
+  CASE_EXPECT_LT(connector->sent_messages[0].data.size(), large_data.size());
+  std::vector<unsigned char> decompressed;
+  int32_t original_type = 0;
+  CASE_EXPECT_EQ(0, atapp::message_compression::decompress(connector->sent_messages[0].data.data(),
+                                                           connector->sent_messages[0].data.size(), 1024 * 1024,
+                                                           decompressed, original_type));
+  CASE_EXPECT_EQ(1, original_type);
+  CASE_EXPECT_TRUE(std::string(decompressed.begin(), decompressed.end()) == large_data);
+
+  CASE_EXPECT_EQ(2, connector->sent_messages[1].type);
+  CASE_EXPECT_EQ("b", connector->sent_messages[1].data);
+}
+
+CASE_TEST(atapp_endpoint, send_message_by_bounded_load) {
+  atapp::app app;
+  if (!load_test_configure(app, "atapp_endpoint_test.bounded_load.yaml")) {
+    return;
+  }
+
+  // Messages are finished once they are sent, the same as atbus
+  std::shared_ptr<atapp_endpoint_test_connector> connector = app.add_connector<atapp_endpoint_test_connector>();
+  CASE_EXPECT_TRUE(!!connector);
+  if (!connector) {
+    return;
+  }
+  CASE_EXPECT_FALSE(connector->has_forward_response());
+
+  atapp::etcd_discovery_set discovery_set;
+  for (uint64_t i = 1; i <= 4; ++i) {
+    discovery_set.add_node(create_test_discovery_node(0x100 + i, "ep-" + std::to_string(i)));
+  }
+
+  // All messages use the same hot key, no node should be over (1 + 25%) * average
+  uint64_t hot_key = 42;
+  atapp::etcd_discovery_consistent_hash_policy_t::type policy =
+      atapp::etcd_discovery_consistent_hash_policy_t::EN_CHP_BOUNDED_LOAD;
+  for (int i = 0; i < 100; ++i) {
+    CASE_EXPECT_EQ(0, app.send_message_by_consistent_hash(discovery_set, policy, hot_key, 1, "a", 1));
+  }
+  CASE_EXPECT_EQ(0, app.get_endpoint_inflight_message_count());
+  CASE_EXPECT_EQ(100, connector->sent_messages.size());
+
+  std::vector<size_t> counts;
+  counts.resize(5, 0);
+  for (size_t i = 0; i < connector->sent_messages.size(); ++i) {
+    uint64_t index = connector->sent_messages[i].target_node_id - 0x100;
+    CASE_EXPECT_TRUE(index >= 1 && index <= 4);
+    if (index >= 1 && index <= 4) {
+      ++counts[index];
+    }
+  }
+  for (size_t i = 1; i <= 4; ++i) {
+    CASE_EXPECT_LE(counts[i], 32);
+  }
+}
+
+CASE_TEST(atapp_endpoint, shared_payload_lifetime) {
+  atapp::app app;
+  std::shared_ptr<atapp_endpoint_test_connector> connector = app.add_connector<atapp_endpoint_test_connector>();
+  CASE_EXPECT_TRUE(!!connector);
+  if (!connector) {
+    return;
+  }
+
+  // Connections are not ready, so messages are kept in pending lists
+  connector->auto_ready = false;
+  atapp::atapp_endpoint::ptr_t ep1 = app.mutable_endpoint(create_test_discovery_node(0x101, "ep-1"));
+  atapp::atapp_endpoint::ptr_t ep2 = app.mutable_endpoint(create_test_discovery_node(0x102, "ep-2"));
+  CASE_EXPECT_TRUE(ep1 && NULL == ep1->get_ready_connection_handle());
+  CASE_EXPECT_TRUE(ep2 && NULL == ep2->get_ready_connection_handle());
+  CASE_EXPECT_EQ(2, connector->handles.size());
+  if (!ep1 || !ep2 || connector->handles.size() < 2) {
+    return;
+  }
+
+  atapp::atapp_endpoint::shared_payload_ptr_t payload = std::make_shared<std::string>("shared payload");
+  std::weak_ptr<const std::string> payload_watcher = payload;
+  uint64_t msg_sequence = 0;
+  CASE_EXPECT_EQ(0, ep1->push_forward_message_shared(1, msg_sequence, payload, NULL));
+  CASE_EXPECT_EQ(0, ep2->push_forward_message_shared(1, msg_sequence, payload, NULL));
+  payload.reset();
+  CASE_EXPECT_FALSE(payload_watcher.expired());
+  CASE_EXPECT_EQ(1, ep1->get_pending_message_count());
+  CASE_EXPECT_EQ(1, ep2->get_pending_message_count());
+
+  // Delivered by ep1, ep2 still holds it
+  connector->handles[0]->set_ready();
+  CASE_EXPECT_EQ(1, ep1->retry_pending_messages(app.get_last_tick_time(), 0));
+  CASE_EXPECT_EQ(0, ep1->get_pending_message_count());
+  CASE_EXPECT_EQ(1, connector->sent_messages.size());
+  if (!connector->sent_messages.empty()) {
+    CASE_EXPECT_EQ("shared payload", connector->sent_messages[0].data);
+  }
+  CASE_EXPECT_FALSE(payload_watcher.expired());
+
+  // Expired in ep2 and released
+  CASE_EXPECT_EQ(1, ep2->retry_pending_messages(app.get_last_tick_time() + std::chrono::hours(24), 0));
+  CASE_EXPECT_EQ(0, ep2->get_pending_message_count());
+  CASE_EXPECT_EQ(1, connector->sent_messages.size());
+  CASE_EXPECT_TRUE(payload_watcher.expired());
+}
+
+CASE_TEST(atapp_endpoint, connect_once) {
+  atapp::app app;
+  std::shared_ptr<atapp_endpoint_test_connector> connector = app.add_connector<atapp_endpoint_test_connector>();
+  CASE_EXPECT_TRUE(!!connector);
+  if (!connector) {
+    return;
+  }
+
+  connector->auto_ready = false;
+  atapp::etcd_discovery_node::ptr_t node = create_test_discovery_node(0x101, "ep-1");
+  atapp::atapp_endpoint::ptr_t ep = app.mutable_endpoint(node);
+  CASE_EXPECT_TRUE(ep && ep->has_connection_handle());
+  CASE_EXPECT_EQ(1, connector->connect_count);
+
+  // The first attempt is still connecting, no more attempts
+  for (int i = 0; i < 3; ++i) {
+    CASE_EXPECT_TRUE(ep == app.mutable_endpoint(node));
+  }
+  CASE_EXPECT_EQ(0, app.send_message(0x101, 1, "a", 1));
+  CASE_EXPECT_EQ(0, app.send_message(std::string("ep-1"), 1, "b", 1));
+  CASE_EXPECT_EQ(1, connector->connect_count);
+  CASE_EXPECT_EQ(2, ep->get_pending_message_count());
+
+  // Sending to a cached endpoint connects again after the attempt failed
+  CASE_EXPECT_EQ(1, connector->handles.size());
+  if (!connector->handles.empty()) {
+    connector->handles[0]->close();
+  }
+  CASE_EXPECT_FALSE(ep->has_connection_handle());
+  CASE_EXPECT_EQ(0, app.send_message(0x101, 1, "c", 1));
+  CASE_EXPECT_EQ(2, connector->connect_count);
+  CASE_EXPECT_TRUE(ep->has_connection_handle());
+
+  // Failed synchronously, wait for the retry interval
+  connector->connect_error_code = EN_ATBUS_ERR_PARAMS;
+  atapp::etcd_discovery_node::ptr_t failed_node = create_test_discovery_node(0x102, "ep-2");
+  atapp::atapp_endpoint::ptr_t failed_ep = app.mutable_endpoint(failed_node);
+  CASE_EXPECT_TRUE(failed_ep && !failed_ep->has_connection_handle());
+  CASE_EXPECT_EQ(3, connector->connect_count);
+  app.mutable_endpoint(failed_node);
+  app.send_message(0x102, 1, "d", 1);
+  CASE_EXPECT_EQ(3, connector->connect_count);
+}
+
+CASE_TEST(atapp_endpoint, inflight_messages) {
+  atapp::app app;
+  std::shared_ptr<atapp_endpoint_test_connector> connector = app.add_connector<atapp_endpoint_test_connector>();
+  CASE_EXPECT_TRUE(!!connector);
+  if (!connector) {
+    return;
+  }
+
+  connector->auto_ready = false;
+  atapp::atapp_endpoint::ptr_t ep = app.mutable_endpoint(create_test_discovery_node(0x101, "ep-1"));
+  CASE_EXPECT_TRUE(!!ep);
+  CASE_EXPECT_EQ(1, connector->handles.size());
+  if (!ep || connector->handles.empty()) {
+    return;
+  }
+
+  // Pending messages are in flight until sent
+  uint64_t msg_sequence = 0;
+  CASE_EXPECT_EQ(0, ep->push_forward_message(1, msg_sequence, "a", 1, NULL));
+  CASE_EXPECT_EQ(1, ep->get_inflight_message_count());
+  CASE_EXPECT_EQ(1, app.get_endpoint_inflight_message_count());
+
+  // Connector without forward response finishes messages once they are sent
+  connector->handles[0]->set_ready();
+  CASE_EXPECT_EQ(1, ep->retry_pending_messages(app.get_last_tick_time(), 0));
+  CASE_EXPECT_EQ(0, ep->get_inflight_message_count());
+  CASE_EXPECT_EQ(0, ep->push_forward_message(1, msg_sequence, "b", 1, NULL));
+  CASE_EXPECT_EQ(0, ep->get_inflight_message_count());
+  CASE_EXPECT_EQ(0, app.get_endpoint_inflight_message_count());
+
+  // Connector with forward response keeps them until it receives the responses
+  connector->forward_response = true;
+  CASE_EXPECT_EQ(0, ep->push_forward_message(1, msg_sequence, "c", 1, NULL));
+  atapp::app::send_message_batch_item_t items[2];
+  set_test_batch_item(items[0], 0x101, "d");
+  set_test_batch_item(items[1], 0x101, "e");
+  CASE_EXPECT_EQ(0, app.send_message_batch(items, 2));
+  CASE_EXPECT_EQ(3, ep->get_inflight_message_count());
+  CASE_EXPECT_EQ(3, app.get_endpoint_inflight_message_count());
+  ep->finish_inflight_messages(3);
+  CASE_EXPECT_EQ(0, ep->get_inflight_message_count());
+  CASE_EXPECT_EQ(0, app.get_endpoint_inflight_message_count());
+
+  // Failed messages are never in flight
+  connector->failed_node_id = 0x101;
+  CASE_EXPECT_EQ(EN_ATBUS_ERR_BUFF_LIMIT, ep->push_forward_message(1, msg_sequence, "f", 1, NULL));
+  CASE_EXPECT_EQ(0, ep->get_inflight_message_count());
+  CASE_EXPECT_EQ(5, connector->sent_messages.size());
+}
@@ -0,0 +1,918 @@
+#include <string>
+#include <vector>
+
+#include <algorithm/murmur_hash.h>
+
+#include <atframe/etcdcli/etcd_discovery.h>
+
+#include "frame/test_macros.h"
+
+static atapp::etcd_discovery_node::ptr_t atapp_etcd_discovery_test_make_node(uint64_t id, const std::string &name) {
+  atapp::protocol::atapp_discovery info;
+  info.set_id(id);
+  info.set_name(name);
+
+  atapp::etcd_discovery_node::ptr_t ret = std::make_shared<atapp::etcd_discovery_node>();
+  ret->copy_from(info);
+  return ret;
+}
+
+static void atapp_etcd_discovery_test_check_same(const atapp::etcd_discovery_set &l,
+                                                 const atapp::etcd_discovery_set &r) {
+  CASE_EXPECT_EQ(l.get_sorted_nodes().size(), r.get_sorted_nodes().size());
+  for (size_t i = 0; i < l.get_sorted_nodes().size() && i < r.get_sorted_nodes().size(); ++i) {
+    CASE_EXPECT_TRUE(l.get_sorted_nodes()[i] == r.get_sorted_nodes()[i]);
+  }
+
+  for (uint64_t key = 0; key < 1024; ++key) {
+    CASE_EXPECT_TRUE(l.get_node_by_consistent_hash(key) == r.get_node_by_consistent_hash(key));
+  }
+}
+
+CASE_TEST(atapp_etcd_discovery, incremental_cache) {
+  std::vector<atapp::etcd_discovery_node::ptr_t> nodes;
+  for (uint64_t i = 1; i <= 64; ++i) {
+    nodes.push_back(atapp_etcd_discovery_test_make_node(i, "node-" + std::to_string(i)));
+  }
+  nodes.push_back(atapp_etcd_discovery_test_make_node(0, "name-only"));
+
+  atapp::etcd_discovery_set incremental;
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    incremental.add_node(nodes[i]);
+    // Build cache after the first node, following changes will update it
+    incremental.get_sorted_nodes();
+  }
+
+  // Replace node 3 with a new name and remove some nodes
+  atapp::etcd_discovery_node::ptr_t renamed = atapp_etcd_discovery_test_make_node(3, "node-3-renamed");
+  incremental.add_node(renamed);
+  incremental.remove_node(static_cast<uint64_t>(5));
+  incremental.remove_node(std::string("node-7"));
+  incremental.remove_node(nodes[9]);
+
+  atapp::etcd_discovery_set rebuilt;
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    if (i == 2 || i == 4 || i == 6 || i == 9) {
+      continue;
+    }
+    rebuilt.add_node(nodes[i]);
+  }
+  rebuilt.add_node(renamed);
+
+  atapp_etcd_discovery_test_check_same(incremental, rebuilt);
+  CASE_EXPECT_TRUE(!incremental.get_node_by_name("node-3"));
+  CASE_EXPECT_TRUE(renamed == incremental.get_node_by_id(3));
+}
+
+CASE_TEST(atapp_etcd_discovery, consistent_hash_layout) {
+  atapp::etcd_discovery_set discovery_set;
+  CASE_EXPECT_TRUE(!discovery_set.get_node_by_consistent_hash(static_cast<uint64_t>(1)));
+
+  atapp::etcd_discovery_node::ptr_t single = atapp_etcd_discovery_test_make_node(1, "single");
+  discovery_set.add_node(single);
+  for (uint64_t key = 0; key < 256; ++key) {
+    CASE_EXPECT_TRUE(single == discovery_set.get_node_by_consistent_hash(key));
+  }
+
+  // Ring of any size(not power of 2) should be searched and wrapped around
+  for (uint64_t i = 2; i <= 37; ++i) {
+    discovery_set.add_node(atapp_etcd_discovery_test_make_node(i, "node-" + std::to_string(i)));
+  }
+  for (uint64_t key = 0; key < 256; ++key) {
+    atapp::etcd_discovery_node::ptr_t node = discovery_set.get_node_by_consistent_hash(key);
+    CASE_EXPECT_TRUE(!!node);
+    if (node) {
+      CASE_EXPECT_TRUE(node == discovery_set.get_node_by_id(node->get_discovery_info().id()));
+    }
+  }
+
+  discovery_set.remove_node(single);
+  for (uint64_t i = 2; i <= 37; ++i) {
+    discovery_set.remove_node(i);
+  }
+  CASE_EXPECT_TRUE(!discovery_set.get_node_by_consistent_hash(static_cast<uint64_t>(1)));
+}
+
+static const atapp::etcd_discovery_consistent_hash_policy_t::type atapp_etcd_discovery_test_policies[] = {
+    atapp::etcd_discovery_consistent_hash_policy_t::EN_CHP_RING,
+    atapp::etcd_discovery_consistent_hash_policy_t::EN_CHP_MAGLEV,
+    atapp::etcd_discovery_consistent_hash_policy_t::EN_CHP_JUMP,
+    atapp::etcd_discovery_consistent_hash_policy_t::EN_CHP_RENDEZVOUS,
+};
+
+CASE_TEST(atapp_etcd_discovery, consistent_hash_policy) {
+  atapp::etcd_discovery_set discovery_set;
+  for (uint64_t i = 1; i <= 50; ++i) {
+    discovery_set.add_node(atapp_etcd_discovery_test_make_node(i, "node-" + std::to_string(i)));
+  }
+
+  for (size_t p = 0; p < sizeof(atapp_etcd_discovery_test_policies) / sizeof(atapp_etcd_discovery_test_policies[0]);
+       ++p) {
+    std::vector<size_t> counter;
+    counter.resize(51, 0);
+    std::vector<atapp::etcd_discovery_node::ptr_t> before;
+    for (uint64_t key = 0; key < 10000; ++key) {
+      atapp::etcd_discovery_node::ptr_t node =
+          discovery_set.get_node_by_consistent_hash(key, atapp_etcd_discovery_test_policies[p]);
+      CASE_EXPECT_TRUE(!!node);
+      if (!node) {
+        return;
+      }
+      CASE_EXPECT_TRUE(node == discovery_set.get_node_by_id(node->get_discovery_info().id()));
+      ++counter[node->get_discovery_info().id()];
+      before.push_back(node);
+    }
+
+    // Every node should get some keys
+    for (uint64_t i = 1; i <= 50; ++i) {
+      CASE_EXPECT_GT(counter[i], 0);
+    }
+
+    // Only keys of the tail node can be moved after it's removed
+    atapp::etcd_discovery_node::ptr_t removed = discovery_set.get_node_by_id(50);
+    discovery_set.remove_node(removed);
+    for (uint64_t key = 0; key < 10000; ++key) {
+      atapp::etcd_discovery_node::ptr_t node =
+          discovery_set.get_node_by_consistent_hash(key, atapp_etcd_discovery_test_policies[p]);
+      CASE_EXPECT_TRUE(node != removed);
+      if (before[key] != removed &&
+          atapp::etcd_discovery_consistent_hash_policy_t::EN_CHP_MAGLEV != atapp_etcd_discovery_test_policies[p]) {
+        CASE_EXPECT_TRUE(before[key] == node);
+      }
+    }
+    discovery_set.add_node(removed);
+  }
+}
+
+CASE_TEST(atapp_etcd_discovery, consistent_hash_rendezvous) {
+  const atapp::etcd_discovery_consistent_hash_policy_t::type policy =
+      atapp::etcd_discovery_consistent_hash_policy_t::EN_CHP_RENDEZVOUS;
+  atapp::etcd_discovery_set discovery_set;
+  CASE_EXPECT_TRUE(!discovery_set.get_node_by_consistent_hash(static_cast<uint64_t>(1), policy));
+
+  // More than one batch of scoring, and the tail is not aligned to vector width
+  for (uint64_t i = 1; i <= 71; ++i) {
+    discovery_set.add_node(atapp_etcd_discovery_test_make_node(i, "node-" + std::to_string(i)));
+  }
+
+  std::vector<atapp::etcd_discovery_node::ptr_t> before;
+  for (uint64_t key = 0; key < 10000; ++key) {
+    before.push_back(discovery_set.get_node_by_consistent_hash(key, policy));
+    CASE_EXPECT_TRUE(!!before.back());
+    CASE_EXPECT_TRUE(before.back() == discovery_set.get_node_by_consistent_hash(key, policy));
+  }
+  CASE_EXPECT_TRUE(!!discovery_set.get_node_by_consistent_hash(std::string("key"), policy));
+
+  // Only keys of the removed node in the middle are moved
+  atapp::etcd_discovery_node::ptr_t removed = discovery_set.get_node_by_id(36);
+  discovery_set.remove_node(removed);
+  size_t moved = 0;
+  for (uint64_t key = 0; key < 10000; ++key) {
+    atapp::etcd_discovery_node::ptr_t node = discovery_set.get_node_by_consistent_hash(key, policy);
+    CASE_EXPECT_TRUE(node != removed);
+    if (before[key] != removed) {
+      CASE_EXPECT_TRUE(before[key] == node);
+    } else {
+      ++moved;
+    }
+  }
+  CASE_EXPECT_GT(moved, 0);
+
+  // Keys are only moved to the new node when it's added
+  atapp::etcd_discovery_node::ptr_t added = atapp_etcd_discovery_test_make_node(100, "node-100");
+  discovery_set.add_node(removed);
+  discovery_set.add_node(added);
+  moved = 0;
+  for (uint64_t key = 0; key < 10000; ++key) {
+    atapp::etcd_discovery_node::ptr_t node = discovery_set.get_node_by_consistent_hash(key, policy);
+    if (node != added) {
+      CASE_EXPECT_TRUE(before[key] == node);
+    } else {
+      ++moved;
+    }
+  }
+  CASE_EXPECT_GT(moved, 0);
+}
+
+// Scalar rendezvous score, the same as fmix64 of murmur3 on (seed ^ key)
+static uint64_t atapp_etcd_discovery_test_rendezvous_mix(uint64_t seed, uint64_t key) {
+  uint64_t h = seed ^ key;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+static uint64_t atapp_etcd_discovery_test_murmur3(const void *buf, size_t bufsz) {
+  uint64_t out[2] = {0};
+  util::hash::murmur_hash3_x64_128(buf, static_cast<int>(bufsz), LIBATAPP_MACRO_HASH_MAGIC_NUMBER, out);
+  return out[0];
+}
+
+CASE_TEST(atapp_etcd_discovery, consistent_hash_rendezvous_simd) {
+  const atapp::etcd_discovery_consistent_hash_policy_t::type policy =
+      atapp::etcd_discovery_consistent_hash_policy_t::EN_CHP_RENDEZVOUS;
+  atapp::etcd_discovery_set discovery_set;
+
+  // Every count of nodes covers a different tail of SIMD lanes, and more than 64 nodes use more than one batch
+  bool all_matched = true;
+  uint64_t key = 0;
+  for (uint64_t i = 1; i <= 130; ++i) {
+    discovery_set.add_node(atapp_etcd_discovery_test_make_node(i * 7919, "node-" + std::to_string(i)));
+
+    const std::vector<atapp::etcd_discovery_node::ptr_t> &nodes = discovery_set.get_sorted_nodes();
+    std::vector<uint64_t> seeds;
+    for (size_t j = 0; j < nodes.size(); ++j) {
+      uint64_t id = nodes[j]->get_discovery_info().id();
+      seeds.push_back(atapp_etcd_discovery_test_murmur3(&id, sizeof(id)));
+    }
+
+    for (int j = 0; j < 64; ++j) {
+      key = key * 6364136223846793005ULL + 1442695040888963407ULL;
+      uint64_t hash_key = atapp_etcd_discovery_test_murmur3(&key, sizeof(key));
+      size_t expected = 0;
+      uint64_t max_score = 0;
+      for (size_t k = 0; k < seeds.size(); ++k) {
+        uint64_t score = atapp_etcd_discovery_test_rendezvous_mix(seeds[k], hash_key);
+        if (score > max_score) {
+          max_score = score;
+          expected = k;
+        }
+      }
+
+      all_matched =
+          all_matched && nodes[expected] == discovery_set.get_node_by_consistent_hash(&key, sizeof(key), policy);
+    }
+  }
+  CASE_EXPECT_TRUE(all_matched);
+}
+
+CASE_TEST(atapp_etcd_discovery, consistent_hash_batch) {
+  atapp::etcd_discovery_set discovery_set;
+  std::vector<uint64_t> keys;
+  std::vector<std::string> string_keys;
+  for (uint64_t key = 0; key < 20000; ++key) {
+    keys.push_back(key * 7);
+    string_keys.push_back("key-" + std::to_string(key));
+  }
+
+  // Empty set
+  std::vector<atapp::etcd_discovery_node::ptr_t> nodes;
+  discovery_set.get_node_by_consistent_hash_batch(&keys[0], 3, nodes,
+                                                  atapp::etcd_discovery_consistent_hash_policy_t::EN_CHP_RING);
+  CASE_EXPECT_EQ(3, nodes.size());
+  CASE_EXPECT_TRUE(!nodes[0] && !nodes[1] && !nodes[2]);
+
+  // Hash ring must have at least 32768 points to be merged with sorted hash codes
+  const uint64_t node_count = 512;
+  CASE_EXPECT_GE(node_count * atapp::etcd_discovery_set::node_hash_t::HASH_POINT_PER_INS, 32768);
+  for (uint64_t i = 1; i <= node_count; ++i) {
+    discovery_set.add_node(atapp_etcd_discovery_test_make_node(i, "node-" + std::to_string(i)));
+  }
+
+  for (size_t p = 0; p < sizeof(atapp_etcd_discovery_test_policies) / sizeof(atapp_etcd_discovery_test_policies[0]);
+       ++p) {
+    atapp::etcd_discovery_consistent_hash_policy_t::type policy = atapp_etcd_discovery_test_policies[p];
+    // A few keys are searched one by one and many keys are merged with the ring
+    size_t counts[] = {3, keys.size()};
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+      nodes.clear();
+      discovery_set.get_node_by_consistent_hash_batch(&keys[0], counts[c], nodes, policy);
+      CASE_EXPECT_EQ(counts[c], nodes.size());
+      for (size_t i = 0; i < nodes.size(); ++i) {
+        CASE_EXPECT_TRUE(nodes[i] == discovery_set.get_node_by_consistent_hash(keys[i], policy));
+      }
+
+      nodes.clear();
+      discovery_set.get_node_by_consistent_hash_batch(&string_keys[0], counts[c], nodes, policy);
+      CASE_EXPECT_EQ(counts[c], nodes.size());
+      for (size_t i = 0; i < nodes.size(); ++i) {
+        CASE_EXPECT_TRUE(nodes[i] == discovery_set.get_node_by_consistent_hash(string_keys[i], policy));
+      }
+    }
+  }
+
+  // Result is appended
+  std::vector<int64_t> signed_keys;
+  signed_keys.push_back(-1);
+  signed_keys.push_back(1);
+  discovery_set.get_node_by_consistent_hash_batch(&signed_keys[0], signed_keys.size(), nodes,
+                                                  atapp::etcd_discovery_consistent_hash_policy_t::EN_CHP_RING);
+  CASE_EXPECT_EQ(string_keys.size() + 2, nodes.size());
+  CASE_EXPECT_TRUE(nodes[string_keys.size()] == discovery_set.get_node_by_consistent_hash(static_cast<int64_t>(-1)));
+  CASE_EXPECT_TRUE(nodes[string_keys.size() + 1] == discovery_set.get_node_by_consistent_hash(static_cast<int64_t>(1)));
+}
+
+CASE_TEST(atapp_etcd_discovery, consistent_hash_weight) {
+  atapp::etcd_discovery_set incremental;
+  std::vector<atapp::etcd_discovery_node::ptr_t> nodes;
+  for (uint64_t i = 1; i <= 8; ++i) {
+    atapp::protocol::atapp_discovery info;
+    info.set_id(i);
+    info.set_name("node-" + std::to_string(i));
+    // Node 1 has 4 times of the default share
+    info.set_weight(1 == i ? 400 : 100);
+
+    atapp::etcd_discovery_node::ptr_t node = std::make_shared<atapp::etcd_discovery_node>();
+    node->copy_from(info);
+    nodes.push_back(node);
+    incremental.add_node(node);
+  }
+
+  std::vector<size_t> counter;
+  counter.resize(9, 0);
+  for (uint64_t key = 0; key < 11000; ++key) {
+    atapp::etcd_discovery_node::ptr_t node = incremental.get_node_by_consistent_hash(key);
+    if (node) {
+      ++counter[node->get_discovery_info().id()];
+    }
+  }
+  // Expect 4000 keys for node 1 and 1000 keys for others
+  CASE_EXPECT_GT(counter[1], 2800);
+  for (uint64_t i = 2; i <= 8; ++i) {
+    CASE_EXPECT_LT(counter[i], counter[1]);
+  }
+
+  // Changing weight just replaces points of this node
+  atapp::protocol::atapp_discovery info = nodes[1]->get_discovery_info();
+  info.set_weight(250);
+  atapp::etcd_discovery_node::ptr_t reweighted = std::make_shared<atapp::etcd_discovery_node>();
+  reweighted->copy_from(info);
+  incremental.add_node(reweighted);
+  nodes[1] = reweighted;
+
+  atapp::etcd_discovery_set rebuilt;
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    rebuilt.add_node(nodes[i]);
+  }
+  atapp_etcd_discovery_test_check_same(incremental, rebuilt);
+}
+
+CASE_TEST(atapp_etcd_discovery, consistent_hash_bounded_load) {
+  atapp::etcd_discovery_set discovery_set;
+  for (uint64_t i = 1; i <= 10; ++i) {
+    discovery_set.add_node(atapp_etcd_discovery_test_make_node(i, "node-" + std::to_string(i)));
+  }
+
+  std::vector<uint64_t> loads;
+  loads.resize(11, 0);
+  atapp::etcd_discovery_set::node_load_fn_t load_fn = [&loads](const atapp::etcd_discovery_node &node) {
+    return loads[node.get_discovery_info().id()];
+  };
+
+  uint64_t hot_key = 42;
+  atapp::etcd_discovery_node::ptr_t affinity = discovery_set.get_node_by_consistent_hash(&hot_key, sizeof(hot_key));
+  CASE_EXPECT_TRUE(affinity ==
+                   discovery_set.get_node_by_consistent_hash_bounded(&hot_key, sizeof(hot_key), 1, load_fn));
+
+  // All messages use the same hot key, no node should be over (1 + 25%) * average
+  uint64_t total = 0;
+  for (int i = 0; i < 1000; ++i) {
+    uint64_t max_load = ((total + 1) * 125 + 10 * 100 - 1) / (10 * 100);
+    atapp::etcd_discovery_node::ptr_t node =
+        discovery_set.get_node_by_consistent_hash_bounded(&hot_key, sizeof(hot_key), max_load, load_fn);
+    CASE_EXPECT_TRUE(!!node);
+    if (!node) {
+      break;
+    }
+
+    ++loads[node->get_discovery_info().id()];
+    ++total;
+    for (uint64_t id = 1; id <= 10; ++id) {
+      CASE_EXPECT_LE(loads[id], max_load);
+    }
+  }
+  CASE_EXPECT_EQ(loads[affinity->get_discovery_info().id()], 125);
+}
+
+CASE_TEST(atapp_etcd_discovery, consistent_hash_assign_bounded_load) {
+  atapp::etcd_discovery_set discovery_set;
+  for (uint64_t i = 1; i <= 10; ++i) {
+    discovery_set.add_node(atapp_etcd_discovery_test_make_node(i, "node-" + std::to_string(i)));
+  }
+
+  uint64_t hot_key = 42;
+  atapp::etcd_discovery_node::ptr_t affinity = discovery_set.get_node_by_consistent_hash(&hot_key, sizeof(hot_key));
+
+  // Loads are counted by the set itself, so no response of messages is required
+  std::vector<uint64_t> loads;
+  loads.resize(11, 0);
+  for (int i = 0; i < 1000; ++i) {
+    atapp::etcd_discovery_node::ptr_t node =
+        discovery_set.assign_node_by_consistent_hash_bounded(&hot_key, sizeof(hot_key), 125, 1);
+    CASE_EXPECT_TRUE(!!node);
+    if (!node) {
+      break;
+    }
+    ++loads[node->get_discovery_info().id()];
+  }
+  for (uint64_t id = 1; id <= 10; ++id) {
+    CASE_EXPECT_LE(loads[id], 125);
+  }
+  CASE_EXPECT_EQ(loads[affinity->get_discovery_info().id()], 125);
+
+  // Loads are halved by each passed epoch, and the hot key goes back to its own node
+  CASE_EXPECT_TRUE(affinity ==
+                   discovery_set.assign_node_by_consistent_hash_bounded(&hot_key, sizeof(hot_key), 125, 2));
+  CASE_EXPECT_TRUE(affinity ==
+                   discovery_set.assign_node_by_consistent_hash_bounded(&hot_key, sizeof(hot_key), 125, 100));
+
+  // Load of a changed node is reset
+  for (int i = 0; i < 100; ++i) {
+    discovery_set.assign_node_by_consistent_hash_bounded(&hot_key, sizeof(hot_key), 125, 100);
+  }
+  CASE_EXPECT_TRUE(affinity !=
+                   discovery_set.assign_node_by_consistent_hash_bounded(&hot_key, sizeof(hot_key), 125, 100));
+  discovery_set.remove_node(affinity);
+  discovery_set.add_node(affinity);
+  CASE_EXPECT_TRUE(affinity ==
+                   discovery_set.assign_node_by_consistent_hash_bounded(&hot_key, sizeof(hot_key), 125, 100));
+}
+
+CASE_TEST(atapp_etcd_discovery, consistent_hash_replicas) {
+  atapp::etcd_discovery_set discovery_set;
+  std::vector<atapp::etcd_discovery_node::ptr_t> out;
+  CASE_EXPECT_EQ(0, discovery_set.get_nodes_by_consistent_hash(static_cast<uint64_t>(1), 3, out));
+
+  for (uint64_t i = 1; i <= 5; ++i) {
+    discovery_set.add_node(atapp_etcd_discovery_test_make_node(i, "node-" + std::to_string(i)));
+  }
+
+  for (uint64_t key = 0; key < 128; ++key) {
+    out.clear();
+    CASE_EXPECT_EQ(3, discovery_set.get_nodes_by_consistent_hash(key, 3, out));
+    CASE_EXPECT_EQ(3, out.size());
+    if (3 != out.size()) {
+      continue;
+    }
+
+    CASE_EXPECT_TRUE(out[0] == discovery_set.get_node_by_consistent_hash(key));
+    CASE_EXPECT_TRUE(out[0] != out[1]);
+    CASE_EXPECT_TRUE(out[0] != out[2]);
+    CASE_EXPECT_TRUE(out[1] != out[2]);
+
+    // Backups are promoted after the primary is removed
+    discovery_set.remove_node(out[0]);
+    CASE_EXPECT_TRUE(out[1] == discovery_set.get_node_by_consistent_hash(key));
+    discovery_set.add_node(out[0]);
+  }
+
+  // n is limited by number of nodes
+  out.clear();
+  CASE_EXPECT_EQ(5, discovery_set.get_nodes_by_consistent_hash(std::string("key"), 16, out));
+}
+
+CASE_TEST(atapp_etcd_discovery, p2c) {
+  atapp::etcd_discovery_set discovery_set;
+  CASE_EXPECT_TRUE(!discovery_set.get_node_by_p2c());
+
+  for (uint64_t i = 1; i <= 3; ++i) {
+    atapp::protocol::atapp_discovery info;
+    info.set_id(i);
+    info.set_name("node-" + std::to_string(i));
+    info.set_load_score(static_cast<uint32_t>(i * 10));
+
+    atapp::etcd_discovery_node::ptr_t node = std::make_shared<atapp::etcd_discovery_node>();
+    node->copy_from(info);
+    discovery_set.add_node(node);
+  }
+
+  // The most loaded node should never be selected, the least loaded one is in 2 of 3 pairs
+  std::vector<size_t> counter;
+  counter.resize(4, 0);
+  for (int i = 0; i < 3000; ++i) {
+    atapp::etcd_discovery_node::ptr_t node = discovery_set.get_node_by_p2c();
+    CASE_EXPECT_TRUE(!!node);
+    if (node) {
+      ++counter[node->get_discovery_info().id()];
+    }
+  }
+  CASE_EXPECT_EQ(0, counter[3]);
+  CASE_EXPECT_GT(counter[1], counter[2]);
+
+  // Custom load overrides load score
+  counter.assign(4, 0);
+  for (int i = 0; i < 3000; ++i) {
+    atapp::etcd_discovery_node::ptr_t node = discovery_set.get_node_by_p2c(
+        [](const atapp::etcd_discovery_node &checked) { return 10 - checked.get_discovery_info().id(); });
+    if (node) {
+      ++counter[node->get_discovery_info().id()];
+    }
+  }
+  CASE_EXPECT_EQ(0, counter[1]);
+  CASE_EXPECT_GT(counter[3], counter[2]);
+}
+
+static atapp::etcd_discovery_node::ptr_t atapp_etcd_discovery_test_make_locality_node(uint64_t id,
+                                                                                     const std::string &region,
+                                                                                     const std::string &district,
+                                                                                     uint64_t zone_id) {
+  atapp::protocol::atapp_discovery info;
+  info.set_id(id);
+  info.set_name("node-" + std::to_string(id));
+  info.mutable_area()->set_region(region);
+  info.mutable_area()->set_district(district);
+  info.mutable_area()->set_zone_id(zone_id);
+
+  atapp::etcd_discovery_node::ptr_t ret = std::make_shared<atapp::etcd_discovery_node>();
+  ret->copy_from(info);
+  return ret;
+}
+
+CASE_TEST(atapp_etcd_discovery, locality) {
+  std::vector<atapp::etcd_discovery_node::ptr_t> nodes;
+  nodes.push_back(atapp::etcd_discovery_node::ptr_t());
+  nodes.push_back(atapp_etcd_discovery_test_make_locality_node(1, "r1", "d1", 1));
+  nodes.push_back(atapp_etcd_discovery_test_make_locality_node(2, "r1", "d1", 1));
+  nodes.push_back(atapp_etcd_discovery_test_make_locality_node(3, "r1", "d1", 2));
+  nodes.push_back(atapp_etcd_discovery_test_make_locality_node(4, "r1", "d1", 2));
+  nodes.push_back(atapp_etcd_discovery_test_make_locality_node(5, "r1", "d2", 3));
+  nodes.push_back(atapp_etcd_discovery_test_make_locality_node(6, "r2", "d3", 4));
+
+  atapp::etcd_discovery_set discovery_set;
+  for (size_t i = 1; i < nodes.size(); ++i) {
+    discovery_set.add_node(nodes[i]);
+  }
+
+  atapp::protocol::atapp_area area;
+  area.set_region("r1");
+  area.set_district("d1");
+  area.set_zone_id(1);
+
+  const atapp::etcd_discovery_set *zone_set =
+      discovery_set.get_locality_set(area, atapp::etcd_discovery_locality_t::EN_DL_ZONE);
+  const atapp::etcd_discovery_set *district_set =
+      discovery_set.get_locality_set(area, atapp::etcd_discovery_locality_t::EN_DL_DISTRICT);
+  const atapp::etcd_discovery_set *region_set =
+      discovery_set.get_locality_set(area, atapp::etcd_discovery_locality_t::EN_DL_REGION);
+  CASE_EXPECT_TRUE(NULL != zone_set && NULL != district_set && NULL != region_set);
+  if (NULL == zone_set || NULL == district_set || NULL == region_set) {
+    return;
+  }
+  CASE_EXPECT_EQ(2, zone_set->get_sorted_nodes().size());
+  CASE_EXPECT_EQ(4, district_set->get_sorted_nodes().size());
+  CASE_EXPECT_EQ(5, region_set->get_sorted_nodes().size());
+
+  // No spill over, always in the same zone
+  for (uint64_t key = 0; key < 256; ++key) {
+    atapp::etcd_discovery_node::ptr_t node = discovery_set.get_node_by_random(area, 0);
+    CASE_EXPECT_TRUE(node == nodes[1] || node == nodes[2]);
+    node = discovery_set.get_node_by_round_robin(area, 0);
+    CASE_EXPECT_TRUE(node == nodes[1] || node == nodes[2]);
+    CASE_EXPECT_TRUE(discovery_set.get_node_by_consistent_hash(key, area, 0) ==
+                     zone_set->get_node_by_consistent_hash(key));
+  }
+
+  // Spill over to district, and consistent hash of the same key always goes to the same locality
+  size_t spilled = 0;
+  for (uint64_t key = 0; key < 1000; ++key) {
+    atapp::etcd_discovery_node::ptr_t node = discovery_set.get_node_by_random(area, 100);
+    CASE_EXPECT_TRUE(node == nodes[1] || node == nodes[2] || node == nodes[3] || node == nodes[4]);
+
+    node = discovery_set.get_node_by_consistent_hash(key, area, 30);
+    CASE_EXPECT_TRUE(node == discovery_set.get_node_by_consistent_hash(key, area, 30));
+    if (node != nodes[1] && node != nodes[2]) {
+      CASE_EXPECT_TRUE(node == nodes[3] || node == nodes[4]);
+      ++spilled;
+    }
+  }
+  CASE_MSG_INFO() << "Spill over 30%, " << spilled << " of 1000 keys go to other zones" << std::endl;
+  CASE_EXPECT_GT(spilled, 50);
+  CASE_EXPECT_LT(spilled, 300);
+
+  // Unknown area uses all nodes
+  atapp::protocol::atapp_area unknown_area;
+  unknown_area.set_region("r3");
+  CASE_EXPECT_TRUE(NULL ==
+                   discovery_set.get_locality_set(unknown_area, atapp::etcd_discovery_locality_t::EN_DL_REGION));
+  for (uint64_t key = 0; key < 256; ++key) {
+    CASE_EXPECT_TRUE(discovery_set.get_node_by_consistent_hash(key, unknown_area, 0) ==
+                     discovery_set.get_node_by_consistent_hash(key));
+  }
+
+  // Sub sets are updated incrementally, fall back to district when the zone is empty
+  discovery_set.remove_node(nodes[1]);
+  discovery_set.remove_node(static_cast<uint64_t>(2));
+  CASE_EXPECT_TRUE(NULL == discovery_set.get_locality_set(area, atapp::etcd_discovery_locality_t::EN_DL_ZONE));
+  for (int i = 0; i < 256; ++i) {
+    atapp::etcd_discovery_node::ptr_t node = discovery_set.get_node_by_round_robin(area, 0);
+    CASE_EXPECT_TRUE(node == nodes[3] || node == nodes[4]);
+  }
+
+  atapp::etcd_discovery_node::ptr_t replaced = atapp_etcd_discovery_test_make_locality_node(4, "r1", "d1", 1);
+  discovery_set.add_node(replaced);
+  zone_set = discovery_set.get_locality_set(area, atapp::etcd_discovery_locality_t::EN_DL_ZONE);
+  district_set = discovery_set.get_locality_set(area, atapp::etcd_discovery_locality_t::EN_DL_DISTRICT);
+  CASE_EXPECT_TRUE(NULL != zone_set && NULL != district_set);
+  if (NULL == zone_set || NULL == district_set) {
+    return;
+  }
+
+  atapp::etcd_discovery_set rebuilt;
+  rebuilt.add_node(nodes[3]);
+  rebuilt.add_node(replaced);
+  atapp_etcd_discovery_test_check_same(*district_set, rebuilt);
+  CASE_EXPECT_EQ(1, zone_set->get_sorted_nodes().size());
+  CASE_EXPECT_TRUE(replaced == discovery_set.get_node_by_random(area, 0));
+}
+
+CASE_TEST(atapp_etcd_discovery, select_nodes) {
+  atapp::etcd_discovery_set discovery_set;
+  std::vector<atapp::etcd_discovery_node::ptr_t> nodes;
+  for (uint64_t i = 1; i <= 32; ++i) {
+    atapp::protocol::atapp_discovery info;
+    info.set_id(i);
+    info.set_name("node-" + std::to_string(i));
+    info.set_type_name(i % 2 == 0 ? "even" : "odd");
+    info.mutable_metadata()->set_namespace_name(i <= 16 ? "ns-1" : "ns-2");
+    (*info.mutable_metadata()->mutable_labels())["mod3"] = std::to_string(i % 3);
+
+    atapp::etcd_discovery_node::ptr_t node = std::make_shared<atapp::etcd_discovery_node>();
+    node->copy_from(info);
+    nodes.push_back(node);
+    discovery_set.add_node(node);
+  }
+
+  atapp::protocol::atapp_metadata selector;
+  selector.set_namespace_name("ns-1");
+  (*selector.mutable_labels())["mod3"] = "0";
+  atapp::etcd_discovery_set::const_ptr_t selected = discovery_set.select_nodes(selector, "even");
+  CASE_EXPECT_TRUE(!!selected);
+  if (!selected) {
+    return;
+  }
+
+  // 6 and 12
+  CASE_EXPECT_EQ(2, selected->get_sorted_nodes().size());
+  CASE_EXPECT_TRUE(nodes[5] == selected->get_node_by_id(6));
+  CASE_EXPECT_TRUE(nodes[11] == selected->get_node_by_id(12));
+  CASE_EXPECT_TRUE(selected == discovery_set.select_nodes(selector, "even"));
+
+  // Empty selector matches all nodes and unknown label matches nothing
+  CASE_EXPECT_EQ(32, discovery_set.select_nodes(atapp::protocol::atapp_metadata())->get_sorted_nodes().size());
+  (*selector.mutable_labels())["mod3"] = "3";
+  CASE_EXPECT_TRUE(discovery_set.select_nodes(selector)->empty());
+
+  // Cached result is updated by add_node and remove_node
+  discovery_set.remove_node(static_cast<uint64_t>(6));
+  atapp::protocol::atapp_discovery info;
+  info.set_id(18);
+  info.set_name("node-18");
+  info.set_type_name("even");
+  info.mutable_metadata()->set_namespace_name("ns-1");
+  (*info.mutable_metadata()->mutable_labels())["mod3"] = "0";
+  atapp::etcd_discovery_node::ptr_t moved = std::make_shared<atapp::etcd_discovery_node>();
+  moved->copy_from(info);
+  discovery_set.add_node(moved);
+
+  CASE_EXPECT_EQ(2, selected->get_sorted_nodes().size());
+  CASE_EXPECT_TRUE(!selected->get_node_by_id(6));
+  CASE_EXPECT_TRUE(moved == selected->get_node_by_id(18));
+
+  // New selectors use updated posting lists
+  atapp::protocol::atapp_metadata ns_selector;
+  ns_selector.set_namespace_name("ns-1");
+  atapp::etcd_discovery_set::const_ptr_t ns_selected = discovery_set.select_nodes(ns_selector);
+  CASE_EXPECT_EQ(16, ns_selected->get_sorted_nodes().size());
+  CASE_EXPECT_TRUE(moved == ns_selected->get_node_by_id(18));
+  CASE_EXPECT_TRUE(!ns_selected->get_node_by_id(6));
+}
+
+CASE_TEST(atapp_etcd_discovery, select_nodes_cache_capacity) {
+  atapp::etcd_discovery_set discovery_set;
+  for (uint64_t i = 1; i <= 16; ++i) {
+    discovery_set.add_node(atapp_etcd_discovery_test_make_node(i, "node-" + std::to_string(i)));
+  }
+  discovery_set.set_selector_cache_capacity(4);
+  CASE_EXPECT_EQ(4, discovery_set.get_selector_cache_capacity());
+
+  // Held result is never evicted and is still updated
+  atapp::protocol::atapp_metadata held_selector;
+  held_selector.set_namespace_name("ns-held");
+  atapp::etcd_discovery_set::const_ptr_t held = discovery_set.select_nodes(held_selector);
+  CASE_EXPECT_TRUE(held->empty());
+
+  atapp::protocol::atapp_metadata selector;
+  for (int i = 0; i < 32; ++i) {
+    selector.set_namespace_name("ns-" + std::to_string(i));
+    discovery_set.select_nodes(selector);
+    CASE_EXPECT_LE(discovery_set.get_selector_cache_size(), 4);
+  }
+  CASE_EXPECT_TRUE(held == discovery_set.select_nodes(held_selector));
+
+  atapp::protocol::atapp_discovery info;
+  info.set_id(17);
+  info.set_name("node-17");
+  info.mutable_metadata()->set_namespace_name("ns-held");
+  atapp::etcd_discovery_node::ptr_t node = std::make_shared<atapp::etcd_discovery_node>();
+  node->copy_from(info);
+  discovery_set.add_node(node);
+  CASE_EXPECT_TRUE(node == held->get_node_by_id(17));
+
+  // Recently used result is kept, and the least recently used one is evicted
+  selector.set_namespace_name("ns-recent");
+  atapp::etcd_discovery_set::const_ptr_t recent = discovery_set.select_nodes(selector);
+  const atapp::etcd_discovery_set *recent_ptr = recent.get();
+  recent.reset();
+  atapp::protocol::atapp_metadata other_selector;
+  other_selector.set_namespace_name("ns-other-1");
+  discovery_set.select_nodes(other_selector);
+  CASE_EXPECT_TRUE(recent_ptr == discovery_set.select_nodes(selector).get());
+  other_selector.set_namespace_name("ns-other-2");
+  discovery_set.select_nodes(other_selector);
+  CASE_EXPECT_TRUE(recent_ptr == discovery_set.select_nodes(selector).get());
+  CASE_EXPECT_EQ(4, discovery_set.get_selector_cache_size());
+
+  // Only the held result is left
+  discovery_set.set_selector_cache_capacity(0);
+  CASE_EXPECT_EQ(1, discovery_set.get_selector_cache_size());
+  CASE_EXPECT_TRUE(held == discovery_set.select_nodes(held_selector));
+}
+
+CASE_TEST(atapp_etcd_discovery, generation_diff) {
+  atapp::etcd_discovery_set discovery_set;
+  CASE_EXPECT_EQ(0, discovery_set.get_generation());
+
+  atapp::etcd_discovery_node::ptr_t node1 = atapp_etcd_discovery_test_make_node(1, "node-1");
+  atapp::etcd_discovery_node::ptr_t node2 = atapp_etcd_discovery_test_make_node(2, "node-2");
+  atapp::etcd_discovery_node::ptr_t node3 = atapp_etcd_discovery_test_make_node(3, "node-3");
+  discovery_set.add_node(node1);
+  discovery_set.add_node(node2);
+  CASE_EXPECT_EQ(2, discovery_set.get_generation());
+
+  // Nothing changed
+  discovery_set.add_node(node1);
+  discovery_set.remove_node(static_cast<uint64_t>(4));
+  CASE_EXPECT_EQ(2, discovery_set.get_generation());
+
+  uint64_t generation = discovery_set.get_generation();
+  atapp::etcd_discovery_node::ptr_t node2_new = atapp_etcd_discovery_test_make_node(2, "node-2");
+  discovery_set.add_node(node2_new);
+  discovery_set.add_node(node3);
+  discovery_set.remove_node(node1);
+  // Added and then removed
+  atapp::etcd_discovery_node::ptr_t node4 = atapp_etcd_discovery_test_make_node(4, "node-4");
+  discovery_set.add_node(node4);
+  discovery_set.remove_node(std::string("node-4"));
+  CASE_EXPECT_EQ(generation + 5, discovery_set.get_generation());
+
+  {
+    atapp::etcd_discovery_set::diff_t diff;
+    CASE_EXPECT_TRUE(discovery_set.get_diff(generation, diff));
+    CASE_EXPECT_EQ(1, diff.added.size());
+    CASE_EXPECT_EQ(1, diff.removed.size());
+    CASE_EXPECT_EQ(1, diff.updated.size());
+    if (1 == diff.added.size() && 1 == diff.removed.size() && 1 == diff.updated.size()) {
+      CASE_EXPECT_TRUE(node3 == diff.added[0]);
+      CASE_EXPECT_TRUE(node1 == diff.removed[0]);
+      CASE_EXPECT_TRUE(node2 == diff.updated[0].first);
+      CASE_EXPECT_TRUE(node2_new == diff.updated[0].second);
+    }
+  }
+
+  {
+    atapp::etcd_discovery_set::diff_t diff;
+    CASE_EXPECT_TRUE(discovery_set.get_diff(generation, generation + 2, diff));
+    CASE_EXPECT_EQ(1, diff.added.size());
+    CASE_EXPECT_EQ(0, diff.removed.size());
+    CASE_EXPECT_EQ(1, diff.updated.size());
+
+    atapp::etcd_discovery_set::diff_t empty_diff;
+    CASE_EXPECT_TRUE(discovery_set.get_diff(discovery_set.get_generation(), empty_diff));
+    CASE_EXPECT_TRUE(empty_diff.added.empty() && empty_diff.removed.empty() && empty_diff.updated.empty());
+    CASE_EXPECT_FALSE(discovery_set.get_diff(generation + 1, generation, empty_diff));
+    CASE_EXPECT_FALSE(discovery_set.get_diff(generation, discovery_set.get_generation() + 1, empty_diff));
+  }
+
+  // Old changes are dropped
+  discovery_set.set_change_log_capacity(2);
+  {
+    atapp::etcd_discovery_set::diff_t diff;
+    CASE_EXPECT_FALSE(discovery_set.get_diff(generation, diff));
+    CASE_EXPECT_TRUE(discovery_set.get_diff(discovery_set.get_generation() - 1, diff));
+    CASE_EXPECT_EQ(1, diff.removed.size());
+  }
+
+  discovery_set.set_change_log_capacity(0);
+  discovery_set.add_node(node4);
+  {
+    atapp::etcd_discovery_set::diff_t diff;
+    CASE_EXPECT_FALSE(discovery_set.get_diff(discovery_set.get_generation() - 1, diff));
+    CASE_EXPECT_TRUE(discovery_set.get_diff(discovery_set.get_generation(), diff));
+  }
+}
+
+CASE_TEST(atapp_etcd_discovery, update_nodes) {
+  atapp::etcd_discovery_set batch_set;
+  atapp::etcd_discovery_set expect_set;
+  std::vector<atapp::etcd_discovery_node::ptr_t> nodes;
+  for (uint64_t i = 1; i <= 100; ++i) {
+    nodes.push_back(atapp_etcd_discovery_test_make_node(i, "node-" + std::to_string(i)));
+    batch_set.add_node(nodes.back());
+    expect_set.add_node(nodes.back());
+  }
+  // Build caches before batch update
+  batch_set.get_node_by_consistent_hash(static_cast<uint64_t>(0));
+
+  // A few changes are updated incrementally and many changes rebuild caches
+  size_t change_counts[] = {3, 40};
+  for (size_t c = 0; c < sizeof(change_counts) / sizeof(change_counts[0]); ++c) {
+    std::vector<atapp::etcd_discovery_node::ptr_t> removed;
+    std::vector<atapp::etcd_discovery_node::ptr_t> added;
+    for (size_t i = 0; i < change_counts[c]; ++i) {
+      removed.push_back(nodes[i * 2]);
+      // Replace nodes of the same id
+      atapp::etcd_discovery_node::ptr_t replaced = atapp_etcd_discovery_test_make_node(
+          nodes[i * 2 + 1]->get_discovery_info().id(), nodes[i * 2 + 1]->get_discovery_info().name());
+      added.push_back(replaced);
+      nodes[i * 2 + 1] = replaced;
+    }
+    // Removed and added again
+    added.push_back(nodes[0]);
+
+    uint64_t generation = batch_set.get_generation();
+    batch_set.update_nodes(removed, added);
+    CASE_EXPECT_EQ(generation + 1, batch_set.get_generation());
+    for (size_t i = 0; i < removed.size(); ++i) {
+      expect_set.remove_node(removed[i]);
+    }
+    for (size_t i = 0; i < added.size(); ++i) {
+      expect_set.add_node(added[i]);
+    }
+
+    CASE_EXPECT_EQ(expect_set.get_sorted_nodes().size(), batch_set.get_sorted_nodes().size());
+    CASE_EXPECT_TRUE(nodes[0] == batch_set.get_node_by_id(1));
+    CASE_EXPECT_TRUE(!batch_set.get_node_by_id(3));
+    for (uint64_t key = 0; key < 1024; ++key) {
+      CASE_EXPECT_TRUE(expect_set.get_node_by_consistent_hash(key) == batch_set.get_node_by_consistent_hash(key));
+    }
+
+    atapp::etcd_discovery_set::diff_t diff;
+    CASE_EXPECT_TRUE(batch_set.get_diff(generation, diff));
+    CASE_EXPECT_EQ(0, diff.added.size());
+    CASE_EXPECT_EQ(change_counts[c] - 1, diff.removed.size());
+    CASE_EXPECT_EQ(change_counts[c], diff.updated.size());
+
+    for (size_t i = 0; i < removed.size(); ++i) {
+      batch_set.add_node(removed[i]);
+      expect_set.add_node(removed[i]);
+    }
+  }
+}
+
+CASE_TEST(atapp_etcd_discovery, snapshot) {
+  atapp::etcd_discovery_set discovery_set;
+  CASE_EXPECT_TRUE(!discovery_set.get_snapshot());
+
+  std::vector<atapp::etcd_discovery_node::ptr_t> nodes;
+  for (uint64_t i = 1; i <= 16; ++i) {
+    nodes.push_back(atapp_etcd_discovery_test_make_node(i, "node-" + std::to_string(i)));
+    discovery_set.add_node(nodes.back());
+  }
+
+  discovery_set.enable_snapshot();
+  atapp::etcd_discovery_snapshot::ptr_t snapshot = discovery_set.get_snapshot();
+  CASE_EXPECT_TRUE(!!snapshot);
+  if (!snapshot) {
+    return;
+  }
+
+  CASE_EXPECT_EQ(16, snapshot->get_sorted_nodes().size());
+  CASE_EXPECT_TRUE(nodes[3] == snapshot->get_node_by_id(4));
+  CASE_EXPECT_TRUE(nodes[3] == snapshot->get_node_by_name("node-4"));
+  for (uint64_t key = 0; key < 1024; ++key) {
+    CASE_EXPECT_TRUE(discovery_set.get_node_by_consistent_hash(key) == snapshot->get_node_by_consistent_hash(key));
+  }
+
+  // Every reader keeps its own selector state
+  atapp::etcd_discovery_snapshot::selector_state_t state;
+  for (size_t i = 0; i < snapshot->get_sorted_nodes().size(); ++i) {
+    CASE_EXPECT_TRUE(snapshot->get_sorted_nodes()[i] == snapshot->get_node_by_round_robin(state));
+  }
+  CASE_EXPECT_TRUE(!!snapshot->get_node_by_random(state));
+
+  // Changes are published together by flush_snapshot() and the old snapshot is immutable
+  discovery_set.remove_node(static_cast<uint64_t>(4));
+  atapp::etcd_discovery_node::ptr_t added = atapp_etcd_discovery_test_make_node(17, "node-17");
+  discovery_set.add_node(added);
+  CASE_EXPECT_TRUE(snapshot == discovery_set.get_snapshot());
+
+  discovery_set.flush_snapshot();
+  atapp::etcd_discovery_snapshot::ptr_t latest = discovery_set.get_snapshot();
+  CASE_EXPECT_TRUE(latest != snapshot);
+  CASE_EXPECT_EQ(snapshot->get_generation() + 2, latest->get_generation());
+  CASE_EXPECT_EQ(discovery_set.get_generation(), latest->get_generation());
+  CASE_EXPECT_TRUE(nodes[3] == snapshot->get_node_by_id(4));
+  CASE_EXPECT_TRUE(!snapshot->get_node_by_id(17));
+  CASE_EXPECT_TRUE(!latest->get_node_by_id(4));
+  CASE_EXPECT_TRUE(added == latest->get_node_by_id(17));
+  for (uint64_t key = 0; key < 1024; ++key) {
+    CASE_EXPECT_TRUE(discovery_set.get_node_by_consistent_hash(key) == latest->get_node_by_consistent_hash(key));
+  }
+
+  // Nothing is published if nothing changed
+  discovery_set.flush_snapshot();
+  CASE_EXPECT_TRUE(latest == discovery_set.get_snapshot());
+}
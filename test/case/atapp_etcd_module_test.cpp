@@ -0,0 +1,428 @@
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <atframe/atapp.h>
+#include <atframe/modules/etcd_module.h>
+
+#include <common/file_system.h>
+
+#include "frame/test_macros.h"
+
+namespace atapp {
+// Access internal state of etcd_module, discovery events are injected without a etcd cluster
+struct etcd_module_test_helper {
+  static bool update_inner_watcher_event(etcd_module &mod, etcd_module::node_info_t &node) {
+    return mod.update_inner_watcher_event(node);
+  }
+
+  static void add_watcher_event(etcd_watcher::response_t &response, const etcd_module::node_info_t &node) {
+    response.events.push_back(etcd_watcher::event_t());
+    etcd_watcher::event_t &evt = response.events.back();
+    if (etcd_module::node_action_t::EN_NAT_DELETE == node.action) {
+      evt.evt_type = etcd_watch_event::EN_WEVT_DELETE;
+      etcd_module::pack(node, evt.prev_kv.value);
+    } else {
+      evt.evt_type = etcd_watch_event::EN_WEVT_PUT;
+      etcd_module::pack(node, evt.kv.value);
+    }
+    evt.kv.key = node.node_discovery.name();
+  }
+
+  static void trigger_watcher_response(etcd_module &mod, const std::string &watcher_path,
+                                       const etcd_watcher::response_t &response,
+                                       std::list<etcd_module::watcher_list_callback_t> *callbacks = NULL) {
+    etcd_response_header header;
+    header.cluster_id = 0;
+    header.member_id = 0;
+    header.revision = 0;
+    header.raft_term = 0;
+    etcd_module::watcher_callback_list_wrapper_t wrapper(mod, callbacks, watcher_path);
+    wrapper(header, response);
+  }
+
+  static void add_warm_start_node(etcd_module &mod, const std::string &watcher_path,
+                                  const atapp::protocol::atapp_discovery &node) {
+    mod.warm_start_watcher_paths_[watcher_path] = true;
+    mod.warm_start_ids_[node.id()] = true;
+    mod.warm_start_names_[node.name()] = true;
+  }
+
+  static void flush_pending_events(etcd_module &mod) { mod.flush_pending_events(); }
+
+  static int init_watchers(etcd_module &mod) { return mod.init_watchers(); }
+
+  static void get_inner_watcher_paths(const etcd_module &mod, std::vector<std::string> &out) {
+    std::vector<etcd_watcher::ptr_t> watchers;
+    mod.get_inner_watchers(watchers);
+    for (size_t i = 0; i < watchers.size(); ++i) {
+      out.push_back(watchers[i]->get_path());
+    }
+  }
+
+  static bool match_discovery_filter(const etcd_module &mod, const std::string *key,
+                                     const atapp::protocol::atapp_discovery &node) {
+    return mod.match_discovery_filter(key, node);
+  }
+
+  static bool is_warm_starting(const etcd_module &mod) {
+    return !mod.warm_start_watcher_paths_.empty() || !mod.warm_start_ids_.empty() || !mod.warm_start_names_.empty();
+  }
+};
+}  // namespace atapp
+
+namespace {
+static atapp::etcd_module::node_info_t atapp_etcd_module_test_make_node(uint64_t id, const std::string &name,
+                                                                        uint64_t type_id,
+                                                                        const std::string &type_name) {
+  atapp::etcd_module::node_info_t ret;
+  ret.node_discovery.set_id(id);
+  ret.node_discovery.set_name(name);
+  ret.node_discovery.set_type_id(type_id);
+  ret.node_discovery.set_type_name(type_name);
+  ret.action = atapp::etcd_module::node_action_t::EN_NAT_PUT;
+  return ret;
+}
+
+static bool atapp_etcd_module_test_load_configure(atapp::app &app, const char *file_name) {
+  std::string conf_path;
+  util::file_system::dirname(__FILE__, 0, conf_path);
+  conf_path += "/";
+  conf_path += file_name;
+
+  if (!util::file_system::is_exist(conf_path.c_str())) {
+    CASE_MSG_INFO() << CASE_MSG_FCOLOR(YELLOW) << conf_path << " not found, skip" << std::endl;
+    return false;
+  }
+
+  const char *argv[] = {"unit-test", "-c", &conf_path[0], "--version"};
+  app.init(NULL, 4, argv);
+  app.reload();
+  return true;
+}
+
+static atapp::etcd_module::node_info_t atapp_etcd_module_test_make_filter_node(uint64_t id, uint64_t type_id,
+                                                                               const std::string &type_name,
+                                                                               const std::string &zone) {
+  atapp::etcd_module::node_info_t ret =
+      atapp_etcd_module_test_make_node(id, "node-" + std::to_string(id), type_id, type_name);
+  ret.node_discovery.mutable_metadata()->set_namespace_name("ns-a");
+  (*ret.node_discovery.mutable_metadata()->mutable_labels())["zone"] = zone;
+  return ret;
+}
+
+static atapp::etcd_watcher::response_t atapp_etcd_module_test_make_response(bool full_range) {
+  atapp::etcd_watcher::response_t ret;
+  ret.watch_id = 0;
+  ret.created = false;
+  ret.canceled = false;
+  ret.compact_revision = 0;
+  ret.full_range = full_range;
+  return ret;
+}
+}  // namespace
+
+CASE_TEST(atapp_etcd_module, typed_discovery_set) {
+  atapp::app app;
+  std::shared_ptr<atapp::etcd_module> mod = app.get_etcd_module();
+  CASE_EXPECT_TRUE(!!mod);
+  if (!mod) {
+    return;
+  }
+
+  CASE_EXPECT_TRUE(!mod->get_discovery_by_type_id(1));
+  CASE_EXPECT_TRUE(!mod->get_discovery_by_type_name("type-a"));
+
+  atapp::etcd_module::node_info_t node1 = atapp_etcd_module_test_make_node(1, "node-1", 1, "type-a");
+  atapp::etcd_module::node_info_t node2 = atapp_etcd_module_test_make_node(2, "node-2", 1, "type-a");
+  atapp::etcd_module::node_info_t node3 = atapp_etcd_module_test_make_node(3, "node-3", 2, "type-b");
+  atapp::etcd_module_test_helper::update_inner_watcher_event(*mod, node1);
+  atapp::etcd_module_test_helper::update_inner_watcher_event(*mod, node2);
+  atapp::etcd_module_test_helper::update_inner_watcher_event(*mod, node3);
+
+  atapp::etcd_discovery_set::ptr_t type_id_set = mod->get_discovery_by_type_id(1);
+  atapp::etcd_discovery_set::ptr_t type_name_set = mod->get_discovery_by_type_name("type-a");
+  atapp::etcd_discovery_set::ptr_t other_set = mod->get_discovery_by_type_id(2);
+  CASE_EXPECT_TRUE(!!type_id_set && !!type_name_set && !!other_set);
+  if (!type_id_set || !type_name_set || !other_set) {
+    return;
+  }
+  CASE_EXPECT_EQ(2, type_id_set->get_sorted_nodes().size());
+  CASE_EXPECT_EQ(2, type_name_set->get_sorted_nodes().size());
+  CASE_EXPECT_EQ(1, other_set->get_sorted_nodes().size());
+
+  // Sets held by caller are still used after all nodes of this type are removed
+  node1.action = atapp::etcd_module::node_action_t::EN_NAT_DELETE;
+  node2.action = atapp::etcd_module::node_action_t::EN_NAT_DELETE;
+  atapp::etcd_module_test_helper::update_inner_watcher_event(*mod, node1);
+  atapp::etcd_module_test_helper::update_inner_watcher_event(*mod, node2);
+  CASE_EXPECT_TRUE(type_id_set->empty());
+  CASE_EXPECT_TRUE(type_name_set->empty());
+  CASE_EXPECT_TRUE(type_id_set == mod->get_discovery_by_type_id(1));
+  CASE_EXPECT_TRUE(type_name_set == mod->get_discovery_by_type_name("type-a"));
+
+  node1.action = atapp::etcd_module::node_action_t::EN_NAT_PUT;
+  atapp::etcd_module_test_helper::update_inner_watcher_event(*mod, node1);
+  CASE_EXPECT_TRUE(!!type_id_set->get_node_by_id(1));
+  CASE_EXPECT_TRUE(!!type_name_set->get_node_by_name("node-1"));
+
+  // Node moves to another type
+  node3.node_discovery.set_type_id(1);
+  node3.node_discovery.set_type_name("type-a");
+  atapp::etcd_module_test_helper::update_inner_watcher_event(*mod, node3);
+  CASE_EXPECT_TRUE(other_set->empty());
+  CASE_EXPECT_TRUE(other_set == mod->get_discovery_by_type_id(2));
+  CASE_EXPECT_TRUE(!!type_id_set->get_node_by_id(3));
+  CASE_EXPECT_EQ(2, type_name_set->get_sorted_nodes().size());
+}
+
+CASE_TEST(atapp_etcd_module, warm_start) {
+  atapp::app app;
+  std::shared_ptr<atapp::etcd_module> mod = app.get_etcd_module();
+  CASE_EXPECT_TRUE(!!mod);
+  if (!mod) {
+    return;
+  }
+
+  const std::string watcher_path = "/atapp/services/test/by_name";
+  atapp::etcd_module::node_info_t node1 = atapp_etcd_module_test_make_node(1, "node-1", 1, "type-a");
+  atapp::etcd_module::node_info_t node2 = atapp_etcd_module_test_make_node(2, "node-2", 1, "type-a");
+  atapp::etcd_module_test_helper::update_inner_watcher_event(*mod, node1);
+  atapp::etcd_module_test_helper::update_inner_watcher_event(*mod, node2);
+  atapp::etcd_module_test_helper::add_warm_start_node(*mod, watcher_path, node1.node_discovery);
+  atapp::etcd_module_test_helper::add_warm_start_node(*mod, watcher_path, node2.node_discovery);
+
+  // Compacted, wait for the range response
+  atapp::etcd_watcher::response_t response = atapp_etcd_module_test_make_response(false);
+  response.canceled = true;
+  response.compact_revision = 10;
+  atapp::etcd_module_test_helper::trigger_watcher_response(*mod, watcher_path, response);
+  CASE_EXPECT_TRUE(atapp::etcd_module_test_helper::is_warm_starting(*mod));
+
+  // Nodes not in range response are removed
+  response = atapp_etcd_module_test_make_response(true);
+  atapp::etcd_module_test_helper::add_watcher_event(response, node1);
+  atapp::etcd_module_test_helper::trigger_watcher_response(*mod, watcher_path, response);
+  CASE_EXPECT_FALSE(atapp::etcd_module_test_helper::is_warm_starting(*mod));
+  CASE_EXPECT_TRUE(!!mod->get_global_discovery().get_node_by_id(1));
+  CASE_EXPECT_TRUE(!mod->get_global_discovery().get_node_by_id(2));
+  CASE_EXPECT_TRUE(!mod->get_global_discovery().get_node_by_name("node-2"));
+
+  // Resumed without range response, nodes from snapshot are kept and warm start is finished
+  atapp::etcd_module_test_helper::add_warm_start_node(*mod, watcher_path, node1.node_discovery);
+  response = atapp_etcd_module_test_make_response(false);
+  response.created = true;
+  atapp::etcd_module_test_helper::trigger_watcher_response(*mod, watcher_path, response);
+  CASE_EXPECT_FALSE(atapp::etcd_module_test_helper::is_warm_starting(*mod));
+  CASE_EXPECT_TRUE(!!mod->get_global_discovery().get_node_by_id(1));
+}
+
+CASE_TEST(atapp_etcd_module, batch_events_coalesce) {
+  atapp::app app;
+  if (!atapp_etcd_module_test_load_configure(app, "atapp_etcd_module_test.batch.yaml")) {
+    return;
+  }
+  std::shared_ptr<atapp::etcd_module> mod = app.get_etcd_module();
+  CASE_EXPECT_TRUE(!!mod);
+  if (!mod) {
+    return;
+  }
+  CASE_EXPECT_TRUE(mod->get_configure().watcher().batch_events());
+
+  std::vector<atapp::etcd_discovery_event_t> events;
+  mod->add_on_node_discovery_events([&events](const std::vector<atapp::etcd_discovery_event_t> &evts) {
+    events.insert(events.end(), evts.begin(), evts.end());
+  });
+
+  const std::string watcher_path = "/atapp/services/test/by_name";
+  atapp::etcd_module::node_info_t node1 = atapp_etcd_module_test_make_node(1, "node-1", 1, "type-a");
+  atapp::etcd_module::node_info_t node2 = atapp_etcd_module_test_make_node(2, "node-2", 1, "type-a");
+
+  // PUT -> DELETE -> PUT of the same node, only the last PUT is applied
+  atapp::etcd_watcher::response_t response = atapp_etcd_module_test_make_response(false);
+  atapp::etcd_module_test_helper::add_watcher_event(response, node1);
+  node1.action = atapp::etcd_module::node_action_t::EN_NAT_DELETE;
+  atapp::etcd_module_test_helper::add_watcher_event(response, node1);
+  node1.action = atapp::etcd_module::node_action_t::EN_NAT_PUT;
+  node1.node_discovery.set_hostname("host-1");
+  atapp::etcd_module_test_helper::add_watcher_event(response, node1);
+  // PUT -> DELETE of a new node, nothing is changed
+  atapp::etcd_module_test_helper::add_watcher_event(response, node2);
+  node2.action = atapp::etcd_module::node_action_t::EN_NAT_DELETE;
+  atapp::etcd_module_test_helper::add_watcher_event(response, node2);
+  atapp::etcd_module_test_helper::trigger_watcher_response(*mod, watcher_path, response);
+  CASE_EXPECT_TRUE(!mod->get_global_discovery().get_node_by_id(1));
+
+  atapp::etcd_module_test_helper::flush_pending_events(*mod);
+  CASE_EXPECT_EQ(1, events.size());
+  if (!events.empty()) {
+    CASE_EXPECT_TRUE(atapp::etcd_module::node_action_t::EN_NAT_PUT == events[0].action);
+    CASE_EXPECT_EQ(1, events[0].node->get_discovery_info().id());
+  }
+  atapp::etcd_discovery_node::ptr_t cached = mod->get_global_discovery().get_node_by_id(1);
+  CASE_EXPECT_TRUE(!!cached);
+  if (cached) {
+    CASE_EXPECT_EQ("host-1", cached->get_discovery_info().hostname());
+  }
+  CASE_EXPECT_TRUE(!mod->get_global_discovery().get_node_by_id(2));
+  CASE_EXPECT_TRUE(!mod->get_global_discovery().get_node_by_name("node-2"));
+
+  // Name moves to a new id, and the old id gets another name in the same tick
+  events.clear();
+  response = atapp_etcd_module_test_make_response(false);
+  node1.action = atapp::etcd_module::node_action_t::EN_NAT_DELETE;
+  atapp::etcd_module_test_helper::add_watcher_event(response, node1);
+  atapp::etcd_module::node_info_t moved = atapp_etcd_module_test_make_node(5, "node-1", 1, "type-a");
+  atapp::etcd_module_test_helper::add_watcher_event(response, moved);
+  atapp::etcd_module::node_info_t renamed = atapp_etcd_module_test_make_node(1, "node-3", 1, "type-a");
+  atapp::etcd_module_test_helper::add_watcher_event(response, renamed);
+  atapp::etcd_module_test_helper::trigger_watcher_response(*mod, watcher_path, response);
+  atapp::etcd_module_test_helper::flush_pending_events(*mod);
+
+  CASE_EXPECT_EQ(2, mod->get_global_discovery().get_sorted_nodes().size());
+  atapp::etcd_discovery_node::ptr_t by_name = mod->get_global_discovery().get_node_by_name("node-1");
+  atapp::etcd_discovery_node::ptr_t by_id = mod->get_global_discovery().get_node_by_id(1);
+  CASE_EXPECT_TRUE(!!by_name && !!by_id);
+  if (by_name && by_id) {
+    CASE_EXPECT_EQ(5, by_name->get_discovery_info().id());
+    CASE_EXPECT_EQ("node-3", by_id->get_discovery_info().name());
+  }
+  CASE_EXPECT_TRUE(by_name == mod->get_global_discovery().get_node_by_id(5));
+  CASE_EXPECT_TRUE(by_id == mod->get_global_discovery().get_node_by_name("node-3"));
+
+  // Name moves to a new id, the old id is removed with it
+  response = atapp_etcd_module_test_make_response(false);
+  moved = atapp_etcd_module_test_make_node(6, "node-1", 1, "type-a");
+  atapp::etcd_module_test_helper::add_watcher_event(response, moved);
+  atapp::etcd_module_test_helper::trigger_watcher_response(*mod, watcher_path, response);
+  atapp::etcd_module_test_helper::flush_pending_events(*mod);
+  CASE_EXPECT_TRUE(!mod->get_global_discovery().get_node_by_id(5));
+  by_name = mod->get_global_discovery().get_node_by_name("node-1");
+  CASE_EXPECT_TRUE(!!by_name && by_name == mod->get_global_discovery().get_node_by_id(6));
+  CASE_EXPECT_EQ(2, mod->get_global_discovery().get_sorted_nodes().size());
+}
+
+CASE_TEST(atapp_etcd_module, batch_events_watcher_callback) {
+  atapp::app app;
+  if (!atapp_etcd_module_test_load_configure(app, "atapp_etcd_module_test.batch.yaml")) {
+    return;
+  }
+  std::shared_ptr<atapp::etcd_module> mod = app.get_etcd_module();
+  CASE_EXPECT_TRUE(!!mod);
+  if (!mod) {
+    return;
+  }
+
+  // Callbacks of watcher are delayed, and they see the discovery after all events are applied
+  int called = 0;
+  int cached = 0;
+  std::list<atapp::etcd_module::watcher_list_callback_t> callbacks;
+  callbacks.push_back([&called, &cached](atapp::etcd_module::watcher_sender_list_t &sender) {
+    ++called;
+    if (sender.atapp_module.get().get_global_discovery().get_node_by_id(sender.node.get().node_discovery.id())) {
+      ++cached;
+    }
+  });
+
+  const std::string watcher_path = "/atapp/services/test/by_name";
+  atapp::etcd_watcher::response_t response = atapp_etcd_module_test_make_response(false);
+  atapp::etcd_module_test_helper::add_watcher_event(response,
+                                                    atapp_etcd_module_test_make_node(1, "node-1", 1, "type-a"));
+  atapp::etcd_module_test_helper::add_watcher_event(response,
+                                                    atapp_etcd_module_test_make_node(2, "node-2", 1, "type-a"));
+  atapp::etcd_module_test_helper::trigger_watcher_response(*mod, watcher_path, response, &callbacks);
+  CASE_EXPECT_EQ(0, called);
+
+  atapp::etcd_module_test_helper::flush_pending_events(*mod);
+  CASE_EXPECT_EQ(2, called);
+  CASE_EXPECT_EQ(2, cached);
+
+  // Delivered only once
+  atapp::etcd_module_test_helper::flush_pending_events(*mod);
+  CASE_EXPECT_EQ(2, called);
+}
+
+CASE_TEST(atapp_etcd_module, discovery_filter) {
+  atapp::app app;
+  if (!atapp_etcd_module_test_load_configure(app, "atapp_etcd_module_test.filter.yaml")) {
+    return;
+  }
+  std::shared_ptr<atapp::etcd_module> mod = app.get_etcd_module();
+  CASE_EXPECT_TRUE(!!mod);
+  if (!mod) {
+    return;
+  }
+
+  // Only selected types and tags are watched, paths end with "/"
+  CASE_EXPECT_EQ(0, atapp::etcd_module_test_helper::init_watchers(*mod));
+  std::vector<std::string> watcher_paths;
+  atapp::etcd_module_test_helper::get_inner_watcher_paths(*mod, watcher_paths);
+  CASE_EXPECT_EQ(3, watcher_paths.size());
+  if (3 == watcher_paths.size()) {
+    CASE_EXPECT_EQ("/atapp/services/test/by_type_id/1/", watcher_paths[0]);
+    CASE_EXPECT_EQ("/atapp/services/test/by_type_name/type-b/", watcher_paths[1]);
+    CASE_EXPECT_EQ("/atapp/services/test/by_tag/foo/", watcher_paths[2]);
+  }
+
+  // Select by type
+  atapp::etcd_module::node_info_t node = atapp_etcd_module_test_make_filter_node(1, 1, "type-a", "a");
+  CASE_EXPECT_TRUE(atapp::etcd_module_test_helper::match_discovery_filter(*mod, NULL, node.node_discovery));
+  node = atapp_etcd_module_test_make_filter_node(2, 10, "type-a", "a");
+  std::string key = "/atapp/services/test/by_type_id/10/node-2-2";
+  CASE_EXPECT_FALSE(atapp::etcd_module_test_helper::match_discovery_filter(*mod, &key, node.node_discovery));
+  // Tag is unknown without key, such as nodes from discovery snapshot
+  CASE_EXPECT_TRUE(atapp::etcd_module_test_helper::match_discovery_filter(*mod, NULL, node.node_discovery));
+  node = atapp_etcd_module_test_make_filter_node(3, 2, "type-b", "a");
+  CASE_EXPECT_TRUE(atapp::etcd_module_test_helper::match_discovery_filter(*mod, NULL, node.node_discovery));
+
+  // Select by tag, which is only known from the key
+  node = atapp_etcd_module_test_make_filter_node(4, 10, "type-c", "a");
+  key = "/atapp/services/test/by_tag/foo/node-4-4";
+  CASE_EXPECT_TRUE(atapp::etcd_module_test_helper::match_discovery_filter(*mod, &key, node.node_discovery));
+  key = "/atapp/services/test/by_tag/foobar/node-4-4";
+  CASE_EXPECT_FALSE(atapp::etcd_module_test_helper::match_discovery_filter(*mod, &key, node.node_discovery));
+
+  // Namespace and labels
+  node = atapp_etcd_module_test_make_filter_node(5, 1, "type-a", "b");
+  CASE_EXPECT_FALSE(atapp::etcd_module_test_helper::match_discovery_filter(*mod, NULL, node.node_discovery));
+  node.node_discovery.mutable_metadata()->mutable_labels()->clear();
+  CASE_EXPECT_FALSE(atapp::etcd_module_test_helper::match_discovery_filter(*mod, NULL, node.node_discovery));
+  node = atapp_etcd_module_test_make_filter_node(5, 1, "type-a", "a");
+  node.node_discovery.mutable_metadata()->set_namespace_name("ns-b");
+  CASE_EXPECT_FALSE(atapp::etcd_module_test_helper::match_discovery_filter(*mod, NULL, node.node_discovery));
+}
+
+CASE_TEST(atapp_etcd_module, discovery_filter_evict) {
+  atapp::app app;
+  if (!atapp_etcd_module_test_load_configure(app, "atapp_etcd_module_test.filter.yaml")) {
+    return;
+  }
+  std::shared_ptr<atapp::etcd_module> mod = app.get_etcd_module();
+  CASE_EXPECT_TRUE(!!mod);
+  if (!mod) {
+    return;
+  }
+
+  const std::string watcher_path = "/atapp/services/test/by_type_id/1/";
+  atapp::etcd_module::node_info_t node1 = atapp_etcd_module_test_make_filter_node(1, 1, "type-a", "a");
+  atapp::etcd_module::node_info_t node2 = atapp_etcd_module_test_make_filter_node(2, 1, "type-a", "b");
+  atapp::etcd_watcher::response_t response = atapp_etcd_module_test_make_response(false);
+  atapp::etcd_module_test_helper::add_watcher_event(response, node1);
+  atapp::etcd_module_test_helper::add_watcher_event(response, node2);
+  atapp::etcd_module_test_helper::trigger_watcher_response(*mod, watcher_path, response);
+
+  // Nodes not matched are never cached
+  CASE_EXPECT_TRUE(!!mod->get_global_discovery().get_node_by_id(1));
+  CASE_EXPECT_TRUE(!mod->get_global_discovery().get_node_by_id(2));
+  CASE_EXPECT_TRUE(!mod->get_global_discovery().get_node_by_name("node-2"));
+
+  // Cached node is removed after it does not match the filter any more
+  (*node1.node_discovery.mutable_metadata()->mutable_labels())["zone"] = "b";
+  response = atapp_etcd_module_test_make_response(false);
+  atapp::etcd_module_test_helper::add_watcher_event(response, node1);
+  atapp::etcd_module_test_helper::trigger_watcher_response(*mod, watcher_path, response);
+  CASE_EXPECT_TRUE(!mod->get_global_discovery().get_node_by_id(1));
+  CASE_EXPECT_TRUE(!mod->get_global_discovery().get_node_by_name("node-1"));
+  CASE_EXPECT_TRUE(mod->get_global_discovery().empty());
+}
@@ -0,0 +1,59 @@
+#include <map>
+#include <string>
+
+#include <atframe/atapp_flat_hash_map.h>
+
+#include "frame/test_macros.h"
+
+CASE_TEST(atapp_flat_hash_map, integer_key) {
+  atapp::flat_hash_map<uint64_t, int> hash_map;
+  std::map<uint64_t, int> checked;
+
+  for (int i = 0; i < 4096; ++i) {
+    uint64_t key = static_cast<uint64_t>((i * 7) % 1000);
+    if (i % 3 == 0) {
+      CASE_EXPECT_EQ(checked.erase(key), hash_map.erase(key));
+    } else {
+      hash_map[key] = i;
+      checked[key] = i;
+    }
+  }
+
+  CASE_EXPECT_EQ(checked.size(), hash_map.size());
+  size_t visited = 0;
+  for (atapp::flat_hash_map<uint64_t, int>::const_iterator iter = hash_map.begin(); iter != hash_map.end(); ++iter) {
+    ++visited;
+    CASE_EXPECT_EQ(checked[iter->first], iter->second);
+  }
+  CASE_EXPECT_EQ(checked.size(), visited);
+
+  for (std::map<uint64_t, int>::const_iterator iter = checked.begin(); iter != checked.end(); ++iter) {
+    atapp::flat_hash_map<uint64_t, int>::iterator found = hash_map.find(iter->first);
+    CASE_EXPECT_TRUE(found != hash_map.end());
+    if (found != hash_map.end()) {
+      CASE_EXPECT_EQ(iter->second, found->second);
+    }
+  }
+}
+
+CASE_TEST(atapp_flat_hash_map, hashed_string_ref) {
+  atapp::flat_hash_map<std::string, int> hash_map;
+  hash_map["hello"] = 1;
+  hash_map["world"] = 2;
+  CASE_EXPECT_TRUE(hash_map.insert(std::make_pair(std::string("atapp"), 3)).second);
+  CASE_EXPECT_FALSE(hash_map.insert(std::make_pair(std::string("atapp"), 4)).second);
+
+  const char *buffer = "worldwide";
+  atapp::flat_hash_map<std::string, int>::const_iterator iter =
+      hash_map.find_as(atapp::hashed_string_ref(buffer, 5));
+  CASE_EXPECT_TRUE(iter != hash_map.end());
+  if (iter != hash_map.end()) {
+    CASE_EXPECT_EQ(2, iter->second);
+  }
+  CASE_EXPECT_TRUE(hash_map.find_as(atapp::hashed_string_ref(buffer, 6)) == hash_map.end());
+
+  hash_map.erase(hash_map.find("hello"));
+  CASE_EXPECT_EQ(2, hash_map.size());
+  CASE_EXPECT_EQ(0, hash_map.count("hello"));
+  CASE_EXPECT_EQ(1, hash_map.count("atapp"));
+}
@@ -0,0 +1,165 @@
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <atframe/connectors/atapp_pending_message_queue.h>
+
+#include "frame/test_macros.h"
+
+namespace {
+static atapp::atapp_pending_message_queue::message_t *push_test_message(atapp::atapp_pending_message_queue &queue,
+                                                                        uint64_t sequence, size_t size) {
+  std::string data;
+  data.resize(size, static_cast<char>('a' + sequence % 26));
+  memcpy(&data[0], &sequence, sizeof(sequence) < size ? sizeof(sequence) : size);
+
+  atapp::atapp_iovec_t iov[2];
+  iov[0].iov_base = data.data();
+  iov[0].iov_len = size / 2;
+  iov[1].iov_base = data.data() + size / 2;
+  iov[1].iov_len = size - size / 2;
+  atapp::atapp_pending_message_queue::message_t *ret = queue.push(size, iov, 2, NULL);
+  if (NULL != ret) {
+    ret->msg_sequence = sequence;
+    ret->expired_timepoint = std::chrono::system_clock::from_time_t(0) + std::chrono::milliseconds(sequence);
+  }
+  return ret;
+}
+
+static bool check_test_message(const atapp::atapp_pending_message_queue::message_t *msg, uint64_t sequence,
+                               size_t size) {
+  if (NULL == msg || msg->msg_sequence != sequence || msg->data_size != size) {
+    return false;
+  }
+
+  uint64_t data_sequence = 0;
+  memcpy(&data_sequence, msg->data, sizeof(data_sequence));
+  return data_sequence == sequence &&
+         reinterpret_cast<const char *>(msg->data)[size - 1] == static_cast<char>('a' + sequence % 26);
+}
+}  // namespace
+
+CASE_TEST(atapp_pending_message_queue, wraparound) {
+  atapp::atapp_pending_message_queue queue;
+  uint64_t push_sequence = 0;
+  uint64_t pop_sequence = 0;
+
+  // Keep about 100 messages in queue, so records keep wrapping into new chunks while the front ones are drained
+  bool all_matched = true;
+  for (int round = 0; round < 3000; ++round) {
+    while (push_sequence - pop_sequence < 100) {
+      CASE_EXPECT_TRUE(NULL != push_test_message(queue, push_sequence, 64 + push_sequence % 300));
+      ++push_sequence;
+    }
+
+    for (int i = 0; i < 7; ++i) {
+      all_matched = all_matched && check_test_message(queue.front(), pop_sequence, 64 + pop_sequence % 300);
+      queue.pop();
+      ++pop_sequence;
+    }
+  }
+  CASE_EXPECT_TRUE(all_matched);
+  CASE_EXPECT_EQ(push_sequence - pop_sequence, queue.size());
+  CASE_EXPECT_GT(queue.get_chunk_count(), 1);
+
+  // A large message uses a dedicated chunk
+  CASE_EXPECT_TRUE(NULL != push_test_message(queue, push_sequence++, 200000));
+  CASE_EXPECT_GE(queue.get_allocated_size(), 200000);
+
+  while (NULL != queue.front()) {
+    queue.pop();
+  }
+  CASE_EXPECT_TRUE(queue.empty());
+  CASE_EXPECT_EQ(0, queue.get_data_size());
+}
+
+CASE_TEST(atapp_pending_message_queue, chunk_recycle) {
+  atapp::atapp_pending_message_queue queue;
+  queue.set_max_chunk_size(8192);
+  CASE_EXPECT_EQ(8192, queue.get_max_chunk_size());
+
+  uint64_t sequence = 0;
+  for (; sequence < 200; ++sequence) {
+    push_test_message(queue, sequence, 100);
+  }
+  size_t peak_allocated_size = queue.get_allocated_size();
+  CASE_EXPECT_GT(queue.get_chunk_count(), 2);
+
+  // Steady state: drained chunks are reused, so nothing is allocated any more
+  for (uint64_t pop_sequence = 0; pop_sequence < 100000; ++pop_sequence) {
+    queue.pop();
+    push_test_message(queue, sequence++, 100);
+  }
+  CASE_EXPECT_LE(queue.get_allocated_size(), peak_allocated_size + 8192);
+  CASE_EXPECT_LE(queue.get_free_chunk_count(), atapp::atapp_pending_message_queue::MAX_FREE_CHUNK_NUMBER);
+
+  // All chunks are released when drained
+  atapp::protocol::atapp_metadata metadata;
+  metadata.set_namespace_name("test");
+  atapp::atapp_pending_message_queue::message_t *msg = queue.push(0, NULL, 0, &metadata);
+  CASE_EXPECT_TRUE(NULL != msg && NULL != msg->metadata);
+  if (NULL != msg && NULL != msg->metadata) {
+    CASE_EXPECT_EQ("test", msg->metadata->namespace_name());
+  }
+  queue.clear();
+  CASE_EXPECT_TRUE(queue.empty());
+  CASE_EXPECT_EQ(0, queue.get_chunk_count());
+  CASE_EXPECT_EQ(0, queue.get_free_chunk_count());
+  CASE_EXPECT_EQ(0, queue.get_allocated_size());
+
+  // Small queue starts from a small chunk
+  push_test_message(queue, 0, 100);
+  CASE_EXPECT_EQ(static_cast<size_t>(atapp::atapp_pending_message_queue::MIN_CHUNK_SIZE), queue.get_allocated_size());
+  queue.pop();
+  CASE_EXPECT_EQ(0, queue.get_allocated_size());
+}
+
+CASE_TEST(atapp_pending_message_queue, expire_order) {
+  atapp::atapp_pending_message_queue queue;
+  for (uint64_t i = 1; i <= 1000; ++i) {
+    push_test_message(queue, i, 1000);
+  }
+
+  // Expire messages from front, just like atapp_endpoint::retry_pending_messages
+  atapp::atapp_pending_message_queue::message_t *msg;
+  util::time::time_utility::raw_time_t now = std::chrono::system_clock::from_time_t(0) + std::chrono::milliseconds(500);
+  uint64_t expected_sequence = 1;
+  bool all_matched = true;
+  while (NULL != (msg = queue.front())) {
+    if (msg->expired_timepoint > now) {
+      break;
+    }
+    all_matched = all_matched && check_test_message(msg, expected_sequence++, 1000);
+    queue.pop();
+  }
+  CASE_EXPECT_TRUE(all_matched);
+  CASE_EXPECT_EQ(501, expected_sequence);
+  CASE_EXPECT_EQ(500, queue.size());
+  CASE_EXPECT_EQ(500 * 1000, queue.get_data_size());
+  CASE_EXPECT_TRUE(check_test_message(queue.front(), 501, 1000));
+}
+
+
+CASE_TEST(atapp_pending_message_queue, shared_payload) {
+  std::shared_ptr<const std::string> payload = std::make_shared<std::string>(1000, 'x');
+  std::weak_ptr<const std::string> payload_watcher = payload;
+
+  atapp::atapp_pending_message_queue queue1;
+  atapp::atapp_pending_message_queue queue2;
+  CASE_EXPECT_TRUE(NULL != queue1.push(payload, NULL));
+  CASE_EXPECT_TRUE(NULL != queue2.push(payload, NULL));
+  payload.reset();
+
+  // Payload is not copied and is kept alive by both queues
+  CASE_EXPECT_FALSE(payload_watcher.expired());
+  CASE_EXPECT_EQ(1000, queue1.get_data_size());
+  CASE_EXPECT_TRUE(queue1.front()->data == queue2.front()->data);
+  CASE_EXPECT_EQ(static_cast<size_t>(atapp::atapp_pending_message_queue::MIN_CHUNK_SIZE), queue1.get_allocated_size());
+
+  queue1.pop();
+  CASE_EXPECT_FALSE(payload_watcher.expired());
+  queue2.clear();
+  CASE_EXPECT_TRUE(payload_watcher.expired());
+}
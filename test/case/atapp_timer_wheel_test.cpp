@@ -0,0 +1,109 @@
+#include <chrono>
+#include <vector>
+
+#include <atframe/atapp_timer_wheel.h>
+
+#include "frame/test_macros.h"
+
+CASE_TEST(atapp_timer_wheel, add_and_cancel) {
+  atapp::timer_wheel wheel;
+  atapp::timer_wheel::time_point now = std::chrono::system_clock::now();
+  wheel.tick(now);
+
+  std::vector<int> triggered;
+  atapp::timer_wheel::timer_ptr_t t1 =
+      wheel.add_timer(now + std::chrono::milliseconds(10), [&triggered](const atapp::timer_wheel::timer_ptr_t &) {
+        triggered.push_back(1);
+      });
+  atapp::timer_wheel::timer_ptr_t t2 =
+      wheel.add_timer(now + std::chrono::seconds(100), [&triggered](const atapp::timer_wheel::timer_ptr_t &) {
+        triggered.push_back(2);
+      });
+  atapp::timer_wheel::timer_ptr_t t3 =
+      wheel.add_timer(now + std::chrono::milliseconds(20), [&triggered](const atapp::timer_wheel::timer_ptr_t &) {
+        triggered.push_back(3);
+      });
+  CASE_EXPECT_EQ(3, wheel.size());
+  CASE_EXPECT_TRUE(wheel.cancel(t3));
+  CASE_EXPECT_FALSE(t3->is_armed());
+  CASE_EXPECT_EQ(2, wheel.size());
+
+  CASE_EXPECT_EQ(0, wheel.tick(now + std::chrono::milliseconds(9)));
+  CASE_EXPECT_EQ(1, wheel.tick(now + std::chrono::milliseconds(10)));
+  CASE_EXPECT_EQ(0, wheel.tick(now + std::chrono::seconds(99)));
+  CASE_EXPECT_TRUE(t2->is_armed());
+  CASE_EXPECT_EQ(1, wheel.tick(now + std::chrono::seconds(100)));
+
+  CASE_EXPECT_EQ(2, triggered.size());
+  if (2 == triggered.size()) {
+    CASE_EXPECT_EQ(1, triggered[0]);
+    CASE_EXPECT_EQ(2, triggered[1]);
+  }
+  CASE_EXPECT_TRUE(wheel.empty());
+}
+
+CASE_TEST(atapp_timer_wheel, rearm) {
+  atapp::timer_wheel wheel;
+  atapp::timer_wheel::time_point now = std::chrono::system_clock::now();
+  wheel.tick(now);
+
+  int count = 0;
+  atapp::timer_wheel::timer_ptr_t timer = atapp::timer_wheel::create_timer(
+      [&count, &wheel](const atapp::timer_wheel::timer_ptr_t &self) {
+        if (++count < 3) {
+          wheel.arm(self, self->get_expire_time() + std::chrono::milliseconds(100));
+        }
+      });
+
+  // Move an armed timer instead of inserting a new one
+  wheel.arm(timer, now + std::chrono::seconds(10));
+  wheel.arm(timer, now + std::chrono::milliseconds(100));
+  CASE_EXPECT_EQ(1, wheel.size());
+
+  for (int i = 1; i <= 1000; ++i) {
+    wheel.tick(now + std::chrono::milliseconds(i));
+  }
+  CASE_EXPECT_EQ(3, count);
+  CASE_EXPECT_FALSE(timer->is_armed());
+  CASE_EXPECT_TRUE(wheel.empty());
+}
+
+CASE_TEST(atapp_timer_wheel, stall) {
+  atapp::timer_wheel wheel;
+  atapp::timer_wheel::time_point now = std::chrono::system_clock::now();
+  wheel.tick(now);
+
+  std::vector<int> triggered;
+  int delays[] = {300000, 5, 70, 7200000, 5000, 4100};
+  std::vector<atapp::timer_wheel::timer_ptr_t> timers;
+  for (size_t i = 0; i < sizeof(delays) / sizeof(delays[0]); ++i) {
+    int delay = delays[i];
+    timers.push_back(wheel.add_timer(now + std::chrono::milliseconds(delay),
+                                     [&triggered, delay](const atapp::timer_wheel::timer_ptr_t &) {
+                                       triggered.push_back(delay);
+                                     }));
+  }
+
+  // A timer armed by callback in a stalled tick is still triggered in order
+  wheel.add_timer(now + std::chrono::milliseconds(1000),
+                  [&triggered, &wheel, now](const atapp::timer_wheel::timer_ptr_t &) {
+                    triggered.push_back(1000);
+                    wheel.add_timer(now + std::chrono::milliseconds(1001),
+                                    [&triggered](const atapp::timer_wheel::timer_ptr_t &) {
+                                      triggered.push_back(1001);
+                                    });
+                  });
+
+  // Stalled for one hour, all timers before it are triggered by one tick
+  CASE_EXPECT_EQ(7, wheel.tick(now + std::chrono::hours(1)));
+  int expected[] = {5, 70, 1000, 1001, 4100, 5000, 300000};
+  CASE_EXPECT_EQ(sizeof(expected) / sizeof(expected[0]), triggered.size());
+  for (size_t i = 0; i < triggered.size() && i < sizeof(expected) / sizeof(expected[0]); ++i) {
+    CASE_EXPECT_EQ(expected[i], triggered[i]);
+  }
+  CASE_EXPECT_EQ(1, wheel.size());
+
+  CASE_EXPECT_EQ(0, wheel.tick(now + std::chrono::milliseconds(7199999)));
+  CASE_EXPECT_EQ(1, wheel.tick(now + std::chrono::hours(3)));
+  CASE_EXPECT_TRUE(wheel.empty());
+}